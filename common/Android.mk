@@ -74,9 +74,12 @@ LOCAL_SRC_FILES := \
 	display/displayplanestate.cpp \
         display/displayqueue.cpp \
         display/vblankeventhandler.cpp \
+        display/vblankservice.cpp \
         display/virtualdisplay.cpp \
+        display/vsyncpredictor.cpp \
         utils/fdhandler.cpp \
         utils/hwcevent.cpp \
+        utils/hwcsynctimeline.cpp \
         utils/hwcthread.cpp \
         utils/hwcutils.cpp \
         utils/disjoint_layers.cpp
@@ -107,6 +110,10 @@ ifeq ($(strip $(ENABLE_HYPER_DMABUF_SHARING)), true)
 LOCAL_CPPFLAGS += -DHYPER_DMABUF_SHARING
 endif
 
+ifeq ($(strip $(ENABLE_ASYNC_COMMIT)), true)
+LOCAL_CPPFLAGS += -DENABLE_ASYNC_COMMIT
+endif
+
 ifeq ($(strip $(TARGET_USES_HWC2)), false)
 LOCAL_C_INCLUDES += \
         system/core/libsync \
@@ -145,7 +152,8 @@ LOCAL_SHARED_LIBRARIES += \
 
 LOCAL_CPPFLAGS += \
         -DUSE_VK \
-        -DDISABLE_EXPLICIT_SYNC
+        -DDISABLE_EXPLICIT_SYNC \
+        -DSHADER_CACHE_PATH='"/data/vendor/hwc"'
 
 LOCAL_C_INCLUDES += \
         $(LOCAL_PATH)/compositor/vk \
@@ -153,6 +161,7 @@ LOCAL_C_INCLUDES += \
 
 LOCAL_SRC_FILES += \
         compositor/vk/vkprogram.cpp \
+        compositor/vk/vkprogramwarmer.cpp \
         compositor/vk/vkrenderer.cpp \
         compositor/vk/vksurface.cpp \
         compositor/vk/nativevkresource.cpp \
@@ -160,10 +169,12 @@ LOCAL_SRC_FILES += \
 else
 LOCAL_CPPFLAGS += \
         -DUSE_GL \
-        -DPREBUILT_SHADER_FILE_PATH='"/vendor/etc"'
+        -DPREBUILT_SHADER_FILE_PATH='"/vendor/etc"' \
+        -DSHADER_CACHE_PATH='"/data/vendor/hwc"'
 
 LOCAL_SRC_FILES += \
         compositor/gl/glprogram.cpp \
+        compositor/gl/glprogramwarmer.cpp \
         compositor/gl/glrenderer.cpp \
         compositor/gl/glsurface.cpp \
         compositor/gl/egloffscreencontext.cpp \
@@ -28,5 +28,48 @@ struct CompositionRegion {
   std::vector<size_t> source_layers;
 };
 
+// Layer attributes composition regions and their render states are derived
+// from. Buffer contents and fences are not part of it, content only updates
+// keep the same geometry.
+struct CompositionLayerGeometry {
+  size_t layer_index;
+  HwcRect<int> display_frame;
+  HwcRect<float> source_crop;
+  uint32_t transform;
+  uint32_t merged_transform;
+  uint32_t buffer_width;
+  uint32_t buffer_height;
+  HWCBlending blending;
+  uint8_t alpha;
+
+  bool operator==(const CompositionLayerGeometry &rhs) const {
+    return layer_index == rhs.layer_index &&
+           display_frame == rhs.display_frame &&
+           source_crop == rhs.source_crop && transform == rhs.transform &&
+           merged_transform == rhs.merged_transform &&
+           buffer_width == rhs.buffer_width &&
+           buffer_height == rhs.buffer_height && blending == rhs.blending &&
+           alpha == rhs.alpha;
+  }
+};
+
+struct CompositionGeometry {
+  // Dedicated layers followed by the layers to be composited.
+  std::vector<CompositionLayerGeometry> layers;
+  size_t num_dedicated_layers = 0;
+  HwcRegion damage_region;
+  uint32_t downscaling_factor = 0;
+  bool uses_display_up_scaling = false;
+  bool use_plane_transform = false;
+
+  bool operator==(const CompositionGeometry &rhs) const {
+    return num_dedicated_layers == rhs.num_dedicated_layers &&
+           downscaling_factor == rhs.downscaling_factor &&
+           uses_display_up_scaling == rhs.uses_display_up_scaling &&
+           use_plane_transform == rhs.use_plane_transform &&
+           damage_region == rhs.damage_region && layers == rhs.layers;
+  }
+};
+
 }  // namespace hwcomposer
 #endif  // COMMON_COMPOSITOR_COMPOSITIONREGION_H_
@@ -59,7 +59,6 @@ void Compositor::Reset() {
 bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
                       std::vector<OverlayLayer> &layers) {
   CTRACE();
-  const DisplayPlaneState *comp = NULL;
   std::vector<size_t> dedicated_layers;
   std::vector<DrawState> draw_state;
   std::vector<DrawState> media_state;
@@ -113,54 +112,66 @@ bool Compositor::Draw(DisplayPlaneStateList &comp_planes,
         }
       }
     } else if (plane.NeedsOffScreenComposition()) {
-      comp = &plane;
       plane.SwapSurfaceIfNeeded();
-      std::vector<CompositionRegion> &comp_regions =
-          plane.GetCompositionRegion();
-      bool regions_empty = comp_regions.empty();
       NativeSurface *surface = plane.GetOffScreenTarget();
       if (surface == NULL) {
         ETRACE("GetOffScreenTarget() returned NULL pointer 'surface'.");
         return false;
       }
-      if (!regions_empty &&
-          (surface->ClearSurface() || surface->IsPartialClear() ||
-           surface->IsSurfaceDamageChanged())) {
-        plane.ResetCompositionRegion();
-        regions_empty = true;
-      }
 
-      if (surface->ClearSurface()) {
+      bool clear_surface = surface->ClearSurface();
+      if (clear_surface) {
         plane.UpdateDamage(plane.GetDisplayFrame());
       }
 
-      if (regions_empty) {
-        SeparateLayers(dedicated_layers, comp->GetSourceLayers(), display_frame,
-                       surface->GetSurfaceDamage(), comp_regions);
+      bool use_plane_transform = false;
+      if (plane.GetRotationType() ==
+          DisplayPlaneState::RotationType::kGPURotation) {
+        use_plane_transform = true;
+      }
+
+      CompositionGeometry geometry;
+      CalculateGeometry(layers, dedicated_layers, plane.GetSourceLayers(),
+                        surface, plane.GetDownScalingFactor(),
+                        plane.IsUsingPlaneScalar(), use_plane_transform,
+                        geometry);
+
+      // Regions and render states only depend on the layer geometry and
+      // damage, content only updates can reuse them.
+      std::vector<CompositionRegion> &comp_regions =
+          plane.GetCompositionRegion();
+      std::vector<RenderState> &render_states = plane.GetRenderStates();
+      if (clear_surface || comp_regions.empty() ||
+          !(geometry == plane.GetCompositionGeometry())) {
+        plane.ResetCompositionRegion();
+        SeparateLayers(dedicated_layers, plane.GetSourceLayers(), display_frame,
+                       geometry.damage_region, comp_regions);
+        CalculateRenderState(layers, comp_regions, render_states,
+                             geometry.downscaling_factor,
+                             geometry.uses_display_up_scaling,
+                             geometry.use_plane_transform);
+        plane.GetCompositionGeometry() = std::move(geometry);
       }
 
       std::vector<size_t>().swap(dedicated_layers);
-      if (comp_regions.empty())
+
+      if (render_states.empty())
         continue;
 
       draw_state.emplace_back();
       DrawState &state = draw_state.back();
       state.surface_ = surface;
-      size_t num_regions = comp_regions.size();
-      state.states_.reserve(num_regions);
-      bool use_plane_transform = false;
-      if (plane.GetRotationType() ==
-          DisplayPlaneState::RotationType::kGPURotation) {
-        use_plane_transform = true;
+      state.states_ = render_states;
+      // Solid colors are read from the layers of this frame.
+      for (RenderState &render_state : state.states_) {
+        for (RenderState::LayerState &layer_state :
+             render_state.layer_state_) {
+          layer_state.solid_color_array_ =
+              layers.at(layer_state.layer_index_).GetSolidColorArray();
+        }
       }
 
-      CalculateRenderState(layers, comp_regions, state,
-                           plane.GetDownScalingFactor(),
-                           plane.IsUsingPlaneScalar(), use_plane_transform);
-
-      if (state.states_.empty()) {
-        draw_state.pop_back();
-      }
+      AddAcquireFences(layers, comp_regions, state);
     }
   }
 
@@ -189,7 +200,7 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
 
   std::vector<CompositionRegion> comp_regions;
   SeparateLayers(std::vector<size_t>(), source_layers, display_frame,
-                 HwcRect<int>(0, 0, width, height), comp_regions);
+                 HwcRegion(1, HwcRect<int>(0, 0, width, height)), comp_regions);
   if (comp_regions.empty()) {
     ETRACE(
         "Failed to prepare offscreen buffer. "
@@ -208,7 +219,8 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
   draw_state.surface_ = surface;
   size_t num_regions = comp_regions.size();
   draw_state.states_.reserve(num_regions);
-  CalculateRenderState(layers, comp_regions, draw_state, 1, false);
+  CalculateRenderState(layers, comp_regions, draw_state.states_, 1, false);
+  AddAcquireFences(layers, comp_regions, draw_state);
 
   if (draw_state.states_.empty()) {
     return true;
@@ -219,6 +231,9 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
   }
 
   bool status = thread_->Draw(draw, media, draw_buffers);
+  if (status)
+    status = thread_->WaitForDraw();
+
   if (status) {
     *retire_fence = draw_state.retire_fence_;
   } else {
@@ -228,15 +243,19 @@ bool Compositor::DrawOffscreen(std::vector<OverlayLayer> &layers,
   return status;
 }
 
+bool Compositor::WaitForDraw() {
+  return thread_->WaitForDraw();
+}
+
 void Compositor::FreeResources() {
   thread_->FreeResources();
 }
 
 void Compositor::CalculateRenderState(
     std::vector<OverlayLayer> &layers,
-    const std::vector<CompositionRegion> &comp_regions, DrawState &draw_state,
-    uint32_t downscaling_factor, bool uses_display_up_scaling,
-    bool use_plane_transform) {
+    const std::vector<CompositionRegion> &comp_regions,
+    std::vector<RenderState> &states, uint32_t downscaling_factor,
+    bool uses_display_up_scaling, bool use_plane_transform) {
   CTRACE();
   size_t num_regions = comp_regions.size();
   for (size_t region_index = 0; region_index < num_regions; region_index++) {
@@ -248,9 +267,45 @@ void Compositor::CalculateRenderState(
       continue;
     }
 
-    draw_state.states_.emplace(draw_state.states_.begin(), state);
-    const std::vector<size_t> &source = region.source_layers;
-    for (size_t texture_index : source) {
+    states.emplace(states.begin(), state);
+  }
+}
+
+void Compositor::CalculateGeometry(std::vector<OverlayLayer> &layers,
+                                   const std::vector<size_t> &dedicated_layers,
+                                   const std::vector<size_t> &source_layers,
+                                   const NativeSurface *surface,
+                                   uint32_t downscaling_factor,
+                                   bool uses_display_up_scaling,
+                                   bool use_plane_transform,
+                                   CompositionGeometry &geometry) {
+  geometry.layers.reserve(dedicated_layers.size() + source_layers.size());
+  geometry.num_dedicated_layers = dedicated_layers.size();
+  for (const std::vector<size_t> *indices :
+       {&dedicated_layers, &source_layers}) {
+    for (size_t index : *indices) {
+      const OverlayLayer &layer = layers.at(index);
+      const OverlayBuffer *buffer = layer.GetBuffer();
+      geometry.layers.emplace_back(CompositionLayerGeometry{
+          index, layer.GetDisplayFrame(), layer.GetSourceCrop(),
+          layer.GetTransform(), layer.GetMergedTransform(),
+          buffer ? buffer->GetWidth() : 0, buffer ? buffer->GetHeight() : 0,
+          layer.GetBlending(), layer.GetAlpha()});
+    }
+  }
+
+  surface->GetSurfaceDamageRegion(geometry.damage_region);
+  geometry.downscaling_factor = downscaling_factor;
+  geometry.uses_display_up_scaling = uses_display_up_scaling;
+  geometry.use_plane_transform = use_plane_transform;
+}
+
+void Compositor::AddAcquireFences(
+    std::vector<OverlayLayer> &layers,
+    const std::vector<CompositionRegion> &comp_regions,
+    DrawState &draw_state) {
+  for (const CompositionRegion &region : comp_regions) {
+    for (size_t texture_index : region.source_layers) {
       OverlayLayer &layer = layers.at(texture_index);
       int32_t fence = layer.ReleaseAcquireFence();
       if (fence > 0) {
@@ -300,73 +355,49 @@ void Compositor::RestoreVideoDefaultDeinterlace() {
 }
 
 // Below code is taken from drm_hwcomposer adopted to our needs.
+template <size_t kWords>
 static std::vector<size_t> SetBitsToVector(
-    uint64_t in, const std::vector<size_t> &index_map) {
+    const RectIDs<kWords> &in, size_t offset,
+    const std::vector<size_t> &index_map) {
   std::vector<size_t> out;
-  size_t msb = sizeof(in) * 8 - 1;
-  uint64_t mask = (uint64_t)1 << msb;
-  for (size_t i = msb; mask != (uint64_t)0; i--, mask >>= 1)
-    if (in & mask)
-      out.emplace_back(index_map[i]);
+  out.reserve(in.count());
+  in.forEachReverse([&](size_t i) {
+    if (i >= offset)
+      out.emplace_back(index_map[i - offset]);
+  });
   return out;
 }
 
-void Compositor::SeparateLayers(const std::vector<size_t> &dedicated_layers,
-                                const std::vector<size_t> &source_layers,
-                                const std::vector<HwcRect<int>> &display_frame,
-                                const HwcRect<int> &damage_region,
-                                std::vector<CompositionRegion> &comp_regions) {
-  CTRACE();
-  if (source_layers.size() > 64) {
-    ETRACE("Failed to separate layers because there are more than 64");
-    return;
-  }
-
-  size_t num_exclude_rects = 0;
+// Rects of the dedicated layers are followed by the ones of source_layers in
+// layer_rects. kWords is chosen by the caller to fit all of them, so the
+// common case of up to 64 rects works on a single word.
+template <size_t kWords>
+static void SeparateRegions(const std::vector<HwcRect<int>> &layer_rects,
+                            const std::vector<size_t> &dedicated_layers,
+                            const std::vector<size_t> &source_layers,
+                            const HwcRegion &damage_region,
+                            std::vector<CompositionRegion> &comp_regions) {
   // Index at which the actual layers begin
   size_t layer_offset = dedicated_layers.size();
-  if (source_layers.size() + layer_offset > 64) {
-    WTRACE(
-        "Exclusion rectangles are being truncated to make the rectangle count "
-        "fit into 64");
-    num_exclude_rects = 64 - source_layers.size() - dedicated_layers.size();
-  }
-
-  // We inject all the exclude rects into the rects list. Any resulting rect
-  // that includes ANY of the first num_exclude_rects is rejected. After the
-  // exclude rects, we add the lower layers. The rects that intersect with
-  // these layers will be inspected and only those which are to be composited
-  // above the layer will be included in the composition regions.
-  std::vector<HwcRect<int>> layer_rects(source_layers.size() + layer_offset);
-  std::transform(
-      dedicated_layers.begin(), dedicated_layers.end(),
-      layer_rects.begin() + num_exclude_rects,
-      [=](size_t layer_index) { return display_frame[layer_index]; });
-  std::transform(source_layers.begin(), source_layers.end(),
-                 layer_rects.begin() + layer_offset, [=](size_t layer_index) {
-                   return display_frame[layer_index];
-                 });
 
-  std::vector<RectSet<int>> separate_regions;
-  get_draw_regions(layer_rects, damage_region, &separate_regions);
-  uint64_t exclude_mask = ((uint64_t)1 << num_exclude_rects) - 1;
-  uint64_t dedicated_mask = (((uint64_t)1 << dedicated_layers.size()) - 1)
-                            << num_exclude_rects;
-
-  for (RectSet<int> &region : separate_regions) {
-    if (region.id_set.getBits() & exclude_mask)
-      continue;
+  // Damage rects of a region don't overlap, so each of them can be separated
+  // on its own without shading any pixel twice.
+  std::vector<RectSet<int, kWords>> separate_regions;
+  for (const HwcRect<int> &damage_rect : damage_region) {
+    get_draw_regions(layer_rects, damage_rect, &separate_regions);
+  }
 
+  for (RectSet<int, kWords> &region : separate_regions) {
     // If a rect intersects one of the dedicated layers, we need to remove the
     // layers from the composition region which appear *below* the dedicated
     // layer. This effectively punches a hole through the composition layer such
     // that the dedicated layer can be placed below the composition and not
     // be occluded.
-    uint64_t dedicated_intersect = region.id_set.getBits() & dedicated_mask;
+    bool dedicated_intersect = region.id_set.anyBelow(layer_offset);
     for (size_t i = 0; dedicated_intersect && i < dedicated_layers.size();
          ++i) {
       // Only exclude layers if they intersect this particular dedicated layer
-      if (!(dedicated_intersect & (1 << (i + num_exclude_rects))))
+      if (!region.id_set.test(i))
         continue;
 
       for (size_t j = 0; j < source_layers.size(); ++j) {
@@ -375,12 +406,49 @@ void Compositor::SeparateLayers(const std::vector<size_t> &dedicated_layers,
       }
     }
 
-    if (!(region.id_set.getBits() >> layer_offset))
+    if (!region.id_set.anyFrom(layer_offset))
       continue;
 
     comp_regions.emplace_back(CompositionRegion{
-        region.rect, SetBitsToVector(region.id_set.getBits() >> layer_offset,
-                                     source_layers)});
+        region.rect,
+        SetBitsToVector(region.id_set, layer_offset, source_layers)});
+  }
+}
+
+void Compositor::SeparateLayers(const std::vector<size_t> &dedicated_layers,
+                                const std::vector<size_t> &source_layers,
+                                const std::vector<HwcRect<int>> &display_frame,
+                                const HwcRegion &damage_region,
+                                std::vector<CompositionRegion> &comp_regions) {
+  CTRACE();
+  size_t total_rects = source_layers.size() + dedicated_layers.size();
+  if (total_rects > RectIDs<kMaxRectIDWords>::max_elements) {
+    ETRACE("Failed to separate layers because there are more than %zu",
+           RectIDs<kMaxRectIDWords>::max_elements);
+    return;
+  }
+
+  // We add the lower layers first followed by the layers to be composited.
+  // The rects that intersect with the lower layers will be inspected and only
+  // those which are to be composited above the layer will be included in the
+  // composition regions.
+  std::vector<HwcRect<int>> layer_rects(total_rects);
+  std::transform(
+      dedicated_layers.begin(), dedicated_layers.end(), layer_rects.begin(),
+      [=](size_t layer_index) { return display_frame[layer_index]; });
+  std::transform(source_layers.begin(), source_layers.end(),
+                 layer_rects.begin() + dedicated_layers.size(),
+                 [=](size_t layer_index) {
+                   return display_frame[layer_index];
+                 });
+
+  if (total_rects <= RectIDs<1>::max_elements) {
+    SeparateRegions<1>(layer_rects, dedicated_layers, source_layers,
+                       damage_region, comp_regions);
+  } else {
+    SeparateRegions<kMaxRectIDWords>(layer_rects, dedicated_layers,
+                                     source_layers, damage_region,
+                                     comp_regions);
   }
 }
 
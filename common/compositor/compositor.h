@@ -51,6 +51,9 @@ class Compositor {
                      ResourceManager *resource_manager, uint32_t width,
                      uint32_t height, HWCNativeHandle output_handle,
                      int32_t acquire_fence, int32_t *retire_fence);
+  // Draw only queues the composition. This needs to be called before the
+  // offscreen targets of the frame are scanned out.
+  bool WaitForDraw();
   void FreeResources();
 
   void SetVideoScalingMode(uint32_t);
@@ -65,13 +68,24 @@ class Compositor {
  private:
   void CalculateRenderState(std::vector<OverlayLayer> &layers,
                             const std::vector<CompositionRegion> &comp_regions,
-                            DrawState &state, uint32_t downscaling_factor,
+                            std::vector<RenderState> &states,
+                            uint32_t downscaling_factor,
                             bool uses_display_up_scaling,
                             bool use_plane_transform = false);
+  void CalculateGeometry(std::vector<OverlayLayer> &layers,
+                         const std::vector<size_t> &dedicated_layers,
+                         const std::vector<size_t> &source_layers,
+                         const NativeSurface *surface,
+                         uint32_t downscaling_factor,
+                         bool uses_display_up_scaling, bool use_plane_transform,
+                         CompositionGeometry &geometry);
+  void AddAcquireFences(std::vector<OverlayLayer> &layers,
+                        const std::vector<CompositionRegion> &comp_regions,
+                        DrawState &draw_state);
   void SeparateLayers(const std::vector<size_t> &dedicated_layers,
                       const std::vector<size_t> &source_layers,
                       const std::vector<HwcRect<int>> &display_frame,
-                      const HwcRect<int> &damage_region,
+                      const HwcRegion &damage_region,
                       std::vector<CompositionRegion> &comp_regions);
 
   std::unique_ptr<CompositorThread> thread_;
@@ -38,7 +38,7 @@ namespace hwcomposer {
 // float mat[4] = { 1, 2, 3, 4 } ===
 // [ 1 3 ]
 // [ 2 4 ]
-static float TransformMatrices[] = {
+static const float TransformMatrices[] = {
     1.0f, 0.0f, 0.0f, 1.0f,  // identity matrix
     0.0f, 1.0f, 1.0f, 0.0f,  // swap x and y
 };
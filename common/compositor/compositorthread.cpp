@@ -82,8 +82,11 @@ void CompositorThread::Wait() {
 bool CompositorThread::Draw(std::vector<DrawState> &states,
                             std::vector<DrawState> &media_states,
                             const std::vector<OverlayBuffer *> &buffers) {
-  states_.swap(states);
+  // states_ and buffers_ are owned by the worker till the previous batch
+  // is done.
+  WaitForDraw();
   tasks_lock_.lock();
+  states_.swap(states);
 
   if (!states_.empty()) {
     buffers_ = buffers;
@@ -98,21 +101,48 @@ bool CompositorThread::Draw(std::vector<DrawState> &states,
   // We start of assuming that the draw calls
   // succeed.
   draw_succeeded_ = true;
-  tasks_lock_.unlock();
 
   // Adding check to avoid waiting in this
   // thread in certain corner case.
   if (states_.empty() && media_states_.empty()) {
+    tasks_lock_.unlock();
     return draw_succeeded_;
   }
 
+  if (!initialized_) {
+    tasks_lock_.unlock();
+    ETRACE("CompositorThread is not running, dropping draw request.");
+    return false;
+  }
+
+  // Has to be set together with tasks_, the worker might already be awake
+  // and pick up the request before Resume is called. Only the worker clears
+  // it again.
+  draw_pending_ = true;
+  tasks_lock_.unlock();
   Resume();
-  Wait();
-  return draw_succeeded_;
+  return true;
+}
+
+bool CompositorThread::WaitForDraw() {
+  tasks_lock_.lock();
+  while (draw_pending_) {
+    tasks_lock_.unlock();
+    Wait();
+    tasks_lock_.lock();
+  }
+
+  bool succeeded = draw_succeeded_;
+  tasks_lock_.unlock();
+  return succeeded;
 }
 
 void CompositorThread::ExitThread() {
   HWCThread::Exit();
+  // Worker is gone, nothing is going to complete a pending draw anymore.
+  tasks_lock_.lock();
+  draw_pending_ = false;
+  tasks_lock_.unlock();
   std::vector<DrawState>().swap(states_);
   std::vector<OverlayBuffer *>().swap(buffers_);
 }
@@ -140,6 +170,9 @@ void CompositorThread::HandleRoutine() {
   }
 
   if (signal) {
+    tasks_lock_.lock();
+    draw_pending_ = false;
+    tasks_lock_.unlock();
     cevent_.Signal();
   }
 }
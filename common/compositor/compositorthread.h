@@ -45,10 +45,17 @@ class CompositorThread : public HWCThread {
 
   void Initialize(ResourceManager* resource_manager, uint32_t gpu_fd);
 
+  // Queues states to be rendered and returns without waiting for the
+  // draw calls to be submitted. Blocks only if the previous batch is still
+  // being processed.
   bool Draw(std::vector<DrawState>& states,
             std::vector<DrawState>& media_states,
             const std::vector<OverlayBuffer*>& buffers);
 
+  // Waits till the last batch queued by Draw has been submitted to the
+  // GPU and returns whether it succeeded.
+  bool WaitForDraw();
+
   void SetDisableExplicitSync(bool disable_explicit_sync);
   void FreeResources();
 
@@ -81,6 +88,7 @@ class CompositorThread : public HWCThread {
   std::vector<ResourceHandle> purged_resources_;
   bool disable_explicit_sync_ = false;
   bool draw_succeeded_ = false;
+  bool draw_pending_ = false;
   ResourceManager* resource_manager_ = NULL;
   uint32_t tasks_ = kNone;
   uint32_t gpu_fd_ = 0;
@@ -30,7 +30,7 @@ EGLOffScreenContext::~EGLOffScreenContext() {
       ETRACE("Failed to destroy OpenGL ES Context.");
 }
 
-bool EGLOffScreenContext::Init() {
+bool EGLOffScreenContext::Init(const EGLOffScreenContext *share_context) {
   EGLint num_configs;
   EGLConfig egl_config;
   static const EGLint context_attribs[] = {
@@ -57,8 +57,10 @@ bool EGLOffScreenContext::Init() {
     return false;
   }
 
-  egl_ctx_ = eglCreateContext(egl_display_, egl_config, EGL_NO_CONTEXT,
-                              context_attribs);
+  egl_ctx_ = eglCreateContext(
+      egl_display_, egl_config,
+      share_context ? share_context->egl_ctx_ : EGL_NO_CONTEXT,
+      context_attribs);
 
   if (egl_ctx_ == EGL_NO_CONTEXT) {
     ETRACE("Failed to create EGL Context.");
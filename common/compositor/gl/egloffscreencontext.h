@@ -26,7 +26,8 @@ class EGLOffScreenContext {
   EGLOffScreenContext();
   ~EGLOffScreenContext();
 
-  bool Init();
+  // Objects like programs are shared with share_context when given.
+  bool Init(const EGLOffScreenContext *share_context = nullptr);
 
   EGLint GetSyncFD(bool onScreen);
 
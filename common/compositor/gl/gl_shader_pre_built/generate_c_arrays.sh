@@ -17,7 +17,6 @@ TARGET_PCI_ID=$1
 OUT_DIR=$SHADER_PRE_BUILT_PATH/shader_prog_arrays
 OUT_HEADER=$SHADER_PRE_BUILT_PATH/glprebuiltshaderarray.h
 
-SHADER_TEST_FILE_PREFIX=hwc_shader_prog_
 SHADER_TEST_FOLDER=$SHADER_PRE_BUILT_PATH/shader-test
 BIN_TO_ARRAY=$SHADER_PRE_BUILT_PATH/bin_to_c_array
 SHADER_DB_DIR=$SHADER_PRE_BUILT_PATH/shader-db
@@ -25,6 +24,10 @@ SHADER_DB_DIR=$SHADER_PRE_BUILT_PATH/shader-db
 MAX_NUM_LAYERS=16
 GEN_SHADER_TEST=$SHADER_PRE_BUILT_PATH/generate_shader_test.sh
 
+# The shader tests define the version, binaries and arrays are named after it.
+SHADER_VERSION=$(sed -n 's/^SHADER_VERSION=//p' $GEN_SHADER_TEST)
+SHADER_TEST_FILE_PREFIX=hwc_shader_prog_v${SHADER_VERSION}_
+
 #building bin_to_c_arrays
 gcc $BIN_TO_ARRAY.c -o $BIN_TO_ARRAY
 
@@ -50,6 +53,7 @@ mkdir -p $OUT_DIR
 
 #generate arrays of shader program binary
 
+prebuilt_shader_header="#define PREBUILT_SHADER_ARRAY_VERSION $SHADER_VERSION\n\n"
 i=1
 while [ $i -le $MAX_NUM_LAYERS ]
 do
@@ -9,6 +9,10 @@ else
     layer_cnt=$1
 fi
 
+# Version of the shader interface, has to match PREBUILT_SHADER_VERSION in
+# glprogram.cpp. Bump both whenever the shaders below change.
+SHADER_VERSION=2
+
 SHADER_PRE_BUILT_PATH=$PWD/compositor/gl/gl_shader_pre_built
 REQ_FILE="$SHADER_PRE_BUILT_PATH/require.txt"
 
@@ -26,21 +30,37 @@ shader_test+="#define LAYER_COUNT "
 shader_test+="$layer_cnt\n"
 
 shader_test+="precision mediump int;\n"
-shader_test+="uniform vec4 uViewport;\n"
-shader_test+="uniform vec4 uLayerCrop[LAYER_COUNT];\n"
-shader_test+="uniform mat2 uTexMatrix[LAYER_COUNT];\n"
-shader_test+="in vec2 vPosition;\n"
-shader_test+="in vec2 vTexCoords;\n"
+shader_test+="layout(location = 0) in vec2 vPosition;\n"
+
+i=0
+while [ $i -lt $layer_cnt ]
+do
+   if [ $(( $i + 1 )) -lt $layer_cnt ]; then
+      attrib_type="vec4"
+   else
+      attrib_type="vec2"
+   fi
+   shader_test+="layout(location = $(( $i / 2 + 1 ))) in $attrib_type vTexCoords$(( $i / 2 ));\n"
+   i=$(( $i + 2 ))
+done
+
 shader_test+="out vec2 fTexCoords[LAYER_COUNT];\n"
 shader_test+="void main() {\n"
-shader_test+="  for (int i = 0; i < LAYER_COUNT; i++) {\n"
-shader_test+="    vec2 tempCoords = vTexCoords * uTexMatrix[i];\n"
-shader_test+="    fTexCoords[i] =\n"
-shader_test+="        uLayerCrop[i].xy + tempCoords * uLayerCrop[i].zw;\n"
-shader_test+="  }\n"
-shader_test+="  vec2 scaledPosition = uViewport.xy + vPosition * uViewport.zw;\n"
+
+i=0
+while [ $i -lt $layer_cnt ]
+do
+   if [ $(( $i % 2 )) -eq 0 ]; then
+      swizzle="xy"
+   else
+      swizzle="zw"
+   fi
+   shader_test+="  fTexCoords[$i] = vTexCoords$(( $i / 2 )).$swizzle;\n"
+   i=$(( $i + 1 ))
+done
+
 shader_test+="  gl_Position =\n"
-shader_test+="      vec4(scaledPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
+shader_test+="      vec4(vPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
 shader_test+="}\n"
 
 # fragment shader creation
@@ -61,13 +81,15 @@ done
 
 shader_test+="uniform float uLayerAlpha[LAYER_COUNT];\n"
 shader_test+="uniform float uLayerPremult[LAYER_COUNT];\n"
+shader_test+="uniform vec4 uLayerColor[LAYER_COUNT];\n"
 shader_test+="in vec2 fTexCoords[LAYER_COUNT];\n"
 shader_test+="out vec4 oFragColor;\n"
 shader_test+="void main() {\n"
 shader_test+="  vec3 color = vec3(0.0, 0.0, 0.0);\n"
 shader_test+="  float alphaCover = 1.0;\n"
 shader_test+="  vec4 texSample;\n"
-shader_test+="  vec3 multRgb;\n";
+shader_test+="  vec3 multRgb;\n"
+shader_test+="  float tempAlpha;\n";
 
 i=0
 while [ $i -lt $layer_cnt ]
@@ -80,8 +102,12 @@ do
    shader_test+=",\n"
    shader_test+="                        fTexCoords[$i"
    shader_test+="]);\n"
+   shader_test+="  texSample.rgb = texSample.rgb + uLayerColor[$i"
+   shader_test+="].rgb;\n"
+   shader_test+="  tempAlpha = min(texSample.a, uLayerColor[$i"
+   shader_test+="].a);\n"
    shader_test+="  multRgb = texSample.rgb *\n"
-   shader_test+="            max(texSample.a, uLayerPremult[$i"
+   shader_test+="            max(tempAlpha, uLayerPremult[$i"
    shader_test+="]);\n"
    shader_test+="  color += multRgb * uLayerAlpha[$i"
    shader_test+="] * alphaCover;\n"
@@ -100,8 +126,8 @@ done
 shader_test+="  oFragColor = vec4(color, 1.0 - alphaCover);\n"
 shader_test+="}\n"
 
-outfile_name=hwc_shader_prog_$layer_cnt.shader_test
+outfile_name=hwc_shader_prog_v${SHADER_VERSION}_$layer_cnt.shader_test
 
-echo -e "$shader_test" > hwc_shader_prog_$layer_cnt.shader_test
+echo -e "$shader_test" > $outfile_name
 
 echo "$outfile_name is generated successfully"
@@ -16,10 +16,14 @@
 
 #include "glprogram.h"
 
+#include <stdio.h>
+
 #include <string>
 #include <sstream>
+#include <vector>
 
 #include "hwctrace.h"
+#include "hwcutils.h"
 #include "renderstate.h"
 
 namespace hwcomposer {
@@ -58,27 +62,31 @@ static GLint CompileAndCheckShader(GLenum type, unsigned source_count,
   return shader;
 }
 
+// Positions and texture coordinates of all regions drawn with the program
+// are calculated upfront and passed as vertex attributes, so that regions
+// sharing the same layers can be drawn with a single call. Texture
+// coordinates of two layers share an attribute, to stay within
+// GL_MAX_VERTEX_ATTRIBS.
 static std::string GenerateVertexShader(int layer_count) {
   std::ostringstream vertex_shader_stream;
+  vertex_shader_stream << "#version 300 es\n"
+                       << "#define LAYER_COUNT " << layer_count << "\n"
+                       << "precision mediump int;\n"
+                       << "layout(location = 0) in vec2 vPosition;\n";
+  for (int i = 0; i < layer_count; i += 2) {
+    vertex_shader_stream << "layout(location = " << i / 2 + 1 << ") in "
+                         << (i + 1 < layer_count ? "vec4" : "vec2")
+                         << " vTexCoords" << i / 2 << ";\n";
+  }
+  vertex_shader_stream << "out vec2 fTexCoords[LAYER_COUNT];\n"
+                       << "void main() {\n";
+  for (int i = 0; i < layer_count; ++i) {
+    vertex_shader_stream << "  fTexCoords[" << i << "] = vTexCoords" << i / 2
+                         << (i % 2 ? ".zw" : ".xy") << ";\n";
+  }
   vertex_shader_stream
-      << "#version 300 es\n"
-      << "#define LAYER_COUNT " << layer_count << "\n"
-      << "precision mediump int;\n"
-      << "uniform vec4 uViewport;\n"
-      << "uniform vec4 uLayerCrop[LAYER_COUNT];\n"
-      << "uniform mat2 uTexMatrix[LAYER_COUNT];\n"
-      << "in vec2 vPosition;\n"
-      << "in vec2 vTexCoords;\n"
-      << "out vec2 fTexCoords[LAYER_COUNT];\n"
-      << "void main() {\n"
-      << "  for (int i = 0; i < LAYER_COUNT; i++) {\n"
-      << "    vec2 tempCoords = vTexCoords * uTexMatrix[i];\n"
-      << "    fTexCoords[i] =\n"
-      << "        uLayerCrop[i].xy + tempCoords * uLayerCrop[i].zw;\n"
-      << "  }\n"
-      << "  vec2 scaledPosition = uViewport.xy + vPosition * uViewport.zw;\n"
       << "  gl_Position =\n"
-      << "      vec4(scaledPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
+      << "      vec4(vPosition * vec2(2.0) - vec2(1.0), 0.0, 1.0);\n"
       << "}\n";
   return vertex_shader_stream.str();
 }
@@ -133,6 +141,13 @@ static std::string GenerateFragmentShader(int layer_count) {
 }
 
 #if defined(LOAD_PREBUILT_SHADER_FILE) || defined(USE_PREBUILT_SHADER_BIN_ARRAY)
+// Version of the shader interface prebuilt binaries have to be built for,
+// bumped whenever the generated shaders change. It is part of the binary
+// file names and of the generated arrays, so that binaries built for older
+// shaders are never loaded. Has to match SHADER_VERSION in
+// gl_shader_pre_built/generate_shader_test.sh.
+#define PREBUILT_SHADER_VERSION 2
+
 static GLint LoadPreBuiltBinary(GLint gl_program, void *binary, long size) {
   GLint status;
 
@@ -156,6 +171,110 @@ static GLint LoadPreBuiltBinary(GLint gl_program, void *binary, long size) {
 
 #ifdef USE_PREBUILT_SHADER_BIN_ARRAY
 #include "glprebuiltshaderarray.h"
+#if !defined(PREBUILT_SHADER_ARRAY_VERSION) || \
+    PREBUILT_SHADER_ARRAY_VERSION != PREBUILT_SHADER_VERSION
+#error "glprebuiltshaderarray.h is stale, rerun generate_c_arrays.sh"
+#endif
+#endif
+
+#ifdef SHADER_CACHE_PATH
+// Program binaries linked at run time are cached under SHADER_CACHE_PATH,
+// one file per layer count. The header holds a FNV-1a hash of the driver
+// strings and shader sources. After a driver update or shader change the
+// stale binary is skipped and overwritten with the newly linked one. Unlike
+// std::hash, the hash doesn't change with the C++ library.
+struct ProgramCacheHeader {
+  uint32_t magic;
+  uint32_t format;
+  uint64_t key;
+  uint32_t length;
+};
+
+static const uint32_t kProgramCacheMagic = 0x50435748;  // "HWCP"
+static const uint32_t kProgramCacheSizeLimit = 10485760;
+
+static uint64_t HashProgramKey(const std::string &key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char c : key) {
+    hash ^= c;
+    hash *= 1099511628211ULL;
+  }
+
+  return hash;
+}
+
+static uint64_t GetProgramCacheKey(unsigned num_textures,
+                                   const std::string &vertex_shader,
+                                   const std::string &fragment_shader) {
+  std::ostringstream key;
+  for (GLenum name : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+    const GLubyte *value = glGetString(name);
+    if (value)
+      key << reinterpret_cast<const char *>(value);
+    key << "\n";
+  }
+
+  key << num_textures << "\n" << vertex_shader << fragment_shader;
+  return HashProgramKey(key.str());
+}
+
+static std::string GetProgramCachePath(unsigned num_textures) {
+  std::ostringstream path;
+  path << SHADER_CACHE_PATH "/hwc_shader_prog_" << num_textures << ".bin";
+  return path.str();
+}
+
+static bool LoadCachedProgram(GLint program, const std::string &path,
+                              uint64_t key) {
+  FILE *fp = fopen(path.c_str(), "rb");
+  if (!fp)
+    return false;
+
+  ProgramCacheHeader header;
+  std::vector<char> binary;
+  bool loaded = false;
+  if (fread(&header, sizeof(header), 1, fp) == 1 &&
+      header.magic == kProgramCacheMagic && header.key == key &&
+      header.length > 0 && header.length <= kProgramCacheSizeLimit) {
+    binary.resize(header.length);
+    if (fread(binary.data(), 1, header.length, fp) == header.length) {
+      GLint status = 0;
+      glProgramBinaryOES(program, header.format, binary.data(),
+                         header.length);
+      glGetProgramiv(program, GL_LINK_STATUS, &status);
+      loaded = status;
+    }
+  }
+
+  fclose(fp);
+  if (!loaded)
+    remove(path.c_str());
+
+  return loaded;
+}
+
+static void StoreCachedProgram(GLint program, const std::string &path,
+                               uint64_t key) {
+  GLint length = 0;
+  glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+  if (length <= 0 || (uint32_t)length > kProgramCacheSizeLimit)
+    return;
+
+  std::vector<char> binary(length);
+  GLenum format = 0;
+  GLsizei written = 0;
+  glGetProgramBinaryOES(program, length, &written, &format, binary.data());
+  if (written <= 0)
+    return;
+
+  // Value initialized, so that the padding written to the file is zero.
+  ProgramCacheHeader header = ProgramCacheHeader();
+  header.magic = kProgramCacheMagic;
+  header.format = format;
+  header.key = key;
+  header.length = written;
+  WriteFileAtomically(path, &header, sizeof(header), binary.data(), written);
+}
 #endif
 
 static GLint GenerateProgram(unsigned num_textures,
@@ -202,8 +321,9 @@ static GLint GenerateProgram(unsigned num_textures,
 
   /* try to load prebuilt shader program from files */
   std::ostringstream shader_program_fname;
-  shader_program_fname << PREBUILT_SHADER_FILE_PATH "/hwc_shader_prog_"
-                       << num_textures << ".shader_test.bin";
+  shader_program_fname << PREBUILT_SHADER_FILE_PATH "/hwc_shader_prog_v"
+                       << PREBUILT_SHADER_VERSION << "_" << num_textures
+                       << ".shader_test.bin";
 
   FILE *shader_prog_fp;
 
@@ -253,13 +373,24 @@ fail_file_open:
 #endif
 
   std::string vertex_shader_string = GenerateVertexShader(num_textures);
+  std::string fragment_shader_string = GenerateFragmentShader(num_textures);
+#ifdef SHADER_CACHE_PATH
+  std::string cache_path = GetProgramCachePath(num_textures);
+  uint64_t cache_key = GetProgramCacheKey(num_textures, vertex_shader_string,
+                                          fragment_shader_string);
+  if (LoadCachedProgram(program, cache_path, cache_key)) {
+    if (shader_log)
+      *shader_log << "Shader program binary has been loaded from cache\n";
+    return program;
+  }
+#endif
+
   const GLchar *vertex_shader_source = vertex_shader_string.c_str();
   GLint vertex_shader = CompileAndCheckShader(
       GL_VERTEX_SHADER, 1, &vertex_shader_source, shader_log);
   if (!vertex_shader)
     return 0;
 
-  std::string fragment_shader_string = GenerateFragmentShader(num_textures);
   const GLchar *fragment_shader_source = fragment_shader_string.c_str();
   GLint fragment_shader = CompileAndCheckShader(
       GL_FRAGMENT_SHADER, 1, &fragment_shader_source, shader_log);
@@ -270,8 +401,6 @@ fail_file_open:
 
   glAttachShader(program, vertex_shader);
   glAttachShader(program, fragment_shader);
-  glBindAttribLocation(program, 0, "vPosition");
-  glBindAttribLocation(program, 1, "vTexCoords");
   glLinkProgram(program);
   glDetachShader(program, vertex_shader);
   glDetachShader(program, fragment_shader);
@@ -291,16 +420,17 @@ fail_file_open:
     return 0;
   }
 
+#ifdef SHADER_CACHE_PATH
+  StoreCachedProgram(program, cache_path, cache_key);
+#endif
+
   return program;
 }
 
 GLProgram::GLProgram()
     : program_(0),
-      viewport_loc_(0),
-      crop_loc_(0),
       alpha_loc_(0),
       premult_loc_(0),
-      tex_matrix_loc_(0),
       solid_color_loc_(0),
       initialized_(false) {
 }
@@ -321,18 +451,13 @@ bool GLProgram::Init(unsigned texture_count) {
   return true;
 }
 
-void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
-                           GLuint viewport_height) {
+void GLProgram::UseProgram(unsigned texture_count) {
   glUseProgram(program_);
-  unsigned size = state.layer_state_.size();
   if (!initialized_) {
-    viewport_loc_ = glGetUniformLocation(program_, "uViewport");
-    crop_loc_ = glGetUniformLocation(program_, "uLayerCrop");
     alpha_loc_ = glGetUniformLocation(program_, "uLayerAlpha");
     premult_loc_ = glGetUniformLocation(program_, "uLayerPremult");
-    tex_matrix_loc_ = glGetUniformLocation(program_, "uTexMatrix");
     solid_color_loc_ = glGetUniformLocation(program_, "uLayerColor");
-    for (unsigned src_index = 0; src_index < size; src_index++) {
+    for (unsigned src_index = 0; src_index < texture_count; src_index++) {
       std::ostringstream texture_name_formatter;
       texture_name_formatter << "uLayerTexture" << src_index;
       GLuint tex_loc =
@@ -342,23 +467,15 @@ void GLProgram::UseProgram(const RenderState &state, GLuint viewport_width,
 
     initialized_ = true;
   }
+}
 
-  glUniform4f(viewport_loc_, state.x_ / (float)viewport_width,
-              state.y_ / (float)viewport_height,
-              (state.width_) / (float)viewport_width,
-              (state.height_) / (float)viewport_height);
-
-  for (unsigned src_index = 0; src_index < size; src_index++) {
-    const RenderState::LayerState &src = state.layer_state_[src_index];
+void GLProgram::SetLayerUniforms(const RenderState &state,
+                                 unsigned first_layer, unsigned count) {
+  for (unsigned src_index = 0; src_index < count; src_index++) {
+    const RenderState::LayerState &src =
+        state.layer_state_[first_layer + src_index];
     glUniform1f(alpha_loc_ + src_index, src.alpha_);
     glUniform1f(premult_loc_ + src_index, src.premult_);
-    glUniform4f(crop_loc_ + src_index, src.crop_bounds_[0], src.crop_bounds_[1],
-                src.crop_bounds_[2] - src.crop_bounds_[0],
-                src.crop_bounds_[3] - src.crop_bounds_[1]);
-    glUniformMatrix2fv(tex_matrix_loc_ + src_index, 1, GL_FALSE,
-                       src.texture_matrix_);
-    glActiveTexture(GL_TEXTURE0 + src_index);
-    glBindTexture(GL_TEXTURE_EXTERNAL_OES, src.handle_);
     glUniform4f(solid_color_loc_ + src_index, (float)src.solid_color_array_[3],
                 (float)src.solid_color_array_[2],
                 (float)src.solid_color_array_[1],
@@ -34,16 +34,18 @@ class GLProgram {
   ~GLProgram();
 
   bool Init(unsigned texture_count);
-  void UseProgram(const RenderState& cmd, GLuint viewport_width,
-                  GLuint viewport_height);
+  void UseProgram(unsigned texture_count);
+
+  // Uploads alpha, premult and solid color of count layers of state,
+  // starting at first_layer. Region geometry is part of the vertex stream
+  // and textures are bound by the caller.
+  void SetLayerUniforms(const RenderState& state, unsigned first_layer,
+                        unsigned count);
 
  private:
   GLint program_;
-  GLint viewport_loc_;
-  GLint crop_loc_;
   GLint alpha_loc_;
   GLint premult_loc_;
-  GLint tex_matrix_loc_;
   GLint solid_color_loc_;
   bool initialized_;
 };
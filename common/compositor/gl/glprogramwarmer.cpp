@@ -0,0 +1,56 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "glprogramwarmer.h"
+
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+GLProgramWarmer::GLProgramWarmer()
+    : ProgramWarmer<GLProgram>("GLProgramWarmer") {
+}
+
+GLProgramWarmer::~GLProgramWarmer() {
+  ExitThread();
+}
+
+bool GLProgramWarmer::Initialize(const EGLOffScreenContext &share_context,
+                                 unsigned first_count, unsigned last_count) {
+  if (!context_.Init(&share_context)) {
+    ETRACE("Failed to create shared context for GLProgramWarmer.");
+    return false;
+  }
+
+  return Start(first_count, last_count);
+}
+
+bool GLProgramWarmer::BeginWarmUp() {
+  return context_.MakeCurrent();
+}
+
+void GLProgramWarmer::ProgramBuilt() {
+  // Make sure the program is complete before the renderer context
+  // starts using it.
+  glFinish();
+}
+
+void GLProgramWarmer::EndWarmUp(bool /*cancelled*/) {
+  eglMakeCurrent(context_.GetDisplay(), EGL_NO_SURFACE, EGL_NO_SURFACE,
+                 EGL_NO_CONTEXT);
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,47 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_GL_GLPROGRAMWARMER_H_
+#define COMMON_COMPOSITOR_GL_GLPROGRAMWARMER_H_
+
+#include "egloffscreencontext.h"
+#include "glprogram.h"
+#include "programwarmer.h"
+
+namespace hwcomposer {
+
+// Builds GL programs, indexed by texture count, in a context shared with
+// the renderer.
+class GLProgramWarmer : public ProgramWarmer<GLProgram> {
+ public:
+  GLProgramWarmer();
+  ~GLProgramWarmer() override;
+
+  // Starts building programs for first_count to last_count textures.
+  bool Initialize(const EGLOffScreenContext &share_context,
+                  unsigned first_count, unsigned last_count);
+
+ protected:
+  bool BeginWarmUp() override;
+  void ProgramBuilt() override;
+  void EndWarmUp(bool cancelled) override;
+
+ private:
+  EGLOffScreenContext context_;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_GL_GLPROGRAMWARMER_H_
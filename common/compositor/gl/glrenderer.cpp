@@ -16,7 +16,10 @@
 
 #include "glrenderer.h"
 
+#include <algorithm>
+
 #include "glprogram.h"
+#include "glprogramwarmer.h"
 #include "hwctrace.h"
 #include "nativesurface.h"
 #include "renderstate.h"
@@ -27,21 +30,31 @@
 
 namespace hwcomposer {
 
+// Programs for up to kInitialTextureCount layers are built by Init, the
+// ones up to kMaxWarmedTextureCount in the background.
+static const unsigned kInitialTextureCount = 4;
+static const unsigned kMaxWarmedTextureCount = 16;
+
+GLRenderer::GLRenderer() {
+}
+
 GLRenderer::~GLRenderer() {
   if (!context_.MakeCurrent()) {
     ETRACE("Failed make current context.");
     return;
   }
 
+  // Programs left in the warmer are deleted using our context.
+  warmer_.reset(nullptr);
+
+  if (vertex_buffer_)
+    glDeleteBuffers(1, &vertex_buffer_);
+
   if (vertex_array_)
     glDeleteVertexArraysOES(1, &vertex_array_);
 }
 
 bool GLRenderer::Init() {
-  // clang-format off
-  const GLfloat verts[] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 2.0f,
-                           0.0f, 2.0f, 2.0f, 0.0f, 2.0f, 0.0f};
-  // clang-format on
   if (!context_.Init()) {
     ETRACE("Failed to initialize EGLContext.");
     return false;
@@ -59,30 +72,148 @@ bool GLRenderer::Init() {
   glGenVertexArraysOES(1, &vertex_array);
   glBindVertexArrayOES(vertex_array);
 
-  GLuint vertex_buffer;
-  glGenBuffers(1, &vertex_buffer);
-  glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
-  glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+  // Vertices are streamed in every Draw.
+  glGenBuffers(1, &vertex_buffer_);
 
-  for (int i = 1; i < 5; i++) {
+  programs_.resize(kInitialTextureCount);
+  for (unsigned i = 1; i <= kInitialTextureCount; i++) {
     std::unique_ptr<GLProgram> program(new GLProgram());
     if (program->Init(i)) {
-      programs_.emplace_back(std::move(program));
+      programs_[i - 1] = std::move(program);
     }
   }
 
-  glEnableVertexAttribArray(0);
-  glEnableVertexAttribArray(1);
+  vertex_array_ = vertex_array;
+
+  // Each program samples one texture per layer and takes two layers'
+  // texture coordinates per vertex attribute, next to the position.
+  GLint max_textures = 0;
+  GLint max_attribs = 0;
+  glGetIntegerv(GL_MAX_TEXTURE_IMAGE_UNITS, &max_textures);
+  glGetIntegerv(GL_MAX_VERTEX_ATTRIBS, &max_attribs);
+  max_layers_ = std::max(1, std::min(max_textures, 2 * (max_attribs - 1)));
+
+  unsigned last_count = std::min(kMaxWarmedTextureCount, max_layers_);
+  if (last_count > kInitialTextureCount) {
+    warmer_.reset(new GLProgramWarmer());
+    if (!warmer_->Initialize(context_, kInitialTextureCount + 1, last_count))
+      warmer_.reset(nullptr);
+  }
+
+  return true;
+}
 
-  glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4, NULL);
-  glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 4,
-                        (void *)(sizeof(float) * 2));
+GLRenderer::DrawBatch *GLRenderer::FindBatch(const RenderState &state,
+                                             unsigned first_layer,
+                                             unsigned count) {
+  for (DrawBatch &batch : batches_) {
+    if (batch.first_layer_ != first_layer || batch.layer_count_ != count)
+      continue;
 
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+    const std::vector<RenderState::LayerState> &layers =
+        batch.state_->layer_state_;
+    if (layers.size() != state.layer_state_.size())
+      continue;
 
-  vertex_array_ = vertex_array;
+    bool same_layers = true;
+    for (size_t i = first_layer; i < first_layer + count && same_layers;
+         i++) {
+      same_layers = layers[i].layer_index_ ==
+                        state.layer_state_[i].layer_index_ &&
+                    layers[i].handle_ == state.layer_state_[i].handle_;
+    }
 
-  return true;
+    if (same_layers)
+      return &batch;
+  }
+
+  return NULL;
+}
+
+// Groups regions using the same layers and writes two triangles per region
+// into vertices_. Each vertex holds the position followed by the texture
+// coordinates of every layer, which used to be calculated by the vertex
+// shader from per region uniforms.
+void GLRenderer::BuildBatches(const std::vector<RenderState> &render_states,
+                              GLuint frame_width, GLuint frame_height) {
+  batches_.clear();
+  for (const RenderState &state : render_states) {
+    unsigned size = state.layer_state_.size();
+    for (unsigned first = 0, pass = 0; first < size;
+         first += max_layers_, pass++) {
+      unsigned count = std::min(max_layers_, size - first);
+      DrawBatch *batch = FindBatch(state, first, count);
+      if (!batch) {
+        batches_.emplace_back(DrawBatch{&state, first, count, pass, 0, 0, 0});
+        batch = &batches_.back();
+      }
+
+      batch->num_regions_++;
+    }
+  }
+
+  // Keep batches using the same program next to each other. Later passes
+  // blend below the earlier ones, so they have to come last.
+  std::stable_sort(batches_.begin(), batches_.end(),
+                   [](const DrawBatch &first, const DrawBatch &second) {
+                     if (first.pass_ != second.pass_)
+                       return first.pass_ < second.pass_;
+                     return first.layer_count_ < second.layer_count_;
+                   });
+
+  size_t total = 0;
+  for (DrawBatch &batch : batches_) {
+    batch.offset_ = batch.fill_ = total;
+    total += batch.num_regions_ * 6 * (2 + 2 * batch.layer_count_);
+  }
+
+  vertices_.resize(total);
+
+  static const GLfloat kQuad[6][2] = {{0.0f, 0.0f}, {1.0f, 0.0f},
+                                      {0.0f, 1.0f}, {0.0f, 1.0f},
+                                      {1.0f, 0.0f}, {1.0f, 1.0f}};
+  for (const RenderState &state : render_states) {
+    GLfloat x = state.x_ / (float)frame_width;
+    GLfloat y = state.y_ / (float)frame_height;
+    GLfloat width = state.width_ / (float)frame_width;
+    GLfloat height = state.height_ / (float)frame_height;
+    unsigned size = state.layer_state_.size();
+    for (unsigned first = 0; first < size; first += max_layers_) {
+      unsigned count = std::min(max_layers_, size - first);
+      DrawBatch *batch = FindBatch(state, first, count);
+      GLfloat *vertex = &vertices_[batch->fill_];
+      for (const GLfloat *corner : kQuad) {
+        *vertex++ = x + corner[0] * width;
+        *vertex++ = y + corner[1] * height;
+        for (unsigned i = first; i < first + count; i++) {
+          // Same as vTexCoords * uTexMatrix followed by scaling to the crop.
+          const RenderState::LayerState &src = state.layer_state_[i];
+          const float *matrix = src.texture_matrix_;
+          const float *crop = src.crop_bounds_;
+          GLfloat s = corner[0] * matrix[0] + corner[1] * matrix[1];
+          GLfloat t = corner[0] * matrix[2] + corner[1] * matrix[3];
+          *vertex++ = crop[0] + s * (crop[2] - crop[0]);
+          *vertex++ = crop[1] + t * (crop[3] - crop[1]);
+        }
+      }
+
+      batch->fill_ = vertex - vertices_.data();
+    }
+  }
+}
+
+void GLRenderer::BindTexture(unsigned unit, GLuint texture,
+                             uint32_t *gl_calls) {
+  if (bound_textures_.size() <= unit)
+    bound_textures_.resize(unit + 1, 0);
+
+  if (bound_textures_[unit] == texture)
+    return;
+
+  glActiveTexture(GL_TEXTURE0 + unit);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, texture);
+  bound_textures_[unit] = texture;
+  *gl_calls += 2;
 }
 
 bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
@@ -115,20 +246,25 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
     if (surface->IsOnScreen() &&
         ((frame_width != clear_width) || (frame_height != clear_height))) {
       glEnable(GL_SCISSOR_TEST);
-      glScissor(damage.left, damage.top, clear_width, clear_height);
-      glClear(GL_COLOR_BUFFER_BIT);
+      // Clear only the damaged rects, not everything in between them.
+      HwcRegion damage_region;
+      surface->GetSurfaceDamageRegion(damage_region);
+      for (const HwcRect<int> &rect : damage_region) {
+        glScissor(rect.left, rect.top, rect.right - rect.left,
+                  rect.bottom - rect.top);
+        glClear(GL_COLOR_BUFFER_BIT);
+      }
+      glDisable(GL_SCISSOR_TEST);
     } else {
       glClear(GL_COLOR_BUFFER_BIT);
-      glEnable(GL_SCISSOR_TEST);
     }
-  } else {
-    glEnable(GL_SCISSOR_TEST);
   }
 
 #ifdef COMPOSITOR_TRACING
   const HwcRect<int> &damage = surface->GetSurfaceDamage();
   uint32_t total_width = 0;
   uint32_t total_height = 0;
+  uint64_t shaded_pixels = 0;
   ICOMPOSITORTRACE(
       "Full clear: %d Partial clear: %d Skipped clear: %d damage.left: %d "
       "damage.top: %d damage.right - "
@@ -136,15 +272,7 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
       clear_surface, partial_clear, !(clear_surface || partial_clear),
       damage.left, damage.top, damage.right - damage.left,
       damage.bottom - damage.top);
-#endif
   for (const RenderState &state : render_states) {
-    unsigned size = state.layer_state_.size();
-    GLProgram *program = GetProgram(size);
-    if (!program)
-      continue;
-
-    program->UseProgram(state, frame_width, frame_height);
-#ifdef COMPOSITOR_TRACING
     ICOMPOSITORTRACE(
         "scissor_x_: %d state.scissor_y_: %d scissor_width_: %d "
         "scissor_height_: %d \n",
@@ -152,6 +280,7 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
         state.scissor_height_);
     total_width += std::max(total_width, state.scissor_width_);
     total_height += state.scissor_height_;
+    shaded_pixels += (uint64_t)state.scissor_width_ * state.scissor_height_;
     const HwcRect<int> &damage = surface->GetSurfaceDamage();
     if (AnalyseOverlap(
             damage, HwcRect<int>(state.scissor_x_, state.scissor_y_,
@@ -160,19 +289,88 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
         kOutside) {
       ICOMPOSITORTRACE("ALERT: Rendering Layer outside Damaged Region. \n");
     }
+  }
 #endif
-    glScissor(state.scissor_x_, state.scissor_y_, state.scissor_width_,
-              state.scissor_height_);
 
-    glDrawArrays(GL_TRIANGLES, 0, 3);
+  // Regions are disjoint, so they can be drawn in any order. Each region is
+  // drawn as two triangles covering exactly its rect.
+  BuildBatches(render_states, frame_width, frame_height);
+  uint32_t gl_calls = 0;
+  if (!batches_.empty()) {
+    glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer_);
+    glBufferData(GL_ARRAY_BUFFER, vertices_.size() * sizeof(GLfloat),
+                 vertices_.data(), GL_STREAM_DRAW);
+    gl_calls += 2;
+  }
+
+  GLProgram *current_program = NULL;
+  bool blending = false;
+  for (const DrawBatch &batch : batches_) {
+    unsigned size = batch.layer_count_;
+    GLProgram *program = GetProgram(size);
+    if (!program)
+      continue;
+
+    if (program != current_program) {
+      program->UseProgram(size);
+      current_program = program;
+      gl_calls++;
+    }
 
+    // The output of a pass is premultiplied with its alpha being the
+    // coverage of its layers, so the layers below are added under it.
+    if (batch.pass_ && !blending) {
+      glEnable(GL_BLEND);
+      glBlendFunc(GL_ONE_MINUS_DST_ALPHA, GL_ONE);
+      blending = true;
+      gl_calls += 2;
+    }
+
+    program->SetLayerUniforms(*batch.state_, batch.first_layer_, size);
+    gl_calls += size * 3;
     for (unsigned src_index = 0; src_index < size; src_index++) {
-      glActiveTexture(GL_TEXTURE0 + src_index);
-      glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+      const RenderState::LayerState &src =
+          batch.state_->layer_state_[batch.first_layer_ + src_index];
+      BindTexture(src_index, src.handle_, &gl_calls);
+    }
+
+    unsigned attribs = 1 + (size + 1) / 2;
+    for (; enabled_attribs_ < attribs; enabled_attribs_++, gl_calls++) {
+      glEnableVertexAttribArray(enabled_attribs_);
+    }
+
+    for (; enabled_attribs_ > attribs; enabled_attribs_--, gl_calls++) {
+      glDisableVertexAttribArray(enabled_attribs_ - 1);
+    }
+
+    GLsizei stride = sizeof(GLfloat) * (2 + 2 * size);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride,
+                          (void *)(sizeof(GLfloat) * batch.offset_));
+    gl_calls++;
+    // Texture coordinates of layers 2 * (attrib - 1) and the one after it,
+    // if any.
+    for (unsigned attrib = 1; attrib < attribs; attrib++, gl_calls++) {
+      GLint components = 2 * attrib <= size ? 4 : 2;
+      glVertexAttribPointer(
+          attrib, components, GL_FLOAT, GL_FALSE, stride,
+          (void *)(sizeof(GLfloat) * (batch.offset_ + 4 * attrib - 2)));
     }
+
+    glDrawArrays(GL_TRIANGLES, 0, batch.num_regions_ * 6);
+    gl_calls++;
   }
 
-  glDisable(GL_SCISSOR_TEST);
+  if (blending) {
+    glDisable(GL_BLEND);
+    gl_calls++;
+  }
+
+  for (unsigned unit = 0; unit < bound_textures_.size(); unit++) {
+    BindTexture(unit, 0, &gl_calls);
+  }
+
+  if (!batches_.empty())
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
 
   if (!disable_explicit_sync_)
     surface->SetNativeFence(context_.GetSyncFD(surface->IsOnScreen()));
@@ -189,6 +387,10 @@ bool GLRenderer::Draw(const std::vector<RenderState> &render_states,
         total_width, surface->GetLayer()->GetDisplayFrameWidth(), total_height,
         surface->GetLayer()->GetDisplayFrameHeight());
   }
+  ICOMPOSITORTRACE("Shaded pixels: %llu \n",
+                   static_cast<unsigned long long>(shaded_pixels));
+  ICOMPOSITORTRACE("Regions: %zu Batches: %zu GL calls: %u \n",
+                   render_states.size(), batches_.size(), gl_calls);
   ICOMPOSITORTRACE("Draw Ends. \n");
 #endif
   return true;
@@ -220,8 +422,17 @@ GLProgram *GLRenderer::GetProgram(unsigned texture_count) {
       return program;
   }
 
-  std::unique_ptr<GLProgram> program(new GLProgram());
-  if (program->Init(texture_count)) {
+  std::unique_ptr<GLProgram> program;
+  if (warmer_)
+    program = warmer_->TakeProgram(texture_count);
+
+  if (!program) {
+    program.reset(new GLProgram());
+    if (!program->Init(texture_count))
+      program.reset(nullptr);
+  }
+
+  if (program) {
     if (programs_.size() < texture_count)
       programs_.resize(texture_count);
 
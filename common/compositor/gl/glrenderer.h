@@ -27,9 +27,11 @@
 
 namespace hwcomposer {
 
+class GLProgramWarmer;
+
 class GLRenderer : public Renderer {
  public:
-  GLRenderer() = default;
+  GLRenderer();
   ~GLRenderer();
 
   bool Init() override;
@@ -41,12 +43,40 @@ class GLRenderer : public Renderer {
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
 
  private:
+  // Regions which use the same layers. These are drawn with a single call.
+  // Regions with more layers than a program can sample are split into
+  // batches of consecutive layers, drawn in passes from top to bottom.
+  struct DrawBatch {
+    const RenderState *state_;
+    unsigned first_layer_;
+    unsigned layer_count_;
+    unsigned pass_;
+    size_t num_regions_;
+    // Index of the first and next free float of the batch in vertices_.
+    size_t offset_;
+    size_t fill_;
+  };
+
   GLProgram *GetProgram(unsigned texture_count);
+  DrawBatch *FindBatch(const RenderState &state, unsigned first_layer,
+                       unsigned count);
+  void BuildBatches(const std::vector<RenderState> &render_states,
+                    GLuint frame_width, GLuint frame_height);
+  void BindTexture(unsigned unit, GLuint texture, uint32_t *gl_calls);
 
   EGLOffScreenContext context_;
 
   std::vector<std::unique_ptr<GLProgram>> programs_;
+  std::unique_ptr<GLProgramWarmer> warmer_;
+  std::vector<DrawBatch> batches_;
+  std::vector<GLfloat> vertices_;
+  // Texture bound to each texture unit during Draw.
+  std::vector<GLuint> bound_textures_;
   GLuint vertex_array_ = 0;
+  GLuint vertex_buffer_ = 0;
+  GLuint enabled_attribs_ = 0;
+  // Most layers a single program can composite.
+  unsigned max_layers_ = 1;
   bool disable_explicit_sync_ = false;
 };
 
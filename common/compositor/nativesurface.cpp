@@ -88,7 +88,8 @@ bool NativeSurface::Init(ResourceManager *resource_manager, uint32_t format,
     }
   }
 
-  modifier_ = modifier;
+  // Buffer was created without the modifier if it wasn't validated.
+  modifier_ = *modifier_succeeded ? modifier : 0;
   native_handle_ = native_handle;
 
   // Ensure a correct status of the destination layer
@@ -138,7 +139,22 @@ void NativeSurface::SetSurfaceAge(int value) {
 }
 
 bool NativeSurface::IsSurfaceDamageChanged() const {
-  return damage_changed_;
+  if (damage_changed_)
+    return true;
+
+  // Bounds might be same with different rects being damaged. Compare with
+  // what GetSurfaceDamageRegion returns, without building the region.
+  const HwcRect<int> &surface_damage = layer_.GetSurfaceDamage();
+  HwcRect<int> bounds;
+  ResetRectToRegion(damage_region_, bounds);
+  if (bounds == surface_damage)
+    return !(damage_region_ == previous_damage_region_);
+
+  if (surface_damage.empty())
+    return !previous_damage_region_.empty();
+
+  return previous_damage_region_.size() != 1 ||
+         !(previous_damage_region_.front() == surface_damage);
 }
 
 void NativeSurface::SetPlaneTarget(const DisplayPlaneState &plane) {
@@ -147,6 +163,8 @@ void NativeSurface::SetPlaneTarget(const DisplayPlaneState &plane) {
   CalculateRect(plane.GetDisplayFrame(), current_damage);
   previous_damage_ = current_damage;
   previous_nc_damage_ = current_damage;
+  HwcRegion(1, current_damage).swap(damage_region_);
+  HwcRegion(1, current_damage).swap(previous_nc_region_);
   clear_surface_ = kFullClear;
   damage_changed_ = true;
   on_screen_ = false;
@@ -185,11 +203,17 @@ void NativeSurface::UpdateSurfaceDamage(
   if (surface_damage.empty()) {
     surface_damage = current_damage;
     damage_changed_ = true;
+    HwcRegion().swap(damage_region_);
+    AddRectToRegion(current_damage, damage_region_);
 
     if (!surface_damage.empty()) {
       CalculateRect(previous_nc_damage_, surface_damage);
+      for (const HwcRect<int> &rect : previous_nc_region_) {
+        AddRectToRegion(rect, damage_region_);
+      }
 
       previous_nc_damage_ = current_damage;
+      HwcRegion(1, current_damage).swap(previous_nc_region_);
     }
 
     if (!force && (previous_damage_ == surface_damage))
@@ -199,6 +223,8 @@ void NativeSurface::UpdateSurfaceDamage(
   }
 
   CalculateRect(current_damage, previous_nc_damage_);
+  AddRectToRegion(current_damage, previous_nc_region_);
+  AddRectToRegion(current_damage, damage_region_);
 
   if (current_damage == surface_damage) {
     return;
@@ -213,9 +239,31 @@ void NativeSurface::UpdateSurfaceDamage(
   }
 }
 
+void NativeSurface::UpdateSurfaceDamage(
+    const HwcRegion &currentsurface_damage, bool force) {
+  for (const HwcRect<int> &rect : currentsurface_damage) {
+    UpdateSurfaceDamage(rect, force);
+  }
+}
+
+void NativeSurface::GetSurfaceDamageRegion(HwcRegion &region) const {
+  const HwcRect<int> &surface_damage = layer_.GetSurfaceDamage();
+  HwcRect<int> bounds;
+  ResetRectToRegion(damage_region_, bounds);
+  if (bounds == surface_damage) {
+    region = damage_region_;
+    return;
+  }
+
+  HwcRegion().swap(region);
+  if (!surface_damage.empty())
+    region.emplace_back(surface_damage);
+}
+
 void NativeSurface::ResetDamage() {
   reset_damage_ = true;
   previous_damage_ = layer_.GetSurfaceDamage();
+  GetSurfaceDamageRegion(previous_damage_region_);
   damage_changed_ = false;
 }
 
@@ -104,6 +104,10 @@ class NativeSurface {
   void UpdateSurfaceDamage(const HwcRect<int>& currentsurface_damage,
                            bool force);
 
+  // Set's Damage of this surface for each rect of currentsurface_damage.
+  void UpdateSurfaceDamage(const HwcRegion& currentsurface_damage,
+                           bool force);
+
   // Resets damage of this surface to empty.
   void ResetDamage();
 
@@ -112,6 +116,10 @@ class NativeSurface {
     return layer_.GetSurfaceDamage();
   }
 
+  // Return's damage area of this surface as a list of rects. Bounds
+  // of it equal GetSurfaceDamage().
+  void GetSurfaceDamageRegion(HwcRegion& region) const;
+
   // Return's damage area of this surface.
   const HwcRect<int>& GetPreviousSurfaceDamage() const {
     return previous_damage_;
@@ -130,6 +138,7 @@ class NativeSurface {
     return on_screen_;
   }
 
+  // Modifier the buffer was created with, 0 if it has none.
   uint64_t GetModifier() const {
     return modifier_;
   }
@@ -151,6 +160,11 @@ class NativeSurface {
   bool on_screen_ = false;
   HwcRect<int> previous_damage_;
   HwcRect<int> previous_nc_damage_;
+  // Same as surface damage and previous_nc_damage_ without merging
+  // disjoint rects.
+  HwcRegion damage_region_;
+  HwcRegion previous_nc_region_;
+  HwcRegion previous_damage_region_;
 };
 
 }  // namespace hwcomposer
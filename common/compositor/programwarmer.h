@@ -0,0 +1,133 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_COMPOSITOR_PROGRAMWARMER_H_
+#define COMMON_COMPOSITOR_PROGRAMWARMER_H_
+
+#include <memory>
+#include <vector>
+
+#include <spinlock.h>
+
+#include "hwcthread.h"
+#include "hwctrace.h"
+
+namespace hwcomposer {
+
+// Builds the programs of a renderer for a range of layer counts on a low
+// priority thread, so that they don't have to be built on first use.
+// TProgram needs a default constructor and bool Init(unsigned count).
+// Subclasses overriding the hooks have to call ExitThread in their own
+// destructor.
+template <class TProgram>
+class ProgramWarmer : public HWCThread {
+ public:
+  explicit ProgramWarmer(const char *name) : HWCThread(10, name) {
+  }
+
+  ~ProgramWarmer() override {
+    ExitThread();
+  }
+
+  // Returns the program for layer_count if it has been built already,
+  // NULL otherwise. The caller takes ownership of the program.
+  std::unique_ptr<TProgram> TakeProgram(unsigned layer_count) {
+    ScopedSpinLock lock(lock_);
+    if (layer_count == 0 || layer_count > programs_.size())
+      return std::unique_ptr<TProgram>();
+
+    return std::move(programs_[layer_count - 1]);
+  }
+
+  void ExitThread() {
+    lock_.lock();
+    cancel_ = true;
+    lock_.unlock();
+    HWCThread::Exit();
+  }
+
+ protected:
+  // Starts building programs for first_count to last_count layers.
+  bool Start(unsigned first_count, unsigned last_count) {
+    if (first_count == 0 || first_count > last_count)
+      return false;
+
+    first_count_ = first_count;
+    last_count_ = last_count;
+    programs_.resize(last_count_);
+    if (!InitWorker()) {
+      ETRACE("Failed to initalize program warmer. %s", PRINTERROR());
+      return false;
+    }
+
+    Resume();
+    return true;
+  }
+
+  // Called on the warmer thread before building the first program,
+  // nothing is built if it fails.
+  virtual bool BeginWarmUp() {
+    return true;
+  }
+
+  // Called on the warmer thread after building every program, before
+  // it is handed out.
+  virtual void ProgramBuilt() {
+  }
+
+  // Called on the warmer thread once done, or when ExitThread interrupted
+  // it.
+  virtual void EndWarmUp(bool /*cancelled*/) {
+  }
+
+  void HandleRoutine() override {
+    if (done_)
+      return;
+
+    done_ = true;
+    if (!BeginWarmUp())
+      return;
+
+    bool cancelled = false;
+    for (unsigned count = first_count_; count <= last_count_; count++) {
+      std::unique_ptr<TProgram> program(new TProgram());
+      if (!program->Init(count))
+        break;
+
+      ProgramBuilt();
+      ScopedSpinLock lock(lock_);
+      cancelled = cancel_;
+      if (cancelled)
+        break;
+
+      programs_[count - 1] = std::move(program);
+    }
+
+    EndWarmUp(cancelled);
+  }
+
+ private:
+  SpinLock lock_;
+  // Programs indexed by layer count - 1.
+  std::vector<std::unique_ptr<TProgram>> programs_;
+  unsigned first_count_ = 0;
+  unsigned last_count_ = 0;
+  bool done_ = false;
+  bool cancel_ = false;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_COMPOSITOR_PROGRAMWARMER_H_
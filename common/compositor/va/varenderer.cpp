@@ -29,6 +29,88 @@
 
 namespace hwcomposer {
 
+// Contexts kept around for render target formats not currently in use.
+static const size_t kMaxVAContexts = 3;
+
+VAPipelineParams::VAPipelineParams() {
+  memset(&param_, 0, sizeof(param_));
+  memset(&surface_region_, 0, sizeof(surface_region_));
+  memset(&output_region_, 0, sizeof(output_region_));
+#ifdef VA_WITH_VPP
+  memset(&blend_state_, 0, sizeof(blend_state_));
+  blend_state_.flags = VA_BLEND_PREMULTIPLIED_ALPHA;
+#endif
+}
+
+bool VAPipelineParams::Update(VADisplay display, VAContextID context,
+                              const VAProcPipelineParameterBuffer& param,
+                              const VARectangle& surface_region,
+                              const VARectangle& output_region,
+                              const std::vector<VABufferID>& filters) {
+  // Point to our own copies, so the parameters can be compared as a whole.
+  VAProcPipelineParameterBuffer next;
+  memcpy(&next, &param, sizeof(next));
+  next.surface_region = &surface_region_;
+  next.output_region = &output_region_;
+  next.filters = filters.empty() ? NULL : filters_.data();
+  next.num_filters = static_cast<unsigned int>(filters.size());
+#ifdef VA_WITH_VPP
+  next.blend_state = &blend_state_;
+#endif
+
+  // The input surface changes with every new video frame. Only that is
+  // patched into the existing buffer, rather than creating a new one.
+  VASurfaceID surface = next.surface;
+  next.surface = param_.surface;
+  if (buffer_ && filters == filters_ &&
+      !memcmp(&surface_region, &surface_region_, sizeof(surface_region_)) &&
+      !memcmp(&output_region, &output_region_, sizeof(output_region_)) &&
+      !memcmp(&next, &param_, sizeof(param_))) {
+    if (surface == param_.surface)
+      return true;
+
+    void* data = NULL;
+    if (vaMapBuffer(display, buffer_->buffer(), &data) == VA_STATUS_SUCCESS) {
+      static_cast<VAProcPipelineParameterBuffer*>(data)->surface = surface;
+      vaUnmapBuffer(display, buffer_->buffer());
+      param_.surface = surface;
+      return true;
+    }
+  }
+
+  next.surface = surface;
+  surface_region_ = surface_region;
+  output_region_ = output_region;
+  filters_ = filters;
+  next.filters = filters_.empty() ? NULL : filters_.data();
+  memcpy(&param_, &next, sizeof(param_));
+
+  buffer_.reset(new ScopedVABufferID(display));
+  if (!buffer_->CreateBuffer(context, VAProcPipelineParameterBufferType,
+                             sizeof(VAProcPipelineParameterBuffer), 1,
+                             &param_)) {
+    buffer_.reset(nullptr);
+    return false;
+  }
+
+  return true;
+}
+
+VAProcContext::~VAProcContext() {
+  // Buffers have to go before the context they were created on.
+  std::vector<std::unique_ptr<VAPipelineParams>>().swap(pipelines_);
+  std::vector<VABufferID>().swap(filters_);
+  std::vector<ScopedVABufferID>().swap(cb_elements_);
+  std::vector<ScopedVABufferID>().swap(sharp_);
+  std::vector<ScopedVABufferID>().swap(deinterlace_);
+
+  if (context_ != VA_INVALID_ID)
+    vaDestroyContext(display_, context_);
+
+  if (config_ != VA_INVALID_ID)
+    vaDestroyConfig(display_, config_);
+}
+
 VARenderer::~VARenderer() {
   DestroyContext();
 
@@ -90,14 +172,14 @@ bool VARenderer::SetVAProcFilterColorDefaultValue(
     }
   }
   sharp_caps_.value_ = sharp_caps_.caps_.range.default_value;
-  update_caps_ = true;
+  filter_generation_++;
   return true;
 }
 
 bool VARenderer::SetVAProcFilterDeinterlaceDefaultMode() {
   if (deinterlace_caps_.mode_ != VAProcDeinterlacingNone) {
     deinterlace_caps_.mode_ = VAProcDeinterlacingNone;
-    update_caps_ = true;
+    filter_generation_++;
   }
   return true;
 }
@@ -111,7 +193,7 @@ bool VARenderer::SetVAProcFilterColorValue(HWCColorControl mode,
     if (prop.use_default_) {
       if (!colorbalance_caps_[mode].use_default_) {
         colorbalance_caps_[mode].use_default_ = true;
-        update_caps_ = true;
+        filter_generation_++;
       }
     } else if (prop.value_ != colorbalance_caps_[mode].value_) {
       if (prop.value_ > colorbalance_caps_[mode].caps_.range.max_value ||
@@ -123,14 +205,14 @@ bool VARenderer::SetVAProcFilterColorValue(HWCColorControl mode,
       }
       colorbalance_caps_[mode].value_ = prop.value_;
       colorbalance_caps_[mode].use_default_ = false;
-      update_caps_ = true;
+      filter_generation_++;
     }
     return true;
   } else if (mode == HWCColorControl::kColorSharpness) {
     if (prop.use_default_) {
       if (!sharp_caps_.use_default_) {
         sharp_caps_.use_default_ = true;
-        update_caps_ = true;
+        filter_generation_++;
       }
     } else if (prop.value_ != sharp_caps_.value_) {
       if (prop.value_ > sharp_caps_.caps_.range.max_value ||
@@ -142,7 +224,7 @@ bool VARenderer::SetVAProcFilterColorValue(HWCColorControl mode,
       }
       sharp_caps_.value_ = prop.value_;
       sharp_caps_.use_default_ = false;
-      update_caps_ = true;
+      filter_generation_++;
     }
     return true;
   } else {
@@ -204,7 +286,7 @@ bool VARenderer::SetVAProcFilterDeinterlaceMode(const HWCDeinterlaceProp& prop,
     for (int i = 0; i < VAProcDeinterlacingCount; i++) {
       if (deinterlace_caps_.caps_[i].type == mode) {
         if (deinterlace_caps_.mode_ != mode) {
-          update_caps_ = true;
+          filter_generation_++;
         }
         deinterlace_caps_.mode_ = mode;
         return true;
@@ -240,14 +322,15 @@ bool VARenderer::Draw(const MediaState& state, NativeSurface* surface) {
     return false;
   }
   int rt_format = DrmFormatToRTFormat(buffer_out->GetFormat());
-  if (va_context_ == VA_INVALID_ID || render_target_format_ != rt_format) {
-    render_target_format_ = rt_format;
-    if (!CreateContext()) {
+  if (!context_ || render_target_format_ != rt_format) {
+    if (!SelectContext(rt_format)) {
       ETRACE("Create VA context failed\n");
       return false;
     }
   }
 
+  context_->last_used_ = ++frame_;
+
   // Get Output Surface.
   OverlayLayer* layer_out = surface->GetLayer();
   HwcRect<int> layer_out_disp_frame = layer_out->GetDisplayFrame();
@@ -274,26 +357,34 @@ bool VARenderer::Draw(const MediaState& state, NativeSurface* surface) {
   }
 
   layer_out->SetProtected(false);
+  bool yuv_output = IsSupportedMediaFormat(layer_out_buffer->GetFormat());
+  const HwcColorDescription& output_color = layer_out->GetColorDescription();
 
+  VAContextID va_context = context_->context_;
   VAStatus ret = VA_STATUS_SUCCESS;
-  ret = vaBeginPicture(va_display_, va_context_, surface_out);
+  ret = vaBeginPicture(va_display_, va_context, surface_out);
+
+  // Color values are the same for all layers.
+  for (auto itr = state.colors_.begin(); itr != state.colors_.end(); itr++) {
+    SetVAProcFilterColorValue(itr->first, itr->second);
+  }
 
   OverlayLayer* layer_in = NULL;
   uint32_t total_layers = state.layers_.size();
-  std::vector<ScopedVABufferID> pipeline_buffers(total_layers, va_display_);
+  std::vector<std::unique_ptr<VAPipelineParams>>& pipelines =
+      context_->pipelines_;
+  pipelines.resize(total_layers);
 
   for (uint32_t i = 0; i < total_layers; i++) {
     layer_in = state.layers_.at(i);
     if (layer_in->IsSolidColor())
       continue;
-    ScopedVABufferID& pipeline_buffer = pipeline_buffers.at(i);
     // Get Input Surface.
     OverlayBuffer* buffer_in = layer_in->GetBuffer();
     if (!buffer_in) {
       ETRACE("Get DRM buffer failed for buffer_in.\n");
       return false;
     }
-    uint32_t dataspace = buffer_in->GetDataSpace();
     const MediaResourceHandle& resource =
         buffer_in->GetMediaResource(va_display_, layer_in->GetSourceCropWidth(),
                                     layer_in->GetSourceCropHeight());
@@ -323,15 +414,22 @@ bool VARenderer::Draw(const MediaState& state, NativeSurface* surface) {
     output_region.width = layer_in->GetDisplayFrameWidth();
     output_region.height = layer_in->GetDisplayFrameHeight();
 
-    VAProcPipelineParameterBuffer pipe_param = {};
+    // Pointers are set up by VAPipelineParams.
+    VAProcPipelineParameterBuffer pipe_param;
+    memset(&pipe_param, 0, sizeof(pipe_param));
     pipe_param.surface = surface_in;
-    pipe_param.surface_region = &surface_region;
-    pipe_param.surface_color_standard = VAProcColorStandardBT601;
-    pipe_param.output_region = &output_region;
-    pipe_param.output_color_standard = VAProcColorStandardBT601;
+    // Let VA convert between colour standards in the same pass. RGB
+    // targets are treated as sRGB by the drivers whatever we pass here.
+    const HwcColorDescription& color = layer_in->GetColorDescription();
+    pipe_param.surface_color_standard = ColorStandardToVA(color.standard_);
+    pipe_param.output_color_standard =
+        yuv_output ? ColorStandardToVA(output_color.standard_)
+                   : VAProcColorStandardBT601;
 #ifdef VA_SUPPORT_COLOR_RANGE
-    if ((dataspace & HAL_DATASPACE_RANGE_FULL) != 0) {
-      pipe_param.input_color_properties.color_range = VA_SOURCE_RANGE_FULL;
+    pipe_param.input_color_properties.color_range = ColorRangeToVA(color);
+    if (yuv_output) {
+      pipe_param.output_color_properties.color_range =
+          ColorRangeToVA(output_color);
     }
 #endif
 
@@ -342,20 +440,11 @@ bool VARenderer::Draw(const MediaState& state, NativeSurface* surface) {
     }
 #endif
 
-#ifdef VA_WITH_VPP
-    VABlendState bs = {};
-    bs.flags = VA_BLEND_PREMULTIPLIED_ALPHA;
-    pipe_param.blend_state = &bs;
-#endif
-
     DUMPTRACE("surface_region: (%d, %d, %d, %d)\n", surface_region.x,
               surface_region.y, surface_region.width, surface_region.height);
     DUMPTRACE("Layer DisplayFrame:(%d,%d,%d,%d)\n", output_region.x,
               output_region.y, output_region.width, output_region.height);
 
-    for (auto itr = state.colors_.begin(); itr != state.colors_.end(); itr++) {
-      SetVAProcFilterColorValue(itr->first, itr->second);
-    }
     SetVAProcFilterDeinterlaceMode(state.deinterlace_, buffer_in);
 
     if (!UpdateCaps()) {
@@ -364,10 +453,6 @@ bool VARenderer::Draw(const MediaState& state, NativeSurface* surface) {
     }
 
     pipe_param.filter_flags = GetVAProcFilterScalingMode(state.scaling_mode_);
-    if (filters_.size()) {
-      pipe_param.filters = filters_.data();
-    }
-    pipe_param.num_filters = static_cast<unsigned int>(filters_.size());
 
 #if VA_MAJOR_VERSION >= 1
     // currently rotation is only supported by VA on Android.
@@ -377,17 +462,20 @@ bool VARenderer::Draw(const MediaState& state, NativeSurface* surface) {
     pipe_param.mirror_state = mirror;
 #endif
 
-    if (!pipeline_buffer.CreateBuffer(
-            va_context_, VAProcPipelineParameterBufferType,
-            sizeof(VAProcPipelineParameterBuffer), 1, &pipe_param)) {
+    std::unique_ptr<VAPipelineParams>& pipeline = pipelines.at(i);
+    if (!pipeline)
+      pipeline.reset(new VAPipelineParams());
+
+    if (!pipeline->Update(va_display_, va_context, pipe_param, surface_region,
+                          output_region, context_->filters_)) {
       return false;
     }
 
-    ret |=
-        vaRenderPicture(va_display_, va_context_, &pipeline_buffer.buffer(), 1);
+    ret |= vaRenderPicture(va_display_, va_context,
+                           &pipeline->buffer_->buffer(), 1);
   }
 
-  ret |= vaEndPicture(va_display_, va_context_);
+  ret |= vaEndPicture(va_display_, va_context);
 
   surface->ResetDamage();
   return ret == VA_STATUS_SUCCESS ? true : false;
@@ -406,22 +494,22 @@ bool VARenderer::DestroyMediaResources(
   return true;
 }
 
-bool VARenderer::LoadCaps() {
+bool VARenderer::LoadCaps(VAContextID context) {
   VAProcFilterCapColorBalance colorbalancecaps[VAProcColorBalanceCount];
   uint32_t colorbalance_num = VAProcColorBalanceCount;
   uint32_t sharp_num = 1;
   uint32_t deinterlace_num = VAProcDeinterlacingCount;
   memset(colorbalancecaps, 0,
          sizeof(VAProcFilterCapColorBalance) * VAProcColorBalanceCount);
-  if (!QueryVAProcFilterCaps(va_context_, VAProcFilterColorBalance,
+  if (!QueryVAProcFilterCaps(context, VAProcFilterColorBalance,
                              colorbalancecaps, &colorbalance_num)) {
     return false;
   }
-  if (!QueryVAProcFilterCaps(va_context_, VAProcFilterSharpening,
+  if (!QueryVAProcFilterCaps(context, VAProcFilterSharpening,
                              &sharp_caps_.caps_, &sharp_num)) {
     return false;
   }
-  if (!QueryVAProcFilterCaps(va_context_, VAProcFilterDeinterlacing,
+  if (!QueryVAProcFilterCaps(context, VAProcFilterDeinterlacing,
                              &deinterlace_caps_.caps_, &deinterlace_num)) {
     return false;
   }
@@ -432,15 +520,41 @@ bool VARenderer::LoadCaps() {
   return true;
 }
 
-bool VARenderer::CreateContext() {
-  DestroyContext();
+bool VARenderer::SelectContext(int rt_format) {
+  render_target_format_ = rt_format;
+  auto it = contexts_.find(rt_format);
+  if (it != contexts_.end()) {
+    context_ = it->second.get();
+    return true;
+  }
+
+  context_ = nullptr;
+  if (contexts_.size() >= kMaxVAContexts) {
+    auto lru = contexts_.begin();
+    for (auto itr = contexts_.begin(); itr != contexts_.end(); itr++) {
+      if (itr->second->last_used_ < lru->second->last_used_)
+        lru = itr;
+    }
 
+    contexts_.erase(lru);
+  }
+
+  std::unique_ptr<VAProcContext> context(new VAProcContext(va_display_));
+  if (!CreateContext(context.get(), rt_format))
+    return false;
+
+  context_ = context.get();
+  contexts_[rt_format] = std::move(context);
+  return true;
+}
+
+bool VARenderer::CreateContext(VAProcContext* context, int rt_format) {
   VAConfigAttrib config_attrib;
   config_attrib.type = VAConfigAttribRTFormat;
-  config_attrib.value = render_target_format_;
+  config_attrib.value = rt_format;
   VAStatus ret =
       vaCreateConfig(va_display_, VAProfileNone, VAEntrypointVideoProc,
-                     &config_attrib, 1, &va_config_);
+                     &config_attrib, 1, &context->config_);
   if (ret != VA_STATUS_SUCCESS) {
     ETRACE("Create VA Config failed\n");
     return false;
@@ -450,47 +564,44 @@ bool VARenderer::CreateContext() {
   // values
   int width = 1;
   int height = 1;
-  ret = vaCreateContext(va_display_, va_config_, width, height, 0x00, nullptr,
-                        0, &va_context_);
+  ret = vaCreateContext(va_display_, context->config_, width, height, 0x00,
+                        nullptr, 0, &context->context_);
+  if (ret != VA_STATUS_SUCCESS)
+    return false;
 
-  update_caps_ = true;
-  if (ret == VA_STATUS_SUCCESS) {
-    if (!LoadCaps() || !UpdateCaps())
+  // Filter caps don't depend on the render target format, query them once
+  // so values set by the user survive a format change.
+  if (!caps_loaded_) {
+    if (!LoadCaps(context->context_))
       return false;
+
+    caps_loaded_ = true;
   }
-  return ret == VA_STATUS_SUCCESS ? true : false;
+
+  return true;
 }
 
 void VARenderer::DestroyContext() {
-  if (va_context_ != VA_INVALID_ID) {
-    vaDestroyContext(va_display_, va_context_);
-    va_context_ = VA_INVALID_ID;
-  }
-  if (va_config_ != VA_INVALID_ID) {
-    vaDestroyConfig(va_display_, va_config_);
-    va_config_ = VA_INVALID_ID;
-  }
-
-  std::vector<VABufferID>().swap(filters_);
-  std::vector<ScopedVABufferID>().swap(cb_elements_);
-  std::vector<ScopedVABufferID>().swap(sharp_);
+  context_ = nullptr;
+  contexts_.clear();
 }
 
 bool VARenderer::UpdateCaps() {
-  if (!update_caps_) {
+  if (context_->filter_generation_ == filter_generation_) {
     return true;
   }
 
-  update_caps_ = false;
+  context_->filter_generation_ = filter_generation_;
 
   std::vector<ScopedVABufferID> cb_elements(1, va_display_);
   std::vector<ScopedVABufferID> sharp(1, va_display_);
   std::vector<ScopedVABufferID> deinterlace(1, va_display_);
 
-  std::vector<VABufferID>().swap(filters_);
-  std::vector<ScopedVABufferID>().swap(cb_elements_);
-  std::vector<ScopedVABufferID>().swap(sharp_);
-  std::vector<ScopedVABufferID>().swap(deinterlace_);
+  std::vector<VABufferID>& filters = context_->filters_;
+  std::vector<VABufferID>().swap(filters);
+  std::vector<ScopedVABufferID>().swap(context_->cb_elements_);
+  std::vector<ScopedVABufferID>().swap(context_->sharp_);
+  std::vector<ScopedVABufferID>().swap(context_->deinterlace_);
 
   VAProcFilterParameterBufferColorBalance cbparam[VAProcColorBalanceCount];
   VAProcFilterParameterBuffer sharpparam;
@@ -514,14 +625,14 @@ bool VARenderer::UpdateCaps() {
 
   if (index) {
     if (!cb_elements[0].CreateBuffer(
-            va_context_, VAProcFilterParameterBufferType,
+            context_->context_, VAProcFilterParameterBufferType,
             sizeof(VAProcFilterParameterBufferColorBalance), index, cbparam)) {
       ETRACE("Create color fail\n");
       return false;
     }
-    filters_.push_back(cb_elements[0].buffer());
+    filters.push_back(cb_elements[0].buffer());
   }
-  cb_elements_.swap(cb_elements);
+  context_->cb_elements_.swap(cb_elements);
 
   if (sharp_caps_.use_default_) {
     sharp_caps_.value_ = sharp_caps_.caps_.range.default_value;
@@ -530,27 +641,27 @@ bool VARenderer::UpdateCaps() {
       sharp_caps_.caps_.range.step) {
     sharpparam.value = sharp_caps_.value_;
     sharpparam.type = VAProcFilterSharpening;
-    if (!sharp[0].CreateBuffer(va_context_, VAProcFilterParameterBufferType,
-                               sizeof(VAProcFilterParameterBuffer), 1,
-                               &sharpparam)) {
+    if (!sharp[0].CreateBuffer(
+            context_->context_, VAProcFilterParameterBufferType,
+            sizeof(VAProcFilterParameterBuffer), 1, &sharpparam)) {
       return false;
     }
-    filters_.push_back(sharp[0].buffer());
+    filters.push_back(sharp[0].buffer());
   }
-  sharp_.swap(sharp);
+  context_->sharp_.swap(sharp);
 
   if (deinterlace_caps_.mode_ != VAProcDeinterlacingNone) {
     deinterlaceparam.algorithm = deinterlace_caps_.mode_;
     deinterlaceparam.type = VAProcFilterDeinterlacing;
     if (!deinterlace[0].CreateBuffer(
-            va_context_, VAProcFilterParameterBufferType,
+            context_->context_, VAProcFilterParameterBufferType,
             sizeof(VAProcFilterParameterBufferDeinterlacing), 1,
             &deinterlaceparam)) {
       return false;
     }
-    filters_.push_back(deinterlace[0].buffer());
+    filters.push_back(deinterlace[0].buffer());
   }
-  deinterlace_.swap(deinterlace);
+  context_->deinterlace_.swap(deinterlace);
 
   return true;
 }
@@ -18,6 +18,8 @@
 #define COMMON_COMPOSITOR_VA_VARENDERER_H_
 
 #include <map>
+#include <memory>
+#include <vector>
 
 #include "hwcdefs.h"
 #include "overlaybuffer.h"
@@ -82,6 +84,49 @@ typedef struct _HwcDeinterlaceCap {
   VAProcDeinterlacingType mode_;
 } HwcDeinterlaceCap;
 
+// Pipeline parameters of a layer, kept across frames together with the
+// data they point to. The VA buffer is only recreated when they change.
+struct VAPipelineParams {
+  VAPipelineParams();
+
+  // Returns false in case the buffer couldn't be created.
+  bool Update(VADisplay display, VAContextID context,
+              const VAProcPipelineParameterBuffer& param,
+              const VARectangle& surface_region,
+              const VARectangle& output_region,
+              const std::vector<VABufferID>& filters);
+
+  std::unique_ptr<ScopedVABufferID> buffer_;
+  VAProcPipelineParameterBuffer param_;
+  VARectangle surface_region_;
+  VARectangle output_region_;
+#ifdef VA_WITH_VPP
+  VABlendState blend_state_;
+#endif
+  std::vector<VABufferID> filters_;
+};
+
+// Video processing context of a render target format together with the
+// buffers created on it.
+struct VAProcContext {
+  VAProcContext(VADisplay display) : display_(display) {
+  }
+  ~VAProcContext();
+
+  VADisplay display_;
+  VAConfigID config_ = VA_INVALID_ID;
+  VAContextID context_ = VA_INVALID_ID;
+  // Filter buffers, up to date if filter_generation_ matches the renderer.
+  std::vector<VABufferID> filters_;
+  std::vector<ScopedVABufferID> cb_elements_;
+  std::vector<ScopedVABufferID> sharp_;
+  std::vector<ScopedVABufferID> deinterlace_;
+  uint32_t filter_generation_ = 0;
+  // Indexed by the position of the layer in MediaState.
+  std::vector<std::unique_ptr<VAPipelineParams>> pipelines_;
+  uint64_t last_used_ = 0;
+};
+
 class VARenderer : public Renderer {
  public:
   VARenderer() = default;
@@ -110,27 +155,29 @@ class VARenderer : public Renderer {
                                      VAProcColorBalanceType vamode);
   bool GetVAProcDeinterlaceFlagFromVideo(const HWCDeinterlaceFlag flag,
                                          OverlayBuffer* buffer);
-  bool CreateContext();
+  // Makes the context for rt_format current, creating it if needed.
+  bool SelectContext(int rt_format);
+  bool CreateContext(VAProcContext* context, int rt_format);
   void DestroyContext();
-  bool LoadCaps();
+  bool LoadCaps(VAContextID context);
   bool UpdateCaps();
 #if VA_MAJOR_VERSION >= 1
   void HWCTransformToVA(uint32_t transform, uint32_t& rotation,
                         uint32_t& mirror);
 #endif
 
-  bool update_caps_ = false;
+  // Bumped whenever a filter value changes.
+  uint32_t filter_generation_ = 1;
+  bool caps_loaded_ = false;
   void* va_display_ = nullptr;
-  std::vector<VABufferID> filters_;
-  std::vector<ScopedVABufferID> cb_elements_;
-  std::vector<ScopedVABufferID> sharp_;
-  std::vector<ScopedVABufferID> deinterlace_;
   std::map<HWCColorControl, HwcColorBalanceCap> colorbalance_caps_;
   HwcFilterCap sharp_caps_;
   HwcDeinterlaceCap deinterlace_caps_;
   int render_target_format_ = VA_RT_FORMAT_YUV420;
-  VAContextID va_context_ = VA_INVALID_ID;
-  VAConfigID va_config_ = VA_INVALID_ID;
+  // Contexts keyed by render target format.
+  std::map<int, std::unique_ptr<VAProcContext>> contexts_;
+  VAProcContext* context_ = nullptr;
+  uint64_t frame_ = 0;
 };
 
 }  // namespace hwcomposer
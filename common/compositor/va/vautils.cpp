@@ -88,4 +88,24 @@ int DrmFormatToRTFormat(int format) {
   return 0;
 }
 
+VAProcColorStandardType ColorStandardToVA(HWCColorStandard standard) {
+  switch (standard) {
+    case HWCColorStandard::kColorStandardBT709:
+      return VAProcColorStandardBT709;
+    case HWCColorStandard::kColorStandardBT2020:
+      return VAProcColorStandardBT2020;
+    default:
+      return VAProcColorStandardBT601;
+  }
+}
+
+#ifdef VA_SUPPORT_COLOR_RANGE
+uint8_t ColorRangeToVA(const HwcColorDescription& color) {
+  if (color.range_ == HWCColorRange::kColorRangeFull)
+    return VA_SOURCE_RANGE_FULL;
+
+  return VA_SOURCE_RANGE_REDUCED;
+}
+#endif
+
 }  // namespace hwcomposer
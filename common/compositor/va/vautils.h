@@ -17,11 +17,25 @@
 #ifndef COMMON_COMPOSITOR_VA_VAUTILS_H_
 #define COMMON_COMPOSITOR_VA_VAUTILS_H_
 
+#include <stdint.h>
+
+#include <va/va.h>
+
+#include <hwcdefs.h>
+
 namespace hwcomposer {
 
 int DrmFormatToVAFormat(int format);
 int DrmFormatToRTFormat(int format);
 
+// Matrix VPP uses to convert between YUV and RGB. Standards VA doesn't
+// know about are treated as BT.601.
+VAProcColorStandardType ColorStandardToVA(HWCColorStandard standard);
+
+#ifdef VA_SUPPORT_COLOR_RANGE
+uint8_t ColorRangeToVA(const HwcColorDescription& color);
+#endif
+
 }  // namespace hwcomposer
 
 #endif  // COMMON_COMPOSITOR_VA_VAUTILS_H_
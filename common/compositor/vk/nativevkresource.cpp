@@ -88,19 +88,18 @@ NativeVKResource::~NativeVKResource() {
 }
 
 void NativeVKResource::Reset() {
-  for (auto& image_view : src_image_views_) {
-    vkDestroyImageView(dev_, image_view, NULL);
-  }
+  // The previous frame might still be rendering from these.
+  garbage_lock_.lock();
+  garbage_.image_views_.insert(garbage_.image_views_.end(),
+                               src_image_views_.begin(),
+                               src_image_views_.end());
+  garbage_.images_.insert(garbage_.images_.end(), src_images_.begin(),
+                          src_images_.end());
+  garbage_.memory_.insert(garbage_.memory_.end(), src_image_memory_.begin(),
+                          src_image_memory_.end());
+  garbage_lock_.unlock();
   src_image_views_.clear();
-
-  for (auto& image : src_images_) {
-    vkDestroyImage(dev_, image, NULL);
-  }
   src_images_.clear();
-
-  for (auto& memory : src_image_memory_) {
-    vkFreeMemory(dev_, memory, NULL);
-  }
   src_image_memory_.clear();
 
   src_barrier_before_clear_.clear();
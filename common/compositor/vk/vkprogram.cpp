@@ -210,7 +210,7 @@ bool VKProgram::Init(unsigned layer_index) {
   return true;
 }
 
-void VKProgram::UseProgram(const RenderState &state,
+bool VKProgram::UseProgram(const RenderState &state,
                            unsigned int viewport_width,
                            unsigned int viewport_height) {
   unsigned layer_count = state.layer_state_.size();
@@ -220,7 +220,7 @@ void VKProgram::UseProgram(const RenderState &state,
       ring_buffer_.Allocate(vert_ub_size * sizeof(float), ub_offset_align_);
   if (!vert_ub_alloc) {
     ETRACE("Failed to allocate space for vert uniform buffer");
-    return;
+    return false;
   }
   float *vert_ub = vert_ub_alloc.get<float>();
 
@@ -250,7 +250,7 @@ void VKProgram::UseProgram(const RenderState &state,
       ring_buffer_.Allocate(frag_ub_size * sizeof(float), ub_offset_align_);
   if (!frag_ub_alloc) {
     ETRACE("failed to allocate space for frag uniform buffer");
-    return;
+    return false;
   }
   float *frag_ub = frag_ub_alloc.get<float>();
 
@@ -282,6 +282,7 @@ void VKProgram::UseProgram(const RenderState &state,
 
   ub_allocs_.emplace_back(std::move(vert_ub_alloc));
   ub_allocs_.emplace_back(std::move(frag_ub_alloc));
+  return true;
 }
 
 }  // namespace hwcomposer
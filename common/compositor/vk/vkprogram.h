@@ -38,7 +38,8 @@ class VKProgram {
   ~VKProgram();
 
   bool Init(unsigned layer_index);
-  void UseProgram(const RenderState& cmd, unsigned int viewport_width,
+  // Returns false if the uniform ring buffer is full.
+  bool UseProgram(const RenderState& cmd, unsigned int viewport_width,
                   unsigned int viewport_height);
 
   VkDescriptorSetLayout getDescLayout() {
@@ -0,0 +1,40 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "vkprogramwarmer.h"
+
+namespace hwcomposer {
+
+VKProgramWarmer::VKProgramWarmer()
+    : ProgramWarmer<VKProgram>("VKProgramWarmer") {
+}
+
+VKProgramWarmer::~VKProgramWarmer() {
+  ExitThread();
+}
+
+bool VKProgramWarmer::Initialize(unsigned first_count, unsigned last_count,
+                                 const VkPhysicalDeviceProperties &props,
+                                 const char *cache_path) {
+  props_ = props;
+  cache_path_ = cache_path;
+  return Start(first_count, last_count);
+}
+
+void VKProgramWarmer::EndWarmUp(bool cancelled) {
+  if (!cancelled)
+    StorePipelineCache(props_, cache_path_);
+}
+
+}  // namespace hwcomposer
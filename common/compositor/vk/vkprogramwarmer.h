@@ -0,0 +1,46 @@
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef VK_PROGRAM_WARMER_H_
+#define VK_PROGRAM_WARMER_H_
+
+#include "programwarmer.h"
+#include "vkprogram.h"
+#include "vkshim.h"
+
+namespace hwcomposer {
+
+// Builds Vulkan programs, indexed by layer count, and stores the pipeline
+// cache once all of them are built.
+class VKProgramWarmer : public ProgramWarmer<VKProgram> {
+ public:
+  VKProgramWarmer();
+  ~VKProgramWarmer() override;
+
+  // Starts building programs for first_count to last_count layers.
+  bool Initialize(unsigned first_count, unsigned last_count,
+                  const VkPhysicalDeviceProperties &props,
+                  const char *cache_path);
+
+ protected:
+  void EndWarmUp(bool cancelled) override;
+
+ private:
+  VkPhysicalDeviceProperties props_;
+  const char *cache_path_ = NULL;
+};
+
+}  // namespace hwcomposer
+
+#endif  // VK_PROGRAM_WARMER_H_
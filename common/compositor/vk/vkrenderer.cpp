@@ -15,13 +15,81 @@
 #include "vkrenderer.h"
 #include "vkprogram.h"
 
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
 #include "hwctrace.h"
+#include "hwcutils.h"
 #include "nativesurface.h"
 #include "renderstate.h"
 
 namespace hwcomposer {
 
+// Number of frames which can be in flight before Draw has to wait for the
+// oldest one.
+static const size_t kMaxFramesInFlight = 3;
+static const size_t kStagingRingSize = 0x10000;
+static const size_t kStagingAlignment = 16;
+// Programs for up to kInitialLayerCount layers are built by Init, the ones
+// up to kMaxWarmedLayerCount in the background.
+static const unsigned kInitialLayerCount = 4;
+static const unsigned kMaxWarmedLayerCount = 16;
+
+#ifdef SHADER_CACHE_PATH
+static const char *const kPipelineCachePath =
+    SHADER_CACHE_PATH "/hwc_vk_pipeline_cache.bin";
+#else
+static const char *const kPipelineCachePath = NULL;
+#endif
+
+static bool HasExtension(const std::vector<VkExtensionProperties> &props,
+                         const char *name) {
+  for (const VkExtensionProperties &prop : props) {
+    if (strcmp(prop.extensionName, name) == 0)
+      return true;
+  }
+
+  return false;
+}
+
 VKRenderer::~VKRenderer() {
+  // Pipelines left in the warmer are destroyed with it.
+  warmer_.reset(nullptr);
+  if (frames_.empty())
+    return;
+
+  RetireFrames();
+  // Released after the last submission, nothing is using it anymore.
+  garbage_lock_.lock();
+  garbage_.Destroy();
+  garbage_lock_.unlock();
+
+  StorePipelineCache(device_props_, kPipelineCachePath);
+  for (Frame &frame : frames_) {
+    vkDestroyFence(dev_, frame.fence_, NULL);
+    if (frame.release_semaphore_ != VK_NULL_HANDLE)
+      vkDestroySemaphore(dev_, frame.release_semaphore_, NULL);
+  }
+
+  for (VkSemaphore semaphore : wait_semaphores_)
+    vkDestroySemaphore(dev_, semaphore, NULL);
+
+  for (VkSemaphore semaphore : free_semaphores_)
+    vkDestroySemaphore(dev_, semaphore, NULL);
+
+  if (staging_buffer_ != VK_NULL_HANDLE) {
+    vkDestroyBuffer(dev_, staging_buffer_, NULL);
+    vkFreeMemory(dev_, staging_buffer_mem_, NULL);
+  }
+
+  if (vert_buffer_mem_ != VK_NULL_HANDLE) {
+    vkDestroyBuffer(dev_, vert_buffer_, NULL);
+    vkFreeMemory(dev_, vert_buffer_mem_, NULL);
+  }
+
+  vkDestroyCommandPool(dev_, cmd_pool_, NULL);
 }
 
 VKAPI_ATTR VkBool32 VKAPI_CALL VulkanDebugReportCallback(
@@ -60,70 +128,45 @@ uint32_t VKRenderer::GetMemoryTypeIndex(uint32_t mem_type_bits,
 }
 
 VkBuffer VKRenderer::UploadBuffer(size_t data_size, const uint8_t *data,
-                                  VkBufferUsageFlags usage) {
+                                  VkBufferUsageFlags usage,
+                                  VkDeviceMemory *memory) {
   VkResult res;
+  RingBuffer::Allocation staging =
+      staging_ring_.Allocate(data_size, kStagingAlignment);
+  if (!staging) {
+    // Uploads still in flight hold the ring, wait for them.
+    RetireFrames();
+    staging = staging_ring_.Allocate(data_size, kStagingAlignment);
+    if (!staging) {
+      ETRACE("Failed to allocate staging space (%zu)\n", data_size);
+      return NULL;
+    }
+  }
+
+  memcpy(staging.ptr(), data, data_size);
+
   VkBufferCreateInfo buffer_create = {};
   buffer_create.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
   buffer_create.size = data_size;
-  buffer_create.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+  buffer_create.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
 
-  VkBuffer src_buffer;
-  res = vkCreateBuffer(dev_, &buffer_create, NULL, &src_buffer);
+  VkBuffer dst_buffer;
+  res = vkCreateBuffer(dev_, &buffer_create, NULL, &dst_buffer);
   if (res != VK_SUCCESS) {
     ETRACE("vkCreateBuffer failed (%d)\n", res);
     return NULL;
   }
 
   VkMemoryRequirements mem_requirements;
-  vkGetBufferMemoryRequirements(dev_, src_buffer, &mem_requirements);
+  vkGetBufferMemoryRequirements(dev_, dst_buffer, &mem_requirements);
   VkMemoryAllocateInfo mem_allocate = {};
   mem_allocate.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
   mem_allocate.allocationSize = mem_requirements.size;
-  mem_allocate.memoryTypeIndex = GetMemoryTypeIndex(
-      mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
-  if (mem_allocate.memoryTypeIndex >= 32) {
-    ETRACE("Failed to find suitable staging device memory\n");
-    return NULL;
-  }
-
-  VkDeviceMemory host_mem;
-  res = vkAllocateMemory(dev_, &mem_allocate, NULL, &host_mem);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateMemory failed (%d)\n", res);
-    return NULL;
-  }
-
-  res = vkBindBufferMemory(dev_, src_buffer, host_mem, 0);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkBindBufferMemory failed (%d)\n", res);
-    return NULL;
-  }
-
-  uint8_t *src_ptr;
-  res = vkMapMemory(dev_, host_mem, 0, mem_allocate.allocationSize, 0,
-                    (void **)&src_ptr);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkMapMemory failed (%d)\n", res);
-    return NULL;
-  }
-
-  memcpy(src_ptr, data, data_size);
-
-  vkUnmapMemory(dev_, host_mem);
-
-  buffer_create.usage = usage | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-  VkBuffer dst_buffer;
-  res = vkCreateBuffer(dev_, &buffer_create, NULL, &dst_buffer);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkCreateBuffer failed (%d)\n", res);
-    return NULL;
-  }
-  vkGetBufferMemoryRequirements(dev_, dst_buffer, &mem_requirements);
-  mem_allocate.allocationSize = mem_requirements.size;
   mem_allocate.memoryTypeIndex = GetMemoryTypeIndex(
       mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
   if (mem_allocate.memoryTypeIndex >= 32) {
     ETRACE("Failed to find suitable buffer device memory");
+    vkDestroyBuffer(dev_, dst_buffer, NULL);
     return NULL;
   }
 
@@ -131,26 +174,20 @@ VkBuffer VKRenderer::UploadBuffer(size_t data_size, const uint8_t *data,
   res = vkAllocateMemory(dev_, &mem_allocate, NULL, &device_mem);
   if (res != VK_SUCCESS) {
     ETRACE("vkAllocateMemory failed (%d)\n", res);
+    vkDestroyBuffer(dev_, dst_buffer, NULL);
     return NULL;
   }
+
   res = vkBindBufferMemory(dev_, dst_buffer, device_mem, 0);
   if (res != VK_SUCCESS) {
     ETRACE("vkBindBufferMemory failed (%d)\n", res);
+    vkDestroyBuffer(dev_, dst_buffer, NULL);
+    vkFreeMemory(dev_, device_mem, NULL);
     return NULL;
   }
 
-  VkCommandBuffer cmd_buffer;
-  VkCommandBufferAllocateInfo cmd_buffer_allocate = {};
-  cmd_buffer_allocate.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cmd_buffer_allocate.commandPool = cmd_pool_;
-  cmd_buffer_allocate.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  cmd_buffer_allocate.commandBufferCount = 1;
-
-  res = vkAllocateCommandBuffers(dev_, &cmd_buffer_allocate, &cmd_buffer);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateCommandBuffers failed (%d)\n", res);
-    return NULL;
-  }
+  Frame *frame = AcquireFrame();
+  VkCommandBuffer cmd_buffer = frame->cmd_buffer_;
 
   VkCommandBufferBeginInfo begin_info = {};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
@@ -159,17 +196,36 @@ VkBuffer VKRenderer::UploadBuffer(size_t data_size, const uint8_t *data,
   res = vkBeginCommandBuffer(cmd_buffer, &begin_info);
   if (res != VK_SUCCESS) {
     ETRACE("vkBeginCommandBuffer failed (%d)\n", res);
+    vkDestroyBuffer(dev_, dst_buffer, NULL);
+    vkFreeMemory(dev_, device_mem, NULL);
     return NULL;
   }
 
   VkBufferCopy buffer_copy = {};
+  buffer_copy.srcOffset = staging.offset();
   buffer_copy.size = data_size;
 
-  vkCmdCopyBuffer(cmd_buffer, src_buffer, dst_buffer, 1, &buffer_copy);
+  vkCmdCopyBuffer(cmd_buffer, staging_buffer_, dst_buffer, 1, &buffer_copy);
+
+  // Make the copy visible to any later submission reading the buffer.
+  VkBufferMemoryBarrier barrier = {};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = dst_buffer;
+  barrier.size = VK_WHOLE_SIZE;
+
+  vkCmdPipelineBarrier(cmd_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0, 0, NULL, 1,
+                       &barrier, 0, NULL);
 
   res = vkEndCommandBuffer(cmd_buffer);
   if (res != VK_SUCCESS) {
     ETRACE("vkEndCommandBuffer failed (%d)\n", res);
+    vkDestroyBuffer(dev_, dst_buffer, NULL);
+    vkFreeMemory(dev_, device_mem, NULL);
     return NULL;
   }
 
@@ -178,22 +234,219 @@ VkBuffer VKRenderer::UploadBuffer(size_t data_size, const uint8_t *data,
   submit.commandBufferCount = 1;
   submit.pCommandBuffers = &cmd_buffer;
 
-  res = vkQueueSubmit(queue_, 1, &submit, VK_NULL_HANDLE);
+  res = vkQueueSubmit(queue_, 1, &submit, frame->fence_);
   if (res != VK_SUCCESS) {
     ETRACE("%d: vkQueueSubmit failed (%d)\n", __LINE__, res);
+    vkDestroyBuffer(dev_, dst_buffer, NULL);
+    vkFreeMemory(dev_, device_mem, NULL);
     return NULL;
   }
 
-  res = vkQueueWaitIdle(queue_);
+  // Staging space is reused once the copy has completed.
+  frame->allocations_.emplace_back(std::move(staging));
+  frame->submitted_ = true;
+  *memory = device_mem;
+
+  return dst_buffer;
+}
+
+bool VKRenderer::QueryExternalSemaphores(VkPhysicalDevice phys_dev) {
+  uint32_t count = 0;
+  VkResult res =
+      vkEnumerateDeviceExtensionProperties(phys_dev, NULL, &count, NULL);
+  if (res != VK_SUCCESS || count == 0)
+    return false;
+
+  std::vector<VkExtensionProperties> props(count);
+  res = vkEnumerateDeviceExtensionProperties(phys_dev, NULL, &count,
+                                             props.data());
+  if (res != VK_SUCCESS)
+    return false;
+
+  if (!HasExtension(props, VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME) ||
+      !HasExtension(props, VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME))
+    return false;
+
+  PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR get_props =
+      (PFN_vkGetPhysicalDeviceExternalSemaphorePropertiesKHR)
+          vkGetInstanceProcAddr(
+              inst_, "vkGetPhysicalDeviceExternalSemaphorePropertiesKHR");
+  if (!get_props)
+    return false;
+
+  VkPhysicalDeviceExternalSemaphoreInfoKHR semaphore_info = {};
+  semaphore_info.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTERNAL_SEMAPHORE_INFO_KHR;
+  semaphore_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR;
+
+  VkExternalSemaphorePropertiesKHR semaphore_props = {};
+  semaphore_props.sType = VK_STRUCTURE_TYPE_EXTERNAL_SEMAPHORE_PROPERTIES_KHR;
+  get_props(phys_dev, &semaphore_info, &semaphore_props);
+
+  VkExternalSemaphoreFeatureFlagsKHR required =
+      VK_EXTERNAL_SEMAPHORE_FEATURE_EXPORTABLE_BIT_KHR |
+      VK_EXTERNAL_SEMAPHORE_FEATURE_IMPORTABLE_BIT_KHR;
+  return (semaphore_props.externalSemaphoreFeatures & required) == required;
+}
+
+bool VKRenderer::InitFrames() {
+  frames_.resize(kMaxFramesInFlight);
+
+  VkCommandBuffer cmd_buffers[kMaxFramesInFlight];
+  VkCommandBufferAllocateInfo cmd_buffer_alloc = {};
+  cmd_buffer_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  cmd_buffer_alloc.commandPool = cmd_pool_;
+  cmd_buffer_alloc.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  cmd_buffer_alloc.commandBufferCount = kMaxFramesInFlight;
+
+  VkResult res = vkAllocateCommandBuffers(dev_, &cmd_buffer_alloc, cmd_buffers);
   if (res != VK_SUCCESS) {
-    ETRACE("vkQueueWaitIdle failed (%d)\n", res);
-    return NULL;
+    ETRACE("vkAllocateCommandBuffers failed (%d)\n", res);
+    return false;
   }
 
-  vkFreeCommandBuffers(dev_, cmd_pool_, 1, &cmd_buffer);
-  vkFreeMemory(dev_, host_mem, NULL);
+  VkFenceCreateInfo fence_create = {};
+  fence_create.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
 
-  return dst_buffer;
+  VkExportSemaphoreCreateInfoKHR export_create = {};
+  export_create.sType = VK_STRUCTURE_TYPE_EXPORT_SEMAPHORE_CREATE_INFO_KHR;
+  export_create.handleTypes = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR;
+
+  VkSemaphoreCreateInfo semaphore_create = {};
+  semaphore_create.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+  semaphore_create.pNext = &export_create;
+
+  for (size_t i = 0; i < frames_.size(); i++) {
+    Frame &frame = frames_[i];
+    frame.cmd_buffer_ = cmd_buffers[i];
+    res = vkCreateFence(dev_, &fence_create, NULL, &frame.fence_);
+    if (res != VK_SUCCESS) {
+      ETRACE("vkCreateFence failed (%d)\n", res);
+      return false;
+    }
+
+    if (!external_semaphores_)
+      continue;
+
+    res = vkCreateSemaphore(dev_, &semaphore_create, NULL,
+                            &frame.release_semaphore_);
+    if (res != VK_SUCCESS) {
+      ETRACE("vkCreateSemaphore failed (%d)\n", res);
+      return false;
+    }
+  }
+
+  return true;
+}
+
+bool VKRenderer::InitStagingRing() {
+  VkBufferCreateInfo buffer_create = {};
+  buffer_create.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_create.size = kStagingRingSize;
+  buffer_create.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+
+  VkResult res = vkCreateBuffer(dev_, &buffer_create, NULL, &staging_buffer_);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkCreateBuffer failed (%d)\n", res);
+    return false;
+  }
+
+  VkMemoryRequirements mem_requirements;
+  vkGetBufferMemoryRequirements(dev_, staging_buffer_, &mem_requirements);
+
+  VkMemoryAllocateInfo mem_allocate = {};
+  mem_allocate.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  mem_allocate.allocationSize = mem_requirements.size;
+  mem_allocate.memoryTypeIndex = GetMemoryTypeIndex(
+      mem_requirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_COHERENT_BIT |
+                                           VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+  if (mem_allocate.memoryTypeIndex >= 32) {
+    ETRACE("Failed to find suitable staging device memory\n");
+    return false;
+  }
+
+  res = vkAllocateMemory(dev_, &mem_allocate, NULL, &staging_buffer_mem_);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkAllocateMemory failed (%d)\n", res);
+    return false;
+  }
+
+  res = vkBindBufferMemory(dev_, staging_buffer_, staging_buffer_mem_, 0);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkBindBufferMemory failed (%d)\n", res);
+    return false;
+  }
+
+  // Stays mapped for the lifetime of the renderer.
+  uint8_t *staging_ptr;
+  res = vkMapMemory(dev_, staging_buffer_mem_, 0, mem_allocate.allocationSize,
+                    0, (void **)&staging_ptr);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkMapMemory failed (%d)\n", res);
+    return false;
+  }
+
+  staging_ring_ = RingBuffer(staging_ptr, buffer_create.size);
+  return true;
+}
+
+VKRenderer::Frame *VKRenderer::AcquireFrame() {
+  Frame *frame = &frames_[next_frame_];
+  next_frame_ = (next_frame_ + 1) % frames_.size();
+  RetireFrame(frame);
+  return frame;
+}
+
+void VKRenderer::RetireFrame(Frame *frame) {
+  if (frame->submitted_) {
+    VkResult res =
+        vkWaitForFences(dev_, 1, &frame->fence_, VK_TRUE, UINT64_MAX);
+    if (res != VK_SUCCESS)
+      ETRACE("vkWaitForFences failed (%d)\n", res);
+
+    vkResetFences(dev_, 1, &frame->fence_);
+    frame->submitted_ = false;
+  }
+
+  if (!frame->desc_sets_.empty()) {
+    vkFreeDescriptorSets(dev_, desc_pool_, frame->desc_sets_.size(),
+                         frame->desc_sets_.data());
+    frame->desc_sets_.clear();
+  }
+
+  // Waiting consumed the imported payloads, semaphores can be reused.
+  free_semaphores_.insert(free_semaphores_.end(),
+                          frame->wait_semaphores_.begin(),
+                          frame->wait_semaphores_.end());
+  frame->wait_semaphores_.clear();
+  frame->allocations_.clear();
+  frame->garbage_.Destroy();
+}
+
+void VKRenderer::RetireFrames() {
+  // Start with the oldest frame.
+  for (size_t i = 0; i < frames_.size(); i++)
+    RetireFrame(&frames_[(next_frame_ + i) % frames_.size()]);
+}
+
+VkSemaphore VKRenderer::GetSemaphore() {
+  if (!free_semaphores_.empty()) {
+    VkSemaphore semaphore = free_semaphores_.back();
+    free_semaphores_.pop_back();
+    return semaphore;
+  }
+
+  VkSemaphoreCreateInfo semaphore_create = {};
+  semaphore_create.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  VkSemaphore semaphore;
+  VkResult res = vkCreateSemaphore(dev_, &semaphore_create, NULL, &semaphore);
+  if (res != VK_SUCCESS) {
+    ETRACE("vkCreateSemaphore failed (%d)\n", res);
+    return VK_NULL_HANDLE;
+  }
+
+  return semaphore;
 }
 
 bool VKRenderer::Init() {
@@ -201,10 +454,27 @@ bool VKRenderer::Init() {
 
   const char *enabled_layers[] = {};
 
-  const char *instance_extensions[] = {
+  std::vector<const char *> instance_extensions = {
       VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_DEBUG_REPORT_EXTENSION_NAME,
   };
 
+  // Needed to query whether fences can be shared as sync fds.
+  uint32_t count = 0;
+  vkEnumerateInstanceExtensionProperties(NULL, &count, NULL);
+  std::vector<VkExtensionProperties> instance_props(count);
+  vkEnumerateInstanceExtensionProperties(NULL, &count, instance_props.data());
+  bool semaphore_caps =
+      HasExtension(instance_props,
+                   VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) &&
+      HasExtension(instance_props,
+                   VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME);
+  if (semaphore_caps) {
+    instance_extensions.emplace_back(
+        VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
+    instance_extensions.emplace_back(
+        VK_KHR_EXTERNAL_SEMAPHORE_CAPABILITIES_EXTENSION_NAME);
+  }
+
   VkApplicationInfo app_info = {};
   app_info.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
   app_info.apiVersion = VK_MAKE_VERSION(1, 0, 0);
@@ -214,8 +484,8 @@ bool VKRenderer::Init() {
   instance_create.pApplicationInfo = &app_info;
   instance_create.enabledLayerCount = ARRAY_SIZE(enabled_layers);
   instance_create.ppEnabledLayerNames = &enabled_layers[0];
-  instance_create.enabledExtensionCount = ARRAY_SIZE(instance_extensions);
-  instance_create.ppEnabledExtensionNames = &instance_extensions[0];
+  instance_create.enabledExtensionCount = instance_extensions.size();
+  instance_create.ppEnabledExtensionNames = instance_extensions.data();
 
   res = vkCreateInstance(&instance_create, NULL, &inst_);
   if (res != VK_SUCCESS) {
@@ -240,7 +510,6 @@ bool VKRenderer::Init() {
     ITRACE("Failed to create vulkan debug callback\n");
   }
 
-  uint32_t count;
   res = vkEnumeratePhysicalDevices(inst_, &count, NULL);
   if (res != VK_SUCCESS) {
     ETRACE("vkEnumeratePhysicalDevices failed (%d)\n", res);
@@ -279,7 +548,14 @@ bool VKRenderer::Init() {
   queue_create.queueCount = 1;
   queue_create.pQueuePriorities = &queue_priority;
 
-  const char *device_extensions[] = {};
+  std::vector<const char *> device_extensions;
+  external_semaphores_ = semaphore_caps && QueryExternalSemaphores(phys_dev);
+  if (external_semaphores_) {
+    device_extensions.emplace_back(VK_KHR_EXTERNAL_SEMAPHORE_EXTENSION_NAME);
+    device_extensions.emplace_back(VK_KHR_EXTERNAL_SEMAPHORE_FD_EXTENSION_NAME);
+  } else {
+    ITRACE("No sync fd semaphores, vulkan composition stays synchronous.\n");
+  }
 
   VkDeviceCreateInfo device_create = {};
   device_create.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
@@ -287,8 +563,8 @@ bool VKRenderer::Init() {
   device_create.pQueueCreateInfos = &queue_create;
   device_create.enabledLayerCount = ARRAY_SIZE(enabled_layers);
   device_create.ppEnabledLayerNames = &enabled_layers[0];
-  device_create.enabledExtensionCount = ARRAY_SIZE(device_extensions);
-  device_create.ppEnabledExtensionNames = &device_extensions[0];
+  device_create.enabledExtensionCount = device_extensions.size();
+  device_create.ppEnabledExtensionNames = device_extensions.data();
 
   res = vkCreateDevice(phys_dev, &device_create, NULL, &dev_);
   if (res != VK_SUCCESS) {
@@ -303,8 +579,18 @@ bool VKRenderer::Init() {
 
   vkGetDeviceQueue(dev_, 0, 0, &queue_);
 
+  if (external_semaphores_) {
+    import_semaphore_fd_ = (PFN_vkImportSemaphoreFdKHR)vkGetDeviceProcAddr(
+        dev_, "vkImportSemaphoreFdKHR");
+    get_semaphore_fd_ = (PFN_vkGetSemaphoreFdKHR)vkGetDeviceProcAddr(
+        dev_, "vkGetSemaphoreFdKHR");
+    external_semaphores_ = import_semaphore_fd_ && get_semaphore_fd_;
+  }
+
+  // Command buffers are recorded again each time their frame comes around.
   VkCommandPoolCreateInfo pool_create = {};
   pool_create.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_create.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
 
   res = vkCreateCommandPool(dev_, &pool_create, NULL, &cmd_pool_);
   if (res != VK_SUCCESS) {
@@ -312,6 +598,9 @@ bool VKRenderer::Init() {
     return false;
   }
 
+  if (!InitFrames() || !InitStagingRing())
+    return false;
+
   // clang-format off
   const float verts[] = {0.0f, 0.0f, 0.0f, 0.0f,
                          0.0f, 2.0f, 0.0f, 2.0f,
@@ -319,7 +608,8 @@ bool VKRenderer::Init() {
   // clang-format on
 
   vert_buffer_ = UploadBuffer(sizeof(verts), (const uint8_t *)verts,
-                              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT);
+                              VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+                              &vert_buffer_mem_);
   if (vert_buffer_ == NULL) {
     ETRACE("UploadBuffer failed\n");
     return false;
@@ -451,16 +741,23 @@ bool VKRenderer::Init() {
     return false;
   }
 
-  VkPipelineCacheCreateInfo pipeline_cache_create = {};
-  pipeline_cache_create.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-
-  res = vkCreatePipelineCache(dev_, &pipeline_cache_create, NULL,
-                              &pipeline_cache_);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkCreatePipelineCache failed (%d)\n", res);
+  if (!CreatePipelineCache(device_props_, kPipelineCachePath))
     return false;
+
+  for (unsigned i = 1; i <= kInitialLayerCount; i++)
+    GetProgram(i);
+
+  unsigned last_count = std::min(
+      kMaxWarmedLayerCount, device_props_.limits.maxPerStageDescriptorSamplers);
+  if (last_count > kInitialLayerCount) {
+    warmer_.reset(new VKProgramWarmer());
+    if (!warmer_->Initialize(kInitialLayerCount + 1, last_count,
+                             device_props_, kPipelineCachePath))
+      warmer_.reset(nullptr);
   }
 
+  // The warmer stores the cache once done, otherwise the first frame does.
+  pipeline_cache_dirty_ = !warmer_;
   return true;
 }
 
@@ -473,43 +770,47 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
   surface->GetLayer()->SetProtected(false);
   surface->MakeCurrent();
 
-  src_image_infos_.clear();
-  ub_allocs_.clear();
+  // Resources of the frame which used this slot before are released here,
+  // everything allocated below is kept alive till this frame completes.
+  Frame *frame = AcquireFrame();
   std::vector<VkDescriptorSetLayout> desc_layouts;
-  std::vector<VkDescriptorSet> desc_sets(render_states.size());
   std::vector<VkDescriptorBufferInfo> ub_infos;
-  for (const RenderState &state : render_states) {
-    unsigned size = state.layer_state_.size();
-    if (size == 0)
-      break;
-
-    VKProgram *program = GetProgram(size);
-    if (!program)
-      continue;
-
-    desc_layouts.emplace_back(program->getDescLayout());
-
-    program->UseProgram(state, frame_width, frame_height);
-
-    ub_infos.emplace_back(program->getVertUBInfo());
-    ub_infos.emplace_back(program->getFragUBInfo());
+  if (!PrepareUniforms(render_states, frame_width, frame_height,
+                       &desc_layouts, &ub_infos)) {
+    // Uniforms of frames in flight fill up the ring buffer.
+    RetireFrames();
+    if (!PrepareUniforms(render_states, frame_width, frame_height,
+                         &desc_layouts, &ub_infos)) {
+      ETRACE("Failed to allocate uniforms\n");
+      return false;
+    }
   }
 
+  frame->allocations_.swap(ub_allocs_);
+
   VkDescriptorSetAllocateInfo alloc_desc_set = {};
   alloc_desc_set.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
   alloc_desc_set.descriptorPool = desc_pool_;
   alloc_desc_set.descriptorSetCount = (uint32_t)desc_layouts.size();
   alloc_desc_set.pSetLayouts = desc_layouts.data();
 
+  std::vector<VkDescriptorSet> desc_sets(desc_layouts.size());
   res = vkAllocateDescriptorSets(dev_, &alloc_desc_set, desc_sets.data());
   if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateDescriptorSets failed (%d)\n", res);
-    return false;
+    // Pool might be exhausted by frames in flight.
+    RetireFrames();
+    res = vkAllocateDescriptorSets(dev_, &alloc_desc_set, desc_sets.data());
+    if (res != VK_SUCCESS) {
+      ETRACE("vkAllocateDescriptorSets failed (%d)\n", res);
+      return false;
+    }
   }
 
+  frame->desc_sets_ = desc_sets;
+
   std::vector<VkWriteDescriptorSet> write_desc_sets;
   size_t src_image_infos_offset = 0;
-  for (size_t cmd_index = 0; cmd_index < render_states.size(); cmd_index++) {
+  for (size_t cmd_index = 0; cmd_index < desc_sets.size(); cmd_index++) {
     const RenderState &state = render_states[cmd_index];
     size_t layer_count = state.layer_state_.size();
     VkDescriptorSet desc_set = desc_sets[cmd_index];
@@ -547,25 +848,14 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
   vkUpdateDescriptorSets(dev_, write_desc_sets.size(), write_desc_sets.data(),
                          0, NULL);
 
-  VkCommandBufferAllocateInfo cmd_buffer_alloc = {};
-  cmd_buffer_alloc.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  cmd_buffer_alloc.commandPool = cmd_pool_;
-  cmd_buffer_alloc.commandBufferCount = 1;
-
-  VkCommandBuffer cmd_buffer;
-  res = vkAllocateCommandBuffers(dev_, &cmd_buffer_alloc, &cmd_buffer);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateCommandBuffer failed (%d)\n", res);
-    return false;
-  }
-
+  VkCommandBuffer cmd_buffer = frame->cmd_buffer_;
   VkCommandBufferBeginInfo begin_info = {};
   begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
   begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
   res = vkBeginCommandBuffer(cmd_buffer, &begin_info);
   if (res != VK_SUCCESS) {
-    ETRACE("vkAllocateCommandBuffer failed (%d)\n", res);
+    ETRACE("vkBeginCommandBuffer failed (%d)\n", res);
     return false;
   }
 
@@ -616,7 +906,7 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
   vkCmdBindVertexBuffers(cmd_buffer, 0, 1, &vert_buffer_, &zero_offset);
 
   size_t last_layer_count = 0;
-  for (size_t cmd_index = 0; cmd_index < render_states.size(); cmd_index++) {
+  for (size_t cmd_index = 0; cmd_index < desc_sets.size(); cmd_index++) {
     const RenderState &state = render_states[cmd_index];
     size_t layer_count = state.layer_state_.size();
     VkDescriptorSet desc_set = desc_sets[cmd_index];
@@ -653,39 +943,133 @@ bool VKRenderer::Draw(const std::vector<RenderState> &render_states,
     return false;
   }
 
+  bool export_fence = external_semaphores_ && !disable_explicit_sync_;
+  std::vector<VkPipelineStageFlags> wait_stages(
+      wait_semaphores_.size(), VK_PIPELINE_STAGE_ALL_COMMANDS_BIT);
+
   VkSubmitInfo submit = {};
   submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit.waitSemaphoreCount = wait_semaphores_.size();
+  submit.pWaitSemaphores = wait_semaphores_.data();
+  submit.pWaitDstStageMask = wait_stages.data();
   submit.commandBufferCount = 1;
   submit.pCommandBuffers = &cmd_buffer;
+  if (export_fence) {
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores = &frame->release_semaphore_;
+  }
 
-  res = vkQueueSubmit(queue_, 1, &submit, VK_NULL_HANDLE);
+  res = vkQueueSubmit(queue_, 1, &submit, frame->fence_);
   if (res != VK_SUCCESS) {
     ETRACE("%d: vkQueueSubmit failed (%d)\n", __LINE__, res);
     return false;
   }
 
-  res = vkQueueWaitIdle(queue_);
-  if (res != VK_SUCCESS) {
-    ETRACE("vkQueueWaitIdle failed (%d)\n", res);
-    return false;
+  frame->submitted_ = true;
+  frame->wait_semaphores_.swap(wait_semaphores_);
+
+  // Objects released since the last frame might be used by frames still in
+  // flight, destroy them once this one completes.
+  garbage_lock_.lock();
+  frame->garbage_.Swap(garbage_);
+  garbage_lock_.unlock();
+
+  int32_t release_fence = -1;
+  if (export_fence) {
+    VkSemaphoreGetFdInfoKHR get_fd_info = {};
+    get_fd_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_GET_FD_INFO_KHR;
+    get_fd_info.semaphore = frame->release_semaphore_;
+    get_fd_info.handleType = VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR;
+    // The caller owns the exported fd. The export also resets the
+    // semaphore, so the frame can signal it again. An fd of -1 means the
+    // semaphore was already signaled.
+    res = get_semaphore_fd_(dev_, &get_fd_info, &release_fence);
+    if (res != VK_SUCCESS) {
+      // The semaphore stays signaled, it can't be used again.
+      ETRACE("vkGetSemaphoreFdKHR failed (%d)\n", res);
+      external_semaphores_ = false;
+      release_fence = -1;
+    }
   }
 
-  vkFreeCommandBuffers(dev_, cmd_pool_, 1, &cmd_buffer);
+  if (release_fence >= 0) {
+    surface->SetNativeFence(release_fence);
+  } else {
+    // Consumers have no way to wait for the frame, finish it here.
+    RetireFrame(frame);
+  }
 
-  res = vkFreeDescriptorSets(dev_, desc_pool_, desc_sets.size(),
-                             desc_sets.data());
-  if (res != VK_SUCCESS) {
-    ETRACE("vkFreeDescriptorSets failed (%d)\n", res);
-    return false;
+  if (pipeline_cache_dirty_) {
+    pipeline_cache_dirty_ = false;
+    StorePipelineCache(device_props_, kPipelineCachePath);
+  }
+
+  return true;
+}
+
+bool VKRenderer::PrepareUniforms(
+    const std::vector<RenderState> &render_states, uint32_t frame_width,
+    uint32_t frame_height, std::vector<VkDescriptorSetLayout> *desc_layouts,
+    std::vector<VkDescriptorBufferInfo> *ub_infos) {
+  src_image_infos_.clear();
+  ub_allocs_.clear();
+  desc_layouts->clear();
+  ub_infos->clear();
+  for (const RenderState &state : render_states) {
+    unsigned size = state.layer_state_.size();
+    if (size == 0)
+      break;
+
+    VKProgram *program = GetProgram(size);
+    if (!program)
+      continue;
+
+    desc_layouts->emplace_back(program->getDescLayout());
+
+    if (!program->UseProgram(state, frame_width, frame_height))
+      return false;
+
+    ub_infos->emplace_back(program->getVertUBInfo());
+    ub_infos->emplace_back(program->getFragUBInfo());
   }
 
   return true;
 }
 
 void VKRenderer::InsertFence(int32_t kms_fence) {
+  if (kms_fence <= 0)
+    return;
+
+  if (external_semaphores_) {
+    VkSemaphore semaphore = GetSemaphore();
+    if (semaphore != VK_NULL_HANDLE) {
+      VkImportSemaphoreFdInfoKHR import_info = {};
+      import_info.sType = VK_STRUCTURE_TYPE_IMPORT_SEMAPHORE_FD_INFO_KHR;
+      import_info.semaphore = semaphore;
+      import_info.flags = VK_SEMAPHORE_IMPORT_TEMPORARY_BIT_KHR;
+      import_info.handleType =
+          VK_EXTERNAL_SEMAPHORE_HANDLE_TYPE_SYNC_FD_BIT_KHR;
+      import_info.fd = kms_fence;
+      VkResult res = import_semaphore_fd_(dev_, &import_info);
+      if (res == VK_SUCCESS) {
+        // Semaphore owns kms_fence now, the next submission waits for it.
+        wait_semaphores_.emplace_back(semaphore);
+        return;
+      }
+
+      // A failed import leaves kms_fence with us and the semaphore as it
+      // was.
+      ETRACE("vkImportSemaphoreFdKHR failed (%d)\n", res);
+      free_semaphores_.emplace_back(semaphore);
+    }
+  }
+
+  HWCPoll(kms_fence, -1);
+  close(kms_fence);
 }
 
 void VKRenderer::SetDisableExplicitSync(bool disable_explicit_sync) {
+  disable_explicit_sync_ = disable_explicit_sync;
 }
 
 VKProgram *VKRenderer::GetProgram(unsigned texture_count) {
@@ -695,16 +1079,23 @@ VKProgram *VKRenderer::GetProgram(unsigned texture_count) {
       return program;
   }
 
-  std::unique_ptr<VKProgram> program(new VKProgram());
-  if (program->Init(texture_count)) {
-    if (programs_.size() < texture_count)
-      programs_.resize(texture_count);
+  std::unique_ptr<VKProgram> program;
+  if (warmer_)
+    program = warmer_->TakeProgram(texture_count);
+
+  if (!program) {
+    program.reset(new VKProgram());
+    if (!program->Init(texture_count))
+      return 0;
 
-    programs_[texture_count - 1] = std::move(program);
-    return programs_[texture_count - 1].get();
+    pipeline_cache_dirty_ = true;
   }
 
-  return 0;
+  if (programs_.size() < texture_count)
+    programs_.resize(texture_count);
+
+  programs_[texture_count - 1] = std::move(program);
+  return programs_[texture_count - 1].get();
 }
 
 }  // namespace hwcomposer
@@ -16,9 +16,11 @@
 #define VK_RENDERER_H_
 
 #include <memory>
+#include <vector>
 
 #include "renderer.h"
 #include "vkprogram.h"
+#include "vkprogramwarmer.h"
 #include "vkshim.h"
 
 namespace hwcomposer {
@@ -35,10 +37,38 @@ class VKRenderer : public Renderer {
   void SetDisableExplicitSync(bool disable_explicit_sync) override;
 
  private:
+  // Resources used by a submitted frame. Frames are recycled from a ring,
+  // once the fence of a frame has signaled.
+  struct Frame {
+    VkCommandBuffer cmd_buffer_ = VK_NULL_HANDLE;
+    VkFence fence_ = VK_NULL_HANDLE;
+    // Signaled when the frame is done, exported as its release fence.
+    VkSemaphore release_semaphore_ = VK_NULL_HANDLE;
+    std::vector<VkSemaphore> wait_semaphores_;
+    std::vector<VkDescriptorSet> desc_sets_;
+    std::vector<RingBuffer::Allocation> allocations_;
+    VKGarbage garbage_;
+    bool submitted_ = false;
+  };
+
   VKProgram *GetProgram(unsigned texture_count);
   uint32_t GetMemoryTypeIndex(uint32_t mem_type_bits, uint32_t required_props);
   VkBuffer UploadBuffer(size_t data_size, const uint8_t *data,
-                        VkBufferUsageFlags usage);
+                        VkBufferUsageFlags usage, VkDeviceMemory *memory);
+  // Returns true if fences can be imported and exported as sync fds.
+  bool QueryExternalSemaphores(VkPhysicalDevice phys_dev);
+  bool InitFrames();
+  bool InitStagingRing();
+  // Returns the next frame of the ring, waits for it to complete if needed.
+  Frame *AcquireFrame();
+  void RetireFrame(Frame *frame);
+  void RetireFrames();
+  // Returns false if the uniform ring buffer is full.
+  bool PrepareUniforms(const std::vector<RenderState> &render_states,
+                       uint32_t frame_width, uint32_t frame_height,
+                       std::vector<VkDescriptorSetLayout> *desc_layouts,
+                       std::vector<VkDescriptorBufferInfo> *ub_infos);
+  VkSemaphore GetSemaphore();
 
   VkPhysicalDeviceProperties device_props_;
   VkPhysicalDeviceMemoryProperties device_mem_props_;
@@ -47,8 +77,27 @@ class VKRenderer : public Renderer {
   VkCommandPool cmd_pool_;
   VkQueue queue_;
   VkBuffer vert_buffer_;
+  VkDeviceMemory vert_buffer_mem_ = VK_NULL_HANDLE;
+
+  // Host visible buffer uploads are copied from.
+  VkBuffer staging_buffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory staging_buffer_mem_ = VK_NULL_HANDLE;
+  RingBuffer staging_ring_;
+
+  std::vector<Frame> frames_;
+  size_t next_frame_ = 0;
+  // Imported acquire fences to be waited for by the next submission.
+  std::vector<VkSemaphore> wait_semaphores_;
+  std::vector<VkSemaphore> free_semaphores_;
+  bool external_semaphores_ = false;
+  bool disable_explicit_sync_ = false;
+  PFN_vkImportSemaphoreFdKHR import_semaphore_fd_ = NULL;
+  PFN_vkGetSemaphoreFdKHR get_semaphore_fd_ = NULL;
 
   std::vector<std::unique_ptr<VKProgram>> programs_;
+  std::unique_ptr<VKProgramWarmer> warmer_;
+  // Set when a pipeline was built outside of the warmer.
+  bool pipeline_cache_dirty_ = false;
 };
 
 }  // namespace hwcomposer
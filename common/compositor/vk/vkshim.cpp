@@ -14,7 +14,13 @@
 
 #include "vkshim.h"
 
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+
 #include "hwctrace.h"
+#include "hwcutils.h"
 
 namespace hwcomposer {
 
@@ -33,6 +39,148 @@ size_t ub_offset_align_;
 std::vector<VkImageMemoryBarrier> src_barrier_before_clear_;
 VkImageMemoryBarrier dst_barrier_before_clear_;
 VkFramebuffer framebuffer_;
+VKGarbage garbage_;
+SpinLock garbage_lock_;
+
+void VKGarbage::Swap(VKGarbage &other) {
+  framebuffers_.swap(other.framebuffers_);
+  image_views_.swap(other.image_views_);
+  images_.swap(other.images_);
+  memory_.swap(other.memory_);
+}
+
+void VKGarbage::Destroy() {
+  for (VkFramebuffer framebuffer : framebuffers_)
+    vkDestroyFramebuffer(dev_, framebuffer, NULL);
+
+  for (VkImageView image_view : image_views_)
+    vkDestroyImageView(dev_, image_view, NULL);
+
+  for (VkImage image : images_)
+    vkDestroyImage(dev_, image, NULL);
+
+  for (VkDeviceMemory memory : memory_)
+    vkFreeMemory(dev_, memory, NULL);
+
+  framebuffers_.clear();
+  image_views_.clear();
+  images_.clear();
+  memory_.clear();
+}
+
+// Pipeline cache files start with this header, followed by the data
+// returned by vkGetPipelineCacheData.
+struct PipelineCacheHeader {
+  uint32_t magic;
+  uint32_t driver_version;
+  uint32_t length;
+};
+
+static const uint32_t kPipelineCacheMagic = 0x43505648;  // "HVPC"
+static const uint32_t kPipelineCacheSizeLimit = 10485760;
+// Size of the header vkGetPipelineCacheData puts in front of its data.
+static const size_t kVKCacheHeaderSize = 16 + VK_UUID_SIZE;
+
+static SpinLock pipeline_cache_lock_;
+static size_t pipeline_cache_size_ = 0;
+
+static bool IsCompatibleCacheData(const VkPhysicalDeviceProperties &props,
+                                  const std::vector<uint8_t> &data) {
+  if (data.size() < kVKCacheHeaderSize)
+    return false;
+
+  uint32_t fields[4];
+  memcpy(fields, data.data(), sizeof(fields));
+  return fields[0] >= kVKCacheHeaderSize &&
+         fields[1] == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+         fields[2] == props.vendorID && fields[3] == props.deviceID &&
+         memcmp(data.data() + sizeof(fields), props.pipelineCacheUUID,
+                VK_UUID_SIZE) == 0;
+}
+
+static void LoadPipelineCacheData(const VkPhysicalDeviceProperties &props,
+                                  const char *path,
+                                  std::vector<uint8_t> *data) {
+  FILE *fp = fopen(path, "rb");
+  if (!fp)
+    return;
+
+  PipelineCacheHeader header;
+  bool loaded = false;
+  if (fread(&header, sizeof(header), 1, fp) == 1 &&
+      header.magic == kPipelineCacheMagic &&
+      header.driver_version == props.driverVersion && header.length > 0 &&
+      header.length <= kPipelineCacheSizeLimit) {
+    data->resize(header.length);
+    loaded = fread(data->data(), 1, header.length, fp) == header.length &&
+             IsCompatibleCacheData(props, *data);
+  }
+
+  fclose(fp);
+  if (!loaded) {
+    ITRACE("Discarding stale pipeline cache %s\n", path);
+    data->clear();
+    remove(path);
+  }
+}
+
+bool CreatePipelineCache(const VkPhysicalDeviceProperties &props,
+                         const char *path) {
+  std::vector<uint8_t> data;
+  if (path)
+    LoadPipelineCacheData(props, path, &data);
+
+  VkPipelineCacheCreateInfo pipeline_cache_create = {};
+  pipeline_cache_create.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  pipeline_cache_create.initialDataSize = data.size();
+  pipeline_cache_create.pInitialData = data.empty() ? NULL : data.data();
+
+  VkResult res = vkCreatePipelineCache(dev_, &pipeline_cache_create, NULL,
+                                       &pipeline_cache_);
+  if (res != VK_SUCCESS && !data.empty()) {
+    // Driver refused the data, start over with an empty cache.
+    pipeline_cache_create.initialDataSize = 0;
+    pipeline_cache_create.pInitialData = NULL;
+    res = vkCreatePipelineCache(dev_, &pipeline_cache_create, NULL,
+                                &pipeline_cache_);
+  }
+
+  if (res != VK_SUCCESS) {
+    ETRACE("vkCreatePipelineCache failed (%d)\n", res);
+    return false;
+  }
+
+  size_t size = 0;
+  vkGetPipelineCacheData(dev_, pipeline_cache_, &size, NULL);
+  ScopedSpinLock lock(pipeline_cache_lock_);
+  pipeline_cache_size_ = size;
+  return true;
+}
+
+void StorePipelineCache(const VkPhysicalDeviceProperties &props,
+                        const char *path) {
+  if (!path || pipeline_cache_ == VK_NULL_HANDLE)
+    return;
+
+  ScopedSpinLock lock(pipeline_cache_lock_);
+  size_t size = 0;
+  VkResult res = vkGetPipelineCacheData(dev_, pipeline_cache_, &size, NULL);
+  if (res != VK_SUCCESS || size == pipeline_cache_size_ ||
+      size > kPipelineCacheSizeLimit)
+    return;
+
+  std::vector<uint8_t> data(size);
+  res = vkGetPipelineCacheData(dev_, pipeline_cache_, &size, data.data());
+  if (res != VK_SUCCESS)
+    return;
+
+  PipelineCacheHeader header = {kPipelineCacheMagic, props.driverVersion,
+                                (uint32_t)size};
+  if (!WriteFileAtomically(path, &header, sizeof(header), data.data(), size))
+    return;
+
+  pipeline_cache_size_ = size;
+}
 
 RingBuffer::Allocation RingBuffer::Allocate(size_t size, size_t alignment) {
   if (size > buffer_size_)
@@ -70,6 +218,11 @@ void RingBuffer::Free(uint8_t *ptr) {
     }
   }
 
+  if (!found) {
+    ETRACE("Freeing memory not allocated from this ring buffer.\n");
+    return;
+  }
+
   auto it = jump_queue_.begin();
   for (; it != jump_queue_.end(); ++it) {
     if (!it->free)
@@ -84,12 +237,6 @@ void RingBuffer::Free(uint8_t *ptr) {
     write_offset_ = 0;
     read_offset_ = 0;
   }
-
-#ifndef NDEBUG
-  if (!jump_queue_.empty()) {
-    auto next = jump_queue_.front();
-  }
-#endif
 }
 
 bool RingBuffer::IsSpanInUse(size_t first, size_t size) {
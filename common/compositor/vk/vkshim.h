@@ -19,6 +19,8 @@
 #include <vulkan/vulkan_intel.h>
 #include <vector>
 
+#include <spinlock.h>
+
 #define ARRAY_SIZE(x) (sizeof(x) / sizeof((x)[0]))
 
 namespace hwcomposer {
@@ -125,6 +127,30 @@ class RingBuffer {
   void Free(uint8_t *ptr);
 };
 
+// Objects which might still be used by frames in flight. VKRenderer hands
+// them over to the next frame it submits and destroys them once that frame
+// has completed.
+struct VKGarbage {
+  std::vector<VkFramebuffer> framebuffers_;
+  std::vector<VkImageView> image_views_;
+  std::vector<VkImage> images_;
+  std::vector<VkDeviceMemory> memory_;
+
+  void Swap(VKGarbage &other);
+  void Destroy();
+};
+
+// Creates pipeline_cache_. It's seeded with the data stored at path, as
+// long as that was written by the same driver for the same device. path
+// may be NULL, in which case the cache starts out empty.
+bool CreatePipelineCache(const VkPhysicalDeviceProperties &props,
+                         const char *path);
+
+// Writes pipeline_cache_ to path, unless it hasn't grown since it was
+// loaded or last stored.
+void StorePipelineCache(const VkPhysicalDeviceProperties &props,
+                        const char *path);
+
 extern VkDevice dev_;
 extern VkInstance inst_;
 extern VkRenderPass render_pass_;
@@ -140,6 +166,8 @@ extern size_t ub_offset_align_;
 extern std::vector<VkImageMemoryBarrier> src_barrier_before_clear_;
 extern VkImageMemoryBarrier dst_barrier_before_clear_;
 extern VkFramebuffer framebuffer_;
+extern VKGarbage garbage_;
+extern SpinLock garbage_lock_;
 
 }  // namespace hwcomposer
 
@@ -19,17 +19,22 @@ namespace hwcomposer {
 
 VKSurface::VKSurface(uint32_t width, uint32_t height)
     : NativeSurface(width, height) {
-  image_memory_ = VK_NULL_HANDLE;
-  image_ = VK_NULL_HANDLE;
-  image_view_ = VK_NULL_HANDLE;
-  surface_fb_ = VK_NULL_HANDLE;
 }
 
 VKSurface::~VKSurface() {
-  vkDestroyFramebuffer(dev_, surface_fb_, NULL);
-  vkDestroyImageView(dev_, image_view_, NULL);
-  vkDestroyImage(dev_, image_, NULL);
-  vkFreeMemory(dev_, image_memory_, NULL);
+  // Frames rendering to the surface might still be in flight.
+  ScopedSpinLock lock(garbage_lock_);
+  if (surface_fb_ != VK_NULL_HANDLE)
+    garbage_.framebuffers_.emplace_back(surface_fb_);
+
+  if (image_view_ != VK_NULL_HANDLE)
+    garbage_.image_views_.emplace_back(image_view_);
+
+  if (image_ != VK_NULL_HANDLE)
+    garbage_.images_.emplace_back(image_);
+
+  if (image_memory_ != VK_NULL_HANDLE)
+    garbage_.memory_.emplace_back(image_memory_);
 }
 
 bool VKSurface::InitializeGPUResources() {
@@ -32,10 +32,10 @@ class VKSurface : public NativeSurface {
 
  private:
   bool InitializeGPUResources();
-  VkDeviceMemory image_memory_;
-  VkImage image_;
-  VkImageView image_view_;
-  VkFramebuffer surface_fb_;
+  VkDeviceMemory image_memory_ = VK_NULL_HANDLE;
+  VkImage image_ = VK_NULL_HANDLE;
+  VkImageView image_view_ = VK_NULL_HANDLE;
+  VkFramebuffer surface_fb_ = VK_NULL_HANDLE;
 };
 
 }  // namespace hwcomposer
@@ -22,20 +22,19 @@ namespace hwcomposer {
 
 void FrameBufferManager::RegisterGemHandles(const uint32_t &num_planes,
                                             const uint32_t (&igem_handles)[4]) {
-  lock_.lock();
   FBKey key(num_planes, igem_handles);
-  auto it = fb_map_.find(key);
-  if (it != fb_map_.end()) {
+  FBShard &shard = GetShard(key);
+  ScopedSpinLock lock(shard.lock_);
+  auto it = shard.fb_map_.find(key);
+  if (it != shard.fb_map_.end()) {
     it->second.fb_ref++;
   } else {
     FBValue value;
     value.fb_ref = 1;
     value.fb_id = 0;
     value.fb_created = false;
-    fb_map_.emplace(std::make_pair(key, value));
+    shard.fb_map_.emplace(std::make_pair(key, value));
   }
-
-  lock_.unlock();
 }
 
 uint32_t FrameBufferManager::FindFB(
@@ -43,11 +42,12 @@ uint32_t FrameBufferManager::FindFB(
     const uint32_t &iframe_buffer_format, const uint32_t &num_planes,
     const uint32_t (&igem_handles)[4], const uint32_t (&ipitches)[4],
     const uint32_t (&ioffsets)[4]) {
-  lock_.lock();
   FBKey key(num_planes, igem_handles);
+  FBShard &shard = GetShard(key);
+  ScopedSpinLock lock(shard.lock_);
   uint32_t fb_id = 0;
-  auto it = fb_map_.find(key);
-  if (it != fb_map_.end()) {
+  auto it = shard.fb_map_.find(key);
+  if (it != shard.fb_map_.end()) {
     if (!it->second.fb_created) {
       it->second.fb_created = true;
       CreateFrameBuffer(iwidth, iheight, modifier, iframe_buffer_format,
@@ -60,48 +60,45 @@ uint32_t FrameBufferManager::FindFB(
     ITRACE("Handle not found in Cache \n");
   }
 
-  lock_.unlock();
   return fb_id;
 }
 
 int FrameBufferManager::RemoveFB(uint32_t num_planes,
                                  const uint32_t (&igem_handles)[4]) {
-  lock_.lock();
-
-  int ret = 0;
   FBKey key(num_planes, igem_handles);
+  FBShard &shard = GetShard(key);
+  ScopedSpinLock lock(shard.lock_);
 
-  auto it = fb_map_.find(key);
-  if (it != fb_map_.end()) {
-    it->second.fb_ref -= 1;
-    if (it->second.fb_ref == 0) {
-      ret = ReleaseFrameBuffer(it->first, it->second.fb_id, gpu_fd_);
-      fb_map_.erase(it);
-    }
-  }
-
-  if (it == fb_map_.end()) {
+  int ret = 0;
+  auto it = shard.fb_map_.find(key);
+  if (it == shard.fb_map_.end()) {
     if (igem_handles[0] != 0 || igem_handles[1] != 0 || igem_handles[2] != 0 ||
         igem_handles[3] != 0) {
       ITRACE("Unable to find fb in cache. %d %d %d %d \n", igem_handles[0],
              igem_handles[1], igem_handles[2], igem_handles[3]);
     }
+
+    return ret;
   }
 
-  lock_.unlock();
+  it->second.fb_ref -= 1;
+  if (it->second.fb_ref == 0) {
+    ret = ReleaseFrameBuffer(it->first, it->second.fb_id, gpu_fd_);
+    shard.fb_map_.erase(it);
+  }
 
   return ret;
 }
 
 void FrameBufferManager::PurgeAllFBs() {
-  lock_.lock();
-  auto it = fb_map_.begin();
+  for (FBShard &shard : shards_) {
+    ScopedSpinLock lock(shard.lock_);
+    for (auto &fb : shard.fb_map_) {
+      ReleaseFrameBuffer(fb.first, fb.second.fb_id, gpu_fd_);
+    }
 
-  while (it != fb_map_.end()) {
-    ReleaseFrameBuffer(it->first, it->second.fb_id, gpu_fd_);
+    shard.fb_map_.clear();
   }
-
-  lock_.unlock();
 }
 
 }  // namespace hwcomposer
@@ -41,7 +41,14 @@ typedef struct {
 
 struct FBHash {
   size_t operator()(FBKey const &key) const {
-    return key.gem_handles_[0];
+    // Planes of multi-planar buffers often share the first handle, all of
+    // them need to be part of the hash. num_planes_ isn't, FBEqual only
+    // compares the handles.
+    size_t seed = 0;
+    for (uint32_t i = 0; i < 4; i++)
+      hash_combine_hwc(seed, key.gem_handles_[i]);
+
+    return seed;
   }
 };
 
@@ -104,13 +111,31 @@ class FrameBufferManager {
   int RemoveFB(uint32_t num_planes, const uint32_t (&igem_handles)[4]);
 
  private:
-  SpinLock lock_;
   /**
-  * Release and remove all framebuffers in the hash fb_map_
+  * Number of independently locked parts of the cache. Lets displays
+  * committing in parallel create and look up framebuffers without
+  * contending on a single lock.
+  */
+  static const size_t kFBShards = 16;
+
+  struct FBShard {
+    SpinLock lock_;
+    std::unordered_map<FBKey, FBValue, FBHash, FBEqual> fb_map_;
+  };
+
+  /**
+  * Returns the shard responsible for key.
+  */
+  FBShard &GetShard(const FBKey &key) {
+    return shards_[FBHash()(key) % kFBShards];
+  }
+
+  /**
+  * Release and remove all framebuffers in all shards.
   */
   void PurgeAllFBs();
 
-  std::unordered_map<FBKey, FBValue, FBHash, FBEqual> fb_map_;
+  FBShard shards_[kFBShards];
   uint32_t gpu_fd_ = 0;
 };
 
@@ -862,6 +862,7 @@ void GpuDevice::HandleHWCSettings() {
 
   bool use_logical = false;
   bool use_mosaic = false;
+  bool align_mosaic_commits = false;
   bool use_cloned = false;
   bool rotate_display = false;
   bool use_float = false;
@@ -883,6 +884,7 @@ void GpuDevice::HandleHWCSettings() {
   std::string cfg_line;
   std::string key_logical("LOGICAL");
   std::string key_mosaic("MOSAIC");
+  std::string key_mosaic_align("MOSAIC_ALIGN_COMMITS");
   std::string key_clone("CLONE");
   std::string key_rotate("ROTATION");
   std::string key_float("FLOAT");
@@ -925,6 +927,11 @@ void GpuDevice::HandleHWCSettings() {
           if (!value.compare(enable_str)) {
             use_mosaic = true;
           }
+          // Got mosaic commit alignment switch
+        } else if (!key.compare(key_mosaic_align)) {
+          if (!value.compare(enable_str)) {
+            align_mosaic_commits = true;
+          }
 #ifdef ENABLE_PANORAMA
           // Got panorama switch
         } else if (!key.compare(key_panorama)) {
@@ -1008,6 +1015,10 @@ void GpuDevice::HandleHWCSettings() {
   if (use_mosaic) {
     InitializeMosaicDisplay(total_displays_, mosaic_displays, temp_displays,
                             available_displays);
+    for (auto &mosaic : mosaic_displays_) {
+      static_cast<MosaicDisplay *>(mosaic.get())
+          ->SetAlignCommits(align_mosaic_commits);
+    }
   } else {
     total_displays_.swap(temp_displays);
   }
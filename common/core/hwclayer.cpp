@@ -109,6 +109,7 @@ void HwcLayer::SetSurfaceDamage(const HwcRegion& surface_damage) {
   state_ |= kSurfaceDamageChanged;
   HwcRect<int> rect;
   ResetRectToRegion(surface_damage, rect);
+  HwcRegion().swap(surface_damage_region_);
   if (rects == 1) {
     if ((rect.top == 0) && (rect.bottom == 0) && (rect.left == 0) &&
         (rect.right == 0)) {
@@ -121,6 +122,14 @@ void HwcLayer::SetSurfaceDamage(const HwcRegion& surface_damage) {
     rect = source_crop_;
   }
 
+  if (rects == 0) {
+    surface_damage_region_.emplace_back(rect);
+  } else {
+    for (const HwcRect<int>& damage : surface_damage) {
+      AddRectToRegion(damage, surface_damage_region_);
+    }
+  }
+
   if ((surface_damage_.left == rect.left) &&
       (surface_damage_.top == rect.top) &&
       (surface_damage_.right == rect.right) &&
@@ -280,6 +289,28 @@ void HwcLayer::SufaceDamageTransfrom() {
   } else {
     current_rendering_damage_ = display_frame_;
   }
+
+  // Same translation for each rect of the damage region.
+  HwcRegion().swap(current_rendering_damage_region_);
+  if (!surface_damage_.empty() &&
+      ((source_crop_.left == 0) && (source_crop_.top == 0))) {
+    float ratiow = display_frame_width_ * 1.0 /
+                   (source_crop_.right - source_crop_.left);
+    float ratioh = display_frame_height_ * 1.0 /
+                   (source_crop_.bottom - source_crop_.top);
+    for (const HwcRect<int>& damage : surface_damage_region_) {
+      HwcRect<int> rect;
+      rect.left = damage.left * ratiow + 0.5;
+      rect.top = damage.top * ratioh + 0.5;
+      rect.right = damage.right * ratiow + 0.5;
+      rect.bottom = damage.bottom * ratioh + 0.5;
+      AddRectToRegion(
+          TranslateRect(rect, display_frame_.left, display_frame_.top),
+          current_rendering_damage_region_);
+    }
+  } else if (!current_rendering_damage_.empty()) {
+    current_rendering_damage_region_.emplace_back(current_rendering_damage_);
+  }
 }
 
 void HwcLayer::Validate() {
@@ -294,6 +325,7 @@ void HwcLayer::Validate() {
     SufaceDamageTransfrom();
   } else {
     current_rendering_damage_ = display_frame_;
+    HwcRegion().swap(current_rendering_damage_region_);
   }
 
   if (left_constraint_.empty() && left_source_constraint_.empty())
@@ -455,4 +487,18 @@ const HwcRect<int>& HwcLayer::GetLayerDamage() {
   return current_rendering_damage_;
 }
 
+const HwcRegion& HwcLayer::GetLayerDamageRegion() {
+  // Rendering damage might have grown since the region was calculated,
+  // fall back to its bounds in that case.
+  HwcRect<int> bounds;
+  ResetRectToRegion(current_rendering_damage_region_, bounds);
+  if (!(bounds == current_rendering_damage_)) {
+    HwcRegion().swap(current_rendering_damage_region_);
+    if (!current_rendering_damage_.empty())
+      current_rendering_damage_region_.emplace_back(current_rendering_damage_);
+  }
+
+  return current_rendering_damage_region_;
+}
+
 }  // namespace hwcomposer
@@ -55,6 +55,10 @@ bool LogicalDisplay::EnableDRMCommit(bool enable) {
   return physical_display_->EnableDRMCommit(enable);
 }
 
+bool LogicalDisplay::GetPresentDeadline(int64_t *deadline, int64_t *vblank) {
+  return physical_display_->GetPresentDeadline(deadline, vblank);
+}
+
 bool LogicalDisplay::SetActiveConfig(uint32_t config) {
   bool success = physical_display_->SetActiveConfig(config);
   width_ = (physical_display_->Width()) / total_divisions_;
@@ -21,7 +21,9 @@
 #include <string>
 
 #include <hwclayer.h>
+#include <hwcutils.h>
 
+#include "hwcthread.h"
 #include "hwctrace.h"
 
 #ifdef ENABLE_PANORAMA
@@ -70,6 +72,74 @@ class MDHotPlugCallback : public hwcomposer::HotPlugCallback {
   MosaicDisplay *display_;
 };
 
+// Presents the displays queued to it on its own thread.
+class MosaicPresentWorker : public HWCThread {
+ public:
+  MosaicPresentWorker() : HWCThread(-8, "MosaicPresentWorker") {
+  }
+
+  ~MosaicPresentWorker() override {
+    HWCThread::Exit();
+  }
+
+  bool Initialize() {
+    if (!done_.Initialize())
+      return false;
+
+    return InitWorker();
+  }
+
+  void Queue(NativeDisplay *display, std::vector<HwcLayer *> *layers,
+             int32_t *retire_fence) {
+    jobs_.emplace_back();
+    PresentJob &job = jobs_.back();
+    job.display_ = display;
+    job.layers_ = layers;
+    job.retire_fence_ = retire_fence;
+  }
+
+  bool HasJobs() const {
+    return !jobs_.empty();
+  }
+
+  void Dispatch() {
+    if (initialized_) {
+      Resume();
+    } else {
+      HandleRoutine();
+    }
+  }
+
+  void Wait() {
+    // Jobs were presented inline by Dispatch.
+    if (!initialized_)
+      return;
+
+    done_.Wait();
+  }
+
+ protected:
+  void HandleRoutine() override {
+    for (PresentJob &job : jobs_) {
+      job.display_->Present(*job.layers_, job.retire_fence_, NULL, true);
+    }
+
+    jobs_.clear();
+    if (initialized_)
+      done_.Signal();
+  }
+
+ private:
+  struct PresentJob {
+    NativeDisplay *display_;
+    std::vector<HwcLayer *> *layers_;
+    int32_t *retire_fence_;
+  };
+
+  std::vector<PresentJob> jobs_;
+  HWCEvent done_;
+};
+
 MosaicDisplay::MosaicDisplay(const std::vector<NativeDisplay *> &displays)
     : dpix_(0), dpiy_(0) {
   uint32_t size = displays.size();
@@ -83,6 +153,11 @@ MosaicDisplay::MosaicDisplay(const std::vector<NativeDisplay *> &displays)
 }
 
 MosaicDisplay::~MosaicDisplay() {
+  for (int32_t fence : previous_fences_) {
+    if (fence > 0)
+      close(fence);
+  }
+
 #ifdef ENABLE_PANORAMA
   if (panorama_mode_) {
     while (!virtual_panorama_displays_->empty()) {
@@ -241,6 +316,13 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
     update_connected_displays_ = false;
   }
   lock_.unlock();
+
+  // Uploads are synchronized once here, displays are presented without
+  // the callback.
+  if (call_back) {
+    call_back->Synchronize();
+  }
+
   uint32_t size = connected_displays_.size();
   int32_t left_constraint = 0;
 #ifdef ENABLE_PANORAMA
@@ -249,12 +331,26 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
   }
 #endif
   size_t total_layers = source_layers.size();
-  int32_t fence = -1;
-  *retire_fence = -1;
+  std::vector<int32_t> acquire_fences(total_layers, -1);
+  std::vector<bool> presented(total_layers, false);
+  for (size_t j = 0; j < total_layers; j++) {
+    HwcLayer *layer = source_layers.at(j);
+    layer->SetReleaseFence(-1);
+    acquire_fences.at(j) = layer->GetAcquireFence();
+  }
+
+  if (frames_.size() < size)
+    frames_.resize(size);
+
+  // Filter layers for every display up front, each display gets its own
+  // copy of the layers it shows.
   for (uint32_t i = 0; i < size; i++) {
     NativeDisplay *display = connected_displays_.at(i);
+    DisplayFrame &frame = frames_.at(i);
+    std::vector<HwcLayer *>().swap(frame.present_layers_);
+    std::vector<HwcLayer *>().swap(frame.source_layers_);
+    frame.retire_fence_ = -1;
     int32_t right_constraint = left_constraint + display->Width();
-    std::vector<HwcLayer *> layers;
     uint32_t dlconstraint = display->GetLogicalIndex() * display->Width();
     uint32_t drconstraint = dlconstraint + display->Width();
     IMOSAICDISPLAYTRACE("Display index %d \n", i);
@@ -263,42 +359,112 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
     IMOSAICDISPLAYTRACE("right_constraint %d \n", right_constraint);
     IMOSAICDISPLAYTRACE("left_constraint %d \n", left_constraint);
     for (size_t j = 0; j < total_layers; j++) {
-      HwcLayer *layer = source_layers.at(j);
-      const HwcRect<int> &frame_Rect = layer->GetDisplayFrame();
+      HwcLayer *source = source_layers.at(j);
+      const HwcRect<int> &frame_Rect = source->GetDisplayFrame();
       if ((frame_Rect.right < left_constraint) ||
           (frame_Rect.left > right_constraint)) {
         continue;
       }
 
+      size_t index = frame.present_layers_.size();
+      if (frame.layers_.size() <= index)
+        frame.layers_.emplace_back(new HwcLayer());
+
+      HwcLayer *layer = frame.layers_.at(index).get();
+      CopyLayerState(source, layer);
       layer->SetUseForMosaic(true);
       layer->SetLeftConstraint(dlconstraint);
       layer->SetRightConstraint(drconstraint);
       layer->SetLeftSourceConstraint(left_constraint);
       layer->SetRightSourceConstraint(right_constraint);
+      int32_t fence = acquire_fences.at(j);
+      layer->SetAcquireFence(fence > 0 ? dup(fence) : -1);
 
-      layers.emplace_back(layer);
+      frame.present_layers_.emplace_back(layer);
+      frame.source_layers_.emplace_back(source);
+      presented.at(j) = true;
     }
 
-    if (layers.empty()) {
+    if (frame.present_layers_.empty()) {
       continue;
     }
 
-    display->Present(layers, &fence, call_back, true);
-    IMOSAICDISPLAYTRACE("Present called for Display index %d \n", i);
-    if (fence > 0) {
-      if (*retire_fence < 0) {
-        *retire_fence = fence;
-      } else {
-        int ret = sync_accumulate("iahwc_mosaic_fence", retire_fence, fence);
-        if (ret) {
-          ETRACE("Unable to merge fences");
-          *retire_fence = -1;
-        }
+    left_constraint = right_constraint;
+  }
+
+  for (int32_t fence : acquire_fences) {
+    if (fence > 0)
+      close(fence);
+  }
+
+  if (align_commits_) {
+    for (int32_t fence : previous_fences_) {
+      if (fence > 0) {
+        HWCPoll(fence, -1);
         close(fence);
       }
     }
+  }
+  std::vector<int32_t>().swap(previous_fences_);
 
-    left_constraint = right_constraint;
+  // Dispatch all displays, then wait for every one of them to submit.
+  std::vector<MosaicPresentWorker *> workers;
+  for (uint32_t i = 0; i < size; i++) {
+    DisplayFrame &frame = frames_.at(i);
+    if (frame.present_layers_.empty())
+      continue;
+
+    NativeDisplay *display = connected_displays_.at(i);
+    MosaicPresentWorker *worker = GetPresentWorker(display->GetDisplayPipe());
+    if (!worker->HasJobs())
+      workers.emplace_back(worker);
+
+    worker->Queue(display, &frame.present_layers_, &frame.retire_fence_);
+  }
+
+  for (MosaicPresentWorker *worker : workers) {
+    worker->Dispatch();
+  }
+
+  for (MosaicPresentWorker *worker : workers) {
+    worker->Wait();
+  }
+
+  // The displays validated only their copies, clear the change state of
+  // the source layers once for all of them.
+  for (size_t j = 0; j < total_layers; j++) {
+    if (presented.at(j))
+      source_layers.at(j)->Validate();
+  }
+
+  *retire_fence = -1;
+  for (uint32_t i = 0; i < size; i++) {
+    DisplayFrame &frame = frames_.at(i);
+    size_t total = frame.present_layers_.size();
+    for (size_t j = 0; j < total; j++) {
+      int32_t release_fence = frame.present_layers_.at(j)->GetReleaseFence();
+      if (release_fence > 0)
+        frame.source_layers_.at(j)->SetReleaseFence(release_fence);
+    }
+
+    int32_t fence = frame.retire_fence_;
+    IMOSAICDISPLAYTRACE("Present called for Display index %d \n", i);
+    if (fence <= 0)
+      continue;
+
+    if (align_commits_)
+      previous_fences_.emplace_back(dup(fence));
+
+    if (*retire_fence < 0) {
+      *retire_fence = fence;
+    } else {
+      int ret = sync_accumulate("iahwc_mosaic_fence", retire_fence, fence);
+      if (ret) {
+        ETRACE("Unable to merge fences");
+        *retire_fence = -1;
+      }
+      close(fence);
+    }
   }
 
 #ifdef ENABLE_PANORAMA
@@ -311,6 +477,57 @@ bool MosaicDisplay::Present(std::vector<HwcLayer *> &source_layers,
   return true;
 }
 
+void MosaicDisplay::CopyLayerState(const HwcLayer *source, HwcLayer *target) {
+  if (target->acquire_fence_ > 0)
+    close(target->acquire_fence_);
+
+  if (target->release_fd_ > 0)
+    close(target->release_fd_);
+
+  *target = *source;
+  // Fences are owned by the source layer, constraints are set per display.
+  target->acquire_fence_ = -1;
+  target->release_fd_ = -1;
+  target->left_constraint_.clear();
+  target->right_constraint_.clear();
+  target->left_source_constraint_.clear();
+  target->right_source_constraint_.clear();
+}
+
+MosaicPresentWorker *MosaicDisplay::GetPresentWorker(int pipe) {
+  std::unique_ptr<MosaicPresentWorker> &worker = workers_[pipe];
+  if (!worker) {
+    worker.reset(new MosaicPresentWorker());
+    // Displays are presented inline in case the thread can't be started.
+    if (!worker->Initialize())
+      ETRACE("Failed to initalize MosaicPresentWorker. %s", PRINTERROR());
+  }
+
+  return worker.get();
+}
+
+bool MosaicDisplay::GetPresentDeadline(int64_t *deadline, int64_t *vblank) {
+  lock_.lock();
+  std::vector<NativeDisplay *> displays(connected_displays_);
+  lock_.unlock();
+
+  bool predicted = false;
+  for (NativeDisplay *display : displays) {
+    int64_t display_deadline;
+    int64_t display_vblank;
+    if (!display->GetPresentDeadline(&display_deadline, &display_vblank))
+      continue;
+
+    if (!predicted || display_deadline < *deadline) {
+      *deadline = display_deadline;
+      *vblank = display_vblank;
+      predicted = true;
+    }
+  }
+
+  return predicted;
+}
+
 bool MosaicDisplay::PresentClone(NativeDisplay * /*display*/) {
   return false;
 }
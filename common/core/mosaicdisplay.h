@@ -20,13 +20,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 
+#include <map>
 #include <memory>
+#include <vector>
 
+#include <hwclayer.h>
 #include <nativedisplay.h>
 #include <spinlock.h>
 #include "hwcevent.h"
 
 namespace hwcomposer {
+class MosaicPresentWorker;
 #ifdef ENABLE_PANORAMA
 class DisplayManager;
 #endif
@@ -100,6 +104,9 @@ class MosaicDisplay : public NativeDisplay {
 
   bool EnableDRMCommit(bool enable) override;
 
+  // Earliest deadline of all the connected displays.
+  bool GetPresentDeadline(int64_t *deadline, int64_t *vblank) override;
+
   bool GetDisplayIdentificationData(uint8_t *outPort, uint32_t *outDataSize,
                                     uint8_t *outData) override;
 
@@ -127,6 +134,13 @@ class MosaicDisplay : public NativeDisplay {
 
   bool ContainConnector(const uint32_t connector_id) override;
 
+  // Displays are presented concurrently, each one commits as soon as it is
+  // ready. When aligned, a frame is dispatched only once the previous one
+  // is on screen on all displays so that no display runs ahead of others.
+  void SetAlignCommits(bool align) {
+    align_commits_ = align;
+  }
+
 #ifdef ENABLE_PANORAMA
   void SetPanoramaMode(bool mode);
   void SetExtraDispInfo(
@@ -137,6 +151,19 @@ class MosaicDisplay : public NativeDisplay {
 #endif
 
  private:
+  // Layers of a frame as seen by one of the connected displays.
+  struct DisplayFrame {
+    // Private copies of the source layers, so that displays can consume
+    // their layers concurrently.
+    std::vector<std::unique_ptr<HwcLayer>> layers_;
+    std::vector<HwcLayer *> present_layers_;
+    std::vector<HwcLayer *> source_layers_;
+    int32_t retire_fence_ = -1;
+  };
+
+  void CopyLayerState(const HwcLayer *source, HwcLayer *target);
+  MosaicPresentWorker *GetPresentWorker(int pipe);
+
   std::vector<NativeDisplay *> physical_displays_;
   std::vector<NativeDisplay *> connected_displays_;
   std::shared_ptr<RefreshCallback> refresh_callback_ = NULL;
@@ -157,6 +184,13 @@ class MosaicDisplay : public NativeDisplay {
   bool connected_ = false;
   bool pending_vsync_ = false;
   bool update_connected_displays_ = true;
+  bool align_commits_ = false;
+  std::vector<DisplayFrame> frames_;
+  // Retire fences of the last frame, used when commits are aligned.
+  std::vector<int32_t> previous_fences_;
+  // Present workers by pipe. Logical displays sharing a pipe are
+  // presented in order by the same worker.
+  std::map<int, std::unique_ptr<MosaicPresentWorker>> workers_;
 #ifdef ENABLE_PANORAMA
   std::vector<NativeDisplay *> *virtual_panorama_displays_;
   std::vector<NativeDisplay *> *physical_panorama_displays_;
@@ -184,11 +184,65 @@ void OverlayLayer::ValidateTransform(uint32_t transform,
   }
 }
 
+HwcRect<int> OverlayLayer::TransformDamageRect(
+    const HwcRect<int>& translated_damage, uint32_t max_height,
+    uint32_t max_width) const {
+  HwcRect<int> surface_damage;
+  float ratio_w_h = max_width * 1.0 / max_height;
+  float ratio_h_w = max_height * 1.0 / max_width;
+
+  int ox = 0, oy = 0;
+
+  if (merged_transform_ == kTransform270) {
+    oy = max_height;
+    surface_damage.left = translated_damage.top * ratio_w_h + 0.5;
+    surface_damage.top = oy - translated_damage.right * ratio_h_w + 0.5;
+    surface_damage.right = translated_damage.bottom * ratio_w_h + 0.5;
+    surface_damage.bottom = oy - translated_damage.left * ratio_h_w + 0.5;
+  } else if (merged_transform_ == kTransform180) {
+    ox = max_width;
+    oy = max_height;
+    surface_damage.left = ox - translated_damage.right;
+    surface_damage.top = oy - translated_damage.bottom;
+    surface_damage.right = ox - translated_damage.left;
+    surface_damage.bottom = oy - translated_damage.top;
+  } else if (merged_transform_ & hwcomposer::HWCTransform::kTransform90) {
+    if (merged_transform_ & kReflectX) {
+      surface_damage.left = translated_damage.top * ratio_w_h + 0.5;
+      surface_damage.top = translated_damage.left * ratio_h_w + 0.5;
+      surface_damage.right = translated_damage.bottom * ratio_w_h + 0.5;
+      surface_damage.bottom = translated_damage.right * ratio_h_w + 0.5;
+    } else if (merged_transform_ & kReflectY) {
+      ox = max_width;
+      oy = max_height;
+      surface_damage.left = ox - (translated_damage.bottom * ratio_w_h + 0.5);
+      surface_damage.top = oy - (translated_damage.right * ratio_h_w + 0.5);
+      surface_damage.right = ox - (translated_damage.top * ratio_w_h + 0.5);
+      surface_damage.bottom = oy - (translated_damage.left * ratio_h_w + 0.5);
+    } else {
+      ox = max_width;
+      surface_damage.left = ox - translated_damage.bottom * ratio_w_h + 0.5;
+      surface_damage.top = translated_damage.left * ratio_h_w + 0.5;
+      surface_damage.right = ox - translated_damage.top * ratio_w_h + 0.5;
+      surface_damage.bottom = translated_damage.right * ratio_h_w + 0.5;
+    }
+  } else if (merged_transform_ == 0) {
+    surface_damage.left = translated_damage.left;
+    surface_damage.top = translated_damage.top;
+    surface_damage.right = translated_damage.right;
+    surface_damage.bottom = translated_damage.bottom;
+  }
+
+  return surface_damage;
+}
+
 void OverlayLayer::TransformDamage(HwcLayer* layer, uint32_t max_height,
                                    uint32_t max_width) {
   const HwcRect<int>& surface_damage = layer->GetLayerDamage();
+  const HwcRegion& damage_region = layer->GetLayerDamageRegion();
   if (surface_damage.empty()) {
     surface_damage_ = surface_damage;
+    HwcRegion().swap(surface_damage_region_);
     return;
   }
   HwcRect<int> translated_damage = TranslateRect(surface_damage, 0, 0);
@@ -211,49 +265,12 @@ void OverlayLayer::TransformDamage(HwcLayer* layer, uint32_t max_height,
                    (display_frame_.right - display_frame_.left),
                    (display_frame_.bottom - display_frame_.top));
 #endif
-  float ratio_w_h = max_width * 1.0 / max_height;
-  float ratio_h_w = max_height * 1.0 / max_width;
-
-  int ox = 0, oy = 0;
-
-  if (merged_transform_ == kTransform270) {
-    oy = max_height;
-    surface_damage_.left = translated_damage.top * ratio_w_h + 0.5;
-    surface_damage_.top = oy - translated_damage.right * ratio_h_w + 0.5;
-    surface_damage_.right = translated_damage.bottom * ratio_w_h + 0.5;
-    surface_damage_.bottom = oy - translated_damage.left * ratio_h_w + 0.5;
-  } else if (merged_transform_ == kTransform180) {
-    ox = max_width;
-    oy = max_height;
-    surface_damage_.left = ox - translated_damage.right;
-    surface_damage_.top = oy - translated_damage.bottom;
-    surface_damage_.right = ox - translated_damage.left;
-    surface_damage_.bottom = oy - translated_damage.top;
-  } else if (merged_transform_ & hwcomposer::HWCTransform::kTransform90) {
-    if (merged_transform_ & kReflectX) {
-      surface_damage_.left = translated_damage.top * ratio_w_h + 0.5;
-      surface_damage_.top = translated_damage.left * ratio_h_w + 0.5;
-      surface_damage_.right = translated_damage.bottom * ratio_w_h + 0.5;
-      surface_damage_.bottom = translated_damage.right * ratio_h_w + 0.5;
-    } else if (merged_transform_ & kReflectY) {
-      ox = max_width;
-      oy = max_height;
-      surface_damage_.left = ox - (translated_damage.bottom * ratio_w_h + 0.5);
-      surface_damage_.top = oy - (translated_damage.right * ratio_h_w + 0.5);
-      surface_damage_.right = ox - (translated_damage.top * ratio_w_h + 0.5);
-      surface_damage_.bottom = oy - (translated_damage.left * ratio_h_w + 0.5);
-    } else {
-      ox = max_width;
-      surface_damage_.left = ox - translated_damage.bottom * ratio_w_h + 0.5;
-      surface_damage_.top = translated_damage.left * ratio_h_w + 0.5;
-      surface_damage_.right = ox - translated_damage.top * ratio_w_h + 0.5;
-      surface_damage_.bottom = translated_damage.right * ratio_h_w + 0.5;
-    }
-  } else if (merged_transform_ == 0) {
-    surface_damage_.left = translated_damage.left;
-    surface_damage_.top = translated_damage.top;
-    surface_damage_.right = translated_damage.right;
-    surface_damage_.bottom = translated_damage.bottom;
+  surface_damage_ =
+      TransformDamageRect(translated_damage, max_height, max_width);
+  HwcRegion().swap(surface_damage_region_);
+  for (const HwcRect<int>& damage : damage_region) {
+    AddRectToRegion(TransformDamageRect(damage, max_height, max_width),
+                    surface_damage_region_);
   }
 #ifdef RECT_DAMAGE_TRACING
   IRECTDAMAGETRACE("Surface_damage (LTWH): %d, %d, %d, %d",
@@ -287,6 +304,8 @@ void OverlayLayer::InitializeState(HwcLayer* layer,
   source_crop_height_ = layer->GetSourceCropHeight();
   source_crop_ = layer->GetSourceCrop();
   dataspace_ = layer->GetDataSpace();
+  color_description_ =
+      DataSpaceToColorDescription(dataspace_, layer->GetSourceCropHeight());
   blending_ = layer->GetBlending();
   solid_color_ = layer->GetSolidColor();
   TransformDamage(layer, max_height, max_width);
@@ -599,6 +618,7 @@ void OverlayLayer::CloneLayer(const OverlayLayer* layer,
   }
   ValidateForOverlayUsage();
   surface_damage_ = layer->GetSurfaceDamage();
+  surface_damage_region_ = layer->surface_damage_region_;
   transform_ = layer->transform_;
   plane_transform_ = layer->plane_transform_;
   merged_transform_ = layer->merged_transform_;
@@ -609,6 +629,21 @@ void OverlayLayer::CloneLayer(const OverlayLayer* layer,
   solid_color_ = layer->solid_color_;
 }
 
+void OverlayLayer::GetSurfaceDamageRegion(HwcRegion& region) const {
+  // surface_damage_ could have been adjusted after the region was
+  // calculated, use the bounds only in that case.
+  HwcRect<int> bounds;
+  ResetRectToRegion(surface_damage_region_, bounds);
+  if (bounds == surface_damage_) {
+    region = surface_damage_region_;
+    return;
+  }
+
+  HwcRegion().swap(region);
+  if (!surface_damage_.empty())
+    region.emplace_back(surface_damage_);
+}
+
 void OverlayLayer::Dump() {
   DUMPTRACE("OverlayLayer Information Starts. -------------");
   switch (blending_) {
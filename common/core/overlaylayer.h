@@ -130,6 +130,10 @@ struct OverlayLayer {
     return surface_damage_;
   }
 
+  // Surface damage as a list of rects, bounds of which equal
+  // GetSurfaceDamage().
+  void GetSurfaceDamageRegion(HwcRegion& region) const;
+
   uint32_t GetSourceCropWidth() const {
     return source_crop_width_;
   }
@@ -194,6 +198,11 @@ struct OverlayLayer {
     return type_ == kLayerSolidColor;
   }
 
+  // Colour encoding in case the layer has YUV content.
+  const HwcColorDescription& GetColorDescription() const {
+    return color_description_;
+  }
+
   bool IsProtected() const {
     return type_ == kLayerProtected;
   }
@@ -287,6 +296,11 @@ struct OverlayLayer {
   void TransformDamage(HwcLayer* layer, uint32_t max_height,
                        uint32_t max_width);
 
+  // Applies merged_transform_ to damage.
+  HwcRect<int> TransformDamageRect(const HwcRect<int>& damage,
+                                   uint32_t max_height,
+                                   uint32_t max_width) const;
+
   void InitializeState(HwcLayer* layer, ResourceManager* buffer_manager,
                        OverlayLayer* previous_layer, uint32_t z_order,
                        uint32_t layer_index, uint32_t max_height,
@@ -304,12 +318,14 @@ struct OverlayLayer {
   uint32_t display_frame_height_ = 0;
   uint8_t alpha_ = 0xff;
   uint32_t dataspace_ = 0;
+  HwcColorDescription color_description_;
 
   uint32_t solid_color_ = 0;
 
   HwcRect<float> source_crop_;
   HwcRect<int> display_frame_;
   HwcRect<int> surface_damage_;
+  HwcRegion surface_damage_region_;
   HWCBlending blending_ = HWCBlending::kBlendingNone;
   uint32_t state_ = kLayerContentChanged | kDimensionsChanged;
   std::unique_ptr<ImportedBuffer> imported_buffer_;
@@ -18,14 +18,17 @@
 
 namespace hwcomposer {
 
+// Initial number of slots in the buffer cache, log2.
+static const uint32_t kInitialCacheBits = 6;
+
 ResourceManager::ResourceManager(NativeBufferHandler* buffer_handler)
     : buffer_handler_(buffer_handler) {
-  for (size_t i = 0; i < BUFFER_CACHE_LENGTH; i++)
-    cached_buffers_.emplace_back();
+  cached_buffers_.resize(1 << kInitialCacheBits);
+  cached_buffers_shift_ = 32 - kInitialCacheBits;
 }
 
 ResourceManager::~ResourceManager() {
-  if (!cached_buffers_.empty()) {
+  if (cached_buffers_count_) {
     ETRACE("ResourceManager destroyed with valid native resources \n");
   }
 
@@ -39,37 +42,92 @@ ResourceManager::~ResourceManager() {
 }
 
 void ResourceManager::PurgeBuffer() {
-  for (auto& map : cached_buffers_) {
-    map.clear();
+  for (CachedBuffer& entry : cached_buffers_) {
+    entry.buffer_.reset();
   }
 
+  cached_buffers_count_ = 0;
+  needs_eviction_ = false;
   PreparePurgedResources();
 }
 
 void ResourceManager::Dump() {
 }
 
-std::shared_ptr<OverlayBuffer>& ResourceManager::FindCachedBuffer(
-    const uint32_t& native_buffer) {
-  BUFFER_MAP& first_map = cached_buffers_[0];
-  static std::shared_ptr<OverlayBuffer> pBufNull = nullptr;
-  for (auto& map : cached_buffers_) {
-    if (map.empty()) {
+size_t ResourceManager::GetSlot(uint32_t native_buffer) const {
+  // Fibonacci hashing, ids tend to be handed out sequentially.
+  return static_cast<uint32_t>(native_buffer * 2654435769u) >>
+         cached_buffers_shift_;
+}
+
+void ResourceManager::GrowBufferCache() {
+  std::vector<CachedBuffer> old_buffers(cached_buffers_.size() * 2);
+  old_buffers.swap(cached_buffers_);
+  cached_buffers_shift_--;
+
+  size_t mask = cached_buffers_.size() - 1;
+  for (CachedBuffer& entry : old_buffers) {
+    if (!entry.buffer_)
       continue;
+
+    size_t slot = GetSlot(entry.native_buffer_);
+    while (cached_buffers_[slot].buffer_)
+      slot = (slot + 1) & mask;
+
+    cached_buffers_[slot] = std::move(entry);
+  }
+}
+
+void ResourceManager::EraseCachedBuffer(size_t slot) {
+  size_t mask = cached_buffers_.size() - 1;
+  size_t hole = slot;
+  size_t next = (hole + 1) & mask;
+  while (cached_buffers_[next].buffer_) {
+    // Entry can fill the hole unless its home slot lies after the hole.
+    size_t home = GetSlot(cached_buffers_[next].native_buffer_);
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      cached_buffers_[hole] = std::move(cached_buffers_[next]);
+      hole = next;
     }
 
-    BUFFER_MAP::iterator it = map.find(native_buffer);
+    next = (next + 1) & mask;
+  }
+
+  cached_buffers_[hole].buffer_.reset();
+  cached_buffers_count_--;
+}
 
-    if (it != map.end()) {
-      std::shared_ptr<OverlayBuffer>& pBuf = it->second;
-      if (&map != &first_map) {
-        first_map.emplace(std::make_pair(native_buffer, pBuf));
-      }
+void ResourceManager::EvictStaleBuffers() {
+  size_t size = cached_buffers_.size();
+  size_t slot = 0;
+  while (slot < size && cached_buffers_count_) {
+    CachedBuffer& entry = cached_buffers_[slot];
+    if (entry.buffer_ && frame_ - entry.frame_ >= BUFFER_CACHE_LENGTH) {
+      // Another entry may have been moved to slot, check it again.
+      EraseCachedBuffer(slot);
+      continue;
+    }
+
+    slot++;
+  }
+}
+
+std::shared_ptr<OverlayBuffer>& ResourceManager::FindCachedBuffer(
+    const uint32_t& native_buffer) {
+  static std::shared_ptr<OverlayBuffer> pBufNull = nullptr;
+  size_t mask = cached_buffers_.size() - 1;
+  size_t slot = GetSlot(native_buffer);
+  while (cached_buffers_[slot].buffer_) {
+    CachedBuffer& entry = cached_buffers_[slot];
+    if (entry.native_buffer_ == native_buffer) {
+      entry.frame_ = frame_;
 #ifdef RESOURCE_CACHE_TRACING
       hit_count_++;
 #endif
-      return pBuf;
+      return entry.buffer_;
     }
+
+    slot = (slot + 1) & mask;
   }
 
 #ifdef RESOURCE_CACHE_TRACING
@@ -84,8 +142,25 @@ std::shared_ptr<OverlayBuffer>& ResourceManager::FindCachedBuffer(
 
 void ResourceManager::RegisterBuffer(const uint32_t& native_buffer,
                                      std::shared_ptr<OverlayBuffer>& pBuffer) {
-  BUFFER_MAP& first_map = cached_buffers_[0];
-  first_map.emplace(std::make_pair(native_buffer, pBuffer));
+  if ((cached_buffers_count_ + 1) * 4 > cached_buffers_.size() * 3)
+    GrowBufferCache();
+
+  size_t mask = cached_buffers_.size() - 1;
+  size_t slot = GetSlot(native_buffer);
+  while (cached_buffers_[slot].buffer_) {
+    if (cached_buffers_[slot].native_buffer_ == native_buffer)
+      break;
+
+    slot = (slot + 1) & mask;
+  }
+
+  CachedBuffer& entry = cached_buffers_[slot];
+  if (!entry.buffer_)
+    cached_buffers_count_++;
+
+  entry.native_buffer_ = native_buffer;
+  entry.frame_ = frame_;
+  entry.buffer_ = pBuffer;
 }
 
 void ResourceManager::MarkResourceForDeletion(const ResourceHandle& handle,
@@ -139,13 +214,15 @@ void ResourceManager::GetPurgedResources(
 }
 
 void ResourceManager::RefreshBufferCache() {
-  auto begin = cached_buffers_.begin();
-  cached_buffers_.emplace(begin);
+  frame_++;
+  needs_eviction_ = true;
 }
 
 bool ResourceManager::PreparePurgedResources() {
-  if (cached_buffers_.size() > 4)
-    cached_buffers_.pop_back();
+  if (needs_eviction_) {
+    EvictStaleBuffers();
+    needs_eviction_ = false;
+  }
 
   if (purged_resources_.empty() && purged_media_resources_.empty())
     return false;
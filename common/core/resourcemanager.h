@@ -22,15 +22,13 @@ to avoid import buffer and glimage/texture generation overhead
 1: the ResourceManager is owned per display, as each display has a
 separate
 GL context
-2: ResourceManager stores a refernce of external buffers in a vector
-   cached_buffers, each vector member is hash map.
-   The vector stores history buffer in this way, vector[0] is for the current
-   frame buffers, vector[1] is for last frame (-1) buffers, vector[2] is -2
-   frames buffers etc. A constant (currently 4) frames of buffers is stored.
-   When a buffer refernce is stored in vector[3] and it is not used in the
-   current frame present, it will go out of scope and be released.
-   If a buffer is fetched from map, it will always re-registered in vector[0]
-map.
+2: ResourceManager stores a refernce of external buffers in a single open
+   addressing hash table keyed by the native buffer id. Every entry
+   remembers the frame it was last used in, RefreshBufferCache starts a
+   new frame. Entries not used in the last constant (currently 4) frames
+   are swept from the table at the end of the frame and their buffers
+   released. Fetching a buffer from the table marks it as used in the
+   current frame.
 3. By this way, drm_buffer now owns eglImage and gltexture and they
    can be resued.
 */
@@ -43,7 +41,7 @@ map.
 #include <platformdefines.h>
 
 #include <memory>
-#include <unordered_map>
+#include <vector>
 
 #include <spinlock.h>
 
@@ -85,9 +83,30 @@ class ResourceManager {
 
  private:
 #define BUFFER_CACHE_LENGTH 4
-  typedef std::unordered_map<uint32_t, std::shared_ptr<OverlayBuffer>>
-      BUFFER_MAP;
-  std::vector<BUFFER_MAP> cached_buffers_;
+  struct CachedBuffer {
+    uint32_t native_buffer_ = 0;
+    // Value of frame_ when the buffer was last used.
+    uint32_t frame_ = 0;
+    // Slot is free if not set.
+    std::shared_ptr<OverlayBuffer> buffer_;
+  };
+
+  size_t GetSlot(uint32_t native_buffer) const;
+  void GrowBufferCache();
+  // Removes the entry at slot, moving back any entries after it which
+  // would otherwise become unreachable.
+  void EraseCachedBuffer(size_t slot);
+  // Drops entries which weren't used in the last BUFFER_CACHE_LENGTH
+  // frames.
+  void EvictStaleBuffers();
+
+  // Size is always a power of two and kept at most 3/4 full, so that
+  // linear probing always finds a free slot.
+  std::vector<CachedBuffer> cached_buffers_;
+  size_t cached_buffers_count_ = 0;
+  uint32_t cached_buffers_shift_ = 0;
+  uint32_t frame_ = 0;
+  bool needs_eviction_ = false;
   // This should be used in same thread handling
   // Present in NativeDisplay.
   std::vector<ResourceHandle> purged_resources_;
@@ -29,6 +29,41 @@
 
 namespace hwcomposer {
 
+static const size_t kMaxPlaneCacheEntries = 8;
+
+// Surfaces preallocated for the primary plane, one per buffer it cycles
+// through.
+static const size_t kPreallocatedSurfaces = 3;
+
+// Memory offscreen surfaces may use before free ones are released, in MB.
+// The budget always covers the preallocated surfaces, however large the
+// display is.
+#ifndef OFFSCREEN_SURFACE_BUDGET
+#define OFFSCREEN_SURFACE_BUDGET 64
+#endif
+
+static size_t GetSurfaceSize(const NativeSurface *surface) {
+  // Worst case of the formats we compose to.
+  return static_cast<size_t>(surface->GetWidth()) * surface->GetHeight() * 4;
+}
+
+// Groups all TestCommit calls of a validation pass, so that they can reuse
+// the same atomic request.
+class ScopedTestCommits {
+ public:
+  explicit ScopedTestCommits(DisplayPlaneHandler *plane_handler)
+      : plane_handler_(plane_handler) {
+    plane_handler_->BeginTestCommits();
+  }
+
+  ~ScopedTestCommits() {
+    plane_handler_->EndTestCommits();
+  }
+
+ private:
+  DisplayPlaneHandler *plane_handler_;
+};
+
 DisplayPlaneManager::DisplayPlaneManager(DisplayPlaneHandler *plane_handler,
                                          ResourceManager *resource_manager)
     : plane_handler_(plane_handler),
@@ -45,6 +80,7 @@ DisplayPlaneManager::~DisplayPlaneManager() {
 }
 
 void DisplayPlaneManager::ResizeOverlays() {
+  InvalidatePlaneCache();
   if (!overlay_planes_.empty()) {
     total_overlays_ = overlay_planes_.size();
     if (total_overlays_ > 1) {
@@ -71,9 +107,32 @@ bool DisplayPlaneManager::Initialize(uint32_t width, uint32_t height) {
   height_ = height;
   bool status = plane_handler_->PopulatePlanes(overlay_planes_);
   ResizeOverlays();
+  if (status)
+    PreallocateOffScreenTargets();
+
   return status;
 }
 
+void DisplayPlaneManager::PreallocateOffScreenTargets() {
+  if (overlay_planes_.empty() || !width_ || !height_)
+    return;
+
+  // The first surface validates the preferred modifier of the plane, or
+  // gets it blacklisted. The others use the modifier it was actually
+  // created with, so that all of them end up in the pool
+  // EnsureOffScreenTarget looks in.
+  DisplayPlane *plane = overlay_planes_.front().get();
+  uint32_t format = plane->GetPreferredFormat();
+  uint64_t modifier = plane->GetPreferredFormatModifier();
+  for (size_t i = surfaces_.size(); i < kPreallocatedSurfaces; i++) {
+    NativeSurface *surface =
+        CreateOffScreenTarget(plane, format, modifier, false);
+    modifier = surface->GetModifier();
+    // Not used by any plane yet.
+    surface->SetSurfaceAge(-1);
+  }
+}
+
 void DisplayPlaneManager::ResetPlanes(drmModeAtomicReqPtr pset) {
   for (auto j = overlay_planes_.begin(); j < overlay_planes_.end(); j++) {
     if (!j->get()->InUse()) {
@@ -83,12 +142,20 @@ void DisplayPlaneManager::ResetPlanes(drmModeAtomicReqPtr pset) {
   }
 }
 
+void DisplayPlaneManager::InvalidateCommittedPlaneState() {
+  for (auto j = overlay_planes_.begin(); j < overlay_planes_.end(); j++) {
+    DrmPlane *drmplane = (DrmPlane *)(j->get());
+    drmplane->InvalidateCommittedState();
+  }
+}
+
 bool DisplayPlaneManager::ValidateLayers(
     std::vector<OverlayLayer> &layers, int add_index, bool disable_overlay,
     DisplayPlaneStateList &composition,
     DisplayPlaneStateList &previous_composition,
     std::vector<NativeSurface *> &mark_later) {
   CTRACE();
+  ScopedTestCommits test_commits(plane_handler_);
 
   size_t video_layers = 0;
   if (total_overlays_ == 1)
@@ -136,12 +203,42 @@ bool DisplayPlaneManager::ValidateLayers(
     return true;
   }
 
+  // Full validation of a layer stack we have already seen, use the result
+  // of last time rather than testing all combinations again.
+  std::vector<size_t> signature;
+  bool full_validation = add_index <= 0 && composition.empty();
+  if (full_validation) {
+    // Which configurations a plane rejects depends on bandwidth used by
+    // the other planes, don't apply what was learned with another number
+    // of layers.
+    if (layers.size() != validated_layers_) {
+      plane_handler_->ResetRejectedConfigs();
+      validated_layers_ = layers.size();
+    }
+
+    GetLayerStackSignature(layers, signature);
+    if (ReplayCachedPlanes(layers, signature, composition)) {
+      plane_cache_hits_++;
+      IPLANECACHETRACE("Plane cache hit, hits: %d misses: %d",
+                       plane_cache_hits_, plane_cache_misses_);
+      return true;
+    }
+
+    plane_cache_misses_++;
+    IPLANECACHETRACE("Plane cache miss, hits: %d misses: %d",
+                     plane_cache_hits_, plane_cache_misses_);
+  }
+
   std::vector<OverlayLayer *> cursor_layers;
   auto layer_begin = layers.begin();
   auto layer_end = layers.end();
   bool validate_final_layers = false;
   bool test_commit_done = false;
   OverlayLayer *previous_layer = NULL;
+  // Squashing planes and falling back from the cursor plane recycle
+  // surfaces and move layers between planes, which ReplayCachedPlanes
+  // can't redo. Such results aren't cached.
+  bool cacheable = true;
 
   if (add_index > 0) {
     layer_begin = layers.begin() + add_index;
@@ -222,6 +319,8 @@ bool DisplayPlaneManager::ValidateLayers(
             size_t squashed_planes = SquashNonVideoPlanes(
                 layers, composition, mark_later, &validate_final_layers);
             j -= squashed_planes;
+            if (squashed_planes)
+              cacheable = false;
             if (squashed_planes && j > overlay_begin)
               plane = (j - 1)->get();
           }
@@ -269,6 +368,7 @@ bool DisplayPlaneManager::ValidateLayers(
             while (SquashPlanesAsNeeded(layers, composition, mark_later,
                                         &validate_final_layers)) {
               j--;
+              cacheable = false;
             }
           }
         }
@@ -287,13 +387,144 @@ bool DisplayPlaneManager::ValidateLayers(
         composition.pop_back();
         // fallback to GPU compostion for cursor layers
         composition.back().AddLayer(cursor_layers[0]);
+        cacheable = false;
       }
     }
   }
 
+  if (full_validation && cacheable)
+    CachePlanes(signature, composition);
+
   return true;
 }
 
+void DisplayPlaneManager::GetLayerStackSignature(
+    const std::vector<OverlayLayer> &layers,
+    std::vector<size_t> &signature) const {
+  signature.reserve(layers.size());
+  for (const OverlayLayer &layer : layers) {
+    size_t hash = 0;
+    OverlayBuffer *buffer = layer.GetBuffer();
+    if (buffer) {
+      hash_combine_hwc(hash, buffer->GetFormat());
+      hash_combine_hwc(hash, buffer->GetTilingMode());
+    }
+
+    // Position matters as well as planes can reject partially visible
+    // frames.
+    const HwcRect<int> &frame = layer.GetDisplayFrame();
+    hash_combine_hwc(hash, frame.left);
+    hash_combine_hwc(hash, frame.top);
+    hash_combine_hwc(hash, layer.GetDisplayFrameWidth());
+    hash_combine_hwc(hash, layer.GetDisplayFrameHeight());
+    hash_combine_hwc(hash, layer.GetSourceCropWidth());
+    hash_combine_hwc(hash, layer.GetSourceCropHeight());
+    hash_combine_hwc(hash, layer.GetMergedTransform());
+    hash_combine_hwc(hash, static_cast<size_t>(layer.GetBlending()));
+    hash_combine_hwc(hash, layer.GetAlpha());
+    hash_combine_hwc(hash, layer.GetZorder());
+    hash_combine_hwc(hash, layer.IsVideoLayer());
+    hash_combine_hwc(hash, layer.IsCursorLayer());
+    hash_combine_hwc(hash, layer.IsSolidColor());
+    signature.emplace_back(hash);
+  }
+}
+
+bool DisplayPlaneManager::ReplayCachedPlanes(
+    std::vector<OverlayLayer> &layers, const std::vector<size_t> &signature,
+    DisplayPlaneStateList &composition) {
+  auto entry = plane_cache_.begin();
+  for (; entry != plane_cache_.end(); ++entry) {
+    if (entry->layers_ == signature)
+      break;
+  }
+
+  if (entry == plane_cache_.end())
+    return false;
+
+  // Make sure layers which were scanned out directly still can be. None of
+  // these checks need a commit.
+  for (const CachedPlane &cached : entry->planes_) {
+    DisplayPlane *plane = overlay_planes_.at(cached.plane_index_).get();
+    if (cached.render_)
+      continue;
+
+    OverlayLayer *layer = &(layers.at(cached.source_layers_.at(0)));
+    OverlayBuffer *buffer = layer->GetBuffer();
+    if (!buffer || buffer->GetFb() == 0 || !plane->ValidateLayer(layer)) {
+      plane_cache_.erase(entry);
+      return false;
+    }
+  }
+
+  for (const CachedPlane &cached : entry->planes_) {
+    DisplayPlane *plane = overlay_planes_.at(cached.plane_index_).get();
+    const std::vector<size_t> &source_layers = cached.source_layers_;
+    OverlayLayer *layer = &(layers.at(source_layers.at(0)));
+    composition.emplace_back(plane, layer, this);
+    DisplayPlaneState &last_plane = composition.back();
+    size_t size = source_layers.size();
+    for (size_t i = 1; i < size; i++) {
+      last_plane.AddLayer(&(layers.at(source_layers.at(i))));
+    }
+
+    if (!cached.render_) {
+      layer->SupportedDisplayComposition(OverlayLayer::kAll);
+      continue;
+    }
+
+    layer->SupportedDisplayComposition(OverlayLayer::kGpu);
+    if (!last_plane.NeedsOffScreenComposition())
+      last_plane.ForceGPURendering();
+
+    if (cached.use_plane_scalar_)
+      last_plane.UsePlaneScalar(true, false);
+
+    // Results of ValidateForDownScaling and ValidateForDisplayTransform.
+    last_plane.SetDisplayDownScalingFactor(cached.downscaling_factor_, false);
+    last_plane.SetRotationType(cached.rotation_type_, false);
+  }
+
+  plane_cache_.splice(plane_cache_.begin(), plane_cache_, entry);
+  return true;
+}
+
+void DisplayPlaneManager::CachePlanes(
+    const std::vector<size_t> &signature,
+    const DisplayPlaneStateList &composition) {
+  PlaneCacheEntry entry;
+  entry.layers_ = signature;
+  for (const DisplayPlaneState &plane : composition) {
+    DisplayPlane *display_plane = plane.GetDisplayPlane();
+    size_t plane_index = 0;
+    size_t total_planes = overlay_planes_.size();
+    while (plane_index < total_planes &&
+           overlay_planes_.at(plane_index).get() != display_plane) {
+      plane_index++;
+    }
+
+    if (plane_index == total_planes)
+      return;
+
+    entry.planes_.emplace_back();
+    CachedPlane &cached = entry.planes_.back();
+    cached.plane_index_ = plane_index;
+    cached.source_layers_ = plane.GetSourceLayers();
+    cached.render_ = plane.NeedsOffScreenComposition();
+    cached.use_plane_scalar_ = plane.IsUsingPlaneScalar();
+    cached.downscaling_factor_ = plane.GetDownScalingFactor();
+    cached.rotation_type_ = plane.GetRotationType();
+  }
+
+  plane_cache_.emplace_front(std::move(entry));
+  if (plane_cache_.size() > kMaxPlaneCacheEntries)
+    plane_cache_.pop_back();
+}
+
+void DisplayPlaneManager::InvalidatePlaneCache() {
+  std::list<PlaneCacheEntry>().swap(plane_cache_);
+}
+
 DisplayPlaneState *DisplayPlaneManager::GetLastUsedOverlay(
     DisplayPlaneStateList &composition) {
   CTRACE();
@@ -438,7 +669,9 @@ void DisplayPlaneManager::ReleaseUnreservedPlanes(
 
 void DisplayPlaneManager::ReleaseAllOffScreenTargets() {
   CTRACE();
+  std::map<SurfaceKey, SurfacePool>().swap(surface_pools_);
   std::vector<std::unique_ptr<NativeSurface>>().swap(surfaces_);
+  surfaces_size_ = 0;
 }
 
 void DisplayPlaneManager::ReleaseFreeOffScreenTargets(bool forced) {
@@ -450,14 +683,37 @@ void DisplayPlaneManager::ReleaseFreeOffScreenTargets(bool forced) {
       "--release_surfaces_:%d, surfaces_.size() = %d",
       forced, release_surfaces_, surfaces_.size());
 #endif
-  std::vector<std::unique_ptr<NativeSurface>> surfaces;
-  for (auto &fb : surfaces_) {
-    if (fb->IsOnScreen()) {
-      surfaces.emplace_back(fb.release());
+  // Unless forced, keep free surfaces around for reuse while within budget
+  // and release the least recently used ones first.
+  size_t budget = 0;
+  if (!forced) {
+    size_t preallocated =
+        kPreallocatedSurfaces * static_cast<size_t>(width_) * height_ * 4;
+    budget = std::max(static_cast<size_t>(OFFSCREEN_SURFACE_BUDGET) << 20,
+                      preallocated);
+  }
+  if (surfaces_size_ > budget) {
+    std::vector<PooledSurface> free_surfaces;
+    for (auto &pool : surface_pools_) {
+      for (const PooledSurface &pooled : pool.second) {
+        if (!pooled.surface_->IsOnScreen())
+          free_surfaces.emplace_back(pooled);
+      }
+    }
+
+    std::sort(free_surfaces.begin(), free_surfaces.end(),
+              [](const PooledSurface &lhs, const PooledSurface &rhs) {
+                return lhs.last_used_ < rhs.last_used_;
+              });
+
+    for (const PooledSurface &pooled : free_surfaces) {
+      if (surfaces_size_ <= budget)
+        break;
+
+      DestroyOffScreenTarget(pooled.surface_);
     }
   }
 
-  surfaces.swap(surfaces_);
 #ifdef SURFACE_RECYCLE_TRACING
   ISURFACERECYCLETRACE(
       "After ReleaseFreeOffScreenTargets surfaces_.size() = %d",
@@ -466,13 +722,110 @@ void DisplayPlaneManager::ReleaseFreeOffScreenTargets(bool forced) {
   release_surfaces_ = false;
 }
 
+NativeSurface *DisplayPlaneManager::CreateOffScreenTarget(DisplayPlane *plane,
+                                                          uint32_t format,
+                                                          uint64_t modifier,
+                                                          bool video) {
+  NativeSurface *new_surface = NULL;
+  uint32_t usage = hwcomposer::kLayerNormal;
+  if (video) {
+#ifdef SURFACE_RECYCLE_TRACING
+    ISURFACERECYCLETRACE("CreateVideoSurface for plane[%d]", plane->id());
+#endif
+    new_surface = CreateVideoSurface(width_, height_);
+    usage = hwcomposer::kLayerVideo;
+  } else {
+#ifdef SURFACE_RECYCLE_TRACING
+    ISURFACERECYCLETRACE("Create3DSurface for plane[%d]", plane->id());
+#endif
+    new_surface = Create3DSurface(width_, height_);
+  }
+
+  bool modifer_succeeded = false;
+  new_surface->Init(resource_manager_, format, usage, modifier,
+                    &modifer_succeeded);
+  if (video)
+    new_surface->GetLayer()->SetVideoLayer(true);
+
+  if (modifer_succeeded) {
+    plane->PreferredFormatModifierValidated();
+  } else {
+    plane->BlackListPreferredFormatModifier();
+  }
+
+  PooledSurface pooled;
+  pooled.surface_ = new_surface;
+  pooled.last_used_ = ++surface_clock_;
+  surface_pools_[SurfaceKey(format, new_surface->GetModifier())].emplace_back(
+      pooled);
+  surfaces_size_ += GetSurfaceSize(new_surface);
+
+  surfaces_.emplace_back(new_surface);
+#ifdef SURFACE_RECYCLE_TRACING
+  ISURFACERECYCLETRACE("Add new surface into surfaces_[%d]", surfaces_.size());
+#endif
+  return new_surface;
+}
+
+NativeSurface *DisplayPlaneManager::AcquireOffScreenTarget(uint32_t format,
+                                                           uint64_t modifier) {
+  auto it = surface_pools_.find(SurfaceKey(format, modifier));
+  if (it == surface_pools_.end())
+    return NULL;
+
+  // Least recently used surfaces are the most likely ones to be free.
+  SurfacePool &pool = it->second;
+  for (size_t i = 0; i < pool.size(); i++) {
+    NativeSurface *surface = pool[i].surface_;
+    if (surface->GetSurfaceAge() != -1 || !surface->GetLayer()->GetBuffer())
+      continue;
+
+    PooledSurface pooled = pool[i];
+    pooled.last_used_ = ++surface_clock_;
+    pool.erase(pool.begin() + i);
+    pool.emplace_back(pooled);
+    return surface;
+  }
+
+  return NULL;
+}
+
+void DisplayPlaneManager::DestroyOffScreenTarget(NativeSurface *surface) {
+  for (auto pool = surface_pools_.begin(); pool != surface_pools_.end();
+       pool++) {
+    SurfacePool &surfaces = pool->second;
+    auto it = std::find_if(surfaces.begin(), surfaces.end(),
+                           [surface](const PooledSurface &pooled) {
+                             return pooled.surface_ == surface;
+                           });
+    if (it == surfaces.end())
+      continue;
+
+    surfaces.erase(it);
+    if (surfaces.empty())
+      surface_pools_.erase(pool);
+
+    break;
+  }
+
+  surfaces_size_ -= GetSurfaceSize(surface);
+  for (auto it = surfaces_.begin(); it != surfaces_.end(); it++) {
+    if (it->get() == surface) {
+      surfaces_.erase(it);
+      break;
+    }
+  }
+}
+
 void DisplayPlaneManager::SetDisplayTransform(uint32_t transform) {
+  if (display_transform_ != transform)
+    InvalidatePlaneCache();
+
   display_transform_ = transform;
 }
 
 void DisplayPlaneManager::EnsureOffScreenTarget(DisplayPlaneState &plane,
                                                 bool force_normal_surface) {
-  NativeSurface *surface = NULL;
   // We only use media formats when video compostion for 1 layer
   int dest_x = plane.GetDisplayFrame().left;
   int dest_w = plane.GetDisplayFrame().right - dest_x;
@@ -480,7 +833,6 @@ void DisplayPlaneManager::EnsureOffScreenTarget(DisplayPlaneState &plane,
   bool video_separate =
       plane.IsVideoPlane() && (plane.GetSourceLayers().size() == 1);
   uint32_t preferred_format = 0;
-  uint32_t usage = hwcomposer::kLayerNormal;
   if (video_separate && !(dest_w % 2 || dest_x % 2) && !force_normal_surface) {
     preferred_format = plane.GetDisplayPlane()->GetPreferredVideoFormat();
   } else {
@@ -491,68 +843,18 @@ void DisplayPlaneManager::EnsureOffScreenTarget(DisplayPlaneState &plane,
       plane.GetDisplayPlane()->GetPreferredFormatModifier();
   if (plane.IsVideoPlane())
     preferred_modifier = 0;
-  size_t surface_index = 0;
-  for (auto &srf : surfaces_) {
-    if (srf->GetSurfaceAge() == -1) {
-      OverlayBuffer *layer_buffer = srf->GetLayer()->GetBuffer();
-      if (!layer_buffer) {
-#ifdef SURFACE_RECYCLE_TRACING
-        ISURFACERECYCLETRACE(
-            "Layer buffer is null, skip surface[%d] for plane[%d]/layer",
-            surface_index, plane.GetDisplayPlane()->id());
-#endif
-        surface_index++;
-        continue;
-      }
-      uint32_t surface_format = layer_buffer->GetFormat();
-      if ((preferred_format == surface_format) &&
-          (preferred_modifier == srf->GetModifier())) {
-#ifdef SURFACE_RECYCLE_TRACING
-        ISURFACERECYCLETRACE("Reuse surface[%d] for the plane[%d].",
-                             surface_index, plane.GetDisplayPlane()->id());
-#endif
-        surface = srf.get();
-        break;
-      }
-    }
-    surface_index++;
-  }
-
-  if (!surface) {
-    NativeSurface *new_surface = NULL;
-    if (video_separate && !force_normal_surface) {
-#ifdef SURFACE_RECYCLE_TRACING
-      ISURFACERECYCLETRACE("CreateVideoSurface for plane[%d]",
-                           plane.GetDisplayPlane()->id());
-#endif
-      new_surface = CreateVideoSurface(width_, height_);
-      usage = hwcomposer::kLayerVideo;
-    } else {
-#ifdef SURFACE_RECYCLE_TRACING
-      ISURFACERECYCLETRACE("Create3DSurface for plane[%d]",
-                           plane.GetDisplayPlane()->id());
-#endif
-      new_surface = Create3DSurface(width_, height_);
-    }
-
-    bool modifer_succeeded = false;
-    new_surface->Init(resource_manager_, preferred_format, usage,
-                      preferred_modifier, &modifer_succeeded);
-    if (video_separate)
-      new_surface->GetLayer()->SetVideoLayer(true);
 
-    if (modifer_succeeded) {
-      plane.GetDisplayPlane()->PreferredFormatModifierValidated();
-    } else {
-      plane.GetDisplayPlane()->BlackListPreferredFormatModifier();
-    }
-
-    surfaces_.emplace_back(std::move(new_surface));
+  NativeSurface *surface =
+      AcquireOffScreenTarget(preferred_format, preferred_modifier);
+  if (surface) {
 #ifdef SURFACE_RECYCLE_TRACING
-    ISURFACERECYCLETRACE("Add new surface into surfaces_[%d]",
-                         surfaces_.size());
+    ISURFACERECYCLETRACE("Reuse surface for the plane[%d].",
+                         plane.GetDisplayPlane()->id());
 #endif
-    surface = surfaces_.back().get();
+  } else {
+    surface = CreateOffScreenTarget(plane.GetDisplayPlane(), preferred_format,
+                                    preferred_modifier,
+                                    video_separate && !force_normal_surface);
   }
 
   surface->SetPlaneTarget(plane);
@@ -749,6 +1051,7 @@ bool DisplayPlaneManager::ReValidatePlanes(
       "ReValidatePlanes called needs_revalidation_checks %d re_validate_commit "
       "%d  \n",
       needs_revalidation_checks, re_validate_commit);
+  ScopedTestCommits test_commits(plane_handler_);
   // Let's first check the current combination works.
   *request_full_validation = false;
   bool render = false;
@@ -17,6 +17,7 @@
 #ifndef COMMON_DISPLAY_DISPLAYPLANEMANAGER_H_
 #define COMMON_DISPLAY_DISPLAYPLANEMANAGER_H_
 
+#include <list>
 #include <map>
 #include <memory>
 #include <tuple>
@@ -72,6 +73,10 @@ class DisplayPlaneManager {
 
   void ReleaseAllOffScreenTargets();
 
+  // Allocates offscreen surfaces for the primary plane up front, so that
+  // the first composited frame doesn't need to allocate any.
+  void PreallocateOffScreenTargets();
+
   bool HasSurfaces() const {
     return !surfaces_.empty();
   }
@@ -121,10 +126,53 @@ class DisplayPlaneManager {
 
   void ResetPlanes(drmModeAtomicReqPtr pset);
 
+  // Makes all planes add their full state to the next commit.
+  void InvalidateCommittedPlaneState();
+
   void EnsureOffScreenTarget(DisplayPlaneState &plane,
                              bool force_normal_surface = false);
 
+  // Drops all plane combinations remembered by ValidateLayers. Needs to be
+  // called when a combination which passed TEST_ONLY commit fails later.
+  void InvalidatePlaneCache();
+
+  uint32_t GetPlaneCacheHits() const {
+    return plane_cache_hits_;
+  }
+
+  uint32_t GetPlaneCacheMisses() const {
+    return plane_cache_misses_;
+  }
+
  private:
+  // Layers to plane mapping of a validated layer stack.
+  struct CachedPlane {
+    size_t plane_index_;
+    std::vector<size_t> source_layers_;
+    bool render_;
+    bool use_plane_scalar_;
+    uint32_t downscaling_factor_;
+    DisplayPlaneState::RotationType rotation_type_;
+  };
+
+  struct PlaneCacheEntry {
+    // Per layer signature of the layer stack.
+    std::vector<size_t> layers_;
+    std::vector<CachedPlane> planes_;
+  };
+
+  void GetLayerStackSignature(const std::vector<OverlayLayer> &layers,
+                              std::vector<size_t> &signature) const;
+
+  // Tries to replay a previously validated combination for layers. Returns
+  // false if none is cached or it's no longer usable.
+  bool ReplayCachedPlanes(std::vector<OverlayLayer> &layers,
+                          const std::vector<size_t> &signature,
+                          DisplayPlaneStateList &composition);
+
+  void CachePlanes(const std::vector<size_t> &signature,
+                   const DisplayPlaneStateList &composition);
+
   DisplayPlaneState *GetLastUsedOverlay(DisplayPlaneStateList &composition);
   bool FallbacktoGPU(DisplayPlane *target_plane, OverlayLayer *layer,
                      const DisplayPlaneStateList &composition) const;
@@ -154,10 +202,34 @@ class DisplayPlaneManager {
 
   void ResizeOverlays();
 
+  // Offscreen surface handed out by EnsureOffScreenTarget.
+  struct PooledSurface {
+    NativeSurface *surface_;
+    // Value of surface_clock_ when the surface was last handed out.
+    uint32_t last_used_;
+  };
+
+  // Surfaces of one format and modifier, least recently used first.
+  typedef std::vector<PooledSurface> SurfacePool;
+  typedef std::pair<uint32_t, uint64_t> SurfaceKey;
+
+  NativeSurface *CreateOffScreenTarget(DisplayPlane *plane, uint32_t format,
+                                       uint64_t modifier, bool video);
+
+  // Returns a free surface of format and modifier, if any.
+  NativeSurface *AcquireOffScreenTarget(uint32_t format, uint64_t modifier);
+
+  // Frees the surface and removes it from surface_pools_ and surfaces_.
+  void DestroyOffScreenTarget(NativeSurface *surface);
+
   DisplayPlaneHandler *plane_handler_;
   ResourceManager *resource_manager_;
   DisplayPlane *cursor_plane_;
   std::vector<std::unique_ptr<NativeSurface>> surfaces_;
+  std::map<SurfaceKey, SurfacePool> surface_pools_;
+  // Memory used by surfaces_, in bytes.
+  size_t surfaces_size_ = 0;
+  uint32_t surface_clock_ = 0;
   std::vector<std::unique_ptr<DisplayPlane>> overlay_planes_;
 
   uint32_t width_;
@@ -165,6 +237,12 @@ class DisplayPlaneManager {
   uint32_t total_overlays_;
   uint32_t display_transform_;
   bool release_surfaces_;
+  // Most recently used combination first.
+  std::list<PlaneCacheEntry> plane_cache_;
+  uint32_t plane_cache_hits_ = 0;
+  uint32_t plane_cache_misses_ = 0;
+  // Number of layers of the last fully validated layer stack.
+  size_t validated_layers_ = 0;
 };
 
 }  // namespace hwcomposer
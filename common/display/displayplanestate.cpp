@@ -263,6 +263,8 @@ void DisplayPlaneState::RefreshLayerRects(
   HwcRect<int> target_display_frame;
   HwcRect<float> target_source_crop;
   HwcRect<int> surface_damage = HwcRect<int>(0, 0, 0, 0);
+  HwcRegion damage_region;
+  HwcRegion layer_region;
   for (const size_t &index : current_layers) {
     const OverlayLayer &layer = layers.at(index);
     const HwcRect<int> &df = layer.GetDisplayFrame();
@@ -272,6 +274,10 @@ void DisplayPlaneState::RefreshLayerRects(
 
     if (layer.HasLayerContentChanged()) {
       CalculateRect(layer.GetSurfaceDamage(), surface_damage);
+      layer.GetSurfaceDamageRegion(layer_region);
+      for (const HwcRect<int> &rect : layer_region) {
+        AddRectToRegion(rect, damage_region);
+      }
     }
   }
 
@@ -293,7 +299,7 @@ void DisplayPlaneState::RefreshLayerRects(
 
   if (!surface_damage.empty()) {
     for (NativeSurface *surface : private_data_->surfaces_) {
-      surface->UpdateSurfaceDamage(surface_damage, true);
+      surface->UpdateSurfaceDamage(damage_region, true);
     }
 
     RefreshSurfaces(NativeSurface::kPartialClear);
@@ -373,6 +379,19 @@ NativeSurface *DisplayPlaneState::GetOffScreenTarget() const {
   return private_data_->surfaces_.at(0);
 }
 
+NativeSurface *DisplayPlaneState::GetNextOffScreenTarget() const {
+  size_t size = private_data_->surfaces_.size();
+  if (size == 0) {
+    return NULL;
+  }
+
+  if (!surface_swapped_ && size == 3) {
+    return private_data_->surfaces_.at(2);
+  }
+
+  return private_data_->surfaces_.at(0);
+}
+
 void DisplayPlaneState::SwapSurfaceIfNeeded() {
   if (surface_swapped_) {
     return;
@@ -517,9 +536,22 @@ void DisplayPlaneState::ResetCompositionRegion() {
   if (!private_data_->composition_region_.empty())
     std::vector<CompositionRegion>().swap(private_data_->composition_region_);
 
+  if (!private_data_->render_states_.empty())
+    std::vector<RenderState>().swap(private_data_->render_states_);
+
+  private_data_->composition_geometry_ = CompositionGeometry();
+
   recycled_surface_ = false;
 }
 
+CompositionGeometry &DisplayPlaneState::GetCompositionGeometry() {
+  return private_data_->composition_geometry_;
+}
+
+std::vector<RenderState> &DisplayPlaneState::GetRenderStates() {
+  return private_data_->render_states_;
+}
+
 bool DisplayPlaneState::IsCursorPlane() const {
   return private_data_->type_ == DisplayPlanePrivateState::PlaneType::kCursor;
 }
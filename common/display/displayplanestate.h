@@ -24,6 +24,7 @@
 #include "displayplane.h"
 #include "nativesurface.h"
 #include "overlaylayer.h"
+#include "renderstate.h"
 
 namespace hwcomposer {
 
@@ -96,6 +97,10 @@ class DisplayPlaneState {
 
   NativeSurface *GetOffScreenTarget() const;
 
+  // Returns the surface GetOffScreenTarget() returns once
+  // SwapSurfaceIfNeeded() has been called.
+  NativeSurface *GetNextOffScreenTarget() const;
+
   // Returns all NativeSurfaces associated with this plane.
   // These can be empty if the plane doesn't need to go
   // through any composition pass before being scanned out.
@@ -130,6 +135,14 @@ class DisplayPlaneState {
   // Resets composition region to null.
   void ResetCompositionRegion();
 
+  // Layer geometry the composition region and render states were
+  // calculated for.
+  CompositionGeometry &GetCompositionGeometry();
+
+  // Render states of the composition region. These stay valid as long as
+  // the geometry doesn't change.
+  std::vector<RenderState> &GetRenderStates();
+
   bool IsCursorPlane() const;
 
   bool HasCursorLayer() const;
@@ -268,6 +281,8 @@ class DisplayPlaneState {
     HwcRect<float> source_crop_;
     std::vector<size_t> source_layers_;
     std::vector<CompositionRegion> composition_region_;
+    CompositionGeometry composition_geometry_;
+    std::vector<RenderState> render_states_;
 
     bool use_plane_scalar_ = false;
     // Even if layer can be scanned out
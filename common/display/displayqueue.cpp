@@ -20,6 +20,7 @@
 #include <hwclayer.h>
 #include <math.h>
 #include <sys/time.h>
+#include <time.h>
 #include <vector>
 
 #include "displayplanemanager.h"
@@ -35,6 +36,15 @@
 
 namespace hwcomposer {
 
+// Time the kernel needs between a commit and the vblank it is latched on.
+static const int64_t kCommitSlackNs = 1000 * 1000;
+
+static int64_t GetMonotonicTime() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec * 1000 * 1000 * 1000 + ts.tv_nsec;
+}
+
 DisplayQueue::DisplayQueue(uint32_t gpu_fd, bool disable_explictsync,
                            NativeBufferHandler* buffer_handler,
                            PhysicalDisplay* display)
@@ -108,6 +118,9 @@ bool DisplayQueue::SetPowerMode(uint32_t power_mode) {
       state_ |= kPoweredOn | kConfigurationChanged | kNeedsColorCorrection |
                 kCanvasColorChanged;
       vblank_handler_->SetPowerMode(kOn);
+      // Surfaces were released when powering off.
+      if (display_plane_manager_)
+        display_plane_manager_->PreallocateOffScreenTargets();
       power_mode_lock_.lock();
       state_ &= ~kIgnoreIdleRefresh;
       compositor_.Init(resource_manager_.get(), gpu_fd_);
@@ -365,11 +378,18 @@ bool DisplayQueue::AssignAndCommitPlanes(
 
   // Handle any 3D Composition.
   if (render_layers) {
+#ifdef ENABLE_ASYNC_COMMIT
+    WaitForReusedSurfaces(current_composition_planes);
+#endif
     compositor_.BeginFrame(disable_explictsync);
-    // Prepare for final composition.
+    // Prepare for final composition. This only queues the draw calls, the
+    // display waits for them through WaitForDraw once the plane properties
+    // of the commit are set.
     if (!compositor_.Draw(current_composition_planes, layers)) {
       ETRACE("Failed to prepare for the frame composition. ");
       composition_passed = false;
+    } else {
+      draw_pending_ = true;
     }
   }
 
@@ -395,6 +415,12 @@ bool DisplayQueue::AssignAndCommitPlanes(
   int32_t fence = 0;
   bool fence_released = false;
   if (!IsIgnoreUpdates()) {
+#ifdef ENABLE_ASYNC_COMMIT
+    // Commit takes ownership of kms_fence_.
+    if (previous_kms_fence_ > 0)
+      close(previous_kms_fence_);
+    previous_kms_fence_ = kms_fence_ > 0 ? dup(kms_fence_) : 0;
+#endif
     composition_passed = display_->Commit(
         current_composition_planes, previous_plane_state_, disable_explictsync,
         kms_fence_, &fence, &fence_released);
@@ -404,6 +430,13 @@ bool DisplayQueue::AssignAndCommitPlanes(
     kms_fence_ = 0;
   }
 
+  // Commit may have bailed out before it got to wait for the draw, it must
+  // not stay pending past this frame.
+  if (!WaitForDraw()) {
+    ETRACE("Failed to compose the frame. ");
+    composition_passed = false;
+  }
+
   if (!composition_passed) {
     DumpCurrentDisplayPlaneList(current_composition_planes);
     last_commit_failed_update_ = true;
@@ -481,6 +514,7 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     return true;
   }
 
+  int64_t present_start = GetMonotonicTime();
   ScopedIdleStateTracker tracker(idle_tracker_, compositor_,
                                  resource_manager_.get(), this);
   if (tracker.IgnoreUpdate()) {
@@ -561,10 +595,23 @@ bool DisplayQueue::QueueUpdate(std::vector<HwcLayer*>& source_layers,
     call_back->Synchronize();
   }
 
-  return AssignAndCommitPlanes(
+  bool success = AssignAndCommitPlanes(
       layers, &source_layers, validate_layers, re_validate_begin,
       force_media_composition && requested_video_effect, retire_fence,
       &tracker);
+
+  present_time_lock_.lock();
+  present_time_.AddSample(GetMonotonicTime() - present_start);
+  present_time_lock_.unlock();
+  return success;
+}
+
+bool DisplayQueue::WaitForDraw() {
+  if (!draw_pending_)
+    return true;
+
+  draw_pending_ = false;
+  return compositor_.WaitForDraw();
 }
 
 void DisplayQueue::PresentClonedCommit(DisplayQueue* queue) {
@@ -690,10 +737,15 @@ void DisplayQueue::ResetPlanes(drmModeAtomicReqPtr pset) {
   display_plane_manager_->ResetPlanes(pset);
 }
 
+void DisplayQueue::InvalidateCommittedPlaneState() {
+  display_plane_manager_->InvalidateCommittedPlaneState();
+}
+
 void DisplayQueue::IgnoreUpdates() {
   idle_tracker_.idle_frames_ = 0;
   idle_tracker_.state_ = FrameStateTracker::kIgnoreUpdates;
   idle_tracker_.revalidate_frames_counter_ = 0;
+  vblank_handler_->RequestVblank();
 }
 
 bool DisplayQueue::IsIgnoreUpdates() {
@@ -702,6 +754,11 @@ bool DisplayQueue::IsIgnoreUpdates() {
 
 void DisplayQueue::HandleCommitFailure(
     DisplayPlaneStateList& current_composition_planes) {
+  // Combination might have come from the plane cache, make sure we don't
+  // replay it again.
+  display_plane_manager_->InvalidatePlaneCache();
+  // We don't know what made it to screen, resync all plane properties.
+  display_plane_manager_->InvalidateCommittedPlaneState();
   for (DisplayPlaneState& plane : current_composition_planes) {
     if (plane.GetSurfaces().empty()) {
       continue;
@@ -779,6 +836,36 @@ void DisplayQueue::UpdateOnScreenSurfaces() {
   }
 }
 
+#ifdef ENABLE_ASYNC_COMMIT
+// Commits are queued, so when rendering a frame the previous one might not
+// be on screen yet and the one before it might still be waiting for its
+// flip. Surfaces rendered to by the previous frame (age 1 or more) are off
+// screen once kms_fence_ signals, older ones once previous_kms_fence_ does.
+// The latter usually has signaled already, so GPU composition only blocks
+// when a plane reuses a surface which is still queued or on screen.
+void DisplayQueue::WaitForReusedSurfaces(const DisplayPlaneStateList& planes) {
+  int32_t fence = 0;
+  for (const DisplayPlaneState& plane : planes) {
+    if (!plane.NeedsOffScreenComposition())
+      continue;
+
+    NativeSurface* surface = plane.GetNextOffScreenTarget();
+    if (!surface)
+      continue;
+
+    if (surface->GetSurfaceAge() > 0) {
+      fence = kms_fence_;
+      break;
+    }
+
+    fence = previous_kms_fence_;
+  }
+
+  if (fence > 0)
+    HWCPoll(fence, -1);
+}
+#endif
+
 void DisplayQueue::SetReleaseFenceToLayers(
     int32_t fence, std::vector<HwcLayer*>& source_layers) {
   for (const DisplayPlaneState& plane : previous_plane_state_) {
@@ -837,6 +924,13 @@ void DisplayQueue::HandleExit() {
     kms_fence_ = 0;
   }
 
+#ifdef ENABLE_ASYNC_COMMIT
+  if (previous_kms_fence_ > 0) {
+    close(previous_kms_fence_);
+    previous_kms_fence_ = 0;
+  }
+#endif
+
   bool disable_explictsync = false;
   if (state_ & kDisableExplictSync) {
     disable_explictsync = true;
@@ -963,17 +1057,32 @@ void DisplayQueue::RegisterRefreshCallback(
   refresh_callback_ = callback;
   refrsh_display_id_ = display_id;
   idle_tracker_.idle_lock_.unlock();
+  vblank_handler_->RequestVblank();
 }
 
 void DisplayQueue::VSyncControl(bool enabled) {
   vblank_handler_->VSyncControl(enabled);
 }
 
-void DisplayQueue::HandleIdleCase() {
+bool DisplayQueue::GetPresentDeadline(int64_t* deadline, int64_t* vblank) {
+  present_time_lock_.lock();
+  int64_t margin = present_time_.GetEstimate() + kCommitSlackNs;
+  present_time_lock_.unlock();
+
+  if (!vblank_handler_->PredictNextVblank(GetMonotonicTime() + margin,
+                                          vblank)) {
+    return false;
+  }
+
+  *deadline = *vblank - margin;
+  return true;
+}
+
+bool DisplayQueue::HandleIdleCase() {
   idle_tracker_.idle_lock_.lock();
   if (idle_tracker_.state_ & FrameStateTracker::kPrepareComposition) {
     idle_tracker_.idle_lock_.unlock();
-    return;
+    return false;
   }
 
   if (idle_tracker_.total_planes_ <= 1 ||
@@ -981,18 +1090,18 @@ void DisplayQueue::HandleIdleCase() {
       (idle_tracker_.state_ & FrameStateTracker::kRevalidateLayers) ||
       idle_tracker_.has_cursor_layer_) {
     idle_tracker_.idle_lock_.unlock();
-    return;
+    return false;
   }
 
   if (idle_tracker_.idle_frames_ > kidleframes) {
     idle_tracker_.idle_lock_.unlock();
-    return;
+    return false;
   }
 
   if (idle_tracker_.idle_frames_ < kidleframes) {
     idle_tracker_.idle_frames_++;
     idle_tracker_.idle_lock_.unlock();
-    return;
+    return true;
   }
 
   idle_tracker_.idle_frames_++;
@@ -1004,6 +1113,7 @@ void DisplayQueue::HandleIdleCase() {
   }
   power_mode_lock_.unlock();
   idle_tracker_.idle_lock_.unlock();
+  return false;
 }
 
 void DisplayQueue::ForceRefresh() {
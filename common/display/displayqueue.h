@@ -32,6 +32,7 @@
 #include "platformdefines.h"
 #include "resourcemanager.h"
 #include "vblankeventhandler.h"
+#include "vsyncpredictor.h"
 
 namespace hwcomposer {
 struct gamma_colors {
@@ -91,7 +92,14 @@ class DisplayQueue {
 
   void VSyncControl(bool enabled);
 
-  void HandleIdleCase();
+  // Latest time a frame can be queued to be shown on the predicted vblank,
+  // based on how long frames have taken to compose and commit so far. Only
+  // reported to clients, commits are never held back till the deadline.
+  bool GetPresentDeadline(int64_t* deadline, int64_t* vblank);
+
+  // Counts idle frames on a vblank. Returns true in case the next vblank
+  // needs to be counted as well.
+  bool HandleIdleCase();
 
   void DisplayConfigurationChanged();
 
@@ -112,6 +120,14 @@ class DisplayQueue {
 
   void ResetPlanes(drmModeAtomicReqPtr pset);
 
+  // Makes all planes add their full state to the next commit.
+  void InvalidateCommittedPlaneState();
+
+  // Waits for the composition queued for the frame being committed, if
+  // any. Called by the display once the plane properties are set, right
+  // before the in fences are added and the request is committed.
+  bool WaitForDraw();
+
   void PresentClonedCommit(DisplayQueue* queue);
 
   const DisplayPlaneStateList& GetCurrentCompositionPlanes() const {
@@ -293,6 +309,9 @@ class DisplayQueue {
       tracker_.total_planes_ = queue_->previous_plane_state_.size();
       tracker_.idle_lock_.unlock();
 
+      // Idle frames are counted on vblanks, restart them.
+      queue_->vblank_handler_->RequestVblank();
+
       // Free any surfaces.
       queue_->display_plane_manager_->ReleaseFreeOffScreenTargets(forced_);
 
@@ -348,6 +367,12 @@ class DisplayQueue {
 
   void UpdateOnScreenSurfaces();
 
+#ifdef ENABLE_ASYNC_COMMIT
+  // Waits till the offscreen surfaces about to be rendered to by planes
+  // are no longer scanned out.
+  void WaitForReusedSurfaces(const DisplayPlaneStateList& planes);
+#endif
+
   // Re-initialize all state. When we are hearing this means the
   // queue is teraing down or re-started for some reason.
   void ResetQueue();
@@ -373,6 +398,10 @@ class DisplayQueue {
   HWCColorTransform color_transform_hint_;
   uint32_t contrast_;
   int32_t kms_fence_ = 0;
+#ifdef ENABLE_ASYNC_COMMIT
+  // Retire fence of the frame queued before the one of kms_fence_.
+  int32_t previous_kms_fence_ = 0;
+#endif
   struct gamma_colors gamma_;
   struct canvas_color_comps canvas_;
   std::unique_ptr<VblankEventHandler> vblank_handler_;
@@ -394,10 +423,15 @@ class DisplayQueue {
   bool handle_display_initializations_ = true;
   uint32_t plane_transform_ = kIdentity;
   SpinLock video_lock_;
+  // Time taken by QueueUpdate to compose and queue a frame.
+  SpinLock present_time_lock_;
+  DurationEstimator present_time_;
   bool requested_video_effect_ = false;
   bool video_effect_changed_ = false;
   // Set to true when layers are validated and commit fails.
   bool last_commit_failed_update_ = false;
+  // Draw of the current frame has been queued and not waited for yet.
+  bool draw_pending_ = false;
   // Set to true if cloned display needs to be validated.
   bool needs_clone_validation_ = false;
   bool clone_mode_ = false;
@@ -21,44 +21,69 @@
 
 #include "displayqueue.h"
 #include "hwctrace.h"
+#include "vblankservice.h"
 
 namespace hwcomposer {
 
 static const int64_t kOneSecondNs = 1 * 1000 * 1000 * 1000;
 
 VblankEventHandler::VblankEventHandler(DisplayQueue* queue)
-    : HWCThread(-8, "VblankEventHandler"),
-      display_(0),
+    : display_(0),
       enabled_(false),
       fd_(-1),
+      pipe_(0),
+      service_id_(0),
       last_timestamp_(-1),
       queue_(queue) {
-  memset(&type_, 0, sizeof(type_));
 }
 
 VblankEventHandler::~VblankEventHandler() {
+  SetPowerMode(kOff);
 }
 
 void VblankEventHandler::Init(int fd, int pipe) {
   fd_ = fd;
-  uint32_t high_crtc = (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
-  type_ = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE |
-                             (high_crtc & DRM_VBLANK_HIGH_CRTC_MASK));
+  pipe_ = pipe;
 }
 
 bool VblankEventHandler::SetPowerMode(uint32_t power_mode) {
   if (power_mode != kOn) {
-    Exit();
+    spin_lock_.lock();
+    uint32_t id = service_id_;
+    service_id_ = 0;
+    predictor_.Reset();
+    spin_lock_.unlock();
+    // Can't hold spin_lock_ here, Unregister waits for HandleVblank.
+    if (id)
+      VblankService::GetInstance().Unregister(id);
   } else {
-    if (!InitWorker()) {
-      ETRACE("Failed to initalize thread for VblankEventHandler. %s",
-             PRINTERROR());
+    spin_lock_.lock();
+    bool registered = service_id_ != 0;
+    spin_lock_.unlock();
+    if (!registered) {
+      uint32_t id = VblankService::GetInstance().Register(fd_, pipe_, this);
+      if (!id)
+        ETRACE("Failed to register pipe %d with VblankService.", pipe_);
+
+      spin_lock_.lock();
+      service_id_ = id;
+      spin_lock_.unlock();
     }
+
+    RequestVblank();
   }
 
   return true;
 }
 
+void VblankEventHandler::RequestVblank() {
+  spin_lock_.lock();
+  uint32_t id = service_id_;
+  spin_lock_.unlock();
+  if (id)
+    VblankService::GetInstance().RequestVblank(id);
+}
+
 int VblankEventHandler::RegisterCallback(
     std::shared_ptr<VsyncCallback> callback, uint32_t display) {
   spin_lock_.lock();
@@ -66,6 +91,7 @@ int VblankEventHandler::RegisterCallback(
   display_ = display;
   last_timestamp_ = -1;
   spin_lock_.unlock();
+  RequestVblank();
   return 0;
 }
 
@@ -79,9 +105,17 @@ int VblankEventHandler::VSyncControl(bool enabled) {
   last_timestamp_ = -1;
   spin_lock_.unlock();
 
+  if (enabled)
+    RequestVblank();
+
   return 0;
 }
 
+bool VblankEventHandler::PredictNextVblank(int64_t time, int64_t* vblank) {
+  ScopedSpinLock lock(spin_lock_);
+  return predictor_.PredictNextVblank(time, vblank);
+}
+
 void VblankEventHandler::HandlePageFlipEvent(unsigned int sec,
                                              unsigned int usec) {
   int64_t timestamp = ((int64_t)sec * kOneSecondNs) + ((int64_t)usec * 1000);
@@ -92,28 +126,21 @@ void VblankEventHandler::HandlePageFlipEvent(unsigned int sec,
   IPAGEFLIPEVENTTRACE("Callback called from HandlePageFlipEvent. %lu",
                       timestamp);
   spin_lock_.lock();
+  predictor_.AddTimestamp(timestamp);
   if (enabled_ && callback_) {
     callback_->Callback(display_, timestamp);
   }
   spin_lock_.unlock();
 }
 
-void VblankEventHandler::HandleWait() {
-}
-
-void VblankEventHandler::HandleRoutine() {
-  queue_->HandleIdleCase();
-
-  drmVBlank vblank;
-  memset(&vblank, 0, sizeof(vblank));
-  vblank.request.sequence = 1;
+bool VblankEventHandler::HandleVblank(unsigned int sec, unsigned int usec) {
+  HandlePageFlipEvent(sec, usec);
+  bool needs_vblank = queue_->HandleIdleCase();
 
-  int fd = fd_;
-  vblank.request.type = type_;
-
-  int ret = drmWaitVBlank(fd, &vblank);
-  if (!ret)
-    HandlePageFlipEvent(vblank.reply.tval_sec, (int64_t)vblank.reply.tval_usec);
+  spin_lock_.lock();
+  needs_vblank |= enabled_ && callback_;
+  spin_lock_.unlock();
+  return needs_vblank;
 }
 
 }  // namespace hwcomposer
@@ -18,23 +18,24 @@
 #define COMMON_DISPLAY_VBLANK_EVENT_HANDLER_H_
 
 #include <stdint.h>
-#include <xf86drm.h>
 
 #include <nativedisplay.h>
 #include <spinlock.h>
 
 #include <memory>
 
-#include "hwcthread.h"
+#include "vsyncpredictor.h"
 
 namespace hwcomposer {
 
 class DisplayQueue;
 
-class VblankEventHandler : public HWCThread {
+// Per pipe front end of VblankService. Vblanks are only requested while a
+// vsync callback is enabled or the idle tracking of queue needs them.
+class VblankEventHandler {
  public:
   VblankEventHandler(DisplayQueue* queue);
-  ~VblankEventHandler() override;
+  ~VblankEventHandler();
 
   void Init(int fd, int pipe);
 
@@ -42,14 +43,22 @@ class VblankEventHandler : public HWCThread {
 
   void HandlePageFlipEvent(unsigned int sec, unsigned int usec);
 
+  // Called by VblankService on every requested vblank. Returns true in case
+  // the next vblank is needed as well.
+  bool HandleVblank(unsigned int sec, unsigned int usec);
+
+  // Makes sure a vblank is delivered while the pipe is on, e.g. after the
+  // idle tracking state changed.
+  void RequestVblank();
+
   int RegisterCallback(std::shared_ptr<VsyncCallback> callback,
                        uint32_t display_id);
 
   int VSyncControl(bool enabled);
 
- protected:
-  void HandleRoutine() override;
-  void HandleWait() override;
+  // Sets vblank to the predicted time of the first vblank after time.
+  // Returns false till enough vblanks have been seen to model them.
+  bool PredictNextVblank(int64_t time, int64_t* vblank);
 
  private:
   // shared_ptr since we need to use this outside of the thread lock (to
@@ -61,8 +70,11 @@ class VblankEventHandler : public HWCThread {
   bool enabled_ = false;
 
   int fd_;
+  int pipe_;
+  // Id of the pipe in VblankService, 0 while powered off.
+  uint32_t service_id_;
   int64_t last_timestamp_;
-  drmVBlankSeqType type_;
+  VsyncPredictor predictor_;
   DisplayQueue* queue_;
 };
 
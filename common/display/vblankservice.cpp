@@ -0,0 +1,175 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "vblankservice.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "hwctrace.h"
+#include "vblankeventhandler.h"
+
+namespace hwcomposer {
+
+VblankService& VblankService::GetInstance() {
+  static VblankService service;
+  return service;
+}
+
+VblankService::VblankService() : HWCThread(-8, "VblankService") {
+}
+
+VblankService::~VblankService() {
+}
+
+uint32_t VblankService::Register(int fd, int pipe,
+                                 VblankEventHandler* handler) {
+  Client client;
+  uint32_t high_crtc = (pipe << DRM_VBLANK_HIGH_CRTC_SHIFT);
+  client.fd_ = fd;
+  client.type_ = (drmVBlankSeqType)(DRM_VBLANK_RELATIVE | DRM_VBLANK_EVENT |
+                                    (high_crtc & DRM_VBLANK_HIGH_CRTC_MASK));
+  client.handler_ = handler;
+
+  lock_.lock();
+  if (!InitWorker()) {
+    lock_.unlock();
+    ETRACE("Failed to initalize thread for VblankService. %s", PRINTERROR());
+    return 0;
+  }
+
+  uint32_t id = next_id_++;
+  clients_[id] = client;
+  fd_users_[fd]++;
+  lock_.unlock();
+
+  // Let the thread pick up fd in case it's new.
+  Resume();
+  return id;
+}
+
+void VblankService::Unregister(uint32_t id) {
+  lock_.lock();
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    lock_.unlock();
+    return;
+  }
+
+  auto users = fd_users_.find(it->second.fd_);
+  if (--users->second == 0)
+    fd_users_.erase(users);
+
+  // A vblank event which is still pending is dropped once it arrives.
+  clients_.erase(it);
+  lock_.unlock();
+
+  // Wait for a handler which might still be running for id.
+  dispatch_lock_.lock();
+  dispatch_lock_.unlock();
+  Resume();
+}
+
+void VblankService::RequestVblank(uint32_t id) {
+  ScopedSpinLock lock(lock_);
+  auto it = clients_.find(id);
+  if (it == clients_.end() || it->second.pending_)
+    return;
+
+  Client& client = it->second;
+  drmVBlank vblank;
+  memset(&vblank, 0, sizeof(vblank));
+  vblank.request.type = client.type_;
+  vblank.request.sequence = 1;
+  vblank.request.signal = id;
+
+  // Only queues the event, this doesn't wait for the vblank.
+  if (drmWaitVBlank(client.fd_, &vblank)) {
+    IPAGEFLIPEVENTTRACE("Failed to request vblank event %s", PRINTERROR());
+    return;
+  }
+
+  client.pending_ = true;
+}
+
+void VblankService::VblankHandler(int /*fd*/, unsigned int /*sequence*/,
+                                  unsigned int sec, unsigned int usec,
+                                  void* data) {
+  uint32_t id = static_cast<uint32_t>(reinterpret_cast<uintptr_t>(data));
+  GetInstance().DispatchVblank(id, sec, usec);
+}
+
+void VblankService::DispatchVblank(uint32_t id, unsigned int sec,
+                                   unsigned int usec) {
+  dispatch_lock_.lock();
+  lock_.lock();
+  auto it = clients_.find(id);
+  if (it == clients_.end()) {
+    lock_.unlock();
+    dispatch_lock_.unlock();
+    return;
+  }
+
+  it->second.pending_ = false;
+  VblankEventHandler* handler = it->second.handler_;
+  lock_.unlock();
+
+  bool needs_vblank = handler->HandleVblank(sec, usec);
+  dispatch_lock_.unlock();
+
+  if (needs_vblank)
+    RequestVblank(id);
+}
+
+void VblankService::UpdateWatchedFds() {
+  std::vector<int> fds;
+  lock_.lock();
+  for (auto& users : fd_users_)
+    fds.emplace_back(users.first);
+  lock_.unlock();
+
+  for (int fd : watched_fds_) {
+    if (std::find(fds.begin(), fds.end(), fd) == fds.end())
+      fd_handler_.RemoveFd(fd);
+  }
+
+  for (int fd : fds) {
+    if (std::find(watched_fds_.begin(), watched_fds_.end(), fd) ==
+        watched_fds_.end())
+      fd_handler_.AddFd(fd);
+  }
+
+  watched_fds_.swap(fds);
+}
+
+void VblankService::HandleRoutine() {
+  UpdateWatchedFds();
+
+  drmEventContext context;
+  memset(&context, 0, sizeof(context));
+  context.version = 2;
+  context.vblank_handler = VblankHandler;
+  for (int fd : watched_fds_) {
+    if (fd_handler_.IsReady(fd) <= 0)
+      continue;
+
+    if (drmHandleEvent(fd, &context))
+      ETRACE("Failed to handle drm events %s", PRINTERROR());
+  }
+}
+
+}  // namespace hwcomposer
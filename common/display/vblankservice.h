@@ -0,0 +1,83 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_VBLANKSERVICE_H_
+#define COMMON_DISPLAY_VBLANKSERVICE_H_
+
+#include <stdint.h>
+#include <xf86drm.h>
+
+#include <spinlock.h>
+
+#include <map>
+#include <vector>
+
+#include "hwcthread.h"
+
+namespace hwcomposer {
+
+class VblankEventHandler;
+
+// Delivers vblanks of all pipes from a single thread. Vblanks are requested
+// as DRM events one at a time, so a pipe nobody asked a vblank for doesn't
+// wake up the service at all.
+class VblankService : public HWCThread {
+ public:
+  static VblankService& GetInstance();
+
+  // Starts delivering vblanks of pipe on fd to handler. Returns an id to
+  // refer to the pipe with, 0 in case of failure.
+  uint32_t Register(int fd, int pipe, VblankEventHandler* handler);
+
+  // Once this returns handler won't be called for id anymore.
+  void Unregister(uint32_t id);
+
+  // Requests a call to the handler of id on the next vblank. Does nothing
+  // in case one is already pending.
+  void RequestVblank(uint32_t id);
+
+ protected:
+  void HandleRoutine() override;
+
+ private:
+  struct Client {
+    int fd_ = -1;
+    drmVBlankSeqType type_;
+    VblankEventHandler* handler_ = NULL;
+    bool pending_ = false;
+  };
+
+  VblankService();
+  ~VblankService() override;
+
+  static void VblankHandler(int fd, unsigned int sequence, unsigned int sec,
+                            unsigned int usec, void* data);
+  void DispatchVblank(uint32_t id, unsigned int sec, unsigned int usec);
+  void UpdateWatchedFds();
+
+  SpinLock lock_;
+  // Held while calling a handler, so that Unregister can wait for it.
+  SpinLock dispatch_lock_;
+  std::map<uint32_t, Client> clients_;
+  // Number of clients per fd.
+  std::map<int, uint32_t> fd_users_;
+  // Fds polled by the service thread. Only accessed by the thread.
+  std::vector<int> watched_fds_;
+  uint32_t next_id_ = 1;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_VBLANKSERVICE_H_
@@ -0,0 +1,167 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "vsyncpredictor.h"
+
+#include <stdlib.h>
+
+namespace hwcomposer {
+
+// Refresh rates outside 10Hz - 250Hz are treated as bogus.
+static const int64_t kMinPeriodNs = 4 * 1000 * 1000;
+static const int64_t kMaxPeriodNs = 100 * 1000 * 1000;
+
+void VsyncPredictor::Reset() {
+  oldest_ = 0;
+  total_samples_ = 0;
+  outliers_ = 0;
+  repeated_steps_ = 0;
+  last_step_ = 0;
+  period_ = 0;
+  phase_ = 0;
+  last_sequence_ = 0;
+  last_timestamp_ = 0;
+}
+
+void VsyncPredictor::AddTimestamp(int64_t timestamp) {
+  // First vblank after being idle, the phase may have drifted and the
+  // refresh rate may have changed since.
+  if (total_samples_ && timestamp - last_timestamp_ > kMaxSampleAgeNs)
+    Reset();
+
+  if (total_samples_ == 0) {
+    sequences_[0] = 0;
+    timestamps_[0] = timestamp;
+    total_samples_ = 1;
+    phase_ = timestamp;
+    last_timestamp_ = timestamp;
+    return;
+  }
+
+  int64_t sequence;
+  if (total_samples_ == 1) {
+    // Second sample gives us the first guess of the period.
+    int64_t period = timestamp - phase_;
+    if (period < kMinPeriodNs || period > kMaxPeriodNs) {
+      Reset();
+      AddTimestamp(timestamp);
+      return;
+    }
+
+    period_ = period;
+    sequence = 1;
+  } else {
+    int64_t elapsed = timestamp - phase_;
+    sequence = (elapsed + period_ / 2) / period_;
+    int64_t error = elapsed - sequence * period_;
+    if (sequence <= last_sequence_ || llabs(error) > period_ / 4) {
+      if (++outliers_ < kMaxOutliers)
+        return;
+
+      // Consistently off, the refresh rate or phase must have changed.
+      Reset();
+      AddTimestamp(timestamp);
+      return;
+    }
+  }
+
+  int64_t step = sequence - last_sequence_;
+  repeated_steps_ = step == last_step_ ? repeated_steps_ + 1 : 0;
+  last_step_ = step;
+  if (step > 1 && repeated_steps_ >= kMaxOutliers) {
+    // Every vblank is late by the same number of periods, the refresh
+    // rate has been divided.
+    Reset();
+    AddTimestamp(timestamp);
+    return;
+  }
+
+  outliers_ = 0;
+  last_sequence_ = sequence;
+  last_timestamp_ = timestamp;
+  int slot;
+  if (total_samples_ < kMaxSamples) {
+    slot = total_samples_++;
+  } else {
+    slot = oldest_;
+    oldest_ = (oldest_ + 1) % kMaxSamples;
+  }
+
+  sequences_[slot] = sequence;
+  timestamps_[slot] = timestamp;
+  Fit();
+}
+
+void VsyncPredictor::Fit() {
+  // Values relative to the oldest sample keep the sums well within the
+  // precision of a double.
+  int64_t base_sequence = sequences_[oldest_];
+  int64_t base_timestamp = timestamps_[oldest_];
+  double mean_x = 0;
+  double mean_y = 0;
+  for (int i = 0; i < total_samples_; i++) {
+    mean_x += sequences_[i] - base_sequence;
+    mean_y += timestamps_[i] - base_timestamp;
+  }
+
+  mean_x /= total_samples_;
+  mean_y /= total_samples_;
+  double sxx = 0;
+  double sxy = 0;
+  for (int i = 0; i < total_samples_; i++) {
+    double x = (sequences_[i] - base_sequence) - mean_x;
+    double y = (timestamps_[i] - base_timestamp) - mean_y;
+    sxx += x * x;
+    sxy += x * y;
+  }
+
+  if (sxx <= 0)
+    return;
+
+  double period = sxy / sxx;
+  if (period < kMinPeriodNs || period > kMaxPeriodNs)
+    return;
+
+  period_ = static_cast<int64_t>(period);
+  double intercept = mean_y - period * mean_x;
+  phase_ = base_timestamp + static_cast<int64_t>(intercept) -
+           base_sequence * period_;
+}
+
+bool VsyncPredictor::PredictNextVblank(int64_t time, int64_t* vblank) const {
+  if (!IsValid() || time - last_timestamp_ > kMaxSampleAgeNs)
+    return false;
+
+  int64_t elapsed = time - phase_;
+  int64_t sequence = elapsed >= 0 ? elapsed / period_ + 1 : 0;
+  *vblank = phase_ + sequence * period_;
+  return true;
+}
+
+void DurationEstimator::AddSample(int64_t duration) {
+  if (!initialized_) {
+    mean_ = duration;
+    deviation_ = duration / 2;
+    initialized_ = true;
+    return;
+  }
+
+  int64_t error = duration - mean_;
+  mean_ += error / 8;
+  deviation_ += (llabs(error) - deviation_) / 4;
+}
+
+}  // namespace hwcomposer
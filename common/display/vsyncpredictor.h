@@ -0,0 +1,97 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_DISPLAY_VSYNCPREDICTOR_H_
+#define COMMON_DISPLAY_VSYNCPREDICTOR_H_
+
+#include <stdint.h>
+
+namespace hwcomposer {
+
+// Models vblanks of a pipe as phase + n * period. Both are fitted by least
+// squares over the last kMaxSamples vblank timestamps. Missed vblanks are
+// accounted for, timestamps which are off the model by more than a quarter
+// period are rejected till enough of them indicate the model is stale.
+// A rate change to a divisor of the old rate looks like missed vblanks, so
+// the model is started over as well when several vblanks in a row skip the
+// same number of predicted ones. Vblanks aren't delivered while a pipe is
+// idle, so a model whose newest sample is older than kMaxSampleAgeNs isn't
+// used for predictions and is started over with the next timestamp.
+// All timestamps are in ns, CLOCK_MONOTONIC.
+class VsyncPredictor {
+ public:
+  VsyncPredictor() = default;
+
+  void AddTimestamp(int64_t timestamp);
+
+  // Drops the model, e.g. after a mode change or power off.
+  void Reset();
+
+  // Returns false if there isn't enough recent data to predict vblanks.
+  // Otherwise, vblank is set to the first predicted vblank after time.
+  bool PredictNextVblank(int64_t time, int64_t* vblank) const;
+
+  bool IsValid() const {
+    return total_samples_ >= kMinSamples;
+  }
+
+  int64_t GetPeriod() const {
+    return period_;
+  }
+
+ private:
+  static const int kMaxSamples = 16;
+  static const int kMinSamples = 4;
+  static const int kMaxOutliers = 3;
+  static const int64_t kMaxSampleAgeNs = 1000 * 1000 * 1000;
+
+  void Fit();
+
+  // Vblank sequence relative to the first sample of the model and its
+  // timestamp.
+  int64_t sequences_[kMaxSamples];
+  int64_t timestamps_[kMaxSamples];
+  int oldest_ = 0;
+  int total_samples_ = 0;
+  int outliers_ = 0;
+  // Number of consecutive samples last_step_ sequences apart.
+  int repeated_steps_ = 0;
+  int64_t last_step_ = 0;
+  int64_t period_ = 0;
+  // Fitted timestamp of sequence 0.
+  int64_t phase_ = 0;
+  int64_t last_sequence_ = 0;
+  int64_t last_timestamp_ = 0;
+};
+
+// Running estimate of how long an operation takes: smoothed mean plus four
+// times the smoothed deviation, as used for TCP retransmit timeouts.
+class DurationEstimator {
+ public:
+  void AddSample(int64_t duration);
+
+  int64_t GetEstimate() const {
+    return mean_ + 4 * deviation_;
+  }
+
+ private:
+  int64_t mean_ = 0;
+  int64_t deviation_ = 0;
+  bool initialized_ = false;
+};
+
+}  // namespace hwcomposer
+#endif  // COMMON_DISPLAY_VSYNCPREDICTOR_H_
@@ -28,76 +28,151 @@
 namespace hwcomposer {
 
 // Some of the structs are adopted from drm_hwcomposer
+// Set of rect ids stored as kWords 64 bit words. Most layer stacks fit in a
+// single word, wider sets are only needed once there are more than 64 rects.
+template <size_t kWords>
 struct RectIDs {
  public:
   typedef uint64_t TId;
 
-  RectIDs() : bitset(0) {
+  RectIDs() {
+    for (size_t i = 0; i < kWords; i++)
+      words_[i] = 0;
   }
 
-  explicit RectIDs(TId id) : bitset(0) {
+  explicit RectIDs(TId id) : RectIDs() {
     add(id);
   }
 
   void add(TId id) {
-    bitset |= ((uint64_t)1) << id;
+    words_[id / 64] |= ((uint64_t)1) << (id % 64);
   }
 
   void subtract(TId id) {
-    bitset &= ~(((uint64_t)1) << id);
+    words_[id / 64] &= ~(((uint64_t)1) << (id % 64));
+  }
+
+  bool test(TId id) const {
+    return words_[id / 64] & (((uint64_t)1) << (id % 64));
   }
 
   bool isEmpty() const {
-    return bitset == 0;
+    for (size_t i = 0; i < kWords; i++) {
+      if (words_[i])
+        return false;
+    }
+
+    return true;
+  }
+
+  // Returns true if any id less than end is set.
+  bool anyBelow(TId end) const {
+    for (size_t i = 0; i < kWords && i * 64 < end; i++) {
+      uint64_t word = words_[i];
+      if (end < (i + 1) * 64)
+        word &= (((uint64_t)1) << (end % 64)) - 1;
+
+      if (word)
+        return true;
+    }
+
+    return false;
   }
 
-  uint64_t getBits() const {
-    return bitset;
+  // Returns true if any id greater than or equal to begin is set.
+  bool anyFrom(TId begin) const {
+    for (size_t i = begin / 64; i < kWords; i++) {
+      uint64_t word = words_[i];
+      if (i == begin / 64)
+        word &= ~((((uint64_t)1) << (begin % 64)) - 1);
+
+      if (word)
+        return true;
+    }
+
+    return false;
+  }
+
+  size_t count() const {
+    size_t total = 0;
+    for (size_t i = 0; i < kWords; i++)
+      total += __builtin_popcountll(words_[i]);
+
+    return total;
+  }
+
+  // Calls func with every set id, starting from the highest one.
+  template <typename TFunc>
+  void forEachReverse(TFunc func) const {
+    for (size_t i = kWords; i > 0; i--) {
+      uint64_t word = words_[i - 1];
+      while (word) {
+        size_t bit = 63 - __builtin_clzll(word);
+        func((i - 1) * 64 + bit);
+        word &= ~(((uint64_t)1) << bit);
+      }
+    }
   }
 
   bool operator==(const RectIDs &rhs) const {
-    return bitset == rhs.bitset;
+    for (size_t i = 0; i < kWords; i++) {
+      if (words_[i] != rhs.words_[i])
+        return false;
+    }
+
+    return true;
   }
 
   bool operator<(const RectIDs &rhs) const {
-    return bitset < rhs.bitset;
+    for (size_t i = kWords; i > 0; i--) {
+      if (words_[i - 1] != rhs.words_[i - 1])
+        return words_[i - 1] < rhs.words_[i - 1];
+    }
+
+    return false;
   }
 
   RectIDs operator|(const RectIDs &rhs) const {
     RectIDs ret;
-    ret.bitset = bitset | rhs.bitset;
+    for (size_t i = 0; i < kWords; i++)
+      ret.words_[i] = words_[i] | rhs.words_[i];
+
     return ret;
   }
 
   RectIDs operator|(TId id) const {
-    RectIDs ret;
-    ret.bitset = bitset;
+    RectIDs ret = *this;
     ret.add(id);
     return ret;
   }
 
-  static const int max_elements = sizeof(TId) * 8;
+  static const size_t max_elements = kWords * sizeof(TId) * 8;
 
  private:
-  uint64_t bitset;
+  uint64_t words_[kWords];
 };
 
-template <typename TNum>
+// Number of words needed to handle the largest layer stacks we support.
+static const size_t kMaxRectIDWords = 4;
+
+template <typename TNum, size_t kWords = 1>
 struct RectSet {
-  RectIDs id_set;
+  RectIDs<kWords> id_set;
   Rect<TNum> rect;
 
-  RectSet(const RectIDs &i, const Rect<TNum> &r) : id_set(i), rect(r) {
+  RectSet(const RectIDs<kWords> &i, const Rect<TNum> &r) : id_set(i), rect(r) {
   }
 
-  bool operator==(const RectSet<TNum> &rhs) const {
+  bool operator==(const RectSet &rhs) const {
     return (id_set == rhs.id_set) && (rect == rhs.rect);
   }
 };
 
+// Instantiated for 1 and kMaxRectIDWords words.
+template <size_t kWords>
 void get_draw_regions(const std::vector<Rect<int>> &in,
                       const HwcRect<int> &damage_region,
-                      std::vector<RectSet<int>> *out);
+                      std::vector<RectSet<int, kWords>> *out);
 }  // namespace hwcomposer
 
 #endif  // COMMON_UTILS_DISJOINT_LAYERS_H_
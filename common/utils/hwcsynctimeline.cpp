@@ -0,0 +1,87 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "hwcsynctimeline.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include <linux/types.h>
+
+#include "hwctrace.h"
+
+#ifndef SW_SYNC_IOC_MAGIC
+struct sw_sync_create_fence_data {
+  __u32 value;
+  char name[32];
+  __s32 fence;
+};
+
+#define SW_SYNC_IOC_MAGIC 'W'
+#define SW_SYNC_IOC_CREATE_FENCE \
+  _IOWR(SW_SYNC_IOC_MAGIC, 0, struct sw_sync_create_fence_data)
+#define SW_SYNC_IOC_INC _IOW(SW_SYNC_IOC_MAGIC, 1, __u32)
+#endif
+
+namespace hwcomposer {
+
+static const char* kSwSyncPaths[] = {"/dev/sw_sync",
+                                     "/sys/kernel/debug/sync/sw_sync"};
+
+HWCSyncTimeline::~HWCSyncTimeline() {
+  if (fd_ >= 0)
+    close(fd_);
+
+  fd_ = -1;
+}
+
+bool HWCSyncTimeline::Initialize() {
+  if (fd_ >= 0)
+    return true;
+
+  for (const char* path : kSwSyncPaths) {
+    fd_ = open(path, O_RDWR);
+    if (fd_ >= 0)
+      return true;
+  }
+
+  return false;
+}
+
+int32_t HWCSyncTimeline::CreateFence(const char* name) {
+  struct sw_sync_create_fence_data data;
+  memset(&data, 0, sizeof(data));
+  data.value = ++point_;
+  snprintf(data.name, sizeof(data.name), "%s", name);
+  if (ioctl(fd_, SW_SYNC_IOC_CREATE_FENCE, &data) < 0) {
+    ETRACE("Failed to create sw_sync fence %s", PRINTERROR());
+    return -1;
+  }
+
+  return data.fence;
+}
+
+void HWCSyncTimeline::Signal() {
+  __u32 increment = 1;
+  if (ioctl(fd_, SW_SYNC_IOC_INC, &increment) < 0) {
+    ETRACE("Failed to advance sw_sync timeline %s", PRINTERROR());
+  }
+}
+
+}  // namespace hwcomposer
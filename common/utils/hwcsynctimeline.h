@@ -0,0 +1,56 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef COMMON_UTILS_HWCSYNCTIMELINE_H_
+#define COMMON_UTILS_HWCSYNCTIMELINE_H_
+
+#include <stdint.h>
+
+namespace hwcomposer {
+
+// This class wraps a sw_sync timeline. Fences are handed out in order and
+// signaled in the same order, one per call to Signal().
+class HWCSyncTimeline {
+ public:
+  HWCSyncTimeline() = default;
+  ~HWCSyncTimeline();
+
+  HWCSyncTimeline(const HWCSyncTimeline& rhs) = delete;
+  HWCSyncTimeline& operator=(const HWCSyncTimeline& rhs) = delete;
+
+  // Creates the timeline. Returns false if sw_sync isn't available.
+  bool Initialize();
+
+  // Returns a fence which is signaled once Signal() has been called for
+  // it and all the fences created before it. Returns -1 on failure, the
+  // call still needs to be matched by a Signal() call.
+  int32_t CreateFence(const char* name);
+
+  // Signals the oldest fence which isn't signaled yet.
+  void Signal();
+
+  bool IsValid() const {
+    return fd_ >= 0;
+  }
+
+ private:
+  int fd_ = -1;
+  uint32_t point_ = 0;
+};
+
+}  // namespace hwcomposer
+
+#endif  // COMMON_UTILS_HWCSYNCTIMELINE_H_
@@ -45,6 +45,7 @@ extern "C" {
 // #define COMPOSITOR_TRACING 1
 // #define RECT_DAMAGE_TRACING 1
 // #define PLANE_RESERVED_TRACING 1
+// #define PLANE_CACHE_TRACING 1
 // #define SURFACE_RECYCLE_TRACING 1
 
 // Function call tracing
@@ -133,6 +134,12 @@ class TraceFunc {
 #define IPLANERESERVEDTRACE(fmt, ...) ((void)0)
 #endif
 
+#ifdef PLANE_CACHE_TRACING
+#define IPLANECACHETRACE ITRACE
+#else
+#define IPLANECACHETRACE(fmt, ...) ((void)0)
+#endif
+
 #ifdef SURFACE_RECYCLE_TRACING
 #define ISURFACERECYCLETRACE ITRACE
 #else
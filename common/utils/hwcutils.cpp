@@ -16,7 +16,11 @@
 
 #include "hwcutils.h"
 
+#include <errno.h>
 #include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
 
 #include "hwctrace.h"
 
@@ -74,6 +78,64 @@ void ResetRectToRegion(const HwcRegion& hwc_region, HwcRect<int>& rect) {
   }
 }
 
+static int64_t GetRectArea(const HwcRect<int>& rect) {
+  return static_cast<int64_t>(rect.right - rect.left) *
+         static_cast<int64_t>(rect.bottom - rect.top);
+}
+
+void AddRectToRegion(const HwcRect<int>& rect, HwcRegion& region) {
+  static const size_t kMaxRegionRects = 4;
+  if (rect.empty())
+    return;
+
+  // Merge with everything the rect touches, the grown rect can reach
+  // others so keep going till nothing changes.
+  HwcRect<int> target = rect;
+  bool merged = true;
+  while (merged) {
+    merged = false;
+    size_t size = region.size();
+    for (size_t i = 0; i < size; i++) {
+      const HwcRect<int>& current = region.at(i);
+      if (target.left <= current.right && current.left <= target.right &&
+          target.top <= current.bottom && current.top <= target.bottom) {
+        CalculateRect(current, target);
+        region.erase(region.begin() + i);
+        merged = true;
+        break;
+      }
+    }
+  }
+
+  region.emplace_back(target);
+  size_t size = region.size();
+  if (size <= kMaxRegionRects)
+    return;
+
+  size_t first = 0;
+  size_t second = 1;
+  int64_t least_waste = -1;
+  for (size_t i = 0; i < size; i++) {
+    for (size_t j = i + 1; j < size; j++) {
+      HwcRect<int> bounds = region.at(i);
+      CalculateRect(region.at(j), bounds);
+      int64_t waste = GetRectArea(bounds) - GetRectArea(region.at(i)) -
+                      GetRectArea(region.at(j));
+      if (least_waste < 0 || waste < least_waste) {
+        least_waste = waste;
+        first = i;
+        second = j;
+      }
+    }
+  }
+
+  HwcRect<int> bounds = region.at(first);
+  CalculateRect(region.at(second), bounds);
+  region.erase(region.begin() + second);
+  region.erase(region.begin() + first);
+  AddRectToRegion(bounds, region);
+}
+
 void CalculateRect(const HwcRect<int>& target_rect, HwcRect<int>& new_rect) {
   if (new_rect.empty()) {
     new_rect = target_rect;
@@ -132,6 +194,63 @@ bool IsSupportedMediaFormat(uint32_t format) {
   return false;
 }
 
+HwcColorDescription DataSpaceToColorDescription(uint32_t dataspace,
+                                                uint32_t height) {
+  HwcColorDescription description;
+  uint32_t standard = dataspace & HAL_DATASPACE_STANDARD_MASK;
+  uint32_t range = dataspace & HAL_DATASPACE_RANGE_MASK;
+  switch (dataspace) {
+    case HAL_DATASPACE_JFIF:
+      standard = HAL_DATASPACE_STANDARD_BT601_625;
+      range = HAL_DATASPACE_RANGE_FULL;
+      break;
+    case HAL_DATASPACE_BT601_625:
+      standard = HAL_DATASPACE_STANDARD_BT601_625;
+      break;
+    case HAL_DATASPACE_BT601_525:
+      standard = HAL_DATASPACE_STANDARD_BT601_525;
+      break;
+    case HAL_DATASPACE_BT709:
+      standard = HAL_DATASPACE_STANDARD_BT709;
+      break;
+    default:
+      break;
+  }
+
+  description.standard_specified_ =
+      standard != HAL_DATASPACE_STANDARD_UNSPECIFIED;
+  if (!description.standard_specified_) {
+    standard = height >= 720 ? HAL_DATASPACE_STANDARD_BT709
+                             : HAL_DATASPACE_STANDARD_BT601_625;
+  }
+
+  switch (standard) {
+    case HAL_DATASPACE_STANDARD_BT709:
+      description.standard_ = HWCColorStandard::kColorStandardBT709;
+      description.primaries_ = HWCColorPrimaries::kColorPrimariesBT709;
+      break;
+    case HAL_DATASPACE_STANDARD_BT601_525:
+    case HAL_DATASPACE_STANDARD_BT601_525_UNADJUSTED:
+      description.standard_ = HWCColorStandard::kColorStandardBT601;
+      description.primaries_ = HWCColorPrimaries::kColorPrimariesBT601_525;
+      break;
+    case HAL_DATASPACE_STANDARD_BT2020:
+    case HAL_DATASPACE_STANDARD_BT2020_CONSTANT_LUMINANCE:
+      description.standard_ = HWCColorStandard::kColorStandardBT2020;
+      description.primaries_ = HWCColorPrimaries::kColorPrimariesBT2020;
+      break;
+    default:
+      description.standard_ = HWCColorStandard::kColorStandardBT601;
+      description.primaries_ = HWCColorPrimaries::kColorPrimariesBT601_625;
+      break;
+  }
+
+  description.range_ = range == HAL_DATASPACE_RANGE_FULL
+                           ? HWCColorRange::kColorRangeFull
+                           : HWCColorRange::kColorRangeLimited;
+  return description;
+}
+
 uint32_t GetTotalPlanesForFormat(uint32_t format) {
   switch (format) {
     case DRM_FORMAT_NV12:
@@ -170,6 +289,43 @@ bool IsEdidFilting() {
   }
 }
 
+bool CreateDirectories(const std::string& path) {
+  size_t separator = 0;
+  do {
+    separator = path.find('/', separator + 1);
+    std::string dir = path.substr(0, separator);
+    if (mkdir(dir.c_str(), 0700) && errno != EEXIST) {
+      ETRACE("Failed to create directory %s: %s", dir.c_str(),
+             strerror(errno));
+      return false;
+    }
+  } while (separator != std::string::npos);
+
+  return true;
+}
+
+bool WriteFileAtomically(const std::string& path, const void* header,
+                         size_t header_size, const void* data, size_t size) {
+  size_t separator = path.rfind('/');
+  if (separator != std::string::npos && separator > 0 &&
+      !CreateDirectories(path.substr(0, separator)))
+    return false;
+
+  std::string temp_path = path + ".tmp";
+  FILE* fp = fopen(temp_path.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  bool written = (!header_size || fwrite(header, header_size, 1, fp) == 1) &&
+                 (!size || fwrite(data, size, 1, fp) == 1);
+  if (fclose(fp) || !written || rename(temp_path.c_str(), path.c_str())) {
+    remove(temp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
 std::string StringifyRect(HwcRect<int> rect) {
   std::stringstream ss;
   ss << "{(" << rect.left << "," << rect.top << ") "
@@ -18,6 +18,7 @@
 
 #include <drm.h>
 #include <drm_fourcc.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <xf86drm.h>
 
@@ -190,6 +191,13 @@ bool GbmBufferHandler::CreateBuffer(uint32_t w, uint32_t h, int format,
 }
 
 bool GbmBufferHandler::ReleaseBuffer(HWCNativeHandle handle) const {
+  if (handle->pixel_memory_) {
+    // Mapping cached by PixelUploader.
+    munmap(handle->pixel_memory_,
+           handle->meta_data_.height_ * handle->meta_data_.pitches_[0]);
+    handle->pixel_memory_ = NULL;
+  }
+
   if (handle->bo || handle->imported_bo) {
     if (handle->bo && handle->hwc_buffer_) {
       gbm_bo_destroy(handle->bo);
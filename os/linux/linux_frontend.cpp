@@ -24,6 +24,14 @@
 
 namespace hwcomposer {
 
+// Number of bos a layer keeps imported, enough for a triple buffered
+// client plus one in flight.
+#define MAX_CACHED_BOS 4
+
+// Guards CachedBo state shared with bo destroy callbacks, which can run on
+// any client thread.
+static SpinLock bo_cache_lock;
+
 class IAHWCVsyncCallback : public hwcomposer::VsyncCallback {
  public:
   IAHWCVsyncCallback(iahwc_callback_data_t data, iahwc_function_ptr_t hook)
@@ -476,6 +484,7 @@ IAHWC::IAHWCLayer::IAHWCLayer(PixelUploader* uploader)
 }
 
 IAHWC::IAHWCLayer::~IAHWCLayer() {
+  ReleaseCachedBos(false);
   if (pixel_buffer_) {
     const NativeBufferHandler* buffer_handler =
         raw_data_uploader_->GetNativeBufferHandler();
@@ -491,8 +500,6 @@ IAHWC::IAHWCLayer::~IAHWCLayer() {
 }
 
 int IAHWC::IAHWCLayer::SetBo(gbm_bo* bo) {
-  int32_t width, height;
-
   if (pixel_buffer_) {
     const NativeBufferHandler* buffer_handler =
         raw_data_uploader_->GetNativeBufferHandler();
@@ -506,24 +513,117 @@ int IAHWC::IAHWCLayer::SetBo(gbm_bo* bo) {
     ClosePrimeHandles();
   }
 
-  width = gbm_bo_get_width(bo);
-  height = gbm_bo_get_height(bo);
+  HWCNativeHandle handle = GetCachedHandle(bo);
+  if (!handle) {
+    // bo can't be tracked, import it for this frame only.
+    FillHandle(bo, &hwc_handle_);
+    handle = &hwc_handle_;
+  }
 
-  hwc_handle_.import_data.fd_data.width = width;
-  hwc_handle_.import_data.fd_data.height = height;
-  hwc_handle_.import_data.fd_data.format = gbm_bo_get_format(bo);
-  hwc_handle_.import_data.fd_data.fd = gbm_bo_get_fd(bo);
-  hwc_handle_.import_data.fd_data.stride = gbm_bo_get_stride(bo);
-  hwc_handle_.meta_data_.num_planes_ =
-      drm_bo_get_num_planes(hwc_handle_.import_data.fd_data.format);
+  iahwc_layer_.SetNativeHandle(handle);
 
-  hwc_handle_.bo = bo;
-  hwc_handle_.hwc_buffer_ = true;
-  hwc_handle_.gbm_flags = 0;
+  return IAHWC_ERROR_NONE;
+}
 
-  iahwc_layer_.SetNativeHandle(&hwc_handle_);
+void IAHWC::IAHWCLayer::FillHandle(gbm_bo* bo, struct gbm_handle* handle) {
+  handle->import_data.fd_data.width = gbm_bo_get_width(bo);
+  handle->import_data.fd_data.height = gbm_bo_get_height(bo);
+  handle->import_data.fd_data.format = gbm_bo_get_format(bo);
+  handle->import_data.fd_data.fd = gbm_bo_get_fd(bo);
+  handle->import_data.fd_data.stride = gbm_bo_get_stride(bo);
+  handle->meta_data_.num_planes_ =
+      drm_bo_get_num_planes(handle->import_data.fd_data.format);
+
+  handle->bo = bo;
+  handle->hwc_buffer_ = true;
+  handle->gbm_flags = 0;
+}
+
+// Called by gbm_bo_destroy on the client's thread, bo is still valid but
+// about to be freed.
+void IAHWC::IAHWCLayer::OnBoDestroyed(gbm_bo* bo, void* data) {
+  std::shared_ptr<CachedBo>* entry =
+      static_cast<std::shared_ptr<CachedBo>*>(data);
+  bo_cache_lock.lock();
+  // Nothing may point at the entry's reference once it is deleted below.
+  gbm_bo_set_user_data(bo, NULL, NULL);
+  (*entry)->destroyed_ = true;
+  (*entry)->user_data_ = NULL;
+  bo_cache_lock.unlock();
+  // The handle owns a dup of the bo's fd and stays valid, the layer
+  // releases it on its next SetBo.
+  delete entry;
+}
+
+HWCNativeHandle IAHWC::IAHWCLayer::GetCachedHandle(gbm_bo* bo) {
+  bo_frame_++;
+  ReleaseCachedBos(true);
+  for (std::shared_ptr<CachedBo>& entry : cached_bos_) {
+    if (entry->bo_ == bo) {
+      entry->last_used_ = bo_frame_;
+      return &entry->handle_;
+    }
+  }
 
-  return IAHWC_ERROR_NONE;
+  // We rely on the destroy callback to know when bo goes away, which is
+  // not possible if its user data is used by the client.
+  if (gbm_bo_get_user_data(bo))
+    return NULL;
+
+  if (cached_bos_.size() >= MAX_CACHED_BOS) {
+    auto lru = cached_bos_.begin();
+    for (auto it = cached_bos_.begin(); it != cached_bos_.end(); it++) {
+      if ((*it)->last_used_ < (*lru)->last_used_)
+        lru = it;
+    }
+
+    ReleaseCachedBo(lru->get());
+    cached_bos_.erase(lru);
+  }
+
+  std::shared_ptr<CachedBo> entry = std::make_shared<CachedBo>();
+  memset(&entry->handle_.import_data, 0, sizeof(entry->handle_.import_data));
+  memset(&entry->handle_.meta_data_, 0, sizeof(entry->handle_.meta_data_));
+  FillHandle(bo, &entry->handle_);
+  entry->bo_ = bo;
+  entry->last_used_ = bo_frame_;
+  entry->user_data_ = new std::shared_ptr<CachedBo>(entry);
+  gbm_bo_set_user_data(bo, entry->user_data_, OnBoDestroyed);
+  cached_bos_.emplace_back(entry);
+
+  return &entry->handle_;
+}
+
+void IAHWC::IAHWCLayer::ReleaseCachedBo(CachedBo* entry) {
+  bo_cache_lock.lock();
+  // user_data_ is only set while the client hasn't destroyed bo_, which is
+  // the only time bo_ may be touched. Detach from it before the reference
+  // the destroy callback would get is deleted.
+  if (entry->user_data_) {
+    gbm_bo_set_user_data(entry->bo_, NULL, NULL);
+    delete entry->user_data_;
+    entry->user_data_ = NULL;
+  }
+  bo_cache_lock.unlock();
+
+  if (entry->handle_.import_data.fd_data.fd > 0)
+    ::close(entry->handle_.import_data.fd_data.fd);
+}
+
+void IAHWC::IAHWCLayer::ReleaseCachedBos(bool destroyed_only) {
+  auto it = cached_bos_.begin();
+  while (it != cached_bos_.end()) {
+    bo_cache_lock.lock();
+    bool destroyed = (*it)->destroyed_;
+    bo_cache_lock.unlock();
+    if (destroyed_only && !destroyed) {
+      it++;
+      continue;
+    }
+
+    ReleaseCachedBo(it->get());
+    it = cached_bos_.erase(it);
+  }
 }
 
 int IAHWC::IAHWCLayer::SetRawPixelData(iahwc_raw_pixel_data bo) {
@@ -569,9 +669,14 @@ int IAHWC::IAHWCLayer::SetRawPixelData(iahwc_raw_pixel_data bo) {
   }
 
   upload_in_progress_ = true;
+  int32_t upload_fence = -1;
   raw_data_uploader_->UpdateLayerPixelData(
       pixel_buffer_, orig_width_, orig_height_, orig_stride_, bo.callback_data,
-      (uint8_t*)bo.buffer, this, iahwc_layer_.GetSurfaceDamage());
+      (uint8_t*)bo.buffer, this, iahwc_layer_.GetSurfaceDamageRegion(),
+      &upload_fence);
+  // Composition of this layer needs to wait for the copy to complete.
+  if (upload_fence > 0)
+    iahwc_layer_.SetAcquireFence(upload_fence);
 
   return IAHWC_ERROR_NONE;
 }
@@ -596,6 +701,9 @@ int IAHWC::IAHWCLayer::SetLayerUsage(int32_t layer_usage) {
     if (pixel_buffer_) {
       const NativeBufferHandler* buffer_handler =
           raw_data_uploader_->GetNativeBufferHandler();
+      if (upload_in_progress_) {
+        raw_data_uploader_->Synchronize();
+      }
       buffer_handler->ReleaseBuffer(pixel_buffer_);
       buffer_handler->DestroyHandle(pixel_buffer_);
       pixel_buffer_ = NULL;
@@ -21,6 +21,7 @@
 #include <hwcdefs.h>
 #include <hwclayer.h>
 #include <map>
+#include <memory>
 #include <type_traits>
 #include <vector>
 #include "iahwc.h"
@@ -62,9 +63,33 @@ class IAHWC : public iahwc_device {
     void UploadDone() override;
 
    private:
+    // A gbm_bo passed to SetBo together with the handle created for it.
+    // The handle and its prime fd are kept across frames, so that
+    // presenting the same bo again needs no new fd or import.
+    // bo_ is owned by the client, which can destroy it at any time. The
+    // layer never destroys it, it only owns the dup of the bo's fd in
+    // handle_ and the reference stored as the bo's user data.
+    struct CachedBo {
+      struct gbm_bo* bo_ = NULL;
+      struct gbm_handle handle_;
+      // Reference owned by the bo's user data, released when the bo is
+      // destroyed or the entry is evicted.
+      std::shared_ptr<CachedBo>* user_data_ = NULL;
+      uint64_t last_used_ = 0;
+      // Set once the client destroyed bo_.
+      bool destroyed_ = false;
+    };
+
+    static void FillHandle(struct gbm_bo* bo, struct gbm_handle* handle);
+    static void OnBoDestroyed(struct gbm_bo* bo, void* data);
+    HWCNativeHandle GetCachedHandle(struct gbm_bo* bo);
+    void ReleaseCachedBo(CachedBo* entry);
+    void ReleaseCachedBos(bool destroyed_only);
     void ClosePrimeHandles();
     hwcomposer::HwcLayer iahwc_layer_;
     struct gbm_handle hwc_handle_;
+    std::vector<std::shared_ptr<CachedBo>> cached_bos_;
+    uint64_t bo_frame_ = 0;
     HWCNativeHandle pixel_buffer_ = NULL;
     uint32_t orig_width_ = 0;
     uint32_t orig_height_ = 0;
@@ -0,0 +1,73 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef OS_LINUX_PIXELCOPY_H_
+#define OS_LINUX_PIXELCOPY_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace hwcomposer {
+
+// Copy of rows_ rows of bytes_ bytes each from src_ to dst_.
+struct CopyJob {
+  uint8_t* dst_;
+  uint32_t dst_pitch_;
+  const uint8_t* src_;
+  uint32_t src_pitch_;
+  uint32_t rows_;
+  uint32_t bytes_;
+};
+
+// Destination is write combined, stream the rows to it without polluting
+// the cache with data we are never going to read back.
+inline void CopyRows(const CopyJob& job) {
+  for (uint32_t row = 0; row < job.rows_; row++) {
+    uint8_t* dst = job.dst_ + row * job.dst_pitch_;
+    const uint8_t* src = job.src_ + row * job.src_pitch_;
+    uint32_t bytes = job.bytes_;
+#ifdef __SSE2__
+    uint32_t head = (16 - (reinterpret_cast<uintptr_t>(dst) & 15)) & 15;
+    if (head > bytes)
+      head = bytes;
+
+    memcpy(dst, src, head);
+    dst += head;
+    src += head;
+    bytes -= head;
+    while (bytes >= 16) {
+      __m128i data =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+      _mm_stream_si128(reinterpret_cast<__m128i*>(dst), data);
+      dst += 16;
+      src += 16;
+      bytes -= 16;
+    }
+#endif
+    memcpy(dst, src, bytes);
+  }
+
+#ifdef __SSE2__
+  _mm_sfence();
+#endif
+}
+
+}  // namespace hwcomposer
+#endif  // OS_LINUX_PIXELCOPY_H_
@@ -22,6 +22,7 @@
 #include "hwcutils.h"
 #include "nativegpuresource.h"
 #include "nativesurface.h"
+#include "pixelcopy.h"
 #include "overlaylayer.h"
 #include "renderer.h"
 #include "resourcemanager.h"
@@ -30,6 +31,9 @@
 
 #include <sys/mman.h>
 
+#include <algorithm>
+#include <thread>
+
 namespace hwcomposer {
 
 #define DMA_BUF_SYNC_READ (1 << 0)
@@ -40,17 +44,59 @@ namespace hwcomposer {
 #define DMA_BUF_BASE 'b'
 #define DMA_BUF_IOCTL_SYNC _IOW(DMA_BUF_BASE, 0, struct dma_buf_sync)
 
+// Uploads smaller than this are copied by the uploader thread alone, the
+// hand off to the workers costs more than it saves.
+#define PARALLEL_COPY_THRESHOLD (256 * 1024)
+#define MAX_COPY_WORKERS 2
+
 struct dma_buf_sync {
   __u64 flags;
 };
 
+class PixelCopyWorker : public HWCThread {
+ public:
+  PixelCopyWorker() : HWCThread(-8, "PixelCopyWorker") {
+  }
+
+  ~PixelCopyWorker() override {
+    HWCThread::Exit();
+  }
+
+  bool Initialize() {
+    if (!done_.Initialize())
+      return false;
+
+    return InitWorker();
+  }
+
+  void Queue(std::vector<CopyJob>& jobs) {
+    jobs_.swap(jobs);
+    Resume();
+  }
+
+  void Wait() {
+    done_.Wait();
+  }
+
+ protected:
+  void HandleRoutine() override {
+    for (const CopyJob& job : jobs_)
+      CopyRows(job);
+
+    jobs_.clear();
+    done_.Signal();
+  }
+
+ private:
+  std::vector<CopyJob> jobs_;
+  HWCEvent done_;
+};
+
 PixelUploader::PixelUploader(const NativeBufferHandler* buffer_handler)
     : HWCThread(-8, "PixelUploader"), buffer_handler_(buffer_handler) {
-  if (!cevent_.Initialize())
-    return;
-
-  fd_chandler_.AddFd(cevent_.get_fd());
   gpu_fd_ = buffer_handler_->GetFd();
+  if (!timeline_.Initialize())
+    ITRACE("No sw_sync timeline available, uploads stay synchronous.");
 }
 
 PixelUploader::~PixelUploader() {
@@ -59,6 +105,20 @@ PixelUploader::~PixelUploader() {
 void PixelUploader::Initialize() {
   if (!InitWorker()) {
     ETRACE("Failed to initalize PixelUploader. %s", PRINTERROR());
+    return;
+  }
+
+  uint32_t cores = std::thread::hardware_concurrency();
+  uint32_t total_workers = cores > 1 ? cores - 1 : 0;
+  total_workers = std::min<uint32_t>(total_workers, MAX_COPY_WORKERS);
+  while (workers_.size() < total_workers) {
+    std::unique_ptr<PixelCopyWorker> worker(new PixelCopyWorker());
+    if (!worker->Initialize()) {
+      ETRACE("Failed to initalize PixelCopyWorker. %s", PRINTERROR());
+      break;
+    }
+
+    workers_.emplace_back(std::move(worker));
   }
 }
 
@@ -70,8 +130,10 @@ void PixelUploader::RegisterPixelUploaderCallback(
 void PixelUploader::UpdateLayerPixelData(
     HWCNativeHandle handle, uint32_t original_width, uint32_t original_height,
     uint32_t original_stride, void* callback_data, uint8_t* byteaddr,
-    PixelUploaderLayerCallback* layer_callback, HwcRect<int> surfaceDamage) {
-  pixel_data_lock_.lock();
+    PixelUploaderLayerCallback* layer_callback,
+    const HwcRegion& surface_damage, int32_t* upload_fence) {
+  *upload_fence = -1;
+  std::unique_lock<std::mutex> lock(pixel_data_lock_);
   pixel_data_.emplace_back();
   PixelData& temp = pixel_data_.back();
   temp.handle_ = handle;
@@ -81,105 +143,88 @@ void PixelUploader::UpdateLayerPixelData(
   temp.callback_data_ = callback_data;
   temp.data_ = byteaddr;
   temp.layer_callback_ = layer_callback;
-  temp.surfaceDamage = surfaceDamage;
-
-  tasks_lock_.lock();
-  tasks_ |= kRefreshRawPixelMap;
-  tasks_lock_.unlock();
-  Resume();
-  pixel_data_lock_.unlock();
-  Wait();
+  temp.surface_damage_ = surface_damage;
+  uint64_t id = ++queued_;
+  // Fences are created in queue order, the timeline is advanced once per
+  // completed upload.
+  int32_t fence = -1;
+  if (timeline_.IsValid())
+    fence = timeline_.CreateFence("iahwc_upload");
+  lock.unlock();
+
+  if (!initialized_) {
+    HandleRawPixelUpdate();
+  } else {
+    Resume();
+  }
+
+  // The client learns through the end access callback when byteaddr can
+  // be reused, we only need to know the copy has started. Without a
+  // callback we have to wait for the copy to complete.
+  if (callback_ && fence > 0) {
+    WaitFor(started_, id);
+    *upload_fence = fence;
+    return;
+  }
+
+  WaitFor(completed_, id);
+  if (fence > 0)
+    close(fence);
 }
 
 void PixelUploader::Synchronize() {
-  sync_lock_.lock();
-  sync_lock_.unlock();
+  uint64_t id = 0;
+  {
+    std::lock_guard<std::mutex> lock(pixel_data_lock_);
+    id = queued_;
+  }
+
+  WaitFor(completed_, id);
 }
 
 void PixelUploader::ExitThread() {
   HWCThread::Exit();
-  std::vector<PixelData>().swap(pixel_data_);
+  std::vector<std::unique_ptr<PixelCopyWorker>>().swap(workers_);
 }
 
 void PixelUploader::HandleExit() {
+  // Complete anything still queued, callers might be waiting on it.
+  HandleRawPixelUpdate();
 }
 
 void PixelUploader::HandleRoutine() {
   HandleRawPixelUpdate();
 }
 
-void PixelUploader::Wait() {
-  if (fd_chandler_.Poll(-1) <= 0) {
-    ETRACE("Poll Failed in PixelUploader %s", PRINTERROR());
-    return;
-  }
-
-  if (fd_chandler_.IsReady(cevent_.get_fd())) {
-    // If eventfd_ is ready, we need to wait on it (using read()) to clean
-    // the flag that says it is ready.
-    cevent_.Wait();
-  }
+void PixelUploader::WaitFor(const uint64_t& counter, uint64_t value) {
+  std::unique_lock<std::mutex> lock(pixel_data_lock_);
+  progress_.wait(lock, [&counter, value] { return counter >= value; });
 }
 
 void PixelUploader::HandleRawPixelUpdate() {
-  tasks_lock_.lock();
-  tasks_ &= ~kRefreshRawPixelMap;
-  tasks_lock_.unlock();
-
-  pixel_data_lock_.lock();
-  sync_lock_.lock();
-  if (pixel_data_.empty()) {
-    pixel_data_lock_.unlock();
-    sync_lock_.unlock();
-    return;
-  }
-
   std::vector<PixelData> texture_uploads;
-  for (auto& buffer : pixel_data_) {
-    texture_uploads.emplace_back(buffer);
+  {
+    std::lock_guard<std::mutex> lock(pixel_data_lock_);
+    texture_uploads.swap(pixel_data_);
   }
 
-  std::vector<PixelData>().swap(pixel_data_);
-  pixel_data_lock_.unlock();
-  bool signal = true;
+  if (texture_uploads.empty())
+    return;
 
   for (auto& buffer : texture_uploads) {
     if (callback_) {
       // Notify everyone that we are going to access this data.
       callback_->Callback(true, buffer.callback_data_);
-      if (signal) {
-        cevent_.Signal();
-        signal = false;
-      }
     }
 
-    uint8_t* ptr = NULL;
-    size_t size = buffer.handle_->meta_data_.height_ *
-                  buffer.handle_->meta_data_.pitches_[0];
-    uint32_t prime_fd = buffer.handle_->meta_data_.prime_fds_[0];
-
-    uint32_t mapStride = buffer.original_stride_;
-    uint32_t bpp = mapStride / buffer.original_width_;
-    uint32_t x1 = buffer.surfaceDamage.left, y1 = buffer.surfaceDamage.top;
-    uint32_t x2 = buffer.surfaceDamage.right, y2 = buffer.surfaceDamage.bottom;
-    uint32_t startx = x1 * bpp;
-    uint32_t block_size = (x2 - x1) * bpp;
-
-    if (prime_fd > 0) {
-      ptr = (uint8_t*)Map(buffer.handle_->meta_data_.prime_fds_[0], size);
+    {
+      std::lock_guard<std::mutex> lock(pixel_data_lock_);
+      started_++;
     }
 
-    if (!ptr) {
-      // FIXME: Create texture and do texture upload.
-    } else {
-      for (int i = y1; i < y2; i++) {
-        memcpy(ptr + (i * buffer.handle_->meta_data_.pitches_[0] + startx),
-               buffer.data_ + (i * mapStride + startx), block_size);
-      }
-    }
+    progress_.notify_all();
 
-    if (ptr)
-      Unmap(buffer.handle_->meta_data_.prime_fds_[0], ptr, size);
+    Upload(buffer);
 
     if (callback_) {
       // Notify everyone that we are done accessing this data.
@@ -189,36 +234,113 @@ void PixelUploader::HandleRawPixelUpdate() {
     if (buffer.layer_callback_) {
       buffer.layer_callback_->UploadDone();
     }
-  }
 
-  sync_lock_.unlock();
+    if (timeline_.IsValid())
+      timeline_.Signal();
+
+    {
+      std::lock_guard<std::mutex> lock(pixel_data_lock_);
+      completed_++;
+    }
+
+    progress_.notify_all();
+  }
 }
 
-void* PixelUploader::Map(uint32_t prime_fd, size_t size) {
-  void* addr =
-      mmap(nullptr, size, (PROT_READ | PROT_WRITE), MAP_SHARED, prime_fd, 0);
-  if (addr == MAP_FAILED)
-    return nullptr;
+void PixelUploader::Upload(const PixelData& buffer) {
+  uint8_t* ptr = Map(buffer.handle_);
+  if (!ptr) {
+    // FIXME: Create texture and do texture upload.
+    return;
+  }
 
+  uint32_t prime_fd = buffer.handle_->meta_data_.prime_fds_[0];
   struct dma_buf_sync sync_start = {0};
   sync_start.flags = DMA_BUF_SYNC_START | DMA_BUF_SYNC_RW;
-  int rv = ioctl(prime_fd, DMA_BUF_IOCTL_SYNC, &sync_start);
-  if (rv) {
+  if (ioctl(prime_fd, DMA_BUF_IOCTL_SYNC, &sync_start)) {
     ETRACE("DMA_BUF_IOCTL_SYNC failed during Map \n");
-    munmap(addr, size);
-    return nullptr;
+    return;
   }
 
-  return addr;
-}
+  uint32_t map_stride = buffer.original_stride_;
+  uint32_t bpp = map_stride / buffer.original_width_;
+  uint32_t pitch = buffer.handle_->meta_data_.pitches_[0];
+  std::vector<CopyJob> jobs;
+  size_t total_bytes = 0;
+  for (const HwcRect<int>& rect : buffer.surface_damage_) {
+    int left = std::max(rect.left, 0);
+    int top = std::max(rect.top, 0);
+    int right = std::min<int>(rect.right, buffer.original_width_);
+    int bottom = std::min<int>(rect.bottom, buffer.original_height_);
+    if (left >= right || top >= bottom)
+      continue;
+
+    uint32_t startx = left * bpp;
+    jobs.emplace_back();
+    CopyJob& job = jobs.back();
+    job.dst_ = ptr + top * pitch + startx;
+    job.dst_pitch_ = pitch;
+    job.src_ = buffer.data_ + top * map_stride + startx;
+    job.src_pitch_ = map_stride;
+    job.rows_ = bottom - top;
+    job.bytes_ = (right - left) * bpp;
+    total_bytes += job.rows_ * job.bytes_;
+  }
+
+  size_t total_workers = workers_.size();
+  if (total_bytes < PARALLEL_COPY_THRESHOLD || !total_workers) {
+    for (const CopyJob& job : jobs)
+      CopyRows(job);
+  } else {
+    // Every worker gets an equal band of rows of each rect, the uploader
+    // thread takes the last one.
+    size_t slices = total_workers + 1;
+    std::vector<std::vector<CopyJob>> worker_jobs(slices);
+    for (const CopyJob& job : jobs) {
+      uint32_t rows_per_slice = (job.rows_ + slices - 1) / slices;
+      uint32_t row = 0;
+      for (size_t i = 0; i < slices && row < job.rows_; i++) {
+        CopyJob slice = job;
+        slice.rows_ = std::min(rows_per_slice, job.rows_ - row);
+        slice.dst_ += row * job.dst_pitch_;
+        slice.src_ += row * job.src_pitch_;
+        worker_jobs[i].emplace_back(slice);
+        row += slice.rows_;
+      }
+    }
+
+    for (size_t i = 0; i < total_workers; i++)
+      workers_[i]->Queue(worker_jobs[i]);
+
+    for (const CopyJob& job : worker_jobs[total_workers])
+      CopyRows(job);
 
-void PixelUploader::Unmap(uint32_t prime_fd, void* addr, size_t size) {
-  if (addr) {
-    struct dma_buf_sync sync_start = {0};
-    sync_start.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW;
-    ioctl(prime_fd, DMA_BUF_IOCTL_SYNC, &sync_start);
-    munmap(addr, size);
+    for (size_t i = 0; i < total_workers; i++)
+      workers_[i]->Wait();
   }
+
+  struct dma_buf_sync sync_end = {0};
+  sync_end.flags = DMA_BUF_SYNC_END | DMA_BUF_SYNC_RW;
+  ioctl(prime_fd, DMA_BUF_IOCTL_SYNC, &sync_end);
+}
+
+uint8_t* PixelUploader::Map(HWCNativeHandle handle) {
+  if (handle->pixel_memory_)
+    return static_cast<uint8_t*>(handle->pixel_memory_);
+
+  uint32_t prime_fd = handle->meta_data_.prime_fds_[0];
+  if (prime_fd <= 0)
+    return nullptr;
+
+  size_t size = handle->meta_data_.height_ * handle->meta_data_.pitches_[0];
+  void* addr =
+      mmap(nullptr, size, (PROT_READ | PROT_WRITE), MAP_SHARED, prime_fd, 0);
+  if (addr == MAP_FAILED)
+    return nullptr;
+
+  // Mapping stays around till the buffer is released.
+  handle->pixel_memory_ = addr;
+  return static_cast<uint8_t*>(addr);
 }
 
 }  // namespace hwcomposer
@@ -20,18 +20,20 @@
 #include <platformdefines.h>
 #include <spinlock.h>
 
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <vector>
 
 #include "factory.h"
 #include "hwcthread.h"
 
-#include "fdhandler.h"
-#include "hwcevent.h"
+#include "hwcsynctimeline.h"
 
 namespace hwcomposer {
 
 class NativeBufferHandler;
+class PixelCopyWorker;
 
 class RawPixelUploadCallback {
  public:
@@ -57,11 +59,18 @@ class PixelUploader : public HWCThread {
   void RegisterPixelUploaderCallback(
       std::shared_ptr<RawPixelUploadCallback> callback);
 
+  // Queues an upload of surface_damage from byteaddr to handle and returns
+  // once the uploader has started accessing byteaddr, i.e. the start access
+  // callback has been called. upload_fence is set to a fence which is
+  // signaled once the copy has completed or -1 in case the upload has
+  // already completed when this returns. The mapping of handle is cached
+  // in it and released with the buffer.
   void UpdateLayerPixelData(HWCNativeHandle handle, uint32_t original_width,
                             uint32_t original_height, uint32_t original_stride,
                             void* callback_data, uint8_t* byteaddr,
                             PixelUploaderLayerCallback* layer_callback,
-                            HwcRect<int> surfaceDamage);
+                            const HwcRegion& surface_damage,
+                            int32_t* upload_fence);
 
   const NativeBufferHandler* GetNativeBufferHandler() const {
     return buffer_handler_;
@@ -71,15 +80,10 @@ class PixelUploader : public HWCThread {
   void HandleExit() override;
   void ExitThread();
 
+  // Blocks till all queued uploads have completed.
   void Synchronize();
 
  private:
-  enum Tasks {
-    kNone = 0,  // No tasks
-    kRefreshRawPixelMap = 1 << 1,
-    kHandleTextureUpload = 1 << 2
-  };
-
   struct PixelData {
     HWCNativeHandle handle_;
     uint32_t original_width_ = 0;
@@ -88,23 +92,28 @@ class PixelUploader : public HWCThread {
     void* callback_data_ = 0;
     uint8_t* data_ = NULL;
     PixelUploaderLayerCallback* layer_callback_ = NULL;
-    HwcRect<int> surfaceDamage;
+    HwcRegion surface_damage_;
   };
 
   void HandleRawPixelUpdate();
-  void* Map(uint32_t prime_fd, size_t size);
-  void Unmap(uint32_t prime_fd, void* addr, size_t size);
-  void Wait();
+  void Upload(const PixelData& buffer);
+  uint8_t* Map(HWCNativeHandle handle);
+  void WaitFor(const uint64_t& counter, uint64_t value);
 
   std::shared_ptr<RawPixelUploadCallback> callback_ = NULL;
-  SpinLock tasks_lock_;
-  SpinLock pixel_data_lock_;
-  SpinLock sync_lock_;
+  std::mutex pixel_data_lock_;
   std::vector<PixelData> pixel_data_;
-  uint32_t tasks_ = kNone;
+  // Number of uploads queued, picked up by the uploader thread and
+  // completed. Guarded by pixel_data_lock_, progress_ is notified whenever
+  // started_ or completed_ advance. Clients and the display thread can
+  // wait at the same time, so every waiter has to be woken.
+  uint64_t queued_ = 0;
+  uint64_t started_ = 0;
+  uint64_t completed_ = 0;
+  std::condition_variable progress_;
+  HWCSyncTimeline timeline_;
+  std::vector<std::unique_ptr<PixelCopyWorker>> workers_;
   uint32_t gpu_fd_ = 0;
-  FDHandler fd_chandler_;
-  HWCEvent cevent_;
   const NativeBufferHandler* buffer_handler_ = NULL;
 };
 
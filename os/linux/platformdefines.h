@@ -32,7 +32,32 @@
 
 #include "platformcommondefines.h"
 
-#define HAL_DATASPACE_RANGE_FULL 0x8000000
+// Dataspace bits as defined by Android's system/graphics.h.
+#define HAL_DATASPACE_STANDARD_SHIFT 16
+#define HAL_DATASPACE_STANDARD_MASK (63 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_UNSPECIFIED 0
+#define HAL_DATASPACE_STANDARD_BT709 (1 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_BT601_625 (2 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_BT601_625_UNADJUSTED \
+  (3 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_BT601_525 (4 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_BT601_525_UNADJUSTED \
+  (5 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_BT2020 (6 << HAL_DATASPACE_STANDARD_SHIFT)
+#define HAL_DATASPACE_STANDARD_BT2020_CONSTANT_LUMINANCE \
+  (7 << HAL_DATASPACE_STANDARD_SHIFT)
+
+#define HAL_DATASPACE_RANGE_SHIFT 27
+#define HAL_DATASPACE_RANGE_MASK (7 << HAL_DATASPACE_RANGE_SHIFT)
+#define HAL_DATASPACE_RANGE_UNSPECIFIED 0
+#define HAL_DATASPACE_RANGE_FULL (1 << HAL_DATASPACE_RANGE_SHIFT)
+#define HAL_DATASPACE_RANGE_LIMITED (2 << HAL_DATASPACE_RANGE_SHIFT)
+
+// Legacy dataspaces.
+#define HAL_DATASPACE_JFIF 0x101
+#define HAL_DATASPACE_BT601_625 0x102
+#define HAL_DATASPACE_BT601_525 0x103
+#define HAL_DATASPACE_BT709 0x104
 
 struct gbm_handle {
   union {
@@ -147,6 +147,41 @@ enum class HWCDisplayCapability : uint32_t {
   kDisplayCapabilityDoze = 2
 };
 
+// Matrix used to convert YUV content to RGB.
+enum class HWCColorStandard : int32_t {
+  kColorStandardBT601 = 0,
+  kColorStandardBT709 = 1,
+  kColorStandardBT2020 = 2
+};
+
+enum class HWCColorPrimaries : int32_t {
+  kColorPrimariesBT601_625 = 0,
+  kColorPrimariesBT601_525 = 1,
+  kColorPrimariesBT709 = 2,
+  kColorPrimariesBT2020 = 3
+};
+
+enum class HWCColorRange : int32_t {
+  kColorRangeLimited = 0,
+  kColorRangeFull = 1
+};
+
+// Colour encoding of YUV content, derived from the dataspace of a layer.
+struct HwcColorDescription {
+  HWCColorStandard standard_ = HWCColorStandard::kColorStandardBT601;
+  HWCColorPrimaries primaries_ = HWCColorPrimaries::kColorPrimariesBT601_625;
+  HWCColorRange range_ = HWCColorRange::kColorRangeLimited;
+  // False if the dataspace doesn't specify a standard and it has been
+  // guessed from the content height.
+  bool standard_specified_ = false;
+
+  bool operator==(const HwcColorDescription& other) const {
+    return standard_ == other.standard_ && primaries_ == other.primaries_ &&
+           range_ == other.range_ &&
+           standard_specified_ == other.standard_specified_;
+  }
+};
+
 struct EnumClassHash {
   template <typename T>
   std::size_t operator()(T t) const {
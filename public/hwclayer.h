@@ -34,8 +34,6 @@ struct HwcLayer {
 
   HwcLayer() = default;
 
-  HwcLayer& operator=(const HwcLayer& rhs) = delete;
-
   void SetNativeHandle(HWCNativeHandle handle);
 
   HWCNativeHandle GetNativeHandle() const {
@@ -112,6 +110,13 @@ struct HwcLayer {
     return surface_damage_;
   }
 
+  /**
+   * API for getting the rects of surface damage of this layer.
+   */
+  const HwcRegion& GetSurfaceDamageRegion() const {
+    return surface_damage_region_;
+  }
+
   /**
    * API for querying if content of layer has changed
    * for last Present call to NativeDisplay.
@@ -282,7 +287,17 @@ struct HwcLayer {
    */
   const HwcRect<int>& GetLayerDamage();
 
+  /**
+   * API for getting damage area caused by this layer for current
+   * frame update as a list of rects. Bounds of it are always equal
+   * to GetLayerDamage().
+   */
+  const HwcRegion& GetLayerDamageRegion();
+
  private:
+  // Copies the fence fds as is, the caller has to sort out their ownership.
+  HwcLayer& operator=(const HwcLayer& rhs) = default;
+
   void Validate();
   void UpdateRenderingDamage(const HwcRect<int>& old_rect,
                              const HwcRect<int>& newrect, bool same_rect);
@@ -331,6 +346,8 @@ struct HwcLayer {
   HwcRect<int> surface_damage_;
   HwcRect<int> visible_rect_;
   HwcRect<int> current_rendering_damage_;
+  HwcRegion surface_damage_region_;
+  HwcRegion current_rendering_damage_region_;
   HWCBlending blending_ = HWCBlending::kBlendingNone;
   HWCNativeHandle sf_handle_ = 0;
   int32_t release_fd_ = -1;
@@ -53,6 +53,17 @@ bool IsLayerAlphaBlendingCommitted(OverlayLayer* layer);
  */
 void ResetRectToRegion(const HwcRegion& hwc_region, HwcRect<int>& rect);
 
+/**
+ * Add a rectangle to a region, coalescing it with the rectangles it touches
+ *
+ * Has no effect if the rectangle has no bounds. The region is kept to a
+ * handful of rectangles, the pair wasting the least area is merged when it
+ * grows beyond that. Bounds of the region are always preserved.
+ * @param rect The rectangle to add
+ * @param region The region to be expanded
+ */
+void AddRectToRegion(const HwcRect<int>& rect, HwcRegion& region);
+
 /**
  * Expand the bounds of a rectangle to enclose the bounds of a target rectangle
  *
@@ -82,6 +93,18 @@ void CalculateSourceRect(const HwcRect<float>& target_rect,
  */
 bool IsSupportedMediaFormat(uint32_t format);
 
+/**
+ * Get the colour encoding of YUV content
+ *
+ * @param dataspace dataspace of the content
+ * @param height height of the content, content which doesn't specify its
+ *        standard is assumed to be BT.601 if SD and BT.709 if HD
+ * @return Colour standard, primaries and range of the content, with
+ *         standard_specified_ false if the standard has been guessed
+ */
+HwcColorDescription DataSpaceToColorDescription(uint32_t dataspace,
+                                                uint32_t height);
+
 /**
  * Check how many planes are used for a given pixel format
  *
@@ -95,6 +118,27 @@ uint32_t GetTotalPlanesForFormat(uint32_t format);
  */
 bool IsEdidFilting();
 
+/**
+ * Create a directory and its missing parents, like mkdir -p.
+ *
+ * @param path directory to create
+ * @return true if path exists once done, false otherwise
+ */
+bool CreateDirectories(const std::string& path);
+
+/**
+ * Write a file as a whole, creating its missing parent directories.
+ *
+ * The file is written to a temporary file first and then renamed, so that
+ * a concurrent reader never sees a partially written file.
+ *
+ * @param header written first, can be NULL if header_size is 0
+ * @param data written after header
+ * @return true if the file has been replaced, false otherwise
+ */
+bool WriteFileAtomically(const std::string& path, const void* header,
+                         size_t header_size, const void* data, size_t size);
+
 /**
  * Check if two rectangles overlap
  *
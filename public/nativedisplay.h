@@ -134,6 +134,20 @@ class NativeDisplay {
                                     uint32_t display_id) = 0;
   virtual void VSyncControl(bool enabled) = 0;
 
+  /**
+   * API for querying how late the next frame can be presented.
+   * @param deadline will be populated with the latest time Present can be
+   *        called for the frame to be shown on vblank. Clients can use this
+   *        to start rendering as late as possible.
+   * @param vblank will be populated with the time of the predicted vblank.
+   *        Both are CLOCK_MONOTONIC timestamps in ns.
+   * @return false if vblanks of the display can't be predicted yet.
+   */
+  virtual bool GetPresentDeadline(int64_t * /*deadline*/,
+                                  int64_t * /*vblank*/) {
+    return false;
+  }
+
   /**
    * API for registering for refresh callback requests.
    * @param callback, function which will be used by HWC to request client to
@@ -17,23 +17,96 @@
 #ifndef PUBLIC_SPINLOCK_H_
 #define PUBLIC_SPINLOCK_H_
 
+#include <sched.h>
+#include <stdint.h>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
 #include <atomic>
 
 namespace hwcomposer {
 
+// Lock for short critical sections. Contended callers spin for a bounded
+// time with exponential backoff and then sleep on a futex, so a preempted
+// lock holder doesn't keep the waiters burning their cores.
 class SpinLock {
  public:
   void lock() {
-    while (atomic_lock_.test_and_set(std::memory_order_acquire)) {
+    int expected = kUnlocked;
+    if (!state_.compare_exchange_strong(expected, kLocked,
+                                        std::memory_order_acquire)) {
+      LockContended();
     }
   }
 
   void unlock() {
-    atomic_lock_.clear(std::memory_order_release);
+    if (state_.exchange(kUnlocked, std::memory_order_release) == kSleeping)
+      Wake();
   }
 
  private:
-  std::atomic_flag atomic_lock_ = ATOMIC_FLAG_INIT;
+  enum State { kUnlocked = 0, kLocked = 1, kSleeping = 2 };
+  // Pause instructions spun at most between two attempts.
+  static const uint32_t kMaxBackoff = 64;
+  // Attempts before going to sleep.
+  static const uint32_t kSpinAttempts = 10;
+
+  static void Pause() {
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+    asm volatile("yield" ::: "memory");
+#endif
+  }
+
+  void LockContended() {
+    uint32_t backoff = 1;
+    for (uint32_t attempt = 0; attempt < kSpinAttempts; attempt++) {
+      for (uint32_t i = 0; i < backoff; i++)
+        Pause();
+
+      if (backoff < kMaxBackoff)
+        backoff <<= 1;
+
+      int expected = kUnlocked;
+      if (state_.load(std::memory_order_relaxed) == kUnlocked &&
+          state_.compare_exchange_weak(expected, kLocked,
+                                       std::memory_order_acquire)) {
+        return;
+      }
+    }
+
+    // Marking the lock as having sleepers makes unlock() wake us up. We may
+    // end up owning it in this state, which only costs a spurious wake.
+    while (state_.exchange(kSleeping, std::memory_order_acquire) !=
+           kUnlocked) {
+      Sleep();
+    }
+  }
+
+  void Sleep() {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<int*>(&state_), FUTEX_WAIT_PRIVATE,
+            kSleeping, NULL, NULL, 0);
+#else
+    sched_yield();
+#endif
+  }
+
+  void Wake() {
+#ifdef __linux__
+    syscall(SYS_futex, reinterpret_cast<int*>(&state_), FUTEX_WAKE_PRIVATE, 1,
+            NULL, NULL, 0);
+#endif
+  }
+
+  static_assert(sizeof(std::atomic<int>) == sizeof(int),
+                "futex needs a plain int");
+  std::atomic<int> state_{kUnlocked};
 };
 
 class ScopedSpinLock {
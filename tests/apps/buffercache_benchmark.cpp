@@ -0,0 +1,196 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures the per frame cost of ResourceManager buffer lookups for 1 to
+// 64 triple buffered layers.
+//
+// Usage: buffercache_benchmark [frames]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <memory>
+
+#include "overlaybuffer.h"
+#include "resourcemanager.h"
+
+namespace hwcomposer {
+
+// Buffer without any backing resources, only its identity matters to
+// the cache.
+class FakeBuffer : public OverlayBuffer {
+ public:
+  void InitializeFromNativeHandle(HWCNativeHandle /*handle*/,
+                                  ResourceManager* /*manager*/) override {
+  }
+
+  uint32_t GetDataSpace() const override {
+    return 0;
+  }
+
+  uint32_t GetWidth() const override {
+    return 0;
+  }
+
+  uint32_t GetHeight() const override {
+    return 0;
+  }
+
+  uint32_t GetFormat() const override {
+    return 0;
+  }
+
+  HWCLayerType GetUsage() const override {
+    return kLayerNormal;
+  }
+
+  uint32_t GetFb(bool* /*isNewCreated*/) override {
+    return 0;
+  }
+
+  uint32_t GetPrimeFD() const override {
+    return 0;
+  }
+
+  const uint32_t* GetPitches() const override {
+    return NULL;
+  }
+
+  const uint32_t* GetOffsets() const override {
+    return NULL;
+  }
+
+  uint32_t GetTilingMode() const override {
+    return 0;
+  }
+
+  void SetDataSpace(uint32_t /*dataspace*/) override {
+  }
+
+  bool GetInterlace() override {
+    return false;
+  }
+
+  void SetInterlace(bool /*isInterlaced*/) override {
+  }
+
+  const ResourceHandle& GetGpuResource(GpuDisplay /*egl_display*/,
+                                       bool /*external_import*/) override {
+    return image_;
+  }
+
+  const ResourceHandle& GetGpuResource() override {
+    return image_;
+  }
+
+  const MediaResourceHandle& GetMediaResource(MediaDisplay /*display*/,
+                                              uint32_t /*width*/,
+                                              uint32_t /*height*/) override {
+    return media_image_;
+  }
+
+  bool CreateFrameBufferWithModifier(uint64_t /*modifier*/) override {
+    return false;
+  }
+
+  HWCNativeHandle GetOriginalHandle() const override {
+    return handle_;
+  }
+
+  void SetOriginalHandle(HWCNativeHandle handle) override {
+    handle_ = handle;
+  }
+
+  void Dump() override {
+  }
+
+ private:
+  ResourceHandle image_;
+  MediaResourceHandle media_image_;
+  HWCNativeHandle handle_ = 0;
+};
+
+}  // namespace hwcomposer
+
+using hwcomposer::FakeBuffer;
+using hwcomposer::OverlayBuffer;
+using hwcomposer::ResourceManager;
+
+static const uint32_t kBuffersPerLayer = 3;
+
+// Does what DisplayQueue does with the cache for one frame of layers
+// layers, returns the number of buffers which weren't in the cache.
+static uint32_t PresentFrame(ResourceManager* manager, uint32_t layers,
+                             uint32_t frame) {
+  uint32_t misses = 0;
+  manager->RefreshBufferCache();
+  for (uint32_t i = 0; i < layers; i++) {
+    uint32_t id = i * kBuffersPerLayer + frame % kBuffersPerLayer + 1;
+    if (manager->FindCachedBuffer(id))
+      continue;
+
+    std::shared_ptr<OverlayBuffer> buffer = std::make_shared<FakeBuffer>();
+    manager->RegisterBuffer(id, buffer);
+    misses++;
+  }
+
+  manager->PreparePurgedResources();
+  return misses;
+}
+
+int main(int argc, char** argv) {
+  uint32_t frames = 100000;
+  if (argc > 1)
+    frames = strtoul(argv[1], NULL, 10);
+
+  int failures = 0;
+  printf("layers  ns per frame\n");
+  for (uint32_t layers = 1; layers <= 64; layers *= 4) {
+    ResourceManager manager(NULL);
+    for (uint32_t frame = 0; frame < kBuffersPerLayer; frame++)
+      PresentFrame(&manager, layers, frame);
+
+    uint32_t misses = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++)
+      misses += PresentFrame(&manager, layers, frame);
+
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    printf("%6u  %12.0f\n", layers, frames ? ns / frames : 0);
+    // Every buffer is reused within BUFFER_CACHE_LENGTH frames.
+    if (misses) {
+      fprintf(stderr, "%u layers: %u unexpected cache misses\n", layers,
+              misses);
+      failures++;
+    }
+
+    // Once the layers go away their buffers have to be released.
+    for (uint32_t frame = 0; frame < BUFFER_CACHE_LENGTH; frame++)
+      PresentFrame(&manager, 0, frame);
+
+    if (manager.FindCachedBuffer(1)) {
+      fprintf(stderr, "%u layers: stale buffers not evicted\n", layers);
+      failures++;
+    }
+
+    manager.PurgeBuffer();
+  }
+
+  return failures ? 1 : 0;
+}
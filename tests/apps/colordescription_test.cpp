@@ -0,0 +1,175 @@
+/*
+// Copyright (c) 2016 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Checks DataSpaceToColorDescription against a table of dataspaces, and
+// the conversion of the resulting descriptions to VA color properties.
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <hwcdefs.h>
+#include <platformdefines.h>
+
+#include "hwcutils.h"
+#include "vautils.h"
+
+using hwcomposer::HWCColorPrimaries;
+using hwcomposer::HWCColorRange;
+using hwcomposer::HWCColorStandard;
+using hwcomposer::HwcColorDescription;
+
+struct ColorDescriptionCase {
+  const char *name;
+  uint32_t dataspace;
+  uint32_t height;
+  HWCColorStandard standard;
+  HWCColorPrimaries primaries;
+  HWCColorRange range;
+  bool standard_specified;
+};
+
+static const ColorDescriptionCase kCases[] = {
+    {"unknown SD", 0, 480, HWCColorStandard::kColorStandardBT601,
+     HWCColorPrimaries::kColorPrimariesBT601_625,
+     HWCColorRange::kColorRangeLimited, false},
+    {"unknown HD", 0, 720, HWCColorStandard::kColorStandardBT709,
+     HWCColorPrimaries::kColorPrimariesBT709,
+     HWCColorRange::kColorRangeLimited, false},
+    {"full range without standard", HAL_DATASPACE_RANGE_FULL, 1080,
+     HWCColorStandard::kColorStandardBT709,
+     HWCColorPrimaries::kColorPrimariesBT709, HWCColorRange::kColorRangeFull,
+     false},
+    {"legacy JFIF", HAL_DATASPACE_JFIF, 1080,
+     HWCColorStandard::kColorStandardBT601,
+     HWCColorPrimaries::kColorPrimariesBT601_625,
+     HWCColorRange::kColorRangeFull, true},
+    {"legacy BT601_625", HAL_DATASPACE_BT601_625, 1080,
+     HWCColorStandard::kColorStandardBT601,
+     HWCColorPrimaries::kColorPrimariesBT601_625,
+     HWCColorRange::kColorRangeLimited, true},
+    {"legacy BT601_525", HAL_DATASPACE_BT601_525, 480,
+     HWCColorStandard::kColorStandardBT601,
+     HWCColorPrimaries::kColorPrimariesBT601_525,
+     HWCColorRange::kColorRangeLimited, true},
+    {"legacy BT709", HAL_DATASPACE_BT709, 480,
+     HWCColorStandard::kColorStandardBT709,
+     HWCColorPrimaries::kColorPrimariesBT709,
+     HWCColorRange::kColorRangeLimited, true},
+    {"BT601_625 full", HAL_DATASPACE_STANDARD_BT601_625 |
+                           HAL_DATASPACE_RANGE_FULL,
+     1080, HWCColorStandard::kColorStandardBT601,
+     HWCColorPrimaries::kColorPrimariesBT601_625,
+     HWCColorRange::kColorRangeFull, true},
+    {"BT601_525 unadjusted", HAL_DATASPACE_STANDARD_BT601_525_UNADJUSTED, 480,
+     HWCColorStandard::kColorStandardBT601,
+     HWCColorPrimaries::kColorPrimariesBT601_525,
+     HWCColorRange::kColorRangeLimited, true},
+    {"BT709 limited", HAL_DATASPACE_STANDARD_BT709 |
+                          HAL_DATASPACE_RANGE_LIMITED,
+     480, HWCColorStandard::kColorStandardBT709,
+     HWCColorPrimaries::kColorPrimariesBT709,
+     HWCColorRange::kColorRangeLimited, true},
+    {"BT2020 full", HAL_DATASPACE_STANDARD_BT2020 | HAL_DATASPACE_RANGE_FULL,
+     2160, HWCColorStandard::kColorStandardBT2020,
+     HWCColorPrimaries::kColorPrimariesBT2020, HWCColorRange::kColorRangeFull,
+     true},
+    {"BT2020 constant luminance",
+     HAL_DATASPACE_STANDARD_BT2020_CONSTANT_LUMINANCE, 2160,
+     HWCColorStandard::kColorStandardBT2020,
+     HWCColorPrimaries::kColorPrimariesBT2020,
+     HWCColorRange::kColorRangeLimited, true},
+};
+
+struct VAColorCase {
+  const char *name;
+  HWCColorStandard standard;
+  HWCColorRange range;
+  VAProcColorStandardType va_standard;
+  uint8_t va_range;
+};
+
+static const VAColorCase kVACases[] = {
+    {"BT601 limited", HWCColorStandard::kColorStandardBT601,
+     HWCColorRange::kColorRangeLimited, VAProcColorStandardBT601,
+     VA_SOURCE_RANGE_REDUCED},
+    {"BT601 full", HWCColorStandard::kColorStandardBT601,
+     HWCColorRange::kColorRangeFull, VAProcColorStandardBT601,
+     VA_SOURCE_RANGE_FULL},
+    {"BT709 limited", HWCColorStandard::kColorStandardBT709,
+     HWCColorRange::kColorRangeLimited, VAProcColorStandardBT709,
+     VA_SOURCE_RANGE_REDUCED},
+    {"BT709 full", HWCColorStandard::kColorStandardBT709,
+     HWCColorRange::kColorRangeFull, VAProcColorStandardBT709,
+     VA_SOURCE_RANGE_FULL},
+    {"BT2020 limited", HWCColorStandard::kColorStandardBT2020,
+     HWCColorRange::kColorRangeLimited, VAProcColorStandardBT2020,
+     VA_SOURCE_RANGE_REDUCED},
+    {"BT2020 full", HWCColorStandard::kColorStandardBT2020,
+     HWCColorRange::kColorRangeFull, VAProcColorStandardBT2020,
+     VA_SOURCE_RANGE_FULL},
+};
+
+static int TestVAColor() {
+  int failures = 0;
+  for (const VAColorCase &test : kVACases) {
+    HwcColorDescription color;
+    color.standard_ = test.standard;
+    color.range_ = test.range;
+    VAProcColorStandardType standard =
+        hwcomposer::ColorStandardToVA(color.standard_);
+    uint8_t range = hwcomposer::ColorRangeToVA(color);
+    if (standard == test.va_standard && range == test.va_range)
+      continue;
+
+    fprintf(stderr, "%s: got VA standard %d range %d, expected %d %d\n",
+            test.name, standard, range, test.va_standard, test.va_range);
+    failures++;
+  }
+
+  return failures;
+}
+
+int main(int /*argc*/, char ** /*argv*/) {
+  int failures = 0;
+  for (const ColorDescriptionCase &test : kCases) {
+    HwcColorDescription expected;
+    expected.standard_ = test.standard;
+    expected.primaries_ = test.primaries;
+    expected.range_ = test.range;
+    expected.standard_specified_ = test.standard_specified;
+
+    HwcColorDescription color = hwcomposer::DataSpaceToColorDescription(
+        test.dataspace, test.height);
+    if (color == expected)
+      continue;
+
+    fprintf(stderr,
+            "%s: got standard %d primaries %d range %d specified %d, "
+            "expected %d %d %d %d\n",
+            test.name, static_cast<int>(color.standard_),
+            static_cast<int>(color.primaries_), static_cast<int>(color.range_),
+            color.standard_specified_, static_cast<int>(expected.standard_),
+            static_cast<int>(expected.primaries_),
+            static_cast<int>(expected.range_), expected.standard_specified_);
+    failures++;
+  }
+
+  int va_failures = TestVAColor();
+  printf("%d of %zu cases failed\n", failures + va_failures,
+         sizeof(kCases) / sizeof(kCases[0]) +
+             sizeof(kVACases) / sizeof(kVACases[0]));
+  return failures || va_failures ? 1 : 0;
+}
@@ -0,0 +1,381 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures pixels shaded and GPU time per frame when composing a desktop
+// like layer stack with the GL renderer's programs, once for the whole
+// frame and once only for the damaged rects. Regions are split by damage
+// rect the way Compositor does it. Also checks that shading the damage
+// only produces the same pixels inside the damage as a full frame.
+//
+// Usage: damageshading_benchmark [frames]
+// Headless machines can use EGL_PLATFORM=surfaceless.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "disjoint_layers.h"
+#include "egloffscreencontext.h"
+#include "glprogram.h"
+#include "hwcutils.h"
+#include "renderstate.h"
+
+using hwcomposer::HwcRect;
+using hwcomposer::HwcRegion;
+using hwcomposer::Rect;
+using hwcomposer::RectSet;
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+
+// Wallpaper, two overlapping windows, a status bar and a cursor, from
+// bottom to top.
+static const HwcRect<int> kLayers[] = {
+    HwcRect<int>(0, 0, 1920, 1080), HwcRect<int>(100, 100, 1100, 800),
+    HwcRect<int>(600, 300, 1700, 1000), HwcRect<int>(0, 0, 1920, 40),
+    HwcRect<int>(900, 500, 932, 532)};
+static const size_t kLayerCount = sizeof(kLayers) / sizeof(kLayers[0]);
+
+struct Scenario {
+  const char *name;
+  std::vector<HwcRect<int>> damage;
+};
+
+struct Layer {
+  GLuint texture = 0;
+  EGLImageKHR image = EGL_NO_IMAGE_KHR;
+  GLuint external_texture = 0;
+};
+
+// Imports a texture with a pattern the way client buffers are imported,
+// as an EGLImage bound to an external texture.
+static bool CreateLayer(EGLDisplay display, int index, int width, int height,
+                        Layer *layer) {
+  std::vector<uint8_t> pixels(width * height * 4);
+  for (int y = 0; y < height; y++) {
+    for (int x = 0; x < width; x++) {
+      uint8_t *pixel = &pixels[(y * width + x) * 4];
+      pixel[0] = x * (index + 1);
+      pixel[1] = y * (index + 2);
+      pixel[2] = (x ^ y) + index * 50;
+      // Windows are slightly translucent so that layers below show.
+      pixel[3] = index == 0 ? 255 : 224;
+    }
+  }
+
+  glGenTextures(1, &layer->texture);
+  glBindTexture(GL_TEXTURE_2D, layer->texture);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, pixels.data());
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_2D, 0);
+
+  const EGLint attribs[] = {EGL_GL_TEXTURE_LEVEL_KHR, 0, EGL_NONE};
+  layer->image = hwcomposer::eglCreateImageKHR(
+      display, eglGetCurrentContext(), EGL_GL_TEXTURE_2D_KHR,
+      (EGLClientBuffer)(uintptr_t)layer->texture, attribs);
+  if (layer->image == EGL_NO_IMAGE_KHR)
+    return false;
+
+  glGenTextures(1, &layer->external_texture);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, layer->external_texture);
+  hwcomposer::glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                                           (GLeglImageOES)layer->image);
+  glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+  glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+  return glGetError() == GL_NO_ERROR;
+}
+
+class Composer {
+ public:
+  explicit Composer(const std::vector<Layer> &layers) : layers_(layers) {
+    static uint8_t transparent[4] = {0, 0, 0, 0};
+    state_.layer_state_.resize(kLayerCount);
+    for (RenderState::LayerState &src : state_.layer_state_) {
+      src.alpha_ = 1.0f;
+      src.premult_ = 1.0f;
+      src.solid_color_array_ = transparent;
+    }
+
+    for (size_t i = 0; i < kLayerCount; i++)
+      layer_rects_.emplace_back(kLayers[i]);
+  }
+
+  // Splits the stack into regions within the damage rects of region.
+  void PrepareRegions(const HwcRegion &region) {
+    regions_.clear();
+    for (const HwcRect<int> &damage_rect : region)
+      hwcomposer::get_draw_regions(layer_rects_, damage_rect, &regions_);
+  }
+
+  size_t GetRegionCount() const {
+    return regions_.size();
+  }
+
+  uint64_t GetShadedPixels() const {
+    uint64_t pixels = 0;
+    for (const RectSet<int, 1> &region : regions_)
+      pixels += (uint64_t)(region.rect.right - region.rect.left) *
+                (region.rect.bottom - region.rect.top);
+
+    return pixels;
+  }
+
+  bool Draw() {
+    for (const RectSet<int, 1> &region : regions_) {
+      std::vector<size_t> ids;
+      region.id_set.forEachReverse([&ids](size_t id) { ids.push_back(id); });
+      hwcomposer::GLProgram *program = GetProgram(ids.size());
+      if (!program)
+        return false;
+
+      program->UseProgram(ids.size());
+      program->SetLayerUniforms(state_, 0, ids.size());
+      for (size_t i = 0; i < ids.size(); i++) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_EXTERNAL_OES,
+                      layers_[ids[i]].external_texture);
+      }
+
+      DrawRegion(region.rect, ids);
+    }
+
+    return glGetError() == GL_NO_ERROR;
+  }
+
+ private:
+  typedef hwcomposer::RenderState RenderState;
+
+  hwcomposer::GLProgram *GetProgram(size_t count) {
+    if (programs_.size() < count)
+      programs_.resize(count);
+
+    std::unique_ptr<hwcomposer::GLProgram> &program = programs_[count - 1];
+    if (!program) {
+      program.reset(new hwcomposer::GLProgram());
+      if (!program->Init(count)) {
+        program.reset(nullptr);
+        return NULL;
+      }
+    }
+
+    return program.get();
+  }
+
+  // Same vertex layout as GLRenderer: position followed by the texture
+  // coordinates of every layer, two layers per attribute.
+  void DrawRegion(const Rect<int> &rect, const std::vector<size_t> &ids) {
+    const int corners[6][2] = {
+        {rect.left, rect.top},     {rect.right, rect.top},
+        {rect.left, rect.bottom},  {rect.right, rect.top},
+        {rect.right, rect.bottom}, {rect.left, rect.bottom}};
+    size_t stride = 2 + 2 * ids.size();
+    vertices_.resize(6 * stride);
+    for (int v = 0; v < 6; v++) {
+      GLfloat *vertex = &vertices_[v * stride];
+      vertex[0] = (GLfloat)corners[v][0] / kWidth;
+      vertex[1] = (GLfloat)corners[v][1] / kHeight;
+      for (size_t i = 0; i < ids.size(); i++) {
+        const HwcRect<int> &frame = kLayers[ids[i]];
+        vertex[2 + 2 * i] =
+            (GLfloat)(corners[v][0] - frame.left) / (frame.right - frame.left);
+        vertex[3 + 2 * i] =
+            (GLfloat)(corners[v][1] - frame.top) / (frame.bottom - frame.top);
+      }
+    }
+
+    unsigned attribs = 1 + (ids.size() + 1) / 2;
+    GLsizei stride_bytes = sizeof(GLfloat) * stride;
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride_bytes,
+                          vertices_.data());
+    for (unsigned attrib = 1; attrib < attribs; attrib++) {
+      GLint components = 2 * attrib <= ids.size() ? 4 : 2;
+      glVertexAttribPointer(attrib, components, GL_FLOAT, GL_FALSE,
+                            stride_bytes, &vertices_[4 * attrib - 2]);
+    }
+
+    for (unsigned attrib = 0; attrib < attribs; attrib++)
+      glEnableVertexAttribArray(attrib);
+
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+    for (unsigned attrib = 0; attrib < attribs; attrib++)
+      glDisableVertexAttribArray(attrib);
+  }
+
+  const std::vector<Layer> &layers_;
+  std::vector<Rect<int>> layer_rects_;
+  RenderState state_;
+  std::vector<RectSet<int, 1>> regions_;
+  std::vector<std::unique_ptr<hwcomposer::GLProgram>> programs_;
+  std::vector<GLfloat> vertices_;
+};
+
+static HwcRegion MakeRegion(const std::vector<HwcRect<int>> &rects) {
+  HwcRegion region;
+  for (const HwcRect<int> &rect : rects)
+    hwcomposer::AddRectToRegion(rect, region);
+
+  return region;
+}
+
+static void ReadFrame(std::vector<uint8_t> *pixels) {
+  pixels->resize(kWidth * kHeight * 4);
+  glReadPixels(0, 0, kWidth, kHeight, GL_RGBA, GL_UNSIGNED_BYTE,
+               pixels->data());
+}
+
+// Checks pixels shaded for region only match full inside region and were
+// left alone outside of it.
+static bool MatchesInsideDamage(const std::vector<uint8_t> &full,
+                                const std::vector<uint8_t> &partial,
+                                const HwcRegion &region) {
+  for (int y = 0; y < kHeight; y++) {
+    for (int x = 0; x < kWidth; x++) {
+      bool damaged = false;
+      for (const HwcRect<int> &rect : region) {
+        if (x >= rect.left && x < rect.right && y >= rect.top &&
+            y < rect.bottom)
+          damaged = true;
+      }
+
+      // Rect y is GL window y, which is also the row glReadPixels uses.
+      size_t offset = (y * kWidth + x) * 4;
+      static const uint8_t kCleared[4] = {0, 0, 0, 0};
+      const uint8_t *expected = damaged ? &full[offset] : kCleared;
+      if (memcmp(&partial[offset], expected, 4))
+        return false;
+    }
+  }
+
+  return true;
+}
+
+// Returns ms per frame of drawing the regions of composer frames times.
+static double TimeFrames(Composer *composer, uint32_t frames, bool *ok) {
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < frames; frame++)
+    *ok = composer->Draw() && *ok;
+
+  glFinish();
+  auto end = std::chrono::steady_clock::now();
+  double ms = std::chrono::duration<double, std::milli>(end - start).count();
+  return frames ? ms / frames : 0;
+}
+
+int main(int argc, char **argv) {
+  uint32_t frames = 20;
+  if (argc > 1)
+    frames = strtoul(argv[1], NULL, 10);
+
+  hwcomposer::EGLOffScreenContext context;
+  if (!context.Init() || !context.MakeCurrent()) {
+    fprintf(stderr, "Failed to create an EGL context.\n");
+    return 1;
+  }
+
+  hwcomposer::InitializeShims();
+  printf("GL renderer: %s\n", glGetString(GL_RENDERER));
+
+  std::vector<Layer> layers(kLayerCount);
+  for (size_t i = 0; i < kLayerCount; i++) {
+    if (!CreateLayer(context.GetDisplay(), i,
+                     kLayers[i].right - kLayers[i].left,
+                     kLayers[i].bottom - kLayers[i].top, &layers[i])) {
+      fprintf(stderr, "Failed to import layer %zu.\n", i);
+      return 1;
+    }
+  }
+
+  GLuint target = 0;
+  GLuint fb = 0;
+  glGenTextures(1, &target);
+  glBindTexture(GL_TEXTURE_2D, target);
+  glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, kWidth, kHeight, 0, GL_RGBA,
+               GL_UNSIGNED_BYTE, NULL);
+  glGenFramebuffers(1, &fb);
+  glBindFramebuffer(GL_FRAMEBUFFER, fb);
+  glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                         target, 0);
+  if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+    fprintf(stderr, "Render target is incomplete.\n");
+    return 1;
+  }
+
+  glViewport(0, 0, kWidth, kHeight);
+  glClearColor(0, 0, 0, 0);
+
+  Composer composer(layers);
+  // The first scenario shades the whole frame, the others only the damage.
+  std::vector<Scenario> scenarios = {
+      {"full frame", {HwcRect<int>(0, 0, kWidth, kHeight)}},
+      {"caret and clock",
+       {HwcRect<int>(700, 400, 702, 420), HwcRect<int>(1800, 8, 1900, 32)}},
+      {"cursor move",
+       {HwcRect<int>(880, 480, 912, 512), HwcRect<int>(900, 500, 932, 532)}},
+      {"scrolling window", {HwcRect<int>(610, 340, 1690, 990)}},
+      {"video in window", {HwcRect<int>(150, 150, 1050, 656)}}};
+
+  int failures = 0;
+  std::vector<uint8_t> full;
+  std::vector<uint8_t> partial;
+  double full_ms = 0;
+  printf("damage             regions   pixels  ms/frame  speedup\n");
+  for (size_t i = 0; i < scenarios.size(); i++) {
+    const Scenario &scenario = scenarios[i];
+    HwcRegion region = MakeRegion(scenario.damage);
+    composer.PrepareRegions(region);
+    bool ok = true;
+    glClear(GL_COLOR_BUFFER_BIT);
+    double ms = TimeFrames(&composer, frames, &ok);
+    if (i == 0) {
+      full_ms = ms;
+      ReadFrame(&full);
+      if (std::count(full.begin(), full.end(), 0) == (long)full.size()) {
+        fprintf(stderr, "Full frame is empty, layers weren't sampled.\n");
+        failures++;
+      }
+    } else {
+      // Static content, a single damage only pass over a cleared target
+      // has to reproduce the full frame inside the damage.
+      glClear(GL_COLOR_BUFFER_BIT);
+      ok = composer.Draw() && ok;
+      ReadFrame(&partial);
+      if (!MatchesInsideDamage(full, partial, region)) {
+        fprintf(stderr, "%s: pixels differ from the full frame.\n",
+                scenario.name);
+        failures++;
+      }
+    }
+
+    if (!ok) {
+      fprintf(stderr, "%s: GL error while drawing.\n", scenario.name);
+      failures++;
+    }
+
+    printf("%-17s  %7zu  %7llu  %8.3f  %6.1fx\n", scenario.name,
+           composer.GetRegionCount(),
+           (unsigned long long)composer.GetShadedPixels(), ms,
+           ms > 0 ? full_ms / ms : 0);
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,104 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Compares the time get_draw_regions and the implementation it replaced
+// take to split stacks of 2 to 64 overlapping layers on a 1080p display.
+//
+// Usage: drawregions_benchmark [iterations]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <vector>
+
+#include "disjoint_layers.h"
+#include "legacydrawregions.h"
+
+using hwcomposer::HwcRect;
+using hwcomposer::Rect;
+using hwcomposer::RectSet;
+
+static const int kWidth = 1920;
+static const int kHeight = 1080;
+// Different stacks of each size, so that a single layout doesn't decide
+// the result.
+static const size_t kStacks = 16;
+
+// Deterministic random number in [min, max].
+static int Random(uint32_t *seed, int min, int max) {
+  *seed = *seed * 1103515245 + 12345;
+  return min + (*seed >> 8) % (max - min + 1);
+}
+
+// Windows of a desktop, each covering up to half of the display.
+static std::vector<Rect<int>> RandomStack(uint32_t *seed, size_t layers) {
+  std::vector<Rect<int>> stack;
+  for (size_t i = 0; i < layers; i++) {
+    int width = Random(seed, 64, kWidth / 2);
+    int height = Random(seed, 64, kHeight / 2);
+    int left = Random(seed, 0, kWidth - width);
+    int top = Random(seed, 0, kHeight - height);
+    stack.emplace_back(left, top, left + width, top + height);
+  }
+
+  return stack;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 2000;
+  if (argc > 1)
+    iterations = strtoul(argv[1], NULL, 10);
+
+  HwcRect<int> damage(0, 0, kWidth, kHeight);
+  uint32_t seed = 1;
+  printf("layers  regions  sweep us  legacy us\n");
+  for (size_t layers = 2; layers <= 64; layers *= 2) {
+    std::vector<std::vector<Rect<int>>> stacks;
+    for (size_t i = 0; i < kStacks; i++)
+      stacks.emplace_back(RandomStack(&seed, layers));
+
+    // Output vectors are reused the way Compositor reuses its own.
+    std::vector<RectSet<int, 1>> out;
+    size_t regions = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++) {
+      out.clear();
+      hwcomposer::get_draw_regions(stacks[i % kStacks], damage, &out);
+      regions += out.size();
+    }
+
+    auto middle = std::chrono::steady_clock::now();
+    std::vector<legacy::RectSet> legacy_out;
+    for (uint32_t i = 0; i < iterations; i++) {
+      legacy_out.clear();
+      legacy::get_draw_regions(stacks[i % kStacks], damage, &legacy_out);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    double sweep =
+        std::chrono::duration<double, std::micro>(middle - start).count();
+    double legacy =
+        std::chrono::duration<double, std::micro>(end - middle).count();
+    printf("%6zu  %7zu  %8.2f  %9.2f\n", layers,
+           iterations ? regions / iterations : 0,
+           iterations ? sweep / iterations : 0,
+           iterations ? legacy / iterations : 0);
+  }
+
+  return 0;
+}
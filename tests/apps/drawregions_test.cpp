@@ -0,0 +1,239 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Checks get_draw_regions against the implementation it replaced on random
+// layer stacks. The two split the covered area into different rects, so
+// they are compared pixel by pixel: every pixel has to be covered by the
+// same set of layers, and by at most one output rect. The old
+// implementation gets a few stacks wrong, it can extend a rect past its
+// bottom edge. Those are counted, and the new output is checked against
+// the input rects instead.
+//
+// Usage: drawregions_test [iterations]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "disjoint_layers.h"
+#include "legacydrawregions.h"
+
+using hwcomposer::HwcRect;
+using hwcomposer::Rect;
+using hwcomposer::RectIDs;
+using hwcomposer::RectSet;
+using hwcomposer::kMaxRectIDWords;
+
+// Rects are placed on a grid of this size, damage can cover part of it.
+static const int kGridSize = 48;
+
+typedef RectIDs<kMaxRectIDWords> Coverage;
+
+// Deterministic random number in [min, max].
+static int Random(uint32_t *seed, int min, int max) {
+  *seed = *seed * 1103515245 + 12345;
+  return min + (*seed >> 8) % (max - min + 1);
+}
+
+// Rects snap to a coarse grid part of the time, so that edges coincide as
+// they do with real layer stacks. Some rects are empty or inverted.
+static Rect<int> RandomRect(uint32_t *seed) {
+  int step = Random(seed, 0, 1) ? 8 : 1;
+  int left = Random(seed, -2, kGridSize / step) * step;
+  int top = Random(seed, -2, kGridSize / step) * step;
+  int right = left + Random(seed, -1, kGridSize / step) * step;
+  int bottom = top + Random(seed, -1, kGridSize / step) * step;
+  return Rect<int>(left, top, right, bottom);
+}
+
+static HwcRect<int> RandomDamage(uint32_t *seed) {
+  if (Random(seed, 0, 2) == 0)
+    return HwcRect<int>(0, 0, kGridSize, kGridSize);
+
+  int left = Random(seed, 0, kGridSize - 1);
+  int top = Random(seed, 0, kGridSize - 1);
+  return HwcRect<int>(left, top, Random(seed, left + 1, kGridSize),
+                      Random(seed, top + 1, kGridSize));
+}
+
+// Layers covering every pixel of the grid inside damage.
+static std::vector<Coverage> ExpectedCoverage(
+    const std::vector<Rect<int>> &in, const HwcRect<int> &damage) {
+  std::vector<Coverage> pixels(kGridSize * kGridSize);
+  for (size_t id = 0; id < in.size(); id++) {
+    const Rect<int> &rect = in[id];
+    for (int y = std::max(rect.top, damage.top);
+         y < std::min(rect.bottom, damage.bottom); y++) {
+      for (int x = std::max(rect.left, damage.left);
+           x < std::min(rect.right, damage.right); x++)
+        pixels[y * kGridSize + x].add(id);
+    }
+  }
+
+  return pixels;
+}
+
+// Paints the output rects, returns false if any of them overlap or leave
+// the grid.
+template <size_t kWords>
+static bool PaintCoverage(const std::vector<RectSet<int, kWords>> &out,
+                          std::vector<Coverage> *pixels) {
+  pixels->assign(kGridSize * kGridSize, Coverage());
+  std::vector<bool> painted(kGridSize * kGridSize, false);
+  for (const RectSet<int, kWords> &region : out) {
+    Coverage ids;
+    region.id_set.forEachReverse([&ids](size_t id) { ids.add(id); });
+    for (int y = region.rect.top; y < region.rect.bottom; y++) {
+      for (int x = region.rect.left; x < region.rect.right; x++) {
+        if (x < 0 || y < 0 || x >= kGridSize || y >= kGridSize ||
+            painted[y * kGridSize + x])
+          return false;
+
+        painted[y * kGridSize + x] = true;
+        (*pixels)[y * kGridSize + x] = ids;
+      }
+    }
+  }
+
+  return true;
+}
+
+// Paints the output of the old implementation, returns false if any of
+// the rects overlap or leave the grid.
+static bool PaintLegacyCoverage(const std::vector<legacy::RectSet> &out,
+                                std::vector<Coverage> *pixels) {
+  pixels->assign(kGridSize * kGridSize, Coverage());
+  std::vector<bool> painted(kGridSize * kGridSize, false);
+  for (const legacy::RectSet &region : out) {
+    uint64_t bits = region.id_set.getBits();
+    Coverage ids;
+    for (size_t id = 0; id < 64; id++) {
+      if (bits & (((uint64_t)1) << id))
+        ids.add(id);
+    }
+
+    for (int y = region.rect.top; y < region.rect.bottom; y++) {
+      for (int x = region.rect.left; x < region.rect.right; x++) {
+        if (x < 0 || y < 0 || x >= kGridSize || y >= kGridSize ||
+            painted[y * kGridSize + x])
+          return false;
+
+        painted[y * kGridSize + x] = true;
+        (*pixels)[y * kGridSize + x] = ids;
+      }
+    }
+  }
+
+  return true;
+}
+
+static void PrintCase(const std::vector<Rect<int>> &in,
+                      const HwcRect<int> &damage) {
+  fprintf(stderr, "  damage %d,%d %d,%d, rects:", damage.left, damage.top,
+          damage.right, damage.bottom);
+  for (const Rect<int> &rect : in)
+    fprintf(stderr, " [%d,%d %d,%d]", rect.left, rect.top, rect.right,
+            rect.bottom);
+
+  fprintf(stderr, "\n");
+}
+
+// Compares the old and the new implementation on stacks of 2 to 64 rects.
+static int TestMatchesLegacy(uint32_t iterations) {
+  int failures = 0;
+  uint32_t legacy_errors = 0;
+  uint32_t seed = 1;
+  for (uint32_t i = 0; i < iterations && failures < 5; i++) {
+    std::vector<Rect<int>> in(Random(&seed, 2, 64));
+    for (Rect<int> &rect : in)
+      rect = RandomRect(&seed);
+
+    HwcRect<int> damage = RandomDamage(&seed);
+    std::vector<RectSet<int, 1>> out;
+    std::vector<legacy::RectSet> legacy_out;
+    hwcomposer::get_draw_regions(in, damage, &out);
+    legacy::get_draw_regions(in, damage, &legacy_out);
+
+    std::vector<Coverage> expected = ExpectedCoverage(in, damage);
+    std::vector<Coverage> pixels;
+    std::vector<Coverage> legacy_pixels;
+    bool legacy_valid = PaintLegacyCoverage(legacy_out, &legacy_pixels) &&
+                        legacy_pixels == expected;
+    if (!legacy_valid)
+      legacy_errors++;
+
+    if (!PaintCoverage(out, &pixels)) {
+      fprintf(stderr, "Iteration %u: output rects overlap\n", i);
+    } else if (legacy_valid && !(pixels == legacy_pixels)) {
+      fprintf(stderr, "Iteration %u: coverage differs from legacy\n", i);
+    } else if (!(pixels == expected)) {
+      fprintf(stderr, "Iteration %u: coverage differs from the rects\n", i);
+    } else {
+      continue;
+    }
+
+    PrintCase(in, damage);
+    failures++;
+  }
+
+  printf("%u stacks, %u of them wrong in the legacy implementation\n",
+         iterations, legacy_errors);
+  return failures;
+}
+
+// Stacks of more than 64 rects, which only the new implementation handles.
+static int TestWideStacks(uint32_t iterations) {
+  int failures = 0;
+  uint32_t seed = 2;
+  for (uint32_t i = 0; i < iterations && failures < 5; i++) {
+    std::vector<Rect<int>> in(
+        Random(&seed, 65, RectIDs<kMaxRectIDWords>::max_elements));
+    for (Rect<int> &rect : in)
+      rect = RandomRect(&seed);
+
+    HwcRect<int> damage = RandomDamage(&seed);
+    std::vector<RectSet<int, kMaxRectIDWords>> out;
+    hwcomposer::get_draw_regions(in, damage, &out);
+    std::vector<Coverage> pixels;
+    if (PaintCoverage(out, &pixels) &&
+        pixels == ExpectedCoverage(in, damage))
+      continue;
+
+    fprintf(stderr, "Wide stack %u: coverage differs from the rects\n", i);
+    failures++;
+  }
+
+  return failures;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 2000;
+  if (argc > 1)
+    iterations = strtoul(argv[1], NULL, 10);
+
+  int failures = TestMatchesLegacy(iterations);
+  failures += TestWideStacks(iterations / 10);
+  if (failures) {
+    fprintf(stderr, "%d failures\n", failures);
+    return 1;
+  }
+
+  printf("All draw region checks passed.\n");
+  return 0;
+}
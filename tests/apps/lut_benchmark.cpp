@@ -0,0 +1,145 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures gamma LUT generation time per table size and the error of the
+// generated entries against powf.
+//
+// Usage: lut_benchmark [iterations]
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "drmlut.h"
+
+// Largest relative error of ClampedPow against powf the gamma LUTs are
+// designed for, see drmlut.cpp.
+static const float kMaxRelativeError = 1.1e-5f;
+
+static const uint32_t kSizes[] = {17, 256, 1024, 4096};
+static const float kGammas[] = {0.45f, 1.0f, 2.2f, 3.3f};
+static const int kContrasts[] = {0, 64, 128, 255};
+static const int kBrightnesses[] = {0, 100, 128, 200};
+
+// What DrmDisplay computed with powf for entry i of a size entry LUT.
+static uint16_t ReferenceEntry(uint32_t i, uint32_t size, float gamma,
+                               float contrast, float brightness) {
+  float value = ((float)i / size - 0.5f) * contrast + 0.5f + brightness;
+  value = std::min(std::max(value, 0.0f), 1.0f);
+  return 65535.0f * std::min(powf(value, gamma), 1.0f);
+}
+
+static void FillReferenceChannel(float gamma, float contrast,
+                                 float brightness, struct drm_color_lut *lut,
+                                 uint32_t size) {
+  for (uint32_t i = 0; i < size; i++)
+    lut[i].red = ReferenceEntry(i, size, gamma, contrast, brightness);
+}
+
+// Returns the largest difference of a LUT entry from the powf result, in
+// steps of the 16 bit entries.
+static int MaxEntryError() {
+  int max_error = 0;
+  for (uint32_t size : kSizes) {
+    std::vector<struct drm_color_lut> lut(size);
+    for (float gamma : kGammas) {
+      for (int c : kContrasts) {
+        for (int b : kBrightnesses) {
+          float contrast = (float)c / 128;
+          float brightness = (float)b / 255 - 0.5f;
+          hwcomposer::FillLUTChannel(gamma, contrast, brightness,
+                                     &drm_color_lut::red, lut.data(), size);
+          for (uint32_t i = 0; i < size; i++) {
+            int expected = ReferenceEntry(i, size, gamma, contrast,
+                                          brightness);
+            max_error = std::max(max_error, abs(lut[i].red - expected));
+          }
+        }
+      }
+    }
+  }
+
+  return max_error;
+}
+
+// Returns the largest relative error of ClampedPow against powf for x in
+// [0, 1] and y in [0.05, 5].
+static float MaxRelativeError() {
+  float max_error = 0.0f;
+  for (float y = 0.05f; y <= 5.0f; y += 0.05f) {
+    for (uint32_t i = 1; i <= 65536; i++) {
+      float x = (float)i / 65536;
+      float expected = powf(x, y);
+      if (expected < 1e-30f)
+        continue;
+
+      float error = fabsf(hwcomposer::ClampedPow(x, y) - expected) / expected;
+      max_error = std::max(max_error, error);
+    }
+  }
+
+  return max_error;
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 1000;
+  if (argc > 1)
+    iterations = strtoul(argv[1], NULL, 10);
+
+  printf("entries  FillLUTChannel us  powf us\n");
+  for (uint32_t size : kSizes) {
+    std::vector<struct drm_color_lut> lut(size);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+      hwcomposer::FillLUTChannel(2.2f, 1.1f, 0.01f, &drm_color_lut::red,
+                                 lut.data(), size);
+
+    auto middle = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+      FillReferenceChannel(2.2f, 1.1f, 0.01f, lut.data(), size);
+
+    auto end = std::chrono::steady_clock::now();
+    double fill =
+        std::chrono::duration<double, std::micro>(middle - start).count();
+    double reference =
+        std::chrono::duration<double, std::micro>(end - middle).count();
+    printf("%7u  %17.2f  %7.2f\n", size,
+           iterations ? fill / iterations : 0,
+           iterations ? reference / iterations : 0);
+  }
+
+  int failures = 0;
+  int entry_error = MaxEntryError();
+  float relative_error = MaxRelativeError();
+  printf("max entry error: %d, max relative error: %g\n", entry_error,
+         relative_error);
+  if (entry_error > 1) {
+    fprintf(stderr, "LUT entries differ from powf by more than 1.\n");
+    failures++;
+  }
+
+  if (relative_error > kMaxRelativeError) {
+    fprintf(stderr, "ClampedPow error exceeds %g.\n", kMaxRelativeError);
+    failures++;
+  }
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,269 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Presents frames on a MosaicDisplay made of fake displays that sleep in
+// Present, and checks that a frame takes as long as the slowest display
+// rather than the sum of all of them. Logical displays sharing a pipe
+// still have to be presented one after another. Every display also has
+// to get its own copy of the layer, with its own constraints.
+//
+// Usage: mosaicpresent_test [frames]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include <hwclayer.h>
+#include <nativedisplay.h>
+
+#include "mosaicdisplay.h"
+
+using hwcomposer::HwcLayer;
+using hwcomposer::HwcRect;
+using hwcomposer::MosaicDisplay;
+using hwcomposer::NativeDisplay;
+
+static const uint32_t kWidth = 1920;
+static const uint32_t kHeight = 1080;
+static const int kMaxPipes = 4;
+
+static int failures = 0;
+
+#define EXPECT(condition)                                             \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__,       \
+              #condition);                                            \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// Presents in progress by pipe.
+static std::atomic<int> presenting[kMaxPipes];
+static std::atomic<int> overlapping_presents(0);
+
+class FakeDisplay : public NativeDisplay {
+ public:
+  FakeDisplay(int pipe, uint32_t index, uint32_t present_ms)
+      : pipe_(pipe), index_(index), present_ms_(present_ms) {
+  }
+
+  bool Initialize(hwcomposer::NativeBufferHandler * /*handler*/) override {
+    return true;
+  }
+
+  hwcomposer::DisplayType Type() const override {
+    return hwcomposer::DisplayType::kInternal;
+  }
+
+  uint32_t Width() const override {
+    return kWidth;
+  }
+
+  uint32_t Height() const override {
+    return kHeight;
+  }
+
+  uint32_t PowerMode() const override {
+    return power_mode_;
+  }
+
+  bool GetDisplayAttribute(uint32_t /*config*/,
+                           hwcomposer::HWCDisplayAttribute /*attribute*/,
+                           int32_t * /*value*/) override {
+    return false;
+  }
+
+  bool GetDisplayConfigs(uint32_t * /*num_configs*/,
+                         uint32_t * /*configs*/) override {
+    return false;
+  }
+
+  bool GetDisplayName(uint32_t * /*size*/, char * /*name*/) override {
+    return false;
+  }
+
+  bool GetDisplayIdentificationData(uint8_t * /*outPort*/,
+                                    uint32_t * /*outDataSize*/,
+                                    uint8_t * /*outData*/) override {
+    return false;
+  }
+
+  void GetDisplayCapabilities(uint32_t *outNumCapabilities,
+                              uint32_t * /*outCapabilities*/) override {
+    *outNumCapabilities = 0;
+  }
+
+  int GetDisplayPipe() override {
+    return pipe_;
+  }
+
+  bool SetActiveConfig(uint32_t /*config*/) override {
+    return true;
+  }
+
+  bool GetActiveConfig(uint32_t *config) override {
+    *config = 0;
+    return true;
+  }
+
+  bool SetPowerMode(uint32_t power_mode) override {
+    power_mode_ = power_mode;
+    return true;
+  }
+
+  bool Present(std::vector<HwcLayer *> &source_layers, int32_t *retire_fence,
+               hwcomposer::PixelUploaderCallback * /*call_back*/,
+               bool /*handle_constraints*/) override {
+    if (presenting[pipe_]++)
+      overlapping_presents++;
+
+    usleep(present_ms_ * 1000);
+    for (HwcLayer *layer : source_layers) {
+      int32_t left = index_ * kWidth;
+      if (layer->GetLeftConstraint() != left ||
+          layer->GetRightConstraint() != left + (int32_t)kWidth ||
+          !(layer->GetDisplayFrame() ==
+            HwcRect<int>(0, 0, 4 * kWidth, kHeight)))
+        wrong_layers_++;
+    }
+
+    layers_ += source_layers.size();
+    *retire_fence = -1;
+    presenting[pipe_]--;
+    return true;
+  }
+
+  int RegisterVsyncCallback(
+      std::shared_ptr<hwcomposer::VsyncCallback> /*callback*/,
+      uint32_t /*display_id*/) override {
+    return 0;
+  }
+
+  void VSyncControl(bool /*enabled*/) override {
+  }
+
+  bool CheckPlaneFormat(uint32_t /*format*/) override {
+    return true;
+  }
+
+  bool IsConnected() const override {
+    return true;
+  }
+
+  uint32_t GetLogicalIndex() const override {
+    return index_;
+  }
+
+  size_t GetPresentedLayers() const {
+    return layers_;
+  }
+
+  size_t GetWrongLayers() const {
+    return wrong_layers_;
+  }
+
+ private:
+  int pipe_;
+  uint32_t index_;
+  uint32_t present_ms_;
+  uint32_t power_mode_ = hwcomposer::kOff;
+  size_t layers_ = 0;
+  size_t wrong_layers_ = 0;
+};
+
+struct DisplayConfig {
+  int pipe;
+  uint32_t present_ms;
+};
+
+// Returns the average time in ms MosaicDisplay::Present takes for a frame
+// with a layer spanning all displays.
+static double PresentFrames(const std::vector<DisplayConfig> &configs,
+                            uint32_t frames) {
+  std::vector<std::unique_ptr<FakeDisplay>> fakes;
+  std::vector<NativeDisplay *> displays;
+  for (size_t i = 0; i < configs.size(); i++) {
+    fakes.emplace_back(
+        new FakeDisplay(configs[i].pipe, i, configs[i].present_ms));
+    displays.emplace_back(fakes.back().get());
+  }
+
+  double ms = 0;
+  {
+    MosaicDisplay mosaic(displays);
+    mosaic.SetPowerMode(hwcomposer::kOn);
+    HwcLayer layer;
+    layer.SetSourceCrop(HwcRect<float>(0, 0, 4 * kWidth, kHeight));
+    layer.SetDisplayFrame(HwcRect<int>(0, 0, 4 * kWidth, kHeight), 0, 0);
+    std::vector<HwcLayer *> layers(1, &layer);
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < frames; frame++) {
+      int32_t retire_fence = -1;
+      EXPECT(mosaic.Present(layers, &retire_fence));
+      if (retire_fence > 0)
+        close(retire_fence);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+    ms = std::chrono::duration<double, std::milli>(end - start).count();
+  }
+
+  for (std::unique_ptr<FakeDisplay> &fake : fakes) {
+    EXPECT(fake->GetPresentedLayers() == frames);
+    EXPECT(fake->GetWrongLayers() == 0);
+  }
+
+  return frames ? ms / frames : 0;
+}
+
+// Displays on their own pipes are presented concurrently.
+static void TestSeparatePipes(uint32_t frames) {
+  std::vector<DisplayConfig> configs = {{0, 4}, {1, 8}, {2, 12}, {3, 16}};
+  double ms = PresentFrames(configs, frames);
+  printf("4/8/12/16 ms on 4 pipes: %.1f ms per frame, serial 40 ms\n", ms);
+  EXPECT(ms >= 16);
+  // Half way between the slowest display and the sum of them, leaves
+  // room for a loaded machine.
+  EXPECT(ms < 28);
+}
+
+// Logical displays sharing a pipe are presented in order.
+static void TestSharedPipe(uint32_t frames) {
+  std::vector<DisplayConfig> configs = {{0, 6}, {1, 6}, {1, 6}};
+  double ms = PresentFrames(configs, frames);
+  printf("6/6/6 ms on 2 pipes: %.1f ms per frame, serial 18 ms\n", ms);
+  EXPECT(ms >= 12);
+  EXPECT(ms < 15);
+}
+
+int main(int argc, char **argv) {
+  uint32_t frames = 20;
+  if (argc > 1)
+    frames = strtoul(argv[1], NULL, 10);
+
+  TestSeparatePipes(frames);
+  TestSharedPipe(frames);
+  EXPECT(overlapping_presents == 0);
+  printf("%d checks failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Measures raw pixel upload throughput into a memfd backed buffer, once
+// mapping the buffer for every upload as PixelUploader used to and once
+// copying rows into a persistent mapping as it does now.
+//
+// Usage: pixelupload_benchmark [frames]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <vector>
+
+#include "pixelcopy.h"
+
+using hwcomposer::CopyJob;
+
+static const uint32_t kWidth = 1920;
+static const uint32_t kHeight = 1080;
+static const uint32_t kBpp = 4;
+static const uint32_t kPitch = kWidth * kBpp;
+static const size_t kSize = kPitch * kHeight;
+
+static int CreateBuffer() {
+  int fd = syscall(__NR_memfd_create, "pixelupload_benchmark", 0);
+  if (fd < 0)
+    return -1;
+
+  if (ftruncate(fd, kSize) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  return fd;
+}
+
+static CopyJob FullFrameJob(uint8_t* dst, const uint8_t* src) {
+  CopyJob job;
+  job.dst_ = dst;
+  job.dst_pitch_ = kPitch;
+  job.src_ = src;
+  job.src_pitch_ = kPitch;
+  job.rows_ = kHeight;
+  job.bytes_ = kPitch;
+  return job;
+}
+
+static double MBPerSecond(uint32_t frames,
+                          std::chrono::steady_clock::duration elapsed) {
+  double seconds = std::chrono::duration<double>(elapsed).count();
+  return seconds > 0 ? kSize * static_cast<double>(frames) / seconds / 1e6 : 0;
+}
+
+// Checks rows of width pixels at left, top were copied from src to dst.
+static bool RectMatches(const uint8_t* dst, const uint8_t* src, uint32_t left,
+                        uint32_t top, uint32_t width, uint32_t rows) {
+  for (uint32_t row = top; row < top + rows; row++) {
+    size_t offset = row * kPitch + left * kBpp;
+    if (memcmp(dst + offset, src + offset, width * kBpp))
+      return false;
+  }
+
+  return true;
+}
+
+int main(int argc, char** argv) {
+  uint32_t frames = 300;
+  if (argc > 1)
+    frames = strtoul(argv[1], NULL, 10);
+
+  int fd = CreateBuffer();
+  if (fd < 0) {
+    fprintf(stderr, "Failed to create memfd buffer.\n");
+    return 1;
+  }
+
+  // Two client frames, uploads alternate between them.
+  std::vector<uint8_t> pixels[2];
+  for (int i = 0; i < 2; i++) {
+    pixels[i].resize(kSize);
+    for (size_t j = 0; j < kSize; j++)
+      pixels[i][j] = static_cast<uint8_t>(j * 7 + i * 13);
+  }
+
+  int failures = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < frames; frame++) {
+    void* addr =
+        mmap(NULL, kSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (addr == MAP_FAILED) {
+      fprintf(stderr, "Failed to map memfd buffer.\n");
+      close(fd);
+      return 1;
+    }
+
+    memcpy(addr, pixels[frame & 1].data(), kSize);
+    munmap(addr, kSize);
+  }
+
+  double map_per_upload =
+      MBPerSecond(frames, std::chrono::steady_clock::now() - start);
+
+  uint8_t* ptr = static_cast<uint8_t*>(
+      mmap(NULL, kSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0));
+  if (ptr == MAP_FAILED) {
+    fprintf(stderr, "Failed to map memfd buffer.\n");
+    close(fd);
+    return 1;
+  }
+
+  start = std::chrono::steady_clock::now();
+  for (uint32_t frame = 0; frame < frames; frame++)
+    hwcomposer::CopyRows(FullFrameJob(ptr, pixels[frame & 1].data()));
+
+  double persistent =
+      MBPerSecond(frames, std::chrono::steady_clock::now() - start);
+
+  printf("mmap/memcpy/munmap per upload:  %8.0f MB/s\n", map_per_upload);
+  printf("persistent mapping, CopyRows:   %8.0f MB/s\n", persistent);
+
+  const uint8_t* last = pixels[(frames - 1) & 1].data();
+  if (frames && memcmp(ptr, last, kSize)) {
+    fprintf(stderr, "Full frame upload doesn't match the source.\n");
+    failures++;
+  }
+
+  // Damage rect with a destination which isn't 16 byte aligned and a
+  // width which isn't a multiple of 16 bytes.
+  const uint8_t* src = pixels[frames & 1].data();
+  uint32_t left = 3, top = 5, width = 101, rows = 37;
+  CopyJob job = FullFrameJob(ptr + top * kPitch + left * kBpp,
+                             src + top * kPitch + left * kBpp);
+  job.rows_ = rows;
+  job.bytes_ = width * kBpp;
+  hwcomposer::CopyRows(job);
+  if (!RectMatches(ptr, src, left, top, width, rows)) {
+    fprintf(stderr, "Damage rect upload doesn't match the source.\n");
+    failures++;
+  }
+
+  munmap(ptr, kSize);
+  close(fd);
+  return failures ? 1 : 0;
+}
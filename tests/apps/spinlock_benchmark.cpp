@@ -0,0 +1,109 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Compares SpinLock with the busy spinning lock it replaced and with
+// std::mutex when 2 to 8 threads contend for a short critical section.
+//
+// Usage: spinlock_benchmark [iterations per thread]
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "spinlock.h"
+
+// Work done while holding the lock, similar to the short sections the
+// compositor protects.
+static const int kCriticalSectionIncrements = 20;
+
+// SpinLock before it backed off and slept, spins until the lock is free.
+class BusySpinLock {
+ public:
+  void lock() {
+    while (atomic_lock_.test_and_set(std::memory_order_acquire)) {
+    }
+  }
+
+  void unlock() {
+    atomic_lock_.clear(std::memory_order_release);
+  }
+
+ private:
+  std::atomic_flag atomic_lock_ = ATOMIC_FLAG_INIT;
+};
+
+template <typename Lock>
+static double Run(unsigned threads, uint32_t iterations, uint64_t *total) {
+  Lock lock;
+  volatile uint64_t counter = 0;
+  std::vector<std::thread> workers;
+  auto start = std::chrono::steady_clock::now();
+  for (unsigned i = 0; i < threads; i++) {
+    workers.emplace_back([&lock, &counter, iterations]() {
+      for (uint32_t j = 0; j < iterations; j++) {
+        lock.lock();
+        for (int k = 0; k < kCriticalSectionIncrements; k++)
+          counter = counter + 1;
+        lock.unlock();
+      }
+    });
+  }
+
+  for (std::thread &worker : workers)
+    worker.join();
+
+  auto end = std::chrono::steady_clock::now();
+  *total = counter;
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+  uint32_t iterations = 200000;
+  if (argc > 1)
+    iterations = strtoul(argv[1], NULL, 10);
+
+  int failures = 0;
+  printf("threads  SpinLock ms  busy spin ms  std::mutex ms\n");
+  for (unsigned threads = 2; threads <= 8; threads++) {
+    uint64_t expected = static_cast<uint64_t>(threads) * iterations *
+                        kCriticalSectionIncrements;
+    uint64_t spin_total = 0;
+    uint64_t busy_total = 0;
+    uint64_t mutex_total = 0;
+    double spin = Run<hwcomposer::SpinLock>(threads, iterations, &spin_total);
+    double busy = Run<BusySpinLock>(threads, iterations, &busy_total);
+    double mutex = Run<std::mutex>(threads, iterations, &mutex_total);
+    printf("%7u  %11.1f  %12.1f  %13.1f\n", threads, spin, busy, mutex);
+    // Lost increments mean the lock didn't exclude.
+    if (spin_total != expected || busy_total != expected ||
+        mutex_total != expected) {
+      fprintf(stderr,
+              "Counter mismatch: expected %llu, got %llu, %llu and %llu\n",
+              (unsigned long long)expected, (unsigned long long)spin_total,
+              (unsigned long long)busy_total,
+              (unsigned long long)mutex_total);
+      failures++;
+    }
+  }
+
+  return failures ? 1 : 0;
+}
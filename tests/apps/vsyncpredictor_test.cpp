@@ -0,0 +1,163 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+// Feeds synthetic vblank timestamps to VsyncPredictor and checks its
+// predictions.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "vsyncpredictor.h"
+
+using hwcomposer::VsyncPredictor;
+
+static const int64_t kOneMsNs = 1000 * 1000;
+static const int64_t kPeriod60Hz = 16666667;
+static const int64_t kPeriod30Hz = 33333333;
+static const int64_t kStart = 1000 * 1000 * kOneMsNs;
+
+static int failures = 0;
+
+#define EXPECT(condition)                                             \
+  do {                                                                \
+    if (!(condition)) {                                               \
+      fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__,       \
+              #condition);                                            \
+      failures++;                                                     \
+    }                                                                 \
+  } while (0)
+
+// Deterministic jitter in [-max_jitter, max_jitter].
+static int64_t Jitter(uint32_t *seed, int64_t max_jitter) {
+  *seed = *seed * 1103515245 + 12345;
+  int64_t value = (*seed >> 8) % (2 * max_jitter + 1);
+  return value - max_jitter;
+}
+
+// Adds vblanks first to last of a display with period starting at start,
+// skipping every skip'th one if skip isn't 0.
+static void AddVblanks(VsyncPredictor *predictor, int64_t start,
+                       int64_t period, int first, int last, int skip,
+                       int64_t max_jitter, uint32_t *seed) {
+  for (int i = first; i <= last; i++) {
+    if (skip && i % skip == 0)
+      continue;
+
+    int64_t jitter = max_jitter ? Jitter(seed, max_jitter) : 0;
+    predictor->AddTimestamp(start + i * period + jitter);
+  }
+}
+
+// Checks the next vblank after time is predicted within max_error of
+// the actual one.
+static bool PredictsWithin(const VsyncPredictor &predictor, int64_t time,
+                           int64_t start, int64_t period, int64_t max_error) {
+  int64_t vblank = 0;
+  if (!predictor.PredictNextVblank(time, &vblank))
+    return false;
+
+  int64_t actual = start + ((time - start) / period + 1) * period;
+  return llabs(vblank - actual) <= max_error;
+}
+
+static void TestNotEnoughSamples() {
+  VsyncPredictor predictor;
+  int64_t vblank = 0;
+  EXPECT(!predictor.PredictNextVblank(kStart, &vblank));
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 0, 2, 0, 0, NULL);
+  EXPECT(!predictor.IsValid());
+  EXPECT(!predictor.PredictNextVblank(kStart + 2 * kPeriod60Hz, &vblank));
+}
+
+static void TestJitter() {
+  VsyncPredictor predictor;
+  uint32_t seed = 1;
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 0, 63, 0, kOneMsNs / 4, &seed);
+  EXPECT(predictor.IsValid());
+  EXPECT(llabs(predictor.GetPeriod() - kPeriod60Hz) < kOneMsNs / 20);
+  int64_t now = kStart + 63 * kPeriod60Hz + kPeriod60Hz / 3;
+  EXPECT(PredictsWithin(predictor, now, kStart, kPeriod60Hz, kOneMsNs / 4));
+}
+
+static void TestMissedVblanks() {
+  VsyncPredictor predictor;
+  uint32_t seed = 2;
+  // Every third vblank is lost, sequences have to account for the gaps.
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 0, 95, 3, kOneMsNs / 8, &seed);
+  EXPECT(predictor.IsValid());
+  EXPECT(llabs(predictor.GetPeriod() - kPeriod60Hz) < kOneMsNs / 20);
+  int64_t now = kStart + 96 * kPeriod60Hz + kPeriod60Hz / 2;
+  EXPECT(PredictsWithin(predictor, now, kStart, kPeriod60Hz, kOneMsNs / 4));
+}
+
+static void TestOutlier() {
+  VsyncPredictor predictor;
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 0, 31, 0, 0, NULL);
+  // A single late event doesn't move the model.
+  predictor.AddTimestamp(kStart + 32 * kPeriod60Hz + kPeriod60Hz / 2);
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 33, 40, 0, 0, NULL);
+  EXPECT(llabs(predictor.GetPeriod() - kPeriod60Hz) < kOneMsNs / 100);
+  int64_t now = kStart + 40 * kPeriod60Hz + 1;
+  EXPECT(PredictsWithin(predictor, now, kStart, kPeriod60Hz, kOneMsNs / 100));
+}
+
+static void TestRateChange() {
+  VsyncPredictor predictor;
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 0, 31, 0, 0, NULL);
+  EXPECT(llabs(predictor.GetPeriod() - kPeriod60Hz) < kOneMsNs / 100);
+
+  // Mode change to 30Hz, the model has to follow within a few vblanks.
+  int64_t start = kStart + 32 * kPeriod60Hz + kOneMsNs;
+  AddVblanks(&predictor, start, kPeriod30Hz, 0, 15, 0, 0, NULL);
+  EXPECT(predictor.IsValid());
+  EXPECT(llabs(predictor.GetPeriod() - kPeriod30Hz) < kOneMsNs / 100);
+  int64_t now = start + 15 * kPeriod30Hz + kPeriod30Hz / 4;
+  EXPECT(PredictsWithin(predictor, now, start, kPeriod30Hz, kOneMsNs / 100));
+}
+
+static void TestStale() {
+  VsyncPredictor predictor;
+  AddVblanks(&predictor, kStart, kPeriod60Hz, 0, 31, 0, 0, NULL);
+  int64_t vblank = 0;
+  int64_t last = kStart + 31 * kPeriod60Hz;
+  EXPECT(predictor.PredictNextVblank(last + 100 * kOneMsNs, &vblank));
+
+  // Vblanks stop while idle, old samples must not be extrapolated.
+  int64_t idle_end = last + 5000 * kOneMsNs;
+  EXPECT(!predictor.PredictNextVblank(idle_end, &vblank));
+
+  // Vblanks resume at a different phase and rate, the model starts over.
+  int64_t start = idle_end + kOneMsNs / 3;
+  AddVblanks(&predictor, start, kPeriod30Hz, 0, 1, 0, 0, NULL);
+  EXPECT(!predictor.IsValid());
+  AddVblanks(&predictor, start, kPeriod30Hz, 2, 7, 0, 0, NULL);
+  EXPECT(predictor.IsValid());
+  EXPECT(llabs(predictor.GetPeriod() - kPeriod30Hz) < kOneMsNs / 100);
+  int64_t now = start + 7 * kPeriod30Hz + kPeriod30Hz / 2;
+  EXPECT(PredictsWithin(predictor, now, start, kPeriod30Hz, kOneMsNs / 100));
+}
+
+int main(int /*argc*/, char ** /*argv*/) {
+  TestNotEnoughSamples();
+  TestJitter();
+  TestMissedVblanks();
+  TestOutlier();
+  TestRateChange();
+  TestStale();
+  printf("%d checks failed\n", failures);
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,75 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef TESTS_COMMON_LEGACYDRAWREGIONS_H_
+#define TESTS_COMMON_LEGACYDRAWREGIONS_H_
+
+#include <stdint.h>
+
+#include <hwcdefs.h>
+
+#include <vector>
+
+// The get_draw_regions implementation which was replaced by the flat
+// sweep in common/utils/disjoint_layers.cpp, kept to check the new one
+// against it and to compare their speed. Handles at most 64 rects.
+namespace legacy {
+
+struct RectIDs {
+ public:
+  typedef uint64_t TId;
+
+  RectIDs() : bitset(0) {
+  }
+
+  void add(TId id) {
+    bitset |= ((uint64_t)1) << id;
+  }
+
+  void subtract(TId id) {
+    bitset &= ~(((uint64_t)1) << id);
+  }
+
+  bool isEmpty() const {
+    return bitset == 0;
+  }
+
+  uint64_t getBits() const {
+    return bitset;
+  }
+
+  static const int max_elements = sizeof(TId) * 8;
+
+ private:
+  uint64_t bitset;
+};
+
+struct RectSet {
+  RectIDs id_set;
+  hwcomposer::Rect<int> rect;
+
+  RectSet(const RectIDs &i, const hwcomposer::Rect<int> &r)
+      : id_set(i), rect(r) {
+  }
+};
+
+void get_draw_regions(const std::vector<hwcomposer::Rect<int>> &in,
+                      const hwcomposer::HwcRect<int> &damage_region,
+                      std::vector<RectSet> *out);
+
+}  // namespace legacy
+
+#endif  // TESTS_COMMON_LEGACYDRAWREGIONS_H_
@@ -55,8 +55,10 @@ endif
 LOCAL_SRC_FILES := \
         physicaldisplay.cpp \
         drm/drmdisplay.cpp \
+        drm/drmlut.cpp \
         drm/drmbuffer.cpp \
         drm/drmplane.cpp \
+        drm/drmcommitthread.cpp \
         drm/drmdisplaymanager.cpp \
 	drm/drmscopedtypes.cpp
 
@@ -122,6 +124,11 @@ LOCAL_CPPFLAGS += \
 	-DDISABLE_HOTPLUG_NOTIFICATION
 endif
 
+ifeq ($(strip $(ENABLE_ASYNC_COMMIT)), true)
+LOCAL_CPPFLAGS += \
+	-DENABLE_ASYNC_COMMIT
+endif
+
 LOCAL_CPPFLAGS += -DENABLE_ANDROID_WA
 
 LOCAL_MODULE := libhwcomposer_wsi
@@ -40,6 +40,15 @@ class DisplayPlaneHandler {
       std::vector<std::unique_ptr<DisplayPlane>>& overlay_planes) = 0;
 
   virtual bool TestCommit(const DisplayPlaneStateList& composition) const = 0;
+
+  // TestCommit calls made between these two belong to the same validation
+  // pass and can share state.
+  virtual void BeginTestCommits() = 0;
+  virtual void EndTestCommits() = 0;
+
+  // Forgets plane configurations TestCommit has learned to fail, as they
+  // depend on the rest of the layer stack.
+  virtual void ResetRejectedConfigs() = 0;
 };
 
 }  // namespace hwcomposer
@@ -0,0 +1,208 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "drmcommitthread.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+#include <xf86drmMode.h>
+
+#include "hwctrace.h"
+#include "hwcutils.h"
+#include "overlaybuffer.h"
+
+namespace hwcomposer {
+
+DrmCommitRequest::~DrmCommitRequest() {
+  for (int32_t fence : in_fences_) {
+    if (fence > 0)
+      close(fence);
+  }
+}
+
+DrmCommitThread::DrmCommitThread() : HWCThread(-8, "DrmCommitThread") {
+  if (!cevent_.Initialize())
+    return;
+
+  fd_chandler_.AddFd(cevent_.get_fd());
+}
+
+DrmCommitThread::~DrmCommitThread() {
+  ExitThread();
+}
+
+bool DrmCommitThread::Initialize(uint32_t gpu_fd, uint32_t crtc_id,
+                                 uint32_t out_fence_ptr_prop) {
+  gpu_fd_ = gpu_fd;
+  crtc_id_ = crtc_id;
+  out_fence_ptr_prop_ = out_fence_ptr_prop;
+
+  if (!out_fence_ptr_prop_)
+    return false;
+
+  if (!timeline_.Initialize()) {
+    ITRACE("No sw_sync timeline available, commits stay synchronous.");
+    return false;
+  }
+
+  if (!InitWorker()) {
+    ETRACE("Failed to initalize DrmCommitThread. %s", PRINTERROR());
+    return false;
+  }
+
+  return true;
+}
+
+int32_t DrmCommitThread::CreateRetireFence() {
+  char name[32];
+  snprintf(name, sizeof(name), "iahwc_retire_%u", crtc_id_);
+  return timeline_.CreateFence(name);
+}
+
+void DrmCommitThread::Wait() {
+  if (fd_chandler_.Poll(-1) <= 0) {
+    ETRACE("Poll Failed in DrmCommitThread %s", PRINTERROR());
+    return;
+  }
+
+  if (fd_chandler_.IsReady(cevent_.get_fd())) {
+    // If eventfd_ is ready, we need to wait on it (using read()) to clean
+    // the flag that says it is ready.
+    cevent_.Wait();
+  }
+}
+
+bool DrmCommitThread::QueueCommit(std::unique_ptr<DrmCommitRequest> request,
+                                  int32_t *retire_fence) {
+  lock_.lock();
+  while (pending_) {
+    lock_.unlock();
+    Wait();
+    lock_.lock();
+  }
+
+  if (commit_failed_) {
+    // Let the caller re-validate everything, the state it assumes is on
+    // screen never made it there.
+    commit_failed_ = false;
+    lock_.unlock();
+    return false;
+  }
+
+  *retire_fence = CreateRetireFence();
+  pending_.swap(request);
+  lock_.unlock();
+
+  Resume();
+  return true;
+}
+
+void DrmCommitThread::Flush() {
+  lock_.lock();
+  while (pending_ || busy_) {
+    lock_.unlock();
+    Wait();
+    lock_.lock();
+  }
+  lock_.unlock();
+}
+
+ScopedDrmAtomicReqPtr DrmCommitThread::TakePropertySet() {
+  lock_.lock();
+  ScopedDrmAtomicReqPtr pset(spare_pset_.release());
+  lock_.unlock();
+
+  if (pset) {
+    drmModeAtomicSetCursor(pset.get(), 0);
+  } else {
+    pset.reset(drmModeAtomicAlloc());
+  }
+
+  return pset;
+}
+
+void DrmCommitThread::ExitThread() {
+  HWCThread::Exit();
+  on_screen_.reset(nullptr);
+}
+
+void DrmCommitThread::HandleExit() {
+  ScopedSpinLock lock(lock_);
+  if (pending_) {
+    pending_.reset(nullptr);
+    timeline_.Signal();
+  }
+}
+
+void DrmCommitThread::HandleRoutine() {
+  lock_.lock();
+  std::unique_ptr<DrmCommitRequest> request(pending_.release());
+  if (request)
+    busy_ = true;
+  // Planes only add the properties which changed since the previous
+  // request, which never made it to screen in case it failed.
+  bool previous_failed = commit_failed_;
+  lock_.unlock();
+
+  if (!request)
+    return;
+
+  // Slot is free again, let the present thread queue the next frame.
+  cevent_.Signal();
+
+  int32_t out_fence = -1;
+  bool succeeded = !previous_failed;
+  if (previous_failed) {
+    ITRACE("Dropping request queued after a failed commit.");
+  } else if (drmModeAtomicAddProperty(request->pset_.get(), crtc_id_,
+                                      out_fence_ptr_prop_,
+                                      (uintptr_t)&out_fence) < 0) {
+    succeeded = false;
+    ETRACE("Failed to add OUT_FENCE_PTR property to pset");
+  } else if (drmModeAtomicCommit(gpu_fd_, request->pset_.get(),
+                                 request->flags_, NULL)) {
+    ETRACE("Failed to commit pset ret=%s\n", PRINTERROR());
+    succeeded = false;
+  }
+
+  // Wait for the flip to complete before retiring the previous frame and
+  // accepting the next commit.
+  if (out_fence > 0) {
+    HWCPoll(out_fence, -1);
+    close(out_fence);
+  }
+
+  if (succeeded)
+    on_screen_.swap(request);
+
+  ScopedDrmAtomicReqPtr pset;
+  if (request)
+    pset.reset(request->pset_.release());
+
+  request.reset(nullptr);
+  timeline_.Signal();
+
+  lock_.lock();
+  spare_pset_.swap(pset);
+  busy_ = false;
+  if (!succeeded)
+    commit_failed_ = true;
+  lock_.unlock();
+  cevent_.Signal();
+}
+
+}  // namespace hwcomposer
@@ -0,0 +1,107 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef WSI_DRM_DRMCOMMITTHREAD_H_
+#define WSI_DRM_DRMCOMMITTHREAD_H_
+
+#include <stdint.h>
+
+#include <spinlock.h>
+
+#include <memory>
+#include <vector>
+
+#include "drmscopedtypes.h"
+#include "fdhandler.h"
+#include "hwcevent.h"
+#include "hwcsynctimeline.h"
+#include "hwcthread.h"
+
+namespace hwcomposer {
+
+class OverlayBuffer;
+
+// A fully built atomic request together with everything which needs to
+// stay alive until the frame it describes has been replaced on screen.
+struct DrmCommitRequest {
+  DrmCommitRequest() = default;
+  ~DrmCommitRequest();
+
+  ScopedDrmAtomicReqPtr pset_;
+  uint32_t flags_ = 0;
+  // IN_FENCE_FD's referenced by pset_. Owned by the request.
+  std::vector<int32_t> in_fences_;
+  // Buffers scanned out by this request.
+  std::vector<std::shared_ptr<OverlayBuffer>> buffers_;
+};
+
+// Submits atomic requests of a pipe from a dedicated thread. A request is
+// committed only once the previous flip has completed, so the present path
+// never blocks on the previous frame's fence. Retire fences are handed out
+// from a sw_sync timeline which is advanced as each flip completes.
+class DrmCommitThread : public HWCThread {
+ public:
+  DrmCommitThread();
+  ~DrmCommitThread() override;
+
+  // Returns false if a sync timeline could not be created, in which case
+  // commits have to be done synchronously.
+  bool Initialize(uint32_t gpu_fd, uint32_t crtc_id,
+                  uint32_t out_fence_ptr_prop);
+
+  // Queues request to be committed after the previous flip. retire_fence
+  // is signaled once the frame is on screen. This blocks only in case the
+  // previously queued request hasn't been picked up by the commit thread
+  // yet. Returns false if the last queued commit failed.
+  bool QueueCommit(std::unique_ptr<DrmCommitRequest> request,
+                   int32_t* retire_fence);
+
+  // Blocks till all queued requests have been committed and are on screen.
+  void Flush();
+
+  // Returns an empty property set to build the next request with. Property
+  // sets of requests which are off screen are recycled.
+  ScopedDrmAtomicReqPtr TakePropertySet();
+
+  void ExitThread();
+
+ protected:
+  void HandleRoutine() override;
+  void HandleExit() override;
+
+ private:
+  int32_t CreateRetireFence();
+  void Wait();
+
+  SpinLock lock_;
+  std::unique_ptr<DrmCommitRequest> pending_;
+  // Request currently on screen. Keeps its buffers alive till the next
+  // flip completes.
+  std::unique_ptr<DrmCommitRequest> on_screen_;
+  // Property set of the last retired request.
+  ScopedDrmAtomicReqPtr spare_pset_;
+  HWCSyncTimeline timeline_;
+  uint32_t gpu_fd_ = 0;
+  uint32_t crtc_id_ = 0;
+  uint32_t out_fence_ptr_prop_ = 0;
+  bool busy_ = false;
+  bool commit_failed_ = false;
+  FDHandler fd_chandler_;
+  HWCEvent cevent_;
+};
+
+}  // namespace hwcomposer
+#endif  // WSI_DRM_DRMCOMMITTHREAD_H_
@@ -16,6 +16,7 @@
 
 #include "drmdisplay.h"
 
+#include <string.h>
 #include <sys/time.h>
 #include <cmath>
 #include <limits>
@@ -33,6 +34,7 @@
 #include "displayplanemanager.h"
 #include "displayqueue.h"
 #include "drmdisplaymanager.h"
+#include "drmlut.h"
 #include "wsi_utils.h"
 
 #define CTA_EXTENSION_TAG 0x02
@@ -42,6 +44,8 @@
 namespace hwcomposer {
 
 static const int32_t kUmPerInch = 25400;
+// Number of gamma LUT blobs kept around for re-use.
+static const size_t kMaxCachedLUTs = 8;
 
 DrmDisplay::DrmDisplay(uint32_t gpu_fd, uint32_t pipe_id, uint32_t crtc_id,
                        DrmDisplayManager *manager)
@@ -53,12 +57,17 @@ DrmDisplay::DrmDisplay(uint32_t gpu_fd, uint32_t pipe_id, uint32_t crtc_id,
 }
 
 DrmDisplay::~DrmDisplay() {
+  commit_thread_.reset(nullptr);
+
   if (blob_id_)
     drmModeDestroyPropertyBlob(gpu_fd_, blob_id_);
 
   if (old_blob_id_)
     drmModeDestroyPropertyBlob(gpu_fd_, old_blob_id_);
 
+  for (const CachedLUT &cached : cached_luts_)
+    drmModeDestroyPropertyBlob(gpu_fd_, cached.blob_id_);
+
   display_queue_->SetPowerMode(kOff);
 }
 
@@ -75,6 +84,14 @@ bool DrmDisplay::InitializeDisplay() {
   GetDrmObjectProperty("OUT_FENCE_PTR", crtc_props, &out_fence_ptr_prop_);
   GetDrmObjectProperty("background_color", crtc_props, &canvas_color_prop_);
 
+#ifdef ENABLE_ASYNC_COMMIT
+  if (!commit_thread_ && out_fence_ptr_prop_) {
+    commit_thread_.reset(new DrmCommitThread());
+    if (!commit_thread_->Initialize(gpu_fd_, crtc_id_, out_fence_ptr_prop_))
+      commit_thread_.reset(nullptr);
+  }
+#endif
+
   return true;
 }
 
@@ -676,8 +693,27 @@ bool DrmDisplay::Commit(
     ETRACE("Failed to commit without DrmMaster");
     return true;
   }
+
+  if (commit_thread_) {
+    if (!(display_state_ & kNeedsModeset) && !first_commit_ &&
+        !disable_explicit_fence) {
+      return QueueFrame(composition_planes, previous_composition_planes,
+                        previous_fence, commit_fence, previous_fence_released);
+    }
+
+    // Modesets and the first commit after becoming DRM master are done
+    // synchronously, ensure nothing is in flight before that.
+    commit_thread_->Flush();
+  }
+
   // Do the actual commit.
-  ScopedDrmAtomicReqPtr pset(drmModeAtomicAlloc());
+  if (commit_pset_) {
+    drmModeAtomicSetCursor(commit_pset_.get(), 0);
+  } else {
+    commit_pset_.reset(drmModeAtomicAlloc());
+  }
+
+  drmModeAtomicReqPtr pset = commit_pset_.get();
   *previous_fence_released = false;
 
   if (!pset) {
@@ -685,20 +721,28 @@ bool DrmDisplay::Commit(
     return false;
   }
 
+  // Whatever was committed before is gone after a modeset or when somebody
+  // else was DRM master, add all plane properties again.
+  if (first_commit_ || (display_state_ & kNeedsModeset))
+    display_queue_->InvalidateCommittedPlaneState();
+
   // Disable not-in-used plane once DRM master is reset
   if (first_commit_)
-    display_queue_->ResetPlanes(pset.get());
+    display_queue_->ResetPlanes(pset);
 
   if (display_state_ & kNeedsModeset) {
-    if (!ApplyPendingModeset(pset.get())) {
+    // Plane limits depend on the mode, start learning them again.
+    ResetRejectedConfigs();
+
+    if (!ApplyPendingModeset(pset)) {
       ETRACE("Failed to Modeset.");
       return false;
     }
   } else if (!disable_explicit_fence && out_fence_ptr_prop_) {
-    GetFence(pset.get(), commit_fence);
+    GetFence(pset, commit_fence);
   }
 
-  if (!CommitFrame(composition_planes, previous_composition_planes, pset.get(),
+  if (!CommitFrame(composition_planes, previous_composition_planes, pset,
                    flags_, previous_fence, previous_fence_released)) {
     ETRACE("Failed to Commit layers.");
     return false;
@@ -747,6 +791,33 @@ bool DrmDisplay::CommitFrame(
     return false;
   }
 
+  if (!UpdatePlanes(comp_planes, previous_composition_planes, pset, NULL) ||
+      !AddPlaneFences(comp_planes, pset, NULL))
+    return false;
+
+#ifndef ENABLE_DOUBLE_BUFFERING
+  if (!GpuDevice::getInstance().IsGvtActive()) {
+    if (previous_fence > 0) {
+      HWCPoll(previous_fence, -1);
+      close(previous_fence);
+      *previous_fence_released = true;
+    }
+  }
+#endif
+
+  int ret = drmModeAtomicCommit(gpu_fd_, pset, flags, NULL);
+  if (ret) {
+    ETRACE("Failed to commit pset ret=%s\n", PRINTERROR());
+    return false;
+  }
+
+  return true;
+}
+
+bool DrmDisplay::UpdatePlanes(
+    const DisplayPlaneStateList &comp_planes,
+    const DisplayPlaneStateList &previous_composition_planes,
+    drmModeAtomicReqPtr pset, DrmCommitRequest *request) {
   for (const DisplayPlaneState &comp_plane : comp_planes) {
     DrmPlane *plane = static_cast<DrmPlane *>(comp_plane.GetDisplayPlane());
 
@@ -771,19 +842,17 @@ bool DrmDisplay::CommitFrame(
       layer->SetDisplayFrame(rotated_rect);
     }
 
-    int32_t fence = layer->GetAcquireFence();
-    if (fence > 0) {
-      plane->SetNativeFence(dup(fence));
-    } else {
-      plane->SetNativeFence(-1);
-    }
-
     if (comp_plane.Scanout() && !comp_plane.IsSurfaceRecycled()) {
       plane->SetBuffer(layer->GetSharedBuffer());
     }
 
     if (!plane->UpdateProperties(pset, crtc_id_, comp_plane))
       return false;
+
+    // pset is committed after this frame's plane state has moved on, so
+    // the request needs to own everything it references.
+    if (request)
+      request->buffers_.emplace_back(layer->GetSharedBuffer());
   }
 
   for (const DisplayPlaneState &comp_plane : previous_composition_planes) {
@@ -793,19 +862,72 @@ bool DrmDisplay::CommitFrame(
     plane->Disable(pset);
   }
 
-#ifndef ENABLE_DOUBLE_BUFFERING
-  if (!GpuDevice::getInstance().IsGvtActive()) {
-    if (previous_fence > 0) {
-      HWCPoll(previous_fence, -1);
-      close(previous_fence);
-      *previous_fence_released = true;
+  IDISPLAYMANAGERTRACE("Committing %d properties.",
+                       drmModeAtomicGetCursor(pset));
+  return true;
+}
+
+bool DrmDisplay::AddPlaneFences(const DisplayPlaneStateList &comp_planes,
+                                drmModeAtomicReqPtr pset,
+                                DrmCommitRequest *request) {
+  // Everything but the fences is in pset already, the composition queued
+  // for this frame only has to be done now.
+  if (!display_queue_->WaitForDraw()) {
+    ETRACE("Failed to compose the frame.");
+    return false;
+  }
+
+  for (const DisplayPlaneState &comp_plane : comp_planes) {
+    DrmPlane *plane = static_cast<DrmPlane *>(comp_plane.GetDisplayPlane());
+    int32_t fence = comp_plane.GetOverlayLayer()->GetAcquireFence();
+    if (fence > 0) {
+      plane->SetNativeFence(dup(fence));
+    } else {
+      plane->SetNativeFence(-1);
+    }
+
+    if (!plane->AddInFence(pset))
+      return false;
+
+    if (request) {
+      int32_t in_fence = plane->ReleaseNativeFence();
+      if (in_fence > 0)
+        request->in_fences_.emplace_back(in_fence);
     }
   }
-#endif
 
-  int ret = drmModeAtomicCommit(gpu_fd_, pset, flags, NULL);
-  if (ret) {
-    ETRACE("Failed to commit pset ret=%s\n", PRINTERROR());
+  return true;
+}
+
+bool DrmDisplay::QueueFrame(
+    const DisplayPlaneStateList &comp_planes,
+    const DisplayPlaneStateList &previous_composition_planes,
+    int32_t previous_fence, int32_t *commit_fence,
+    bool *previous_fence_released) {
+  CTRACE();
+  std::unique_ptr<DrmCommitRequest> request(new DrmCommitRequest());
+  request->pset_ = commit_thread_->TakePropertySet();
+  if (!request->pset_) {
+    ETRACE("Failed to allocate property set %d", -ENOMEM);
+    return false;
+  }
+
+  request->flags_ = flags_;
+  if (!UpdatePlanes(comp_planes, previous_composition_planes,
+                    request->pset_.get(), request.get()) ||
+      !AddPlaneFences(comp_planes, request->pset_.get(), request.get())) {
+    return false;
+  }
+
+  // Commit thread orders flips itself, we don't need to wait for the
+  // previous frame here.
+  if (previous_fence > 0) {
+    close(previous_fence);
+    *previous_fence_released = true;
+  }
+
+  if (!commit_thread_->QueueCommit(std::move(request), commit_fence)) {
+    ETRACE("Previous queued commit failed.");
     return false;
   }
 
@@ -966,21 +1088,9 @@ void DrmDisplay::ApplyPendingCTM(
   drmModeDestroyPropertyBlob(gpu_fd_, ctm_post_offset_id);
 }
 
-void DrmDisplay::ApplyPendingLUT(struct drm_color_lut *lut) const {
-  if (lut_id_prop_ == 0)
-    return;
-
-  uint32_t lut_blob_id = 0;
-
-  drmModeCreatePropertyBlob(
-      gpu_fd_, lut, sizeof(struct drm_color_lut) * lut_size_, &lut_blob_id);
-  if (lut_blob_id == 0) {
-    return;
-  }
-
+void DrmDisplay::ApplyPendingLUT(uint32_t lut_blob_id) const {
   drmModeObjectSetProperty(gpu_fd_, crtc_id_, DRM_MODE_OBJECT_CRTC,
                            lut_id_prop_, lut_blob_id);
-  drmModeDestroyPropertyBlob(gpu_fd_, lut_blob_id);
 }
 
 uint64_t DrmDisplay::DrmRGBA(uint16_t bpc, uint16_t red, uint16_t green,
@@ -1035,30 +1145,6 @@ bool DrmDisplay::SetPipeMaxBpc(uint16_t max_bpc) const {
   return true;
 }
 
-float DrmDisplay::TransformContrastBrightness(float value, float brightness,
-                                              float contrast) const {
-  float result;
-  result = (value - 0.5) * contrast + 0.5 + brightness;
-
-  if (result < 0.0)
-    result = 0.0;
-  if (result > 1.0)
-    result = 1.0;
-  return result;
-}
-
-float DrmDisplay::TransformGamma(float value, float gamma) const {
-  float result;
-
-  result = pow(value, gamma);
-  if (result < 0.0)
-    result = 0.0;
-  if (result > 1.0)
-    result = 1.0;
-
-  return result;
-}
-
 void DrmDisplay::SetColorTransformMatrix(
     const float *color_transform_matrix,
     HWCColorTransform color_transform_hint) const {
@@ -1110,23 +1196,31 @@ void DrmDisplay::SetColorTransformMatrix(
 void DrmDisplay::SetColorCorrection(struct gamma_colors gamma,
                                     uint32_t contrast_c,
                                     uint32_t brightness_c) const {
-  struct drm_color_lut *lut;
   float brightness[3];
   float contrast[3];
   uint8_t temp[3];
 
+  if (lut_id_prop_ == 0 || lut_size_ == 0)
+    return;
+
   /* reset lut when contrast and brightness are all 0 */
   if (contrast_c == 0 && brightness_c == 0) {
-    lut = NULL;
-    ApplyPendingLUT(lut);
-    free(lut);
+    ApplyPendingLUT(0);
     return;
   }
 
-  lut =
-      (struct drm_color_lut *)malloc(sizeof(struct drm_color_lut) * lut_size_);
-  if (!lut) {
-    ETRACE("Cannot allocate LUT memory");
+  // Values are often animated back and forth, re-use the blob in case these
+  // have been applied recently.
+  for (auto it = cached_luts_.begin(); it != cached_luts_.end(); ++it) {
+    if (it->gamma_[0] != gamma.red || it->gamma_[1] != gamma.green ||
+        it->gamma_[2] != gamma.blue || it->contrast_ != contrast_c ||
+        it->brightness_ != brightness_c)
+      continue;
+
+    CachedLUT cached = *it;
+    cached_luts_.erase(it);
+    cached_luts_.emplace_back(cached);
+    ApplyPendingLUT(cached.blob_id_);
     return;
   }
 
@@ -1150,31 +1244,41 @@ void DrmDisplay::SetColorCorrection(struct gamma_colors gamma,
   contrast[1] = (float)(temp[1]) / 128;
   contrast[2] = (float)(temp[2]) / 128;
 
-  for (uint64_t i = 0; i < lut_size_; i++) {
-    /* Set lut[0] as 0 always as the darkest color should has brightness 0 */
-    if (i == 0) {
-      lut[i].red = 0;
-      lut[i].green = 0;
-      lut[i].blue = 0;
-      continue;
-    }
+  uint32_t size = lut_size_;
+  lut_.resize(size);
+  struct drm_color_lut *lut = lut_.data();
+  FillLUTChannel(gamma.red, contrast[0], brightness[0], &drm_color_lut::red,
+                 lut, size);
+  FillLUTChannel(gamma.green, contrast[1], brightness[1],
+                 &drm_color_lut::green, lut, size);
+  FillLUTChannel(gamma.blue, contrast[2], brightness[2], &drm_color_lut::blue,
+                 lut, size);
+
+  /* Set lut[0] as 0 always as the darkest color should has brightness 0 */
+  lut[0].red = 0;
+  lut[0].green = 0;
+  lut[0].blue = 0;
 
-    lut[i].red = 0xFFFF * TransformGamma(TransformContrastBrightness(
-                                             (float)(i) / lut_size_,
-                                             brightness[0], contrast[0]),
-                                         gamma.red);
-    lut[i].green = 0xFFFF * TransformGamma(TransformContrastBrightness(
-                                               (float)(i) / lut_size_,
-                                               brightness[1], contrast[1]),
-                                           gamma.green);
-    lut[i].blue = 0xFFFF * TransformGamma(TransformContrastBrightness(
-                                              (float)(i) / lut_size_,
-                                              brightness[2], contrast[2]),
-                                          gamma.blue);
-  }
-
-  ApplyPendingLUT(lut);
-  free(lut);
+  uint32_t lut_blob_id = 0;
+  drmModeCreatePropertyBlob(gpu_fd_, lut, sizeof(struct drm_color_lut) * size,
+                            &lut_blob_id);
+  if (lut_blob_id == 0)
+    return;
+
+  if (cached_luts_.size() >= kMaxCachedLUTs) {
+    drmModeDestroyPropertyBlob(gpu_fd_, cached_luts_.front().blob_id_);
+    cached_luts_.erase(cached_luts_.begin());
+  }
+
+  CachedLUT cached;
+  cached.gamma_[0] = gamma.red;
+  cached.gamma_[1] = gamma.green;
+  cached.gamma_[2] = gamma.blue;
+  cached.contrast_ = contrast_c;
+  cached.brightness_ = brightness_c;
+  cached.blob_id_ = lut_blob_id;
+  cached_luts_.emplace_back(cached);
+  ApplyPendingLUT(lut_blob_id);
 }
 
 bool DrmDisplay::ApplyPendingModeset(drmModeAtomicReqPtr property_set) {
@@ -1221,6 +1325,8 @@ bool DrmDisplay::GetFence(drmModeAtomicReqPtr property_set,
 
 void DrmDisplay::Disable(const DisplayPlaneStateList &composition_planes) {
   IHOTPLUGEVENTTRACE("Disable: Disabling Display: %p", this);
+  if (commit_thread_)
+    commit_thread_->Flush();
 
   for (const DisplayPlaneState &comp_plane : composition_planes) {
     DrmPlane *plane = static_cast<DrmPlane *>(comp_plane.GetDisplayPlane());
@@ -1324,21 +1430,145 @@ void DrmDisplay::NotifyClientsOfDisplayChangeStatus() {
   manager_->NotifyClientsOfDisplayChangeStatus();
 }
 
+static const size_t kMaxRejectedConfigs = 32;
+
+static size_t GetPlaneConfigKey(const OverlayLayer *layer) {
+  size_t key = 0;
+  OverlayBuffer *buffer = layer->GetBuffer();
+  if (buffer) {
+    hash_combine_hwc(key, buffer->GetFormat());
+    hash_combine_hwc(key, buffer->GetTilingMode());
+  }
+
+  // Scaler limits depend on the actual sizes, not only on whether the
+  // layer is scaled.
+  hash_combine_hwc(key, layer->GetSourceCropWidth());
+  hash_combine_hwc(key, layer->GetSourceCropHeight());
+  hash_combine_hwc(key, layer->GetDisplayFrameWidth());
+  hash_combine_hwc(key, layer->GetDisplayFrameHeight());
+  hash_combine_hwc(key, layer->GetMergedTransform());
+  hash_combine_hwc(key, static_cast<size_t>(layer->GetBlending()));
+  hash_combine_hwc(key, layer->GetAlpha() != 0xFF);
+  hash_combine_hwc(key, layer->IsProtected());
+  return key;
+}
+
+bool DrmDisplay::IsRejectedConfig(const DisplayPlaneState &plane_state) const {
+  if (rejected_configs_.empty() || !plane_state.Scanout())
+    return false;
+
+  const DisplayPlane *plane = plane_state.GetDisplayPlane();
+  size_t key = GetPlaneConfigKey(plane_state.GetOverlayLayer());
+  for (const RejectedConfig &config : rejected_configs_) {
+    if (config.plane_ == plane && config.key_ == key)
+      return true;
+  }
+
+  return false;
+}
+
+bool DrmDisplay::IsTestedPlane(const TestedPlane &tested,
+                               const DisplayPlaneState &plane_state) const {
+  const OverlayLayer *layer = plane_state.GetOverlayLayer();
+  return tested.plane_ == plane_state.GetDisplayPlane() &&
+         tested.layer_ == layer && tested.buffer_ == layer->GetBuffer() &&
+         tested.acquire_fence_ == layer->GetAcquireFence() &&
+         tested.display_frame_ == plane_state.GetDisplayFrame() &&
+         tested.source_crop_ == layer->GetSourceCrop() &&
+         tested.rotation_type_ == plane_state.GetRotationType();
+}
+
+void DrmDisplay::BeginTestCommits() {
+  std::vector<TestedPlane>().swap(tested_planes_);
+  passed_planes_ = 0;
+  test_commits_ = 0;
+}
+
+void DrmDisplay::EndTestCommits() {
+  IDISPLAYMANAGERTRACE("Validation done with %d test commits.",
+                       test_commits_);
+  // Layers and buffers referenced by tested_planes_ can go away once
+  // validation is done.
+  BeginTestCommits();
+}
+
+void DrmDisplay::ResetRejectedConfigs() {
+  std::vector<RejectedConfig>().swap(rejected_configs_);
+}
+
 bool DrmDisplay::TestCommit(const DisplayPlaneStateList &composition) const {
-  ScopedDrmAtomicReqPtr pset(drmModeAtomicAlloc());
-  for (auto &plane_state : composition) {
-    DrmPlane *plane = static_cast<DrmPlane *>(plane_state.GetDisplayPlane());
-    if (!(plane->UpdateProperties(pset.get(), crtc_id_, plane_state, true))) {
+  if (!test_pset_) {
+    test_pset_.reset(drmModeAtomicAlloc());
+    if (!test_pset_) {
+      ETRACE("Failed to allocate property set %d", -ENOMEM);
       return false;
     }
   }
 
-  if (drmModeAtomicCommit(gpu_fd_, pset.get(), DRM_MODE_ATOMIC_TEST_ONLY,
+  size_t size = composition.size();
+  if (size && IsRejectedConfig(composition.back())) {
+    IDISPLAYMANAGERTRACE("Skipping test commit of a rejected plane config.");
+    return false;
+  }
+
+  // Keep properties of planes which are unchanged since the last test.
+  size_t common = 0;
+  while (common < size && common < tested_planes_.size() &&
+         IsTestedPlane(tested_planes_.at(common), composition.at(common))) {
+    common++;
+  }
+
+  tested_planes_.resize(common);
+  if (passed_planes_ > common)
+    passed_planes_ = common;
+
+  drmModeAtomicSetCursor(test_pset_.get(),
+                         common ? tested_planes_.back().cursor_ : 0);
+  for (size_t i = common; i < size; i++) {
+    const DisplayPlaneState &plane_state = composition.at(i);
+    DrmPlane *plane = static_cast<DrmPlane *>(plane_state.GetDisplayPlane());
+    if (!(plane->UpdateProperties(test_pset_.get(), crtc_id_, plane_state,
+                                  true))) {
+      drmModeAtomicSetCursor(test_pset_.get(),
+                             common ? tested_planes_.back().cursor_ : 0);
+      return false;
+    }
+
+    const OverlayLayer *layer = plane_state.GetOverlayLayer();
+    TestedPlane tested;
+    tested.plane_ = plane;
+    tested.layer_ = layer;
+    tested.buffer_ = layer->GetBuffer();
+    tested.acquire_fence_ = layer->GetAcquireFence();
+    tested.display_frame_ = plane_state.GetDisplayFrame();
+    tested.source_crop_ = layer->GetSourceCrop();
+    tested.rotation_type_ = plane_state.GetRotationType();
+    tested.cursor_ = drmModeAtomicGetCursor(test_pset_.get());
+    tested_planes_.emplace_back(tested);
+    common = tested_planes_.size();
+  }
+
+  test_commits_++;
+  if (drmModeAtomicCommit(gpu_fd_, test_pset_.get(), DRM_MODE_ATOMIC_TEST_ONLY,
                           NULL)) {
     IDISPLAYMANAGERTRACE("Test Commit Failed. %s ", PRINTERROR());
+    // Everything but the last plane passed before, so it's the one the
+    // kernel doesn't like. Remember that for layers scanned out directly.
+    const DisplayPlaneState &last = composition.back();
+    if (passed_planes_ && passed_planes_ + 1 == size && last.Scanout()) {
+      if (rejected_configs_.size() == kMaxRejectedConfigs)
+        rejected_configs_.erase(rejected_configs_.begin());
+
+      RejectedConfig config;
+      config.plane_ = last.GetDisplayPlane();
+      config.key_ = GetPlaneConfigKey(last.GetOverlayLayer());
+      rejected_configs_.emplace_back(config);
+    }
+
     return false;
   }
 
+  passed_planes_ = size;
   return true;
 }
 
@@ -23,6 +23,7 @@
 
 #include <drmscopedtypes.h>
 
+#include "drmcommitthread.h"
 #include "drmplane.h"
 #include "physicaldisplay.h"
 
@@ -105,6 +106,12 @@ class DrmDisplay : public PhysicalDisplay {
 
   bool TestCommit(const DisplayPlaneStateList &commit_planes) const override;
 
+  void BeginTestCommits() override;
+
+  void EndTestCommits() override;
+
+  void ResetRejectedConfigs() override;
+
   bool PopulatePlanes(
       std::vector<std::unique_ptr<DisplayPlane>> &overlay_planes) override;
 
@@ -150,19 +157,32 @@ class DrmDisplay : public PhysicalDisplay {
                                 const drmModeConnector *connector,
                                 const ScopedDrmObjectPropertyPtr &props,
                                 uint32_t *id, int *value = NULL) const;
-  float TransformGamma(float value, float gamma) const;
-  float TransformContrastBrightness(float value, float brightness,
-                                    float contrast) const;
   int64_t FloatToFixedPoint(float value) const;
   void ApplyPendingCTM(struct drm_color_ctm *ctm,
                        struct drm_color_ctm_post_offset *ctm_post_offset) const;
-  void ApplyPendingLUT(struct drm_color_lut *lut) const;
+  void ApplyPendingLUT(uint32_t lut_blob_id) const;
   bool ApplyPendingModeset(drmModeAtomicReqPtr property_set);
   bool GetFence(drmModeAtomicReqPtr property_set, int32_t *out_fence);
   bool CommitFrame(const DisplayPlaneStateList &comp_planes,
                    const DisplayPlaneStateList &previous_composition_planes,
                    drmModeAtomicReqPtr pset, uint32_t flags,
                    int32_t previous_fence, bool *previous_fence_released);
+  // Adds properties of all planes of this frame but their in fences to
+  // pset. If request is not NULL, it takes over the buffers referenced by
+  // pset.
+  bool UpdatePlanes(const DisplayPlaneStateList &comp_planes,
+                    const DisplayPlaneStateList &previous_composition_planes,
+                    drmModeAtomicReqPtr pset, DrmCommitRequest *request);
+  // Waits for the composition of this frame and adds the in fences of all
+  // planes to pset. If request is not NULL, it takes over the fences.
+  bool AddPlaneFences(const DisplayPlaneStateList &comp_planes,
+                      drmModeAtomicReqPtr pset, DrmCommitRequest *request);
+  // Builds the atomic request for this frame and hands it over to
+  // commit_thread_.
+  bool QueueFrame(const DisplayPlaneStateList &comp_planes,
+                  const DisplayPlaneStateList &previous_composition_planes,
+                  int32_t previous_fence, int32_t *commit_fence,
+                  bool *previous_fence_released);
   uint64_t DrmRGBA(uint16_t, uint16_t red, uint16_t green, uint16_t blue,
                    uint16_t alpha) const;
   std::unique_ptr<DrmPlane> CreatePlane(uint32_t plane_id,
@@ -198,6 +218,18 @@ class DrmDisplay : public PhysicalDisplay {
   bool dcip3_ = false;
   uint32_t max_bpc_prop_ = 0;
   uint64_t lut_size_ = 0;
+
+  // Blob of a gamma LUT and the parameters it was generated for.
+  struct CachedLUT {
+    float gamma_[3];
+    uint32_t contrast_;
+    uint32_t brightness_;
+    uint32_t blob_id_;
+  };
+  // Recently applied gamma LUTs, least recently used first.
+  mutable std::vector<CachedLUT> cached_luts_;
+  // Scratch space to generate LUTs in.
+  mutable std::vector<struct drm_color_lut> lut_;
   int64_t broadcastrgb_full_ = -1;
   int64_t broadcastrgb_automatic_ = -1;
   uint32_t flags_ = DRM_MODE_ATOMIC_ALLOW_MODESET;
@@ -215,6 +247,48 @@ class DrmDisplay : public PhysicalDisplay {
   std::vector<drmModeModeInfo> modes_;
   SpinLock display_lock_;
   DrmDisplayManager *manager_;
+  std::unique_ptr<DrmCommitThread> commit_thread_;
+  // Request reused by all synchronous commits.
+  ScopedDrmAtomicReqPtr commit_pset_;
+
+  // Plane whose properties have been added to test_pset_, together with
+  // everything they were derived from.
+  struct TestedPlane {
+    DrmPlane *plane_;
+    const OverlayLayer *layer_;
+    const OverlayBuffer *buffer_;
+    int32_t acquire_fence_;
+    HwcRect<int> display_frame_;
+    HwcRect<float> source_crop_;
+    DisplayPlaneState::RotationType rotation_type_;
+    // Cursor of test_pset_ after adding this plane.
+    int cursor_;
+  };
+
+  // Layer configuration a plane failed a TEST_ONLY commit with, while
+  // all other planes of the request had passed.
+  struct RejectedConfig {
+    const DisplayPlane *plane_;
+    size_t key_;
+  };
+
+  bool IsTestedPlane(const TestedPlane &tested,
+                     const DisplayPlaneState &plane_state) const;
+
+  // Returns true if plane_state is known to fail the test commit.
+  bool IsRejectedConfig(const DisplayPlaneState &plane_state) const;
+
+  // Single request reused by all TestCommit calls of a validation pass.
+  // Planes common with the previous test are kept, the rest is rolled
+  // back using drmModeAtomicSetCursor.
+  mutable ScopedDrmAtomicReqPtr test_pset_;
+  mutable std::vector<TestedPlane> tested_planes_;
+  // Number of planes in the last test which passed.
+  mutable size_t passed_planes_ = 0;
+  mutable uint32_t test_commits_ = 0;
+  // Learned while probing, reset on modeset and when the layer stack
+  // changes significantly.
+  mutable std::vector<RejectedConfig> rejected_configs_;
 };
 
 }  // namespace hwcomposer
@@ -0,0 +1,190 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#include "drmlut.h"
+
+#include <float.h>
+#include <string.h>
+
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace hwcomposer {
+
+// Gamma is applied with pow(x, y) = exp2(y * log2(x)), using polynomials
+// for log2 and exp2. Compared to powf, results are within 1.1e-5 relative
+// error for x in [0, 1] and y in [0.05, 5], which is within one step of
+// the 16 bit LUT entries.
+static const float kSqrt2 = 1.41421356f;
+static const float kTwoOverLn2 = 2.88539008f;
+static const float kLog2C3 = 1.0f / 3;
+static const float kLog2C5 = 1.0f / 5;
+static const float kLog2C7 = 1.0f / 7;
+static const float kLog2C9 = 1.0f / 9;
+static const float kExp2C1 = 0.693147181f;
+static const float kExp2C2 = 0.240226507f;
+static const float kExp2C3 = 0.0555041087f;
+static const float kExp2C4 = 0.00961812911f;
+static const float kExp2C5 = 0.00133335581f;
+static const float kExp2C6 = 0.000154035304f;
+
+float ClampedPow(float x, float y) {
+  if (x <= 0.0f)
+    return y > 0.0f ? 0.0f : 1.0f;
+
+  if (x < FLT_MIN)
+    x = FLT_MIN;
+
+  // log2(x) = e + log2(m) with m in [sqrt(2) / 2, sqrt(2)], where
+  // log2(m) = 2 / ln(2) * (t + t^3 / 3 + t^5 / 5 + ...), t = (m - 1) / (m + 1)
+  uint32_t bits;
+  memcpy(&bits, &x, sizeof(bits));
+  float e = (float)((int32_t)(bits >> 23) - 127);
+  bits = (bits & 0x7fffff) | 0x3f800000;
+  float m;
+  memcpy(&m, &bits, sizeof(m));
+  if (m > kSqrt2) {
+    m -= m * 0.5f;
+    e += 1.0f;
+  }
+
+  float t = (m - 1.0f) / (m + 1.0f);
+  float t2 = t * t;
+  float s = kLog2C7 + t2 * kLog2C9;
+  s = kLog2C5 + t2 * s;
+  s = kLog2C3 + t2 * s;
+  s = 1.0f + t2 * s;
+  float p = y * (e + kTwoOverLn2 * t * s);
+  if (p >= 0.0f)
+    return 1.0f;
+
+  if (p < -126.0f)
+    return 0.0f;
+
+  // exp2(p) = 2^n * exp2(f) with n = floor(p) and f in [0, 1).
+  float n = (float)(int32_t)p;
+  if (n > p)
+    n -= 1.0f;
+
+  float f = p - n;
+  float r = kExp2C5 + f * kExp2C6;
+  r = kExp2C4 + f * r;
+  r = kExp2C3 + f * r;
+  r = kExp2C2 + f * r;
+  r = kExp2C1 + f * r;
+  r = 1.0f + f * r;
+  uint32_t scale_bits = (uint32_t)((int32_t)n + 127) << 23;
+  float scale;
+  memcpy(&scale, &scale_bits, sizeof(scale));
+  r *= scale;
+  return r > 1.0f ? 1.0f : r;
+}
+
+#ifdef __SSE2__
+// Same as ClampedPow, for four values at once.
+static __m128 ClampedPow4(__m128 x, __m128 y) {
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  __m128 nonpositive = _mm_cmple_ps(x, zero);
+  __m128 at_zero = _mm_andnot_ps(_mm_cmpgt_ps(y, zero), one);
+  x = _mm_max_ps(x, _mm_set1_ps(FLT_MIN));
+
+  __m128i bits = _mm_castps_si128(x);
+  __m128 e = _mm_cvtepi32_ps(
+      _mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(127)));
+  __m128 m = _mm_castsi128_ps(
+      _mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x7fffff)),
+                   _mm_set1_epi32(0x3f800000)));
+  __m128 above = _mm_cmpgt_ps(m, _mm_set1_ps(kSqrt2));
+  m = _mm_sub_ps(m, _mm_and_ps(above, _mm_mul_ps(m, _mm_set1_ps(0.5f))));
+  e = _mm_add_ps(e, _mm_and_ps(above, one));
+
+  __m128 t = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+  __m128 t2 = _mm_mul_ps(t, t);
+  __m128 s = _mm_add_ps(_mm_set1_ps(kLog2C7),
+                        _mm_mul_ps(t2, _mm_set1_ps(kLog2C9)));
+  s = _mm_add_ps(_mm_set1_ps(kLog2C5), _mm_mul_ps(t2, s));
+  s = _mm_add_ps(_mm_set1_ps(kLog2C3), _mm_mul_ps(t2, s));
+  s = _mm_add_ps(one, _mm_mul_ps(t2, s));
+  __m128 log2 = _mm_add_ps(
+      e, _mm_mul_ps(_mm_set1_ps(kTwoOverLn2), _mm_mul_ps(t, s)));
+
+  __m128 p = _mm_mul_ps(y, log2);
+  __m128 saturated = _mm_cmpge_ps(p, zero);
+  __m128 underflow = _mm_cmplt_ps(p, _mm_set1_ps(-126.0f));
+  p = _mm_max_ps(_mm_min_ps(p, zero), _mm_set1_ps(-126.0f));
+
+  __m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(p));
+  n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, p), one));
+  __m128 f = _mm_sub_ps(p, n);
+  __m128 r = _mm_add_ps(_mm_set1_ps(kExp2C5),
+                        _mm_mul_ps(f, _mm_set1_ps(kExp2C6)));
+  r = _mm_add_ps(_mm_set1_ps(kExp2C4), _mm_mul_ps(f, r));
+  r = _mm_add_ps(_mm_set1_ps(kExp2C3), _mm_mul_ps(f, r));
+  r = _mm_add_ps(_mm_set1_ps(kExp2C2), _mm_mul_ps(f, r));
+  r = _mm_add_ps(_mm_set1_ps(kExp2C1), _mm_mul_ps(f, r));
+  r = _mm_add_ps(one, _mm_mul_ps(f, r));
+  __m128i scale = _mm_slli_epi32(
+      _mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+  r = _mm_min_ps(_mm_mul_ps(r, _mm_castsi128_ps(scale)), one);
+
+  r = _mm_or_ps(_mm_and_ps(saturated, one), _mm_andnot_ps(saturated, r));
+  r = _mm_andnot_ps(underflow, r);
+  return _mm_or_ps(_mm_and_ps(nonpositive, at_zero),
+                   _mm_andnot_ps(nonpositive, r));
+}
+#endif
+
+void FillLUTChannel(float gamma, float contrast, float brightness,
+                    uint16_t drm_color_lut::*channel, struct drm_color_lut *lut,
+                    uint32_t size) {
+  uint32_t i = 0;
+  float offset = 0.5f + brightness;
+#ifdef __SSE2__
+  const __m128 size4 = _mm_set1_ps((float)size);
+  const __m128 half4 = _mm_set1_ps(0.5f);
+  const __m128 contrast4 = _mm_set1_ps(contrast);
+  const __m128 offset4 = _mm_set1_ps(offset);
+  const __m128 gamma4 = _mm_set1_ps(gamma);
+  const __m128 one4 = _mm_set1_ps(1.0f);
+  __m128 index4 = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f);
+  for (; i + 4 <= size; i += 4) {
+    __m128 value = _mm_div_ps(index4, size4);
+    value = _mm_add_ps(_mm_mul_ps(_mm_sub_ps(value, half4), contrast4),
+                       offset4);
+    value = _mm_min_ps(_mm_max_ps(value, _mm_setzero_ps()), one4);
+    value = _mm_mul_ps(ClampedPow4(value, gamma4), _mm_set1_ps(65535.0f));
+
+    int32_t entries[4];
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(entries),
+                     _mm_cvttps_epi32(value));
+    for (uint32_t j = 0; j < 4; j++)
+      lut[i + j].*channel = entries[j];
+
+    index4 = _mm_add_ps(index4, _mm_set1_ps(4.0f));
+  }
+#endif
+  for (; i < size; i++) {
+    float value = ((float)i / size - 0.5f) * contrast + offset;
+    value = std::min(std::max(value, 0.0f), 1.0f);
+    lut[i].*channel = 65535.0f * ClampedPow(value, gamma);
+  }
+}
+
+}  // namespace hwcomposer
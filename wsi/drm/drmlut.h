@@ -0,0 +1,35 @@
+/*
+// Copyright (c) 2018 Intel Corporation
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//      http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+*/
+
+#ifndef WSI_DRM_DRMLUT_H_
+#define WSI_DRM_DRMLUT_H_
+
+#include <stdint.h>
+#include <xf86drmMode.h>
+
+namespace hwcomposer {
+
+// Returns pow(x, y) clamped to [0, 1], for x in [0, 1].
+float ClampedPow(float x, float y);
+
+// Fills channel of all size entries of lut with contrast and brightness
+// applied to the input, followed by gamma.
+void FillLUTChannel(float gamma, float contrast, float brightness,
+                    uint16_t drm_color_lut::*channel, struct drm_color_lut *lut,
+                    uint32_t size);
+
+}  // namespace hwcomposer
+#endif  // WSI_DRM_DRMLUT_H_
@@ -202,6 +202,16 @@ bool DrmPlane::Initialize(uint32_t gpu_fd, const std::vector<uint32_t>& formats,
     decryption_prop_.id = 0;
   }
 
+  ret = color_encoding_prop_.Initialize(gpu_fd, "COLOR_ENCODING", plane_props);
+  if (!ret)
+    color_encoding_prop_.id = 0;
+
+  ret = color_range_prop_.Initialize(gpu_fd, "COLOR_RANGE", plane_props);
+  if (!ret)
+    color_range_prop_.id = 0;
+
+  InitializeColorProperties(gpu_fd);
+
   // query and store supported modifiers for format, from in_formats
   // property
   uint64_t in_formats_prop_value = 0;
@@ -267,10 +277,72 @@ bool DrmPlane::Initialize(uint32_t gpu_fd, const std::vector<uint32_t>& formats,
   return true;
 }
 
+void DrmPlane::InitializeColorProperties(uint32_t gpu_fd) {
+  static const char* kEncodings[] = {"ITU-R BT.601 YCbCr", "ITU-R BT.709 YCbCr",
+                                     "ITU-R BT.2020 YCbCr"};
+  static const char* kRanges[] = {"YCbCr limited range", "YCbCr full range"};
+
+  if (color_encoding_prop_.id) {
+    ScopedDrmPropertyPtr property(
+        drmModeGetProperty(gpu_fd, color_encoding_prop_.id));
+    for (int i = 0; property && i < property->count_enums; i++) {
+      for (size_t j = 0; j < sizeof(kEncodings) / sizeof(kEncodings[0]); j++) {
+        if (!strcmp(property->enums[i].name, kEncodings[j]))
+          color_encodings_[j] = property->enums[i].value;
+      }
+    }
+  }
+
+  if (color_range_prop_.id) {
+    ScopedDrmPropertyPtr property(
+        drmModeGetProperty(gpu_fd, color_range_prop_.id));
+    for (int i = 0; property && i < property->count_enums; i++) {
+      for (size_t j = 0; j < sizeof(kRanges) / sizeof(kRanges[0]); j++) {
+        if (!strcmp(property->enums[i].name, kRanges[j]))
+          color_ranges_[j] = property->enums[i].value;
+      }
+    }
+  }
+}
+
+bool DrmPlane::IsSupportedColorDescription(
+    const HwcColorDescription& color) const {
+  // Without the properties the plane scans out BT.601 limited range.
+  // A standard guessed from the content height isn't worth losing the
+  // plane for, the plane uses what it can express in that case.
+  if (!color_encoding_prop_.id) {
+    if (color.standard_specified_ &&
+        color.standard_ != HWCColorStandard::kColorStandardBT601)
+      return false;
+  } else if (color.standard_specified_ &&
+             color_encodings_[static_cast<int>(color.standard_)] < 0) {
+    return false;
+  }
+
+  if (!color_range_prop_.id)
+    return color.range_ == HWCColorRange::kColorRangeLimited;
+
+  return color_ranges_[static_cast<int>(color.range_)] >= 0;
+}
+
+bool DrmPlane::AddProperty(drmModeAtomicReqPtr property_set,
+                           Property& property, uint64_t value,
+                           bool test_commit, bool always) {
+  if (!test_commit) {
+    if (!always && property.committed && property.value == value)
+      return true;
+
+    property.value = value;
+    property.committed = true;
+  }
+
+  return drmModeAtomicAddProperty(property_set, id_, property.id, value) >= 0;
+}
+
 bool DrmPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
                                 uint32_t crtc_id,
                                 const DisplayPlaneState& plane,
-                                bool test_commit) const {
+                                bool test_commit) {
   uint32_t alpha = 0xFFFF;
   const OverlayLayer* layer = plane.GetOverlayLayer();
   OverlayBuffer* buffer = layer->GetBuffer();
@@ -287,10 +359,6 @@ bool DrmPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
   }
 
   const HwcRect<float>& source_crop = layer->GetSourceCrop();
-  int fence = kms_fence_;
-  if (test_commit) {
-    fence = layer->GetAcquireFence();
-  }
 
   // i915 driver reads high 8bit of 16bit value
   if (layer->GetBlending() == HWCBlending::kBlendingPremult)
@@ -298,53 +366,61 @@ bool DrmPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
 
   IDISPLAYMANAGERTRACE("buffer->GetFb() ---------------------- STARTS %d",
                        buffer->GetFb());
-  int success =
-      drmModeAtomicAddProperty(property_set, id_, crtc_prop_.id, crtc_id) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, fb_prop_.id,
-                                      buffer->GetFb()) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, crtc_x_prop_.id,
-                                      display_frame.left) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, crtc_y_prop_.id,
-                                      display_frame.top) < 0;
+  int success = !AddProperty(property_set, crtc_prop_, crtc_id, test_commit);
+  // FB_ID is added for every frame, it's what makes the plane part of the
+  // flip even if the same buffer is presented again.
+  success |=
+      !AddProperty(property_set, fb_prop_, buffer->GetFb(), test_commit, true);
+  success |= !AddProperty(property_set, crtc_x_prop_, display_frame.left,
+                          test_commit);
+  success |= !AddProperty(property_set, crtc_y_prop_, display_frame.top,
+                          test_commit);
 
   if (layer->IsCursorLayer()) {
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_w_prop_.id,
-                                        buffer->GetWidth()) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_h_prop_.id,
-                                        buffer->GetHeight()) < 0;
-    success |=
-        drmModeAtomicAddProperty(property_set, id_, src_x_prop_.id, 0) < 0;
-    success |=
-        drmModeAtomicAddProperty(property_set, id_, src_y_prop_.id, 0) < 0;
-
-    success |= drmModeAtomicAddProperty(property_set, id_, src_w_prop_.id,
-                                        buffer->GetWidth() << 16) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, src_h_prop_.id,
-                                        buffer->GetHeight() << 16) < 0;
+    success |= !AddProperty(property_set, crtc_w_prop_, buffer->GetWidth(),
+                            test_commit);
+    success |= !AddProperty(property_set, crtc_h_prop_, buffer->GetHeight(),
+                            test_commit);
+    success |= !AddProperty(property_set, src_x_prop_, 0, test_commit);
+    success |= !AddProperty(property_set, src_y_prop_, 0, test_commit);
+    success |= !AddProperty(property_set, src_w_prop_,
+                            buffer->GetWidth() << 16, test_commit);
+    success |= !AddProperty(property_set, src_h_prop_,
+                            buffer->GetHeight() << 16, test_commit);
   } else {
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_w_prop_.id,
-                                        layer->GetDisplayFrameWidth()) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, crtc_h_prop_.id,
-                                        layer->GetDisplayFrameHeight()) < 0;
-    success |= drmModeAtomicAddProperty(
-                   property_set, id_, src_x_prop_.id,
-                   static_cast<int>(ceilf(source_crop.left)) << 16) < 0;
-    success |= drmModeAtomicAddProperty(
-                   property_set, id_, src_y_prop_.id,
-                   static_cast<int>(ceilf((source_crop.top))) << 16) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, src_w_prop_.id,
-                                        layer->GetSourceCropWidth() << 16) < 0;
-    success |= drmModeAtomicAddProperty(property_set, id_, src_h_prop_.id,
-                                        layer->GetSourceCropHeight() << 16) < 0;
+    success |= !AddProperty(property_set, crtc_w_prop_,
+                            layer->GetDisplayFrameWidth(), test_commit);
+    success |= !AddProperty(property_set, crtc_h_prop_,
+                            layer->GetDisplayFrameHeight(), test_commit);
+    success |= !AddProperty(property_set, src_x_prop_,
+                            static_cast<int>(ceilf(source_crop.left)) << 16,
+                            test_commit);
+    success |= !AddProperty(property_set, src_y_prop_,
+                            static_cast<int>(ceilf((source_crop.top))) << 16,
+                            test_commit);
+    success |= !AddProperty(property_set, src_w_prop_,
+                            layer->GetSourceCropWidth() << 16, test_commit);
+    success |= !AddProperty(property_set, src_h_prop_,
+                            layer->GetSourceCropHeight() << 16, test_commit);
   }
 
   if (decryption_prop_.id != 0) {
-    if (layer->IsProtected()) {
-      success |= drmModeAtomicAddProperty(property_set, id_,
-                                          decryption_prop_.id, 1) < 0;
-    } else {
-      success |= drmModeAtomicAddProperty(property_set, id_,
-                                          decryption_prop_.id, 0) < 0;
+    success |= !AddProperty(property_set, decryption_prop_,
+                            layer->IsProtected() ? 1 : 0, test_commit);
+  }
+
+  if (IsSupportedMediaFormat(buffer->GetFormat())) {
+    const HwcColorDescription& color = layer->GetColorDescription();
+    int64_t encoding = color_encodings_[static_cast<int>(color.standard_)];
+    int64_t range = color_ranges_[static_cast<int>(color.range_)];
+    if (color_encoding_prop_.id && encoding >= 0) {
+      success |= !AddProperty(property_set, color_encoding_prop_, encoding,
+                              test_commit);
+    }
+
+    if (color_range_prop_.id && range >= 0) {
+      success |=
+          !AddProperty(property_set, color_range_prop_, range, test_commit);
     }
   }
 
@@ -364,18 +440,19 @@ bool DrmPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
     else
       rotation |= DRM_MODE_ROTATE_0;
 
-    success = drmModeAtomicAddProperty(property_set, id_, rotation_prop_.id,
-                                       rotation) < 0;
+    success |=
+        !AddProperty(property_set, rotation_prop_, rotation, test_commit);
   }
 
   if (alpha_prop_.id) {
-    success =
-        drmModeAtomicAddProperty(property_set, id_, alpha_prop_.id, alpha) < 0;
+    success |= !AddProperty(property_set, alpha_prop_, alpha, test_commit);
   }
 
-  if (fence > 0 && in_fence_fd_prop_.id) {
-    success = drmModeAtomicAddProperty(property_set, id_, in_fence_fd_prop_.id,
-                                       fence) < 0;
+  // IN_FENCE_FD only applies to the request it's part of.
+  int fence = layer->GetAcquireFence();
+  if (test_commit && fence > 0 && in_fence_fd_prop_.id) {
+    success |= drmModeAtomicAddProperty(property_set, id_,
+                                        in_fence_fd_prop_.id, fence) < 0;
   }
 
   if (success) {
@@ -387,6 +464,19 @@ bool DrmPlane::UpdateProperties(drmModeAtomicReqPtr property_set,
   return true;
 }
 
+bool DrmPlane::AddInFence(drmModeAtomicReqPtr property_set) {
+  if (kms_fence_ <= 0 || !in_fence_fd_prop_.id)
+    return true;
+
+  if (drmModeAtomicAddProperty(property_set, id_, in_fence_fd_prop_.id,
+                               kms_fence_) < 0) {
+    ETRACE("Could not add in fence for plane with id: %d", id_);
+    return false;
+  }
+
+  return true;
+}
+
 void DrmPlane::SetNativeFence(int32_t fd) {
   // Release any existing fence.
   if (kms_fence_ > 0) {
@@ -396,6 +486,12 @@ void DrmPlane::SetNativeFence(int32_t fd) {
   kms_fence_ = fd;
 }
 
+int32_t DrmPlane::ReleaseNativeFence() {
+  int32_t fence = kms_fence_;
+  kms_fence_ = -1;
+  return fence;
+}
+
 void DrmPlane::SetBuffer(std::shared_ptr<OverlayBuffer>& buffer) {
   buffer_ = buffer;
 }
@@ -411,21 +507,16 @@ void DrmPlane::PreferredFormatModifierValidated() {
 
 bool DrmPlane::Disable(drmModeAtomicReqPtr property_set) {
   in_use_ = false;
-  int success =
-      drmModeAtomicAddProperty(property_set, id_, crtc_prop_.id, 0) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, fb_prop_.id, 0) < 0;
-  success |=
-      drmModeAtomicAddProperty(property_set, id_, crtc_x_prop_.id, 0) < 0;
-  success |=
-      drmModeAtomicAddProperty(property_set, id_, crtc_y_prop_.id, 0) < 0;
-  success |=
-      drmModeAtomicAddProperty(property_set, id_, crtc_w_prop_.id, 0) < 0;
-  success |=
-      drmModeAtomicAddProperty(property_set, id_, crtc_h_prop_.id, 0) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, src_x_prop_.id, 0) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, src_y_prop_.id, 0) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, src_w_prop_.id, 0) < 0;
-  success |= drmModeAtomicAddProperty(property_set, id_, src_h_prop_.id, 0) < 0;
+  int success = !AddProperty(property_set, crtc_prop_, 0, false);
+  success |= !AddProperty(property_set, fb_prop_, 0, false);
+  success |= !AddProperty(property_set, crtc_x_prop_, 0, false);
+  success |= !AddProperty(property_set, crtc_y_prop_, 0, false);
+  success |= !AddProperty(property_set, crtc_w_prop_, 0, false);
+  success |= !AddProperty(property_set, crtc_h_prop_, 0, false);
+  success |= !AddProperty(property_set, src_x_prop_, 0, false);
+  success |= !AddProperty(property_set, src_y_prop_, 0, false);
+  success |= !AddProperty(property_set, src_w_prop_, 0, false);
+  success |= !AddProperty(property_set, src_h_prop_, 0, false);
 
   if (success) {
     ETRACE("Could not update properties for plane with id: %d", id_);
@@ -438,6 +529,17 @@ bool DrmPlane::Disable(drmModeAtomicReqPtr property_set) {
   return true;
 }
 
+void DrmPlane::InvalidateCommittedState() {
+  Property* properties[] = {&crtc_prop_,     &fb_prop_,       &crtc_x_prop_,
+                            &crtc_y_prop_,   &crtc_w_prop_,   &crtc_h_prop_,
+                            &src_x_prop_,    &src_y_prop_,    &src_w_prop_,
+                            &src_h_prop_,    &rotation_prop_, &alpha_prop_,
+                            &decryption_prop_, &color_encoding_prop_,
+                            &color_range_prop_};
+  for (Property* property : properties)
+    property->committed = false;
+}
+
 uint32_t DrmPlane::id() const {
   return id_;
 }
@@ -488,6 +590,13 @@ bool DrmPlane::ValidateLayer(const OverlayLayer* layer) {
     return false;
   }
 
+  if (IsSupportedMediaFormat(layer_buffer->GetFormat()) &&
+      !IsSupportedColorDescription(layer->GetColorDescription())) {
+    IDISPLAYMANAGERTRACE(
+        "Layer cannot be supported as its colour encoding is not supported.");
+    return false;
+  }
+
   return IsSupportedTransform(transform);
 }
 
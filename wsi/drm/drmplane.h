@@ -43,16 +43,32 @@ class DrmPlane : public DisplayPlane {
   bool Initialize(uint32_t gpu_fd, const std::vector<uint32_t>& formats,
                   bool use_modifer);
 
+  // Adds the properties of plane to property_set. Unless test_commit is
+  // set, only properties which differ from the ones last added for commit
+  // are emitted.
   bool UpdateProperties(drmModeAtomicReqPtr property_set, uint32_t crtc_id,
                         const DisplayPlaneState& plane,
-                        bool test_commit = false) const;
+                        bool test_commit = false);
+
+  // Adds the fence set through SetNativeFence as IN_FENCE_FD of the plane.
+  // The fence of a composed plane is only known once its draw is done, so
+  // UpdateProperties leaves it out of commits.
+  bool AddInFence(drmModeAtomicReqPtr property_set);
 
   void SetNativeFence(int32_t fd);
 
+  // Returns the current native fence and gives up its ownership.
+  int32_t ReleaseNativeFence();
+
   void SetBuffer(std::shared_ptr<OverlayBuffer>& buffer);
 
   bool Disable(drmModeAtomicReqPtr property_set);
 
+  // Forgets the property values last committed, so that the next update
+  // adds all of them again. Needs to be called after a modeset or when the
+  // state of the plane on screen is unknown, i.e. a commit failed.
+  void InvalidateCommittedState();
+
   bool GetCrtcSupported(uint32_t pipe_id) const;
 
   uint32_t type() const;
@@ -96,8 +112,22 @@ class DrmPlane : public DisplayPlane {
                     uint32_t* rotation = NULL,
                     uint64_t* in_formats_prop_value = NULL);
     uint32_t id = 0;
+    // Value last added to a request which is to be committed.
+    uint64_t value = 0;
+    bool committed = false;
   };
 
+  // Looks up the enum values of COLOR_ENCODING and COLOR_RANGE.
+  void InitializeColorProperties(uint32_t gpu_fd);
+
+  // Returns false in case the plane can't scan out YUV content with color.
+  bool IsSupportedColorDescription(const HwcColorDescription& color) const;
+
+  // Adds property to property_set if value differs from the committed one
+  // or always is set. For test commits the committed state is left alone.
+  bool AddProperty(drmModeAtomicReqPtr property_set, Property& property,
+                   uint64_t value, bool test_commit, bool always = false);
+
   Property crtc_prop_;
   Property fb_prop_;
   Property crtc_x_prop_;
@@ -113,6 +143,8 @@ class DrmPlane : public DisplayPlane {
   Property in_fence_fd_prop_;
   Property in_formats_prop_;
   Property decryption_prop_;
+  Property color_encoding_prop_;
+  Property color_range_prop_;
 
   uint32_t id_;
 
@@ -130,6 +162,10 @@ class DrmPlane : public DisplayPlane {
   uint32_t prefered_format_ = 0;
   uint64_t prefered_modifier_ = 0;
   uint32_t rotation_ = 0;
+  // Values of COLOR_ENCODING indexed by HWCColorStandard and of COLOR_RANGE
+  // indexed by HWCColorRange, -1 if not supported.
+  int64_t color_encodings_[3] = {-1, -1, -1};
+  int64_t color_ranges_[2] = {-1, -1};
 
   // keep supported modifiers for each supported format
   typedef struct format_mods {
@@ -205,6 +205,11 @@ bool PhysicalDisplay::EnableDRMCommit(bool enable) {
     return display_queue_->IsIgnoreUpdates();
 }
 
+bool PhysicalDisplay::GetPresentDeadline(int64_t *deadline,
+                                         int64_t *vblank) {
+  return display_queue_->GetPresentDeadline(deadline, vblank);
+}
+
 bool PhysicalDisplay::SetActiveConfig(uint32_t config) {
   // update the activeConfig
   IHOTPLUGEVENTTRACE(
@@ -492,6 +497,15 @@ bool PhysicalDisplay::TestCommit(
   return false;
 }
 
+void PhysicalDisplay::BeginTestCommits() {
+}
+
+void PhysicalDisplay::EndTestCommits() {
+}
+
+void PhysicalDisplay::ResetRejectedConfigs() {
+}
+
 void PhysicalDisplay::UpdateScalingRatio(uint32_t primary_width,
                                          uint32_t primary_height,
                                          uint32_t display_width,
@@ -108,6 +108,12 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
 
   bool TestCommit(const DisplayPlaneStateList &commit_planes) const override;
 
+  void BeginTestCommits() override;
+
+  void EndTestCommits() override;
+
+  void ResetRejectedConfigs() override;
+
   bool PopulatePlanes(
       std::vector<std::unique_ptr<DisplayPlane>> &overlay_planes) override;
 
@@ -131,6 +137,8 @@ class PhysicalDisplay : public NativeDisplay, public DisplayPlaneHandler {
 
   bool EnableDRMCommit(bool enable) override;
 
+  bool GetPresentDeadline(int64_t *deadline, int64_t *vblank) override;
+
   /**
    * API for composition to non-zero X coordinate.
    * This is applicable when float mode is enabled.
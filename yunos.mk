@@ -47,6 +47,7 @@ LOCAL_SRC_FILES := os/alios/hwf_alioshal.cpp \
     common/utils/hwcutils.cpp \
     common/utils/hwcthread.cpp \
     common/utils/hwcevent.cpp \
+    common/utils/hwcsynctimeline.cpp \
     common/utils/fdhandler.cpp \
     common/utils/disjoint_layers.cpp \
     common/display/virtualdisplay.cpp \
@@ -54,6 +55,8 @@ LOCAL_SRC_FILES := os/alios/hwf_alioshal.cpp \
     common/display/displayplanestate.cpp \
     common/display/displayplanemanager.cpp \
     common/display/vblankeventhandler.cpp \
+    common/display/vblankservice.cpp \
+    common/display/vsyncpredictor.cpp \
     common/compositor/compositor.cpp \
     common/compositor/compositorthread.cpp \
     common/compositor/nativesurface.cpp \
@@ -65,12 +68,15 @@ LOCAL_SRC_FILES := os/alios/hwf_alioshal.cpp \
     common/compositor/gl/egloffscreencontext.cpp \
     common/compositor/gl/nativeglresource.cpp \
     common/compositor/gl/glprogram.cpp \
+    common/compositor/gl/glprogramwarmer.cpp \
     common/compositor/va/varenderer.cpp \
     common/compositor/va/vautils.cpp \
     wsi/drm/drmdisplaymanager.cpp \
     wsi/drm/drmscopedtypes.cpp \
     wsi/drm/drmdisplay.cpp \
+    wsi/drm/drmlut.cpp \
     wsi/drm/drmplane.cpp \
+    wsi/drm/drmcommitthread.cpp \
     wsi/drm/drmbuffer.cpp \
     wsi/physicaldisplay.cpp \
     os/platformcommondrmdefines.cpp \